@@ -8,13 +8,15 @@
 #define CHIP_YM2149   1
 #define CHIP_OPL3      2
 
+// Pitch bend resolution passed to set_pitch_bend(): steps per semitone
+#define PITCH_BEND_STEPS     32
+
 // Voice state structure
 typedef struct {
     uint8_t active;        // Voice is currently playing
     uint8_t midi_note;     // Current MIDI note (0-127)
     uint8_t velocity;      // Current velocity (0-127)
     uint8_t channel;       // MIDI channel (0-15)
-    uint32_t start_time;    // Note start time for envelope tracking
 } voice_t;
 
 // Abstract sound chip interface
@@ -40,12 +42,14 @@ typedef struct {
     void (*set_release)(uint8_t voice, uint8_t release);      // CC 8
     void (*set_vibrato)(uint8_t depth);                       // CC 9
     void (*set_tremolo)(uint8_t rate);                         // CC 10
-    void (*set_pitch_bend)(int16_t bend);                       // CC 11
+    void (*set_pitch_bend)(uint8_t channel, int16_t steps);     // Pitch wheel / CC 11
     void (*set_modulation)(uint8_t depth);                      // CC 12
+    void (*set_tremolo_sync)(uint8_t clocks);   // Tremolo cycle in MIDI clocks, 0 = free
     
     // Chip-specific functions
     void (*set_preset)(uint8_t preset);
     void (*panic)(void);        // Emergency silence all notes
+    void (*tick)(void);         // Modulation update, every LFO_TICK_INTERVAL ticks
     
     // Voice state management
     voice_t* voices;          // Pointer to voice array
@@ -12,7 +12,7 @@ sound_chip_interface_t* chip_manager_get_current(void);
 
 // Hardware detection functions
 extern uint8_t detect_ym2149(void);  // Implemented in ym2149.c
-uint8_t detect_opl3(void);           // Implemented here (future)
+extern uint8_t detect_opl3(void);    // Implemented in opl3.c
 
 // Global status
 extern uint8_t available_chips;      // Bitmask of detected chips
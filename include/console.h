@@ -0,0 +1,54 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+
+// Buffered console output.
+// Messages are queued and drained by an idle task, so logging never
+// blocks MIDI processing.  When the queue is full, messages are dropped
+// and counted instead of stalling the synth.
+#define CON_QUEUE_SIZE     2048   // Must be a power of two
+#define CON_QUEUE_MASK     (CON_QUEUE_SIZE - 1)
+#define CON_DRAIN_BUDGET   8      // Characters written per idle pass
+
+// Verbosity levels (a message is queued if its level <= verbosity)
+#define CON_ERROR   0   // Errors and failures
+#define CON_INFO    1   // Command output, status, keyboard feedback
+#define CON_MIDI    2   // Per-message MIDI input log
+#define CON_DEBUG   3   // Diagnostics
+#define CON_DEFAULT_VERBOSITY  CON_MIDI
+
+// Console statistics
+typedef struct {
+    uint16_t dropped;        // Messages dropped because the queue was full
+    uint16_t peak;           // Highest queue fill level, in bytes
+} console_stats_t;
+
+void console_init(void);
+void console_set_verbosity(uint8_t level);
+uint8_t console_get_verbosity(void);
+
+// Queue output
+void con_puts(uint8_t level, const char* text);
+
+// Lean message builder: no format strings.  A message is assembled in
+// the queue piece by piece and only becomes visible at con_endl(), which
+// appends the newline.  When the level is filtered the pieces do nothing;
+// when the queue fills up the whole message is dropped.  Fixed text comes
+// from the string table in messages.h.
+uint8_t con_begin(uint8_t level);    // Returns 0 if the level is filtered
+void con_msg(uint8_t id);            // String table entry (MSG_*)
+void con_str(const char* text);
+void con_char(char c);
+void con_dec(uint16_t value);        // Unsigned decimal
+void con_hex(uint8_t value);         // Two hex digits
+void con_endl(void);
+void con_msg_dec(uint8_t level, uint8_t id, uint16_t value);  // "<text><value>\n"
+
+// Drain output
+void console_service(void);      // Idle task: write up to CON_DRAIN_BUDGET chars
+void console_flush(void);        // Write everything (startup / exit only)
+
+extern console_stats_t console_stats;
+
+#endif // CONSOLE_H
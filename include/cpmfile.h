@@ -0,0 +1,55 @@
+#ifndef CPMFILE_H
+#define CPMFILE_H
+
+#include <stdint.h>
+
+// Read-only file access through BDOS FCB calls.
+//
+// Files are read in 128-byte CP/M records, either at random (BDOS 33)
+// straight into a caller's buffer, or sequentially through one shared
+// record buffer that callers may read in place.  Nothing from the stdio
+// file stack is linked on the Z80.  The host build keeps the same
+// interface over stdio so the loaders can be tested.
+//
+// Config files are parsed in a single pass over the byte stream:
+// cpmf_config() calls back with each key=value pair, without line
+// buffers, strtok or strtoul.
+
+#define CPMF_RECORD_SIZE   128
+#define CPMF_FCB_SIZE      36      // Including the random record field
+#define CPMF_TOKEN_MAX     16      // Longest config key or value kept
+#define CPMF_EOF           (-1)
+#define CPMF_TEXT_EOF      0x1A    // ^Z ends a CP/M text file
+
+typedef struct {
+    uint8_t fcb[CPMF_FCB_SIZE];
+    uint8_t open;
+    uint16_t seq_record;     // Sequential position: record ...
+    uint8_t seq_pos;         // ... and byte within it
+#ifndef __Z88DK
+    void* host;              // Host build: stdio FILE
+#endif
+} cpm_file_t;
+
+// Called once per "key=value" line of a config file
+typedef void (*cpmf_config_fn)(const char* key, const char* value);
+
+uint8_t cpmf_open(cpm_file_t* f, const char* name);     // 1 = opened
+void cpmf_close(cpm_file_t* f);
+
+// Random access: read `record` into `dma`.  Returns 0 past the end.
+uint8_t cpmf_read_record(cpm_file_t* f, uint16_t record, uint8_t* dma);
+
+// Random access into the shared record buffer, read in place.  The
+// buffer stays valid until the next cpmf_* read.  Returns 0 past the end.
+const uint8_t* cpmf_record(cpm_file_t* f, uint16_t record);
+
+// Sequential access from the start of the file
+int16_t cpmf_getc(cpm_file_t* f);                        // CPMF_EOF at the end
+uint16_t cpmf_read(cpm_file_t* f, uint8_t* buf, uint16_t len);
+
+// Config files
+uint8_t cpmf_config(const char* name, cpmf_config_fn fn);  // 0 = not found
+uint16_t cpmf_number(const char* text);                   // Decimal or 0x hex
+
+#endif // CPMFILE_H
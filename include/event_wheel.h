@@ -0,0 +1,60 @@
+#ifndef EVENT_WHEEL_H
+#define EVENT_WHEEL_H
+
+#include <stdint.h>
+
+// Timing wheel for deferred synth events.
+//
+// An event is a callback and a byte argument due at a timebase tick.
+// Events come from a fixed pool and are hung on one of EVW_SLOTS lists
+// by their due tick, so scheduling is a push onto a list and the
+// scheduler pass task evw_service() only looks at the slots the clock
+// has moved past.  Events further away than one turn of the wheel stay
+// in their slot and are passed over on each turn until due.  Events run
+// at the end of their slot, never early and at most EVW_SLOT_TICKS - 1
+// ticks late; those sharing a slot run in no set order.  Nothing is
+// allocated and nothing blocks: a callback that wants to run again
+// schedules itself.
+//
+// Sequences are built on top: a step function does one step and returns
+// the ticks to wait before the next, and queued sequences run back to
+// back.  The audio test routines are sequences, so MIDI input and the
+// console keep running while they play.
+
+#define EVW_SLOTS         64       // Power of two
+#define EVW_SLOT_MASK     (EVW_SLOTS - 1)
+#define EVW_SLOT_SHIFT    2        // 4 ticks (~4 ms) per slot
+#define EVW_SLOT_TICKS    (1 << EVW_SLOT_SHIFT)
+#define EVW_SPAN          (EVW_SLOTS * EVW_SLOT_TICKS)   // One turn, ticks
+#define EVW_POOL          32       // Events pending at once
+#define EVW_MAX_DELAY     0x7000   // Longer delays are clamped
+#define EVW_NONE          0xFF     // No event / end of list
+
+#define EVW_SEQ_QUEUE     8        // Sequences queued at once
+#define EVW_SEQ_END       0xFFFF   // Step return: sequence finished
+
+typedef void (*evw_fn)(uint8_t arg);
+typedef uint16_t (*evw_step_fn)(uint8_t step);
+
+typedef struct {
+    uint16_t fired;          // Callbacks run
+    uint16_t dropped;        // Schedules refused because the pool was empty
+    uint16_t slots;          // Slots expired (wraps)
+    uint8_t pending;         // Events in the wheel now
+    uint8_t peak;            // Most events pending at once
+} evw_stats_t;
+
+extern evw_stats_t evw_stats;
+
+void evw_init(void);
+void evw_clear(void);                    // Drop every event and sequence
+uint8_t evw_schedule(uint16_t delay, evw_fn fn, uint8_t arg);  // Handle or EVW_NONE
+void evw_cancel(uint8_t handle);         // Only until the event has fired
+void evw_service(void);                  // Scheduler pass task
+
+// Sequences
+uint8_t evw_sequence_start(evw_step_fn step);   // 0 = queue full
+void evw_sequence_stop(void);                   // Stop and forget the queue
+uint8_t evw_sequence_active(void);
+
+#endif // EVENT_WHEEL_H
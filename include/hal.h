@@ -0,0 +1,86 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+// Hardware abstraction layer — port I/O, console and interrupt control.
+//
+// The Z80 build (zcc, which defines __Z88DK) maps every call straight
+// onto z88dk's outp/inp, conio and inline asm, so the HAL costs nothing
+// on the target.  Any other compiler gets the host build: src/hal/
+// hal_host.c provides a fake bus that records every port write and
+// answers reads through a pluggable device model, a captured console
+// and a scripted keyboard.  `make host` builds the synth core against
+// it for the unit tests and benchmarks in tests/host/.
+//
+// Code that is inherently Z80-only (naked asm delay loops, the SIO
+// receive ISR and the RST 38H hook) is wrapped in #ifdef __Z88DK with a
+// plain C equivalent for the host.
+
+#ifdef __Z88DK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <conio.h>
+
+#define hal_outp(port, value)  outp(port, value)
+#define hal_inp(port)          inp(port)
+#define hal_putc(c)            putchar(c)
+#define hal_kbhit()            kbhit()
+#define hal_getch()            getch()
+#define hal_di()               __asm__("di")
+#define hal_ei()               __asm__("ei")
+
+#else // Host build
+
+#define HAL_HOST  1
+
+void hal_outp(uint8_t port, uint8_t value);
+uint8_t hal_inp(uint8_t port);
+void hal_putc(char c);
+int hal_kbhit(void);
+char hal_getch(void);
+
+#define hal_di()
+#define hal_ei()
+
+// --- Host-only fake bus control (tests and benchmarks) ---
+
+// One recorded port write
+typedef struct {
+    uint8_t port;
+    uint8_t value;
+} hal_bus_write_t;
+
+#define HAL_BUS_LOG_SIZE     4096   // Writes kept; later ones are only counted
+#define HAL_CONSOLE_SIZE     8192   // Captured console bytes
+
+// Device model: sees every write and answers every read.  Without one,
+// writes are only logged and reads return 0xFF (an empty bus).
+typedef struct {
+    void (*write)(uint8_t port, uint8_t value);
+    uint8_t (*read)(uint8_t port);
+} hal_bus_device_t;
+
+void hal_bus_reset(void);                        // Clear log, counters, device, HBIOS timer
+void hal_bus_attach(const hal_bus_device_t* device);
+uint32_t hal_bus_write_count(void);              // Writes since last clear
+const hal_bus_write_t* hal_bus_write_at(uint16_t index);  // 0 if not kept
+void hal_bus_clear_log(void);
+
+void hal_console_clear(void);
+const char* hal_console_text(void);              // NUL-terminated capture
+void hal_console_echo(uint8_t on);               // Also copy to stdout
+
+void hal_keys_push(const char* keys);            // Queue console key presses
+
+// RomWBW HBIOS system timer (SYSGET TIMER), which the Z80 build calls
+// through RST 08H.  Returns the low word of the tick count and sets
+// *rate to the ticks per second, 0 if there is no timer.  The model's
+// count advances once every `calls_per_tick` calls (0 = never).
+uint16_t hal_hbios_timer(uint8_t* rate);
+void hal_hbios_timer_set(uint8_t rate, uint16_t calls_per_tick);
+
+#endif // __Z88DK
+
+#endif // HAL_H
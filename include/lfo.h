@@ -0,0 +1,63 @@
+#ifndef LFO_H
+#define LFO_H
+
+#include <stdint.h>
+
+// Fixed-point software LFO engine.
+//
+// Each LFO is a 16-bit phase accumulator whose high byte indexes a
+// 256-step waveform (sine from a 64-entry quarter-wave table, the rest
+// computed from the phase).  lfo_step() costs one table lookup and one
+// 8x8 multiply, whatever the waveform.
+//
+// An LFO can instead follow the MIDI clock tempo: with `sync` set to a
+// cycle length in MIDI clocks (24 = one beat) its rate is recomputed
+// from lfo_tempo whenever the tempo estimate moves, and left alone
+// until a tempo is known.
+
+// Waveforms
+#define LFO_WAVE_SINE      0
+#define LFO_WAVE_TRIANGLE  1
+#define LFO_WAVE_SQUARE    2
+#define LFO_WAVE_SAW       3
+
+// Modulation tick: LFOs advance once every LFO_TICK_INTERVAL timebase
+// ticks (~8 ms, 125 Hz)
+#define LFO_TICK_INTERVAL  8
+#define LFO_TICK_HZ        125
+
+// Phase increment for a rate in tenths of a Hz at LFO_TICK_HZ:
+// 65536 / 125 / 10 = 52.4 per 0.1 Hz
+#define LFO_RATE_DHZ(dhz)  ((uint16_t)((dhz) * 52))
+
+// Phase increment x beat length (1/16 ms) x cycle length (clocks) for
+// tempo-synced LFOs: 65536 * tick ms * 16 * 24 clocks per beat
+#define LFO_SYNC_SCALE     (65536UL * LFO_TICK_INTERVAL * 16 * 24)
+
+typedef struct {
+    uint16_t phase;          // Phase accumulator (high byte = table step)
+    uint16_t rate;           // Phase increment per LFO tick
+    uint8_t depth;           // Output scale, 0-127
+    uint8_t wave;            // LFO_WAVE_*
+    uint8_t sync;            // Cycle length in MIDI clocks, 0 = own rate
+    uint16_t synced_beat;    // lfo_tempo the rate was computed for
+} lfo_t;
+
+// LFO engine statistics (updated by the chip tick functions)
+typedef struct {
+    uint16_t ticks;          // Modulation ticks run
+    uint16_t late;           // Ticks skipped because the loop was busy
+    uint8_t last_writes;     // Register writes issued by the last tick
+    uint8_t max_writes;      // Worst-case register writes in one tick
+} lfo_stats_t;
+
+void lfo_init(lfo_t* lfo, uint8_t wave);
+void lfo_set_rate_cc(lfo_t* lfo, uint8_t value);
+int8_t lfo_wave(uint8_t wave, uint8_t phase);
+int8_t lfo_step(lfo_t* lfo);
+void lfo_set_tempo(uint16_t beat_ms16);
+
+extern lfo_stats_t lfo_stats;
+extern uint16_t lfo_tempo;           // Beat length, 1/16 ms (0 = unknown)
+
+#endif // LFO_H
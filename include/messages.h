@@ -0,0 +1,126 @@
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+#include <stdint.h>
+
+// Console string table.
+// The fixed text of every message that has values spliced in lives
+// here, once, and is printed with con_msg() between con_begin() and
+// con_endl().  Shared fragments (" writes, ", " ticks" ...) are reused
+// across modules instead of each carrying its own format strings.
+
+enum {
+    // Shared fragments
+    MSG_HEX_PREFIX,          // "0x"
+    MSG_OPEN_PAREN,          // " ("
+    MSG_CLOSE_PAREN,         // ")"
+    MSG_COMMA,               // ", "
+    MSG_COLON,               // ": "
+    MSG_WRITES,              // " writes, "
+    MSG_SKIPPED,             // " skipped, "
+    MSG_TICKS,               // " ticks"
+    MSG_EVENTS,              // " events, "
+    MSG_DISK_STALLS,         // " disk stalls"
+    MSG_PLAYING,             // "Playing "
+    MSG_NOTE,                // "Note: "
+    MSG_MIDI_IN,             // "MIDI IN: "
+
+    // Commands (main.c)
+    MSG_HELP,
+    MSG_REGISTER_PORT,
+    MSG_DATA_PORT,
+    MSG_OPL3_PORT,
+    MSG_DETECTED,
+    MSG_NOT_DETECTED,
+    MSG_STOPPED,
+    MSG_VERBOSITY,
+    MSG_UNKNOWN_COMMAND,
+    MSG_UNKNOWN_COMMAND_END,
+    MSG_PRESS_F_TO_STOP,
+    MSG_CANNOT_PLAY,
+    MSG_READ_AHEAD,
+    MSG_LATE,
+    MSG_YM_BUS,
+    MSG_SHADOW_READS,
+    MSG_LATCH_HITS,
+    MSG_YM_TIMING,
+    MSG_PROFILE,
+    MSG_DELAY_LOOPS,
+    MSG_CALIBRATED,
+    MSG_FIXED,
+    MSG_OPL3_BUS,
+    MSG_PACING_LOOPS,
+    MSG_YM_CARDS,
+    MSG_VOICES_SUFFIX,
+    MSG_CARD,
+    MSG_VOICES,
+    MSG_CURRENT_CHIP,
+
+    // Status (synthesizer.c)
+    MSG_ACTIVE_CHIP,
+    MSG_VOICE_COUNT,
+    MSG_VOICE,
+    MSG_VOICE_NOTE,
+    MSG_VOICE_VEL,
+    MSG_VOICE_CH,
+    MSG_MIDI_RX,
+    MSG_INTERRUPT,
+    MSG_POLLED,
+    MSG_OVERRUNS_RING,
+    MSG_SIO,
+    MSG_SCHED_BUDGET,
+    MSG_PEAK_BURST,
+    MSG_BUDGET_HITS,
+    MSG_TIMEBASE_CTC,
+    MSG_TIMEBASE_SOFT,
+    MSG_TIMEBASE_HBIOS,
+    MSG_CHAINED,
+    MSG_HZ,
+    MSG_UPTIME,
+    MSG_TB_OVERRUNS,
+    MSG_CONSOLE_VERBOSITY,
+    MSG_DROPPED,
+    MSG_PEAK,
+    MSG_BYTES,
+    MSG_LFO,
+    MSG_LATE_WRITES,
+    MSG_MAX,
+    MSG_CC,
+    MSG_VOICE_ALLOC,
+    MSG_ALLOCS,
+    MSG_STEALS,
+    MSG_RETRIGGERS,
+    MSG_SYSEX_DEVICE,
+    MSG_DUMPS,
+    MSG_REQUESTS,
+    MSG_IGNORED,
+    MSG_ERRORS,
+    MSG_MIDI_CLOCK,
+    MSG_RUNNING,
+    MSG_HALTED,
+    MSG_BPM,
+    MSG_CLOCKS,
+    MSG_REJECTED,
+    MSG_EVENTS_PENDING,
+    MSG_FIRED,
+
+    // MIDI input and keyboard mode (midi_driver.c)
+    MSG_VEL_KB,
+    MSG_OCTAVE,
+    MSG_VELOCITY,
+    MSG_NOTE_OFF_KB,
+    MSG_CH,
+    MSG_BEND_RANGE,
+    MSG_NOTE_ON_IN,
+    MSG_NOTE_OFF_IN,
+    MSG_VEL_IN,
+
+    // MIDI file player (smf_player.c)
+    MSG_FINISHED,
+
+    MSG_COUNT
+};
+
+extern const char* const con_messages[MSG_COUNT];
+
+#endif // MESSAGES_H
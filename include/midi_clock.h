@@ -0,0 +1,46 @@
+#ifndef MIDI_CLOCK_H
+#define MIDI_CLOCK_H
+
+#include <stdint.h>
+
+// MIDI clock follower.
+//
+// Timing clock (F8, 24 per quarter note), start (FA), continue (FB) and
+// stop (FC) each cost a few counter updates.  Once per beat the beat
+// length is measured on the timebase and folded into a smoothed
+// estimate: lengths within 25% of the estimate move it a quarter of the
+// way, and a bigger jump is only taken as a tempo change when the next
+// beat agrees with it.  The estimate is handed to the LFOs (see
+// lfo_set_tempo()) for tempo-synced rates.
+//
+// With receive interrupts active the ISR counts clock bytes instead of
+// queueing them, so a clock stream never takes ring space or parser
+// budget from notes.  Those clocks are replayed at the start of each
+// drain, so their order against start/stop is kept to within one
+// scheduler pass.
+
+#define MIDI_CLOCK_PPQN       24
+#define MIDI_CLOCK_MAX_BEAT   4095     // Longest beat measured, ms (~15 BPM)
+
+#define MIDI_CLOCK          0xF8
+#define MIDI_START          0xFA
+#define MIDI_CONTINUE       0xFB
+#define MIDI_STOP           0xFC
+
+typedef struct {
+    uint8_t running;         // Between start/continue and stop
+    uint8_t clock;           // Clock within the beat, 0-23
+    uint16_t beat;           // Beats since start
+    uint16_t beat_ms16;      // Smoothed beat length, 1/16 ms (0 = no tempo yet)
+    uint16_t clocks;         // Clocks received (wraps)
+    uint16_t rejected;       // Beat lengths discarded as jitter
+} midi_clock_t;
+
+extern midi_clock_t midi_clock;
+
+void midi_clock_init(void);
+void midi_clock_realtime(uint8_t byte);     // Any F8-FF byte
+void midi_clock_pulse(void);                // One timing clock
+uint16_t midi_clock_bpm(void);              // Rounded; 0 = no tempo yet
+
+#endif // MIDI_CLOCK_H
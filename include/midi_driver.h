@@ -26,19 +26,81 @@ typedef struct {
     uint8_t byte_count;      // Bytes received so far
 } midi_state_t;
 
-// MIDI CC mapping for keyboard controls
+// Interrupt-driven receive ring buffer (SIO Channel B)
+// Size must be a power of two so the ISR can wrap with a mask.
+#define MIDI_RX_BUF_SIZE     64
+#define MIDI_RX_BUF_MASK     (MIDI_RX_BUF_SIZE - 1)
+
+// Receive statistics — updated by the ISR, read by the status display
+typedef struct {
+    uint16_t ring_overruns;  // Bytes dropped because the ring buffer was full
+    uint16_t sio_overruns;   // SIO receiver overruns (RR1 bit 5) seen by the ISR
+} midi_rx_stats_t;
+
+// Per-channel (part) state.  Every channel message looks up its block
+// once.  The chip holds one patch and one modulation depth, so a part's
+// program and modulation are loaded when it next starts a note (or at
+// once, if it was the last part to play).  `group` and `chip` are the
+// part's route: the voice group it allocates from (see voice_alloc.h)
+// and the chip it plays on.
+#define MIDI_BEND_RANGE_DEFAULT  2    // Semitones, GM default
+#define MIDI_BEND_RANGE_MAX      24
+#define MIDI_RPN_NULL            0x7F // RPN MSB/LSB value meaning "none selected"
+#define MIDI_VOLUME_NONE         0xFF // No volume CC yet: notes keep their velocity level
+#define MIDI_PART_NONE           0xFF // No part loaded on the chip
+
+typedef struct {
+    int16_t bend;            // Pitch wheel position, -8192..8191
+    uint8_t bend_range;      // Bend range in semitones (RPN 0)
+    uint8_t rpn_msb;         // Selected RPN (CC#101), MIDI_RPN_NULL = none
+    uint8_t rpn_lsb;         // Selected RPN (CC#100)
+    uint8_t program;         // Last program change
+    uint8_t volume;          // Last volume CC, MIDI_VOLUME_NONE = none yet
+    uint8_t modulation;      // Last modulation CC
+    uint8_t last_voice;      // Voice of the channel's latest note-on
+    uint8_t group;           // Route: voice group
+    uint8_t chip;            // Route: CHIP_* the part plays on, CHIP_NONE = any
+} midi_channel_state_t;
+
+// CC dispatch table: one entry per controller number, indexed directly.
+// Defaults match the 8-knob / 4-slider controller (CC#1-12) and can be
+// overridden from MIDI_CC_MAP_FILE.  CC#6 (data entry), CC#38, CC#100
+// and CC#101 also drive RPN handling regardless of the table.
+#define MIDI_CC_COUNT        128
+#define MIDI_CC_MAP_FILE     "ccmap.cfg"
+
+// CC handlers (index into the handler and name tables)
+#define MIDI_CC_NONE         0
+#define MIDI_CC_VOLUME       1
+#define MIDI_CC_ATTACK       2
+#define MIDI_CC_DECAY        3
+#define MIDI_CC_SUSTAIN      4
+#define MIDI_CC_RELEASE      5
+#define MIDI_CC_VIBRATO      6
+#define MIDI_CC_TREMOLO      7
+#define MIDI_CC_BEND         8
+#define MIDI_CC_MODULATION   9
+#define MIDI_CC_TREMOLO_SYNC 10    // Value / 16 picks a cycle: free, 1 bar .. 1/32
+#define MIDI_CC_HANDLER_COUNT 11
+
+// Voice targets for per-voice handlers (0..voice_count-1 = fixed voice)
+#define MIDI_CC_TARGET_LAST  0xFF  // Voice of the channel's most recent note-on
+#define MIDI_CC_TARGET_ALL   0xFE  // Every voice the channel is sounding
+
 typedef struct {
-    uint8_t cc_number;       // CC number
-    uint8_t value;          // Current value (0-127)
-    uint8_t is_knob;        // TRUE for rotary knobs, FALSE for sliders
-    const char* name;        // Human-readable name
-} midi_cc_control_t;
+    uint8_t handler;         // MIDI_CC_*
+    uint8_t target;          // Voice or MIDI_CC_TARGET_*
+} midi_cc_map_t;
 
 // Function declarations
 void midi_driver_init(void);
 uint8_t midi_driver_available(void);
 uint8_t midi_driver_read_byte(void);
-void midi_driver_process_input(void);
+uint8_t midi_driver_drain(uint8_t budget);
+uint8_t midi_driver_send_ready(void);         // MIDI OUT can take a byte now
+void midi_driver_send(uint8_t byte);          // MIDI OUT (BIOS mode only), no wait
+void midi_driver_shutdown(void);
+uint8_t midi_driver_irq_active(void);
 
 // MIDI input mode control
 void midi_set_mode(uint8_t mode);
@@ -47,12 +109,21 @@ uint8_t midi_get_mode(void);
 // Keyboard MIDI mode
 void midi_keyboard_process_key(char key);
 
+// CC mapping
+void midi_cc_map_defaults(void);
+int midi_cc_map_load(const char* filename);
+const char* midi_cc_handler_name(uint8_t handler);
+
 // MIDI message processing
 void midi_process_byte(uint8_t byte);
 void midi_process_message(uint8_t status, uint8_t data1, uint8_t data2);
+void midi_parts_reset(void);       // Chip re-initialised: reload parts on use
 
 // External state
 extern midi_state_t midi_state;
-extern midi_cc_control_t midi_cc_controls[12];  // 8 knobs + 4 sliders
+extern midi_rx_stats_t midi_rx_stats;
+extern midi_channel_state_t midi_channels[16];
+extern midi_cc_map_t midi_cc_map[MIDI_CC_COUNT];
+extern uint8_t midi_cc_value[MIDI_CC_COUNT];   // Last value seen per CC
 
 #endif // MIDI_DRIVER_H
\ No newline at end of file
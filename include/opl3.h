@@ -0,0 +1,145 @@
+#ifndef OPL3_H
+#define OPL3_H
+
+#include <stdint.h>
+#include "chip_interface.h"
+#include "port_config.h"
+
+// YMF262 (OPL3) FM driver — 18 two-operator voices.
+//
+// The card decodes four consecutive ports from opl3_port in ports.conf:
+//   base+0 = bank 0 address (write) / status (read)
+//   base+1 = bank 0 data
+//   base+2 = bank 1 address
+//   base+3 = bank 1 data
+// Registers are addressed as 9 bits: bank in bit 8, register in 0-7.
+#define OPL3_PORT_DEFAULT    0x60
+#define OPL3_VOICES          18
+
+// Status register bits
+#define OPL3_STATUS_IRQ      0x80
+#define OPL3_STATUS_T1       0x40
+#define OPL3_STATUS_T2       0x20
+#define OPL3_STATUS_TIMERS   0xE0
+#define OPL3_STATUS_OPL2     0x06   // Always 0 on OPL3, set on OPL2
+
+// Global registers
+#define OPL3_TEST            0x001
+#define OPL3_TIMER1          0x002
+#define OPL3_TIMER_CTRL      0x004
+#define OPL3_CSM_NOTESEL     0x008
+#define OPL3_PERCUSSION      0x0BD  // AM/VIB depth, rhythm mode
+#define OPL3_4OP_ENABLE      0x104
+#define OPL3_NEW             0x105  // Bit 0 enables OPL3 mode
+
+// Timer control values
+#define OPL3_TIMER_RESET     0x60   // Mask both timers, stop them
+#define OPL3_IRQ_RESET       0x80
+#define OPL3_TIMER1_START    0x21   // Mask T2, start T1
+
+// Per-operator registers (add operator offset)
+#define OPL3_OP_CHAR         0x20   // AM, VIB, EG type, KSR, MULT
+#define OPL3_OP_LEVEL        0x40   // KSL, total level (attenuation)
+#define OPL3_OP_AR_DR        0x60   // Attack, decay rate
+#define OPL3_OP_SL_RR        0x80   // Sustain level, release rate
+#define OPL3_OP_WAVE         0xE0   // Waveform select
+
+// Per-channel registers (add channel 0-8)
+#define OPL3_CH_FNUM_LO      0xA0
+#define OPL3_CH_KEY_BLOCK    0xB0   // Key-on, block, F-number bits 8-9
+#define OPL3_CH_FB_CONN      0xC0   // Output enables, feedback, connection
+
+#define OPL3_KEY_ON          0x20
+#define OPL3_CHAR_AM         0x80
+#define OPL3_CHAR_VIB        0x40
+#define OPL3_DEEP_AM         0x80   // OPL3_PERCUSSION: 4.8 dB tremolo
+#define OPL3_DEEP_VIB        0x40   // OPL3_PERCUSSION: 14 cent vibrato
+#define OPL3_OUT_LR          0x30   // Channel to both speakers
+
+// Register shadow: every register of both banks
+#define OPL3_SHADOW_SIZE     512
+#define OPL3_SHADOW_FIRST    0x20   // Lower registers (timers, test) write through
+
+// Write pacing: the OPL3 needs 32 master clocks (~2.3 us at 14.318 MHz)
+// after an address or data write.  The C write path already spends this
+// many T-states between the two OUTs; delay loops are only added when
+// the CPU clock is fast enough to beat the chip.
+#define OPL3_WRITE_NS        2300
+#define OPL3_WRITE_PATH_T    40
+
+// Playable range: MIDI 12 (C0, block 0) to 107 (B7, block 7)
+#define OPL3_MIDI_NOTE_MIN   12
+#define OPL3_MIDI_NOTE_MAX   107
+
+// Built-in instruments (program change 0-3).  Operators are per voice,
+// so each voice keeps the program its last note was started with and
+// a program change only takes effect on the part's next note.
+#define OPL3_PATCH_COUNT     4
+#define OPL3_PATCH_NONE      0xFF // opl3_voice_extra_t.patch: registers zeroed
+
+// Two-operator instrument: modulator then carrier for each register
+typedef struct {
+    uint8_t op_char[2];      // OPL3_OP_CHAR (without AM/VIB, set by CC)
+    uint8_t op_level[2];     // OPL3_OP_LEVEL (carrier TL is the volume)
+    uint8_t op_ar_dr[2];     // OPL3_OP_AR_DR
+    uint8_t op_sl_rr[2];     // OPL3_OP_SL_RR
+    uint8_t op_wave[2];      // OPL3_OP_WAVE
+    uint8_t fb_conn;         // OPL3_CH_FB_CONN (without output bits)
+} opl3_patch_t;
+
+// OPL3 chip-specific voice extras (separate from base voice_t)
+typedef struct {
+    uint8_t volume;          // Current volume (0-15)
+    uint8_t key_block;       // Last OPL3_CH_KEY_BLOCK value, key bit clear
+    uint8_t patch;           // Program loaded into the voice's operators
+} opl3_voice_extra_t;
+
+// Register write statistics
+typedef struct {
+    uint16_t writes;         // Register writes that reached the bus
+    uint16_t skipped;        // Redundant writes eliminated by the shadow
+} opl3_reg_stats_t;
+
+// Function declarations
+void opl3_init(void);
+void opl3_reset(void);
+void opl3_all_off(void);
+
+// Voice control
+void opl3_note_on(uint8_t voice, uint8_t note, uint8_t velocity, uint8_t channel);
+void opl3_note_off(uint8_t voice);
+
+// Parameter control (CC mapping)
+void opl3_set_volume(uint8_t voice, uint8_t volume);
+void opl3_set_attack(uint8_t voice, uint8_t attack);
+void opl3_set_decay(uint8_t voice, uint8_t decay);
+void opl3_set_sustain(uint8_t voice, uint8_t sustain);
+void opl3_set_release(uint8_t voice, uint8_t release);
+void opl3_set_vibrato(uint8_t depth);
+void opl3_set_tremolo(uint8_t rate);
+void opl3_set_pitch_bend(uint8_t channel, int16_t steps);
+void opl3_set_modulation(uint8_t depth);
+
+// Chip-specific
+void opl3_set_preset(uint8_t preset);
+void opl3_panic(void);
+
+// Low-level register access
+void opl3_write_register(uint16_t reg, uint8_t data);
+uint8_t opl3_read_shadow(uint16_t reg);
+
+// Chip detection and write pacing
+uint8_t detect_opl3(void);
+void opl3_pacing_init(uint16_t cpu_khz);
+
+// Test functions
+void opl3_play_test_sequence(void);
+
+// External interface
+extern sound_chip_interface_t opl3_interface;
+extern voice_t opl3_voices[OPL3_VOICES];
+extern opl3_voice_extra_t opl3_voice_extra[OPL3_VOICES];
+extern opl3_reg_stats_t opl3_reg_stats;
+extern uint8_t opl3_pace_loops;
+
+#endif // OPL3_H
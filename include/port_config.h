@@ -4,6 +4,14 @@
 typedef struct {
     unsigned char addr_port;
     unsigned char data_port;
+    unsigned char addr_port2;   // Second YM2149 card (0 = not fitted)
+    unsigned char data_port2;
+    unsigned char addr_port3;   // Third YM2149 card (0 = not fitted)
+    unsigned char data_port3;
+    unsigned char opl3_port;    // OPL3 card base port (0 = not fitted)
+    unsigned char bus_timing;   // YM2149_TIMING_* profile, or YM2149_TIMING_AUTO
+    unsigned char ctc_port;     // Z80 CTC channel 0 port for the timebase (0 = none)
+    unsigned int cpu_khz;       // CPU clock in kHz (CTC tick scaling)
 } port_config_t;
 
 // External declarations - implemented in ym2149.c
@@ -0,0 +1,34 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+// Main-loop scheduler tuning
+#define SCHED_MIDI_BUDGET_DEFAULT  32   // Max MIDI bytes parsed per pass
+#define SCHED_CONSOLE_INTERVAL     32   // Passes between console (kbhit) polls
+#define SCHED_MAX_IDLE_TASKS        8   // Idle task slots
+#define SCHED_MAX_PASS_TASKS        4   // Every-pass task slots
+
+typedef void (*sched_task_fn)(void);
+typedef void (*sched_key_fn)(char key);
+
+// Scheduler statistics
+typedef struct {
+    uint8_t  midi_budget;    // Current per-pass MIDI byte budget
+    uint8_t  peak_burst;     // Most MIDI bytes drained in a single pass
+    uint16_t budget_hits;    // Passes that stopped because the budget ran out
+} sched_stats_t;
+
+void scheduler_init(void);
+void scheduler_set_midi_budget(uint8_t budget);
+uint8_t scheduler_add_idle_task(sched_task_fn task);
+uint8_t scheduler_add_pass_task(sched_task_fn task);
+void scheduler_set_key_handler(sched_key_fn handler);
+
+// Run one scheduler pass / run forever
+void scheduler_pass(void);
+void scheduler_run(void);
+
+extern sched_stats_t sched_stats;
+
+#endif // SCHEDULER_H
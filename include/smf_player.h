@@ -0,0 +1,49 @@
+#ifndef SMF_PLAYER_H
+#define SMF_PLAYER_H
+
+#include <stdint.h>
+
+// Standard MIDI File player (type 0 and type 1).
+//
+// Tracks are streamed from disk in 128-byte CP/M records.  Each track has
+// two record buffers: the parser reads from one while the scheduler's
+// idle pass fills the other, so a disk read only lands in the event path
+// when the idle pass could not keep up (counted in smf_stats.underruns).
+// Type-1 tracks are merged through a min-heap keyed on each track's next
+// event tick.  Event times are converted with the file's tempo map and
+// checked against the timebase tick counter on every scheduler pass.
+
+#define SMF_MAX_TRACKS      16
+#define SMF_RECORD_SIZE     128    // CP/M record
+#define SMF_DEFAULT_FILE    "SONG.MID"
+#define SMF_NAME_MAX        16     // "D:FILENAME.EXT" plus terminator
+#define SMF_TEMPO_DEFAULT   500000UL   // Microseconds per quarter note (120 BPM)
+
+// smf_player_open() results
+#define SMF_OK              0
+#define SMF_ERR_OPEN        1      // File not found
+#define SMF_ERR_FORMAT      2      // Not an SMF, or SMPTE timing / type 2
+#define SMF_ERR_TRACKS      3      // More than SMF_MAX_TRACKS tracks
+#define SMF_ERR_READ        4      // Truncated file
+
+// Playback statistics
+typedef struct {
+    uint16_t events;         // Channel messages sent to the synth
+    uint16_t prefetches;     // Records read ahead by the idle pass
+    uint16_t underruns;      // Records read in the event path instead
+    uint16_t max_late;       // Worst dispatch lateness, in ticks
+} smf_stats_t;
+
+uint8_t smf_player_open(const char* filename);
+void smf_player_stop(void);
+uint8_t smf_player_active(void);
+const char* smf_player_error_name(uint8_t error);
+const char* smf_player_file(void);
+
+// Scheduler hooks: dispatch due events every pass, read ahead when idle
+void smf_player_service(void);
+void smf_player_prefetch(void);
+
+extern smf_stats_t smf_stats;
+
+#endif // SMF_PLAYER_H
@@ -5,15 +5,37 @@
 #include "chip_interface.h"
 #include "chip_manager.h"
 #include "midi_driver.h"
+#include "voice_alloc.h"
 
 // Main synthesizer functions
 void synthesizer_init(void);
 void synthesizer_panic(void);
 
-// Voice allocation functions
-uint8_t allocate_voice(uint8_t note, uint8_t velocity, uint8_t channel);
+// Note-to-voice index: chained hash keyed on (channel, note), so note-off
+// lookup cost doesn't grow with polyphony.  128 bytes of state.
+#define VOICE_MAP_BUCKETS     64    // Power of two
+#define VOICE_MAP_MAX_VOICES  32    // Voices beyond this are not indexed
+#define VOICE_MAP_END         0xFF  // End of chain / empty bucket
+#define VOICE_MAP_HASH(note, channel) \
+    (((note) ^ ((channel) << 2)) & (VOICE_MAP_BUCKETS - 1))
+
+// Voice lookup (allocation is in voice_alloc.h)
 uint8_t find_voice_by_note(uint8_t note, uint8_t channel);
 
+// Note dispatch: allocate/steal or look up a voice and keep the index current
+uint8_t synthesizer_note_on(uint8_t note, uint8_t velocity, uint8_t channel);
+uint8_t synthesizer_note_off(uint8_t note, uint8_t channel);
+void synthesizer_channel_off(uint8_t channel);   // Release all the channel's notes
+void voice_map_reset(void);
+
+// MIDI channel (0-based) the audio tests play on.  Test notes go through
+// the allocator like any other, so live notes on other channels are
+// neither overwritten by them nor cut off when they end.
+#define SYNTH_TEST_CHANNEL    15
+
+// Modulation tick (scheduler idle task)
+void synthesizer_tick(void);
+
 // System status
 void synthesizer_print_status(void);
 
@@ -0,0 +1,74 @@
+#ifndef SYSEX_H
+#define SYSEX_H
+
+#include <stdint.h>
+
+// System Exclusive bulk dumps.
+//
+// SysEx is parsed one byte at a time as it arrives, with no message
+// buffer: a patch dump is decoded straight into its slot in the YM2149
+// patch bank.  Messages use the non-commercial manufacturer ID and a
+// device ID, so several synths can share one MIDI chain:
+//
+//   F0 7D <dev> 01 <prog> <16 nibbles> <sum> F7   patch dump
+//   F0 7D <dev> 02 <prog> F7                      patch dump request
+//   F0 7D <dev> 03 F7                             bank dump request
+//
+// Patch bytes travel as high/low nibble pairs.  <sum> makes the 7-bit
+// sum of <prog>, the nibbles and itself zero.  Requests are answered
+// with patch dumps on MIDI OUT (SIO Channel B transmit).  A reply is
+// not sent from the parser: the scheduler pass task sysex_service()
+// sends it a byte at a time whenever the transmitter is free, so a bank
+// request (128 dumps, about 0.9 s at 31250 baud) never holds up MIDI
+// input or timing.  A request that arrives while a reply is going out
+// replaces what is left of it once the current dump is finished.
+
+#define SYSEX_ID              0x7D    // Non-commercial / educational use
+#define SYSEX_DEVICE_ALL      0x7F    // Device ID every synth answers to
+#define SYSEX_DEVICE_DEFAULT  0x00
+
+// Commands
+#define SYSEX_PATCH_DUMP      0x01
+#define SYSEX_PATCH_REQUEST   0x02
+#define SYSEX_BANK_REQUEST    0x03
+
+#define SYSEX_PATCH_NIBBLES   16      // Two per ym2149_patch_t byte
+#define SYSEX_PATCH_DUMP_LEN  (5 + SYSEX_PATCH_NIBBLES + 2)   // F0 .. F7
+
+// Parser states (SYSEX_IDLE = not inside a SysEx message)
+#define SYSEX_IDLE            0
+#define SYSEX_MANUFACTURER    1
+#define SYSEX_DEVICE          2
+#define SYSEX_COMMAND         3
+#define SYSEX_PROGRAM         4
+#define SYSEX_DATA            5
+#define SYSEX_CHECKSUM        6
+#define SYSEX_END             7       // Complete, waiting for F7
+#define SYSEX_SKIP            8       // Not for us: ignore up to F7
+
+typedef struct {
+    uint16_t dumps;          // Patch dumps stored
+    uint16_t requests;       // Dump requests answered
+    uint16_t ignored;        // Other manufacturers or devices
+    uint16_t errors;         // Bad checksum, truncated or malformed
+} sysex_stats_t;
+
+extern sysex_stats_t sysex_stats;
+extern uint8_t sysex_state;              // SYSEX_*
+
+void sysex_init(void);
+void sysex_set_device(uint8_t device);
+uint8_t sysex_get_device(void);
+
+// Called by midi_process_byte(): F0, each data byte while sysex_state
+// is not SYSEX_IDLE, and the status byte that ends the message
+// (`eox` = 1 for F7, 0 if another status byte cut it short)
+void sysex_start(void);
+void sysex_byte(uint8_t byte);
+void sysex_end(uint8_t eox);
+
+// Reply transmitter (scheduler pass task)
+void sysex_service(void);
+uint8_t sysex_tx_busy(void);
+
+#endif // SYSEX_H
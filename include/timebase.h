@@ -0,0 +1,58 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+
+// System timebase — a free-running 16-bit tick counter (~1 ms per tick).
+//
+// The preferred source is a Z80 CTC, polled by timebase_update() (no
+// interrupts).  Channel 0 counts CPU clocks / 256 and wraps every 65536
+// clocks (~8.9 ms at 7.3728 MHz).  Where ZC/TO0 is linked to CLK/TRG1,
+// channel 1 counts those wraps, so passes may be up to 2^24 clocks
+// (~2.3 s) apart before time is lost.  Without the link a single pass
+// longer than 65536 clocks loses a wrap.
+//
+// Boards without a CTC use the RomWBW HBIOS system timer (SYSGET
+// TIMER), which ticks at 50 or 60 Hz from the HBIOS interrupt; ticks
+// then advance in steps of 1000 / rate ms.  Only when neither is
+// running does the tick fall back to counting scheduler passes, which
+// tracks the load rather than time.
+//
+// Nothing waits on the timebase; timed work goes on the event wheel
+// (event_wheel.h).
+
+#define TIMEBASE_CTC_PORT_DEFAULT  0x88   // RC2014 Z80 CTC module, channel 0
+#define TIMEBASE_CPU_KHZ_DEFAULT   7373   // 7.3728 MHz
+
+// Tick sources
+#define TIMEBASE_SOURCE_SOFT   0   // Scheduler pass count (nothing else found)
+#define TIMEBASE_SOURCE_CTC    1   // Z80 CTC channel 0 (and 1 if chained), polled
+#define TIMEBASE_SOURCE_HBIOS  2   // RomWBW HBIOS system timer
+
+// Software mode: timebase_update() calls per tick (rough main-loop rate)
+#define TIMEBASE_SOFT_CALLS_PER_TICK  16
+
+// HBIOS mode: timebase_update() calls per HBIOS timer read.  The call
+// is a bank-switched round trip, far dearer than a CTC read.
+#define TIMEBASE_HBIOS_POLL_CALLS     8
+
+typedef struct {
+    uint16_t overruns;       // CTC reads more than half the counter period apart
+} timebase_stats_t;
+
+extern timebase_stats_t timebase_stats;
+
+// Current tick count.  Read directly — wraps every ~65 seconds, so
+// compare ticks with (uint16_t)(a - b), never with < or >.
+extern volatile uint16_t timebase_tick;
+
+#define timebase_now()  (timebase_tick)
+
+void timebase_init(uint8_t ctc_port, uint16_t cpu_khz);
+void timebase_update(void);
+uint8_t timebase_source(void);
+uint8_t timebase_ctc_port(void);
+uint8_t timebase_ctc_chained(void);
+uint8_t timebase_hbios_rate(void);
+
+#endif // TIMEBASE_H
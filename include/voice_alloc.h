@@ -0,0 +1,56 @@
+#ifndef VOICE_ALLOC_H
+#define VOICE_ALLOC_H
+
+#include <stdint.h>
+
+// Voice allocation.
+//
+// Free voices sit on a free list and sounding voices on an LRU ring
+// (least recently started first), so a free voice is found in O(1) and
+// "oldest" needs no timestamps: it is the head of the ring.  The other
+// steal policies walk the ring from the oldest end, and only when every
+// voice is busy.  State is kept as parallel byte arrays indexed by voice.
+//
+// The voices can be split into groups of consecutive voices, each with
+// its own free list and ring.  A MIDI channel allocates from the group
+// its routing entry names (midi_channels[].group), so parts never steal
+// from each other.  Group 0 starts at voice 0; by default it has them all.
+
+#define VALLOC_MAX_VOICES   32      // Voices beyond this are never allocated
+#define VALLOC_GROUPS       4
+#define VALLOC_NONE         0xFF    // No voice / end of list / unused group
+
+// Steal policies
+#define VALLOC_OLDEST       0       // Steal the least recently started voice
+#define VALLOC_QUIETEST     1       // Steal the lowest velocity, oldest first
+#define VALLOC_RETRIGGER    2       // A repeated note reuses its voice; else oldest
+#define VALLOC_RESERVE      3       // Never steal below a channel's reservation
+#define VALLOC_POLICY_COUNT 4
+
+// Policy, reservations, groups and part routing, from VALLOC_CONFIG_FILE:
+//   policy=oldest|quietest|retrigger|reserve
+//   ch<1-16>=<voices reserved>
+//   group<1-3>=<first voice>            groups in ascending voice order
+//   part<1-16>=<group>[,ym2149|opl3]    channel's group and chip
+#define VALLOC_CONFIG_FILE  "voices.cfg"
+
+typedef struct {
+    uint16_t allocs;         // Voices taken from the free list
+    uint16_t steals;         // Sounding voices taken over
+    uint16_t retriggers;     // Repeated notes that kept their voice
+} valloc_stats_t;
+
+extern valloc_stats_t valloc_stats;
+
+void valloc_reset(void);                       // Resync with the chip on next use
+uint8_t allocate_voice(uint8_t note, uint8_t velocity, uint8_t channel);
+void valloc_release(uint8_t voice);
+
+void valloc_set_policy(uint8_t policy);
+uint8_t valloc_get_policy(void);
+const char* valloc_policy_name(uint8_t policy);
+void valloc_set_reserve(uint8_t channel, uint8_t voices);
+void valloc_set_group(uint8_t group, uint8_t first_voice);  // VALLOC_NONE = unused
+int valloc_config_load(const char* filename);  // 1 = file read
+
+#endif // VOICE_ALLOC_H
@@ -4,10 +4,16 @@
 #include <stdint.h>
 #include "chip_interface.h"
 #include "port_config.h"
+#include "lfo.h"
 
-// YM2149 Register definitions
-#define YM2149_ADDR_PORT     ym2149_ports.addr_port    // Address register (configurable)
-#define YM2149_DATA_PORT     ym2149_ports.data_port    // Data register (configurable)
+// Multi-card support: every detected card adds 3 voices to one pool.
+// Voice v plays on card v / 3, tone channel v % 3.
+#define YM2149_MAX_CARDS     3
+#define YM2149_MAX_VOICES    (YM2149_MAX_CARDS * 3)
+
+// YM2149 Register definitions — ports of the currently selected card
+#define YM2149_ADDR_PORT     ym2149_card->addr_port    // Address register (configurable)
+#define YM2149_DATA_PORT     ym2149_card->data_port    // Data register (configurable)
 
 // YM2149 Register addresses
 #define YM2149_FREQ_A_LSB     0x00     // Channel A frequency low byte
@@ -58,9 +64,105 @@ typedef struct {
     uint8_t volume;              // Current volume (0-15)
     uint8_t envelope_enabled;    // Envelope mode active
     uint8_t envelope_shape;      // Current envelope shape
-    uint16_t frequency;          // Current frequency value
+    uint16_t frequency;          // Tone period for the note (from the table)
+    uint16_t period;             // Period after pitch bend, before vibrato
+    uint8_t patch;               // Program the note was started with
 } ym2149_voice_extra_t;
 
+// Software modulation
+#define YM2149_VIBRATO_RATE    LFO_RATE_DHZ(55)  // 5.5 Hz vibrato
+#define YM2149_TREMOLO_DEPTH   64                // Up to 8 volume steps
+
+// Register shadow cache
+// Registers below YM2149_SHADOW_CACHED are write-cached.  The envelope
+// shape (13) is always written through, because any write to it
+// restarts the envelope, and so are the I/O port registers (14, 15).
+#define YM2149_SHADOW_SIZE    16
+#define YM2149_SHADOW_CACHED  13
+
+// Address latch contents when the last register selected is not known
+#define YM2149_LATCH_UNKNOWN  0xFF
+
+// Per-card state: I/O ports, address latch and the register shadow
+typedef struct {
+    uint8_t addr_port;
+    uint8_t data_port;
+    uint8_t latched;         // Register in the address latch, or YM2149_LATCH_UNKNOWN
+    uint8_t shadow_valid;    // Shadow trusted (set by ym2149_reset)
+    uint8_t shadow[YM2149_SHADOW_SIZE];
+    uint8_t patch;           // Program whose registers 6-7, 11-13 are loaded
+} ym2149_card_t;
+
+// Register write statistics (all cards)
+typedef struct {
+    uint16_t writes;         // Register writes that reached the bus
+    uint16_t skipped;        // Redundant writes eliminated by the shadow
+    uint16_t shadow_hits;    // Register reads served from the shadow
+    uint16_t latch_hits;     // Writes that reused the latched address
+} ym2149_reg_stats_t;
+
+// Bus timing profiles
+// Each profile is the number of DJNZ iterations (13 T-states each) run
+// after every address and data port write.  The profile is chosen at
+// startup by calibration, or forced with bus_timing= in ports.conf.
+// Profiles are named by delay, not CPU clock: calibration measures what
+// the card needs, not how fast the CPU runs.
+#define YM2149_TIMING_NONE    0    // No delay
+#define YM2149_TIMING_SHORT   1    // 1 loop
+#define YM2149_TIMING_MEDIUM  2    // 3 loops
+#define YM2149_TIMING_SAFE    3    // Conservative (used for detection)
+#define YM2149_TIMING_COUNT   4
+#define YM2149_TIMING_AUTO    0xFF // Calibrate at startup
+
+typedef struct {
+    const char* name;        // Profile name, as in ports.conf
+    uint8_t delay_loops;     // DJNZ iterations after each port write
+} ym2149_timing_profile_t;
+
+// Patch bank
+// 128 patches, one per MIDI program, loaded at startup from
+// YM2149_BANK_FILE into a contiguous table (built-in patches when the
+// file is missing).  File layout: "YMPB", version, patch count, two
+// reserved bytes, then one 8-byte ym2149_patch_t per program.
+#define YM2149_BANK_FILE      "PATCHES.BNK"
+#define YM2149_BANK_SIZE      128
+#define YM2149_BANK_VERSION   1
+#define YM2149_BUILTIN_PATCHES 4
+
+// Velocity to level curves (ym2149_patch_t.curve)
+#define YM2149_CURVE_LINEAR   0    // Level follows velocity
+#define YM2149_CURVE_SOFT     1    // Compressed: quiet notes louder
+#define YM2149_CURVE_HARD     2    // Expanded: more dynamic range
+#define YM2149_CURVE_FIXED    3    // Always full level
+#define YM2149_CURVE_COUNT    4
+
+// One patch.  regs_6_7 and regs_11_13 are the images of registers 6-7
+// and 11-13, uploaded straight from the table.  Mixer, noise and
+// envelope are shared by the three voices of a card: they are uploaded
+// when a note starts with a program other than the one loaded on its
+// card, which also changes them for notes of other parts on that card.
+// The level mode, curve and detune are per voice and follow the program
+// each note was started with.
+#define YM2149_PATCH_NONE     0xFF // ym2149_card_t.patch: nothing loaded
+#define YM2149_PATCH_NOISE    0    // regs_6_7: R6 noise period (0-31)
+#define YM2149_PATCH_MIXER    1    // regs_6_7: R7 tone/noise enables
+#define YM2149_PATCH_ENV_LSB  0    // regs_11_13: R11-12 envelope period
+#define YM2149_PATCH_ENV_MSB  1
+#define YM2149_PATCH_SHAPE    2    // regs_11_13: R13 envelope shape (YM2149_ENV_*)
+
+typedef struct {
+    uint8_t regs_6_7[2];     // R6-7: noise period, mixer
+    uint8_t regs_11_13[3];   // R11-13: envelope period LSB, MSB, shape
+    uint8_t level_mode;      // 0, or YM2149_VOLUME_ENV to level from the envelope
+    uint8_t curve;           // Velocity to level curve (YM2149_CURVE_*)
+    int8_t detune;           // Tone period offset
+} ym2149_patch_t;
+
+// ym2149_bank_load() results
+#define YM2149_BANK_OK        0
+#define YM2149_BANK_ERR_OPEN  1    // File not found: built-in patches kept
+#define YM2149_BANK_ERR_FORMAT 2   // Bad header or short file
+
 // Frequency table range
 #define YM2149_MIDI_NOTE_MIN  24   // C1
 #define YM2149_MIDI_NOTE_MAX  96   // C7
@@ -82,35 +184,54 @@ void ym2149_set_sustain(uint8_t voice, uint8_t sustain);
 void ym2149_set_release(uint8_t voice, uint8_t release);
 void ym2149_set_vibrato(uint8_t depth);
 void ym2149_set_tremolo(uint8_t rate);
-void ym2149_set_pitch_bend(int16_t bend);
+void ym2149_set_pitch_bend(uint8_t channel, int16_t steps);
 void ym2149_set_modulation(uint8_t depth);
+void ym2149_set_tremolo_sync(uint8_t clocks);
 
 // Chip-specific
 void ym2149_set_preset(uint8_t preset);
+void ym2149_patch_refresh(void);
+void ym2149_bank_defaults(void);
+uint8_t ym2149_bank_load(const char* filename);
 void ym2149_panic(void);
+void ym2149_tick(void);
 
 // Low-level register access
 void ym2149_write_register(uint8_t reg, uint8_t data);
+void ym2149_write_block(uint8_t first, const uint8_t* data, uint8_t count);  // Registers 0-13
+uint8_t ym2149_read_shadow(uint8_t reg);
+void ym2149_shadow_invalidate(void);
 void ym2149_set_frequency(uint8_t voice, uint16_t freq);
 
 // Frequency conversion
 uint16_t ym2149_note_to_freq(uint8_t note);
-uint16_t ym2149_apply_pitch_bend(uint16_t base_freq, int16_t bend);
+uint16_t ym2149_bend_period(uint8_t note, int16_t steps);
 
-// Chip detection
+// Chip detection and card pool
 uint8_t detect_ym2149(void);
+void ym2149_cards_clear(void);
+uint8_t ym2149_add_card(uint8_t addr_port, uint8_t data_port);
 
-// Utility
-void delay_ms(uint16_t ms);
+// Bus timing
+void ym2149_timing_init(uint8_t profile);
+uint8_t ym2149_timing_profile(void);
+uint8_t ym2149_timing_calibrated(void);
 
-// Test functions
+// Test functions: queued on the event wheel, return at once
 void ym2149_play_test_sequence(void);
 void ym2149_play_arpeggio(void);
 void ym2149_play_scale(void);
 
 // External interface
 extern sound_chip_interface_t ym2149_interface;
-extern voice_t ym2149_voices[3];               // Base voice state (used via chip_interface)
-extern ym2149_voice_extra_t ym2149_voice_extra[3];  // Chip-specific extras
+extern voice_t ym2149_voices[YM2149_MAX_VOICES];               // Base voice state (used via chip_interface)
+extern ym2149_voice_extra_t ym2149_voice_extra[YM2149_MAX_VOICES];  // Chip-specific extras
+extern ym2149_card_t ym2149_cards[YM2149_MAX_CARDS];
+extern ym2149_card_t* ym2149_card;             // Card register writes go to
+extern uint8_t ym2149_card_count;
+extern ym2149_reg_stats_t ym2149_reg_stats;
+extern ym2149_patch_t ym2149_bank[YM2149_BANK_SIZE];
+extern const ym2149_patch_t* ym2149_patch;   // Program for the next note
+extern const ym2149_timing_profile_t ym2149_timing_profiles[YM2149_TIMING_COUNT];
 
 #endif // YM2149_H
\ No newline at end of file
@@ -0,0 +1,525 @@
+#include "../../include/opl3.h"
+#include "../../include/port_config.h"
+#include "../../include/console.h"
+#include "../../include/messages.h"
+#include "../../include/event_wheel.h"
+#include "../../include/synthesizer.h"
+#include "../../include/hal.h"
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Global voice arrays — split to match voice_t stride expected by chip_interface
+voice_t opl3_voices[OPL3_VOICES];
+opl3_voice_extra_t opl3_voice_extra[OPL3_VOICES];
+
+// Channel register offset per voice (bank in bit 8)
+static const uint16_t opl3_voice_chan[OPL3_VOICES] = {
+    0x000, 0x001, 0x002, 0x003, 0x004, 0x005, 0x006, 0x007, 0x008,
+    0x100, 0x101, 0x102, 0x103, 0x104, 0x105, 0x106, 0x107, 0x108
+};
+
+// Modulator operator offset per voice; the carrier is 3 above it
+static const uint16_t opl3_voice_op[OPL3_VOICES] = {
+    0x000, 0x001, 0x002, 0x008, 0x009, 0x00A, 0x010, 0x011, 0x012,
+    0x100, 0x101, 0x102, 0x108, 0x109, 0x10A, 0x110, 0x111, 0x112
+};
+
+#define OPL3_CARRIER  3
+
+// Built-in instruments, selected by program change
+static const opl3_patch_t opl3_patches[OPL3_PATCH_COUNT] = {
+    // 0: Piano — decaying FM
+    { {0x01, 0x11}, {0x4F, 0x00}, {0xF1, 0xD2}, {0x53, 0x74}, {0x00, 0x00}, 0x06 },
+    // 1: Organ — additive sines, octave apart
+    { {0x22, 0x21}, {0x10, 0x00}, {0xF0, 0xF0}, {0x0F, 0x0F}, {0x00, 0x00}, 0x01 },
+    // 2: Brass — slow attack, strong feedback
+    { {0x21, 0x21}, {0x16, 0x00}, {0x71, 0x61}, {0x17, 0x17}, {0x00, 0x00}, 0x0E },
+    // 3: Bell — inharmonic modulator
+    { {0x07, 0x01}, {0x1C, 0x00}, {0xF5, 0xF3}, {0x35, 0x35}, {0x00, 0x00}, 0x00 },
+};
+static uint8_t opl3_program = 0;   // Program for the next note
+
+// F-numbers for C..C' at the block where MIDI note 60 is block 4:
+// fnum = round(freq * 2^(20 - block) / 49716)
+static const uint16_t opl3_fnum[13] = {
+    345, 365, 387, 410, 435, 460, 488, 517, 547, 580, 615, 651, 690
+};
+
+// Block (high nibble) and semitone (low nibble) per MIDI note, built at
+// init so the pitch path never divides by 12
+static uint8_t opl3_note_pos[128];
+
+// Pitch bend per MIDI channel, in PITCH_BEND_STEPS per semitone
+static int16_t opl3_channel_bend[16];
+
+// Hardware LFO state: AM/VIB operator bits and the depth register
+static uint8_t opl3_lfo_bits = 0;
+static uint8_t opl3_vibrato_depth = 0;   // CC#9
+static uint8_t opl3_mod_depth = 0;       // CC#12
+static uint8_t opl3_tremolo_rate = 0;    // CC#10
+
+// Register shadow — last value written to every register of both banks.
+// Only trusted once opl3_reset() has written every cached register.
+static uint8_t opl3_shadow[OPL3_SHADOW_SIZE];
+static uint8_t opl3_shadow_valid = 0;
+opl3_reg_stats_t opl3_reg_stats;
+
+// Write pacing, in DJNZ iterations — conservative until opl3_pacing_init()
+uint8_t opl3_pace_loops = 8;
+
+// Pacing delay: opl3_pace_loops x 13 T-states
+#ifdef __Z88DK
+static void opl3_pace_delay(void) __naked {
+    __asm
+        ld a, (_opl3_pace_loops)
+        or a
+        ret z
+        ld b, a
+    opl3_pace_delay_loop:
+        djnz opl3_pace_delay_loop
+        ret
+    __endasm;
+}
+#else
+static void opl3_pace_delay(void) {
+    // The fake bus accepts writes back to back
+}
+#endif
+
+#define OPL3_PACE()  do { if (opl3_pace_loops) opl3_pace_delay(); } while (0)
+
+// Raw bus write — always reaches the chip, never touches the shadow.
+// Bank 1 registers (bit 8 set) use the second address/data port pair.
+static void opl3_bus_write(uint16_t reg, uint8_t data) {
+    uint8_t port = ym2149_ports.opl3_port + ((uint8_t)(reg >> 7) & 0x02);
+
+    hal_outp(port, (uint8_t)reg);
+    OPL3_PACE();
+    hal_outp(port + 1, data);
+    OPL3_PACE();
+}
+
+// Low-level register write function.
+// Writes that would not change the register are skipped.
+void opl3_write_register(uint16_t reg, uint8_t data) {
+    reg &= OPL3_SHADOW_SIZE - 1;
+    if (opl3_shadow_valid && (uint8_t)reg >= OPL3_SHADOW_FIRST &&
+        opl3_shadow[reg] == data) {
+        opl3_reg_stats.skipped++;
+        return;
+    }
+    opl3_shadow[reg] = data;
+    opl3_reg_stats.writes++;
+    opl3_bus_write(reg, data);
+}
+
+// Read a register value from the shadow (the OPL3 registers are write-only)
+uint8_t opl3_read_shadow(uint16_t reg) {
+    return opl3_shadow[reg & (OPL3_SHADOW_SIZE - 1)];
+}
+
+// Choose the pacing delay for the CPU clock.  Returns with no delay at
+// all unless the CPU can issue two OUTs faster than the chip accepts them.
+void opl3_pacing_init(uint16_t cpu_khz) {
+    // T-states the chip needs per write: OPL3_WRITE_NS * cpu_khz / 10^6
+    uint16_t needed = (cpu_khz / 100) * (OPL3_WRITE_NS / 100) / 100;
+
+    opl3_pace_loops = 0;
+    if (needed > OPL3_WRITE_PATH_T) {
+        opl3_pace_loops = (uint8_t)((needed - OPL3_WRITE_PATH_T + 12) / 13);
+    }
+}
+
+// Detect an OPL3 via its timers: after a reset the status reads 0, and
+// once timer 1 is started it must overflow and raise IRQ + T1.  Status
+// bits 1-2 are set on an OPL2, so that is rejected too.
+uint8_t detect_opl3(void) {
+    uint8_t status;
+
+    if (ym2149_ports.opl3_port == 0) return 0;  // Disabled in ports.conf
+
+    opl3_pace_loops = 8;
+    opl3_bus_write(OPL3_TIMER_CTRL, OPL3_TIMER_RESET);
+    opl3_bus_write(OPL3_TIMER_CTRL, OPL3_IRQ_RESET);
+    status = hal_inp(ym2149_ports.opl3_port);
+    if (status & OPL3_STATUS_TIMERS) {
+        return 0;  // Floating bus (0xFF) or not a timer chip
+    }
+
+    // Timer 1 at 0xFF overflows after one 80 us step; poll rather than
+    // sleep so detection works before the timebase is running
+    opl3_bus_write(OPL3_TIMER1, 0xFF);
+    opl3_bus_write(OPL3_TIMER_CTRL, OPL3_TIMER1_START);
+    for (uint8_t n = 0; n < 255; n++) {
+        status = hal_inp(ym2149_ports.opl3_port);
+        if ((status & OPL3_STATUS_TIMERS) == (OPL3_STATUS_IRQ | OPL3_STATUS_T1)) {
+            break;
+        }
+    }
+    opl3_bus_write(OPL3_TIMER_CTRL, OPL3_TIMER_RESET);
+    opl3_bus_write(OPL3_TIMER_CTRL, OPL3_IRQ_RESET);
+
+    if ((status & OPL3_STATUS_TIMERS) != (OPL3_STATUS_IRQ | OPL3_STATUS_T1)) {
+        return 0;
+    }
+    if (status & OPL3_STATUS_OPL2) {
+        return 0;  // OPL2: no second bank
+    }
+
+    // Detection bypassed the shadow
+    opl3_shadow_valid = 0;
+    return 1;
+}
+
+// F-number/block for a note bent by `steps` (1/PITCH_BEND_STEPS semitone),
+// as (key/block byte << 8) | F-number low byte.  F-numbers are linear in
+// frequency, so the fraction interpolates between adjacent semitones;
+// adjacent entries differ by at most 39, so this is 8x8 maths.
+static uint16_t opl3_note_fnum(uint8_t note, int16_t steps) {
+    int16_t pos = (int16_t)note * PITCH_BEND_STEPS + steps;
+
+    if (pos < OPL3_MIDI_NOTE_MIN * PITCH_BEND_STEPS) {
+        pos = OPL3_MIDI_NOTE_MIN * PITCH_BEND_STEPS;
+    }
+    if (pos > OPL3_MIDI_NOTE_MAX * PITCH_BEND_STEPS) {
+        pos = OPL3_MIDI_NOTE_MAX * PITCH_BEND_STEPS;
+    }
+
+    uint8_t np = opl3_note_pos[pos >> 5];
+    const uint16_t* f = &opl3_fnum[np & 0x0F];
+    uint16_t fnum = f[0];
+    uint8_t frac = pos & (PITCH_BEND_STEPS - 1);
+
+    if (frac) {
+        fnum += ((f[1] - f[0]) * frac) >> 5;
+    }
+    return ((uint16_t)(((np >> 2) & 0x1C) | (fnum >> 8)) << 8) | (fnum & 0xFF);
+}
+
+// Load a program into one voice (key stays off)
+static void opl3_load_patch(uint8_t voice, uint8_t program) {
+    uint16_t op = opl3_voice_op[voice];
+    const opl3_patch_t* p = &opl3_patches[program];
+
+    opl3_voice_extra[voice].patch = program;
+
+    for (uint8_t i = 0; i < 2; i++) {
+        opl3_write_register(OPL3_OP_CHAR + op, p->op_char[i] | opl3_lfo_bits);
+        opl3_write_register(OPL3_OP_LEVEL + op, p->op_level[i]);
+        opl3_write_register(OPL3_OP_AR_DR + op, p->op_ar_dr[i]);
+        opl3_write_register(OPL3_OP_SL_RR + op, p->op_sl_rr[i]);
+        opl3_write_register(OPL3_OP_WAVE + op, p->op_wave[i]);
+        op += OPL3_CARRIER;
+    }
+    opl3_write_register(OPL3_CH_FB_CONN + opl3_voice_chan[voice],
+                        p->fb_conn | OPL3_OUT_LR);
+}
+
+// Initialize OPL3 chip
+void opl3_init(void) {
+    // Clear all voices
+    memset(opl3_voices, 0, sizeof(opl3_voices));
+    memset(opl3_voice_extra, 0, sizeof(opl3_voice_extra));
+    memset(opl3_channel_bend, 0, sizeof(opl3_channel_bend));
+
+    // Note → block/semitone table (MIDI 12 = C0 = block 0)
+    uint8_t block = 0, semi = 0;
+    for (uint8_t n = 0; n < 128; n++) {
+        opl3_note_pos[n] = (block << 4) | semi;
+        if (n >= OPL3_MIDI_NOTE_MIN && ++semi == 12) {
+            semi = 0;
+            block++;
+        }
+    }
+
+    opl3_lfo_bits = 0;
+    opl3_vibrato_depth = 0;
+    opl3_mod_depth = 0;
+    opl3_tremolo_rate = 0;
+    opl3_program = 0;
+
+    // Initialize to known state, then load the default instrument
+    opl3_reset();
+    for (uint8_t i = 0; i < OPL3_VOICES; i++) {
+        opl3_load_patch(i, 0);
+    }
+}
+
+// Reset the OPL3 to silence: OPL3 mode, 2-op voices, every voice
+// register zeroed.  Writes go through to the bus, after which the
+// shadow is known-good.
+void opl3_reset(void) {
+    opl3_shadow_valid = 0;
+    opl3_write_register(OPL3_NEW, 0x01);
+    opl3_write_register(OPL3_4OP_ENABLE, 0x00);
+    opl3_write_register(OPL3_TEST, 0x00);
+    opl3_write_register(OPL3_CSM_NOTESEL, 0x00);
+    for (uint16_t bank = 0; bank <= 0x100; bank += 0x100) {
+        for (uint16_t reg = OPL3_SHADOW_FIRST; reg <= 0xF5; reg++) {
+            opl3_write_register(bank | reg, 0x00);
+        }
+    }
+    opl3_shadow_valid = 1;
+    for (uint8_t i = 0; i < OPL3_VOICES; i++) {
+        opl3_voice_extra[i].patch = OPL3_PATCH_NONE;
+    }
+}
+
+// Turn off all voices
+void opl3_all_off(void) {
+    for (uint8_t i = 0; i < OPL3_VOICES; i++) {
+        opl3_note_off(i);
+    }
+}
+
+// Note on function
+void opl3_note_on(uint8_t voice, uint8_t note, uint8_t velocity, uint8_t channel) {
+    if (voice >= OPL3_VOICES) return;
+
+    voice_t* v = &opl3_voices[voice];
+    opl3_voice_extra_t* vx = &opl3_voice_extra[voice];
+    uint16_t ch = opl3_voice_chan[voice];
+
+    // A stolen voice must key off first or the envelope won't restart
+    if (opl3_read_shadow(OPL3_CH_KEY_BLOCK + ch) & OPL3_KEY_ON) {
+        opl3_write_register(OPL3_CH_KEY_BLOCK + ch, vx->key_block);
+    }
+
+    // Only this voice takes the part's program, and only if it differs
+    if (vx->patch != opl3_program) {
+        opl3_load_patch(voice, opl3_program);
+    }
+
+    // Store note information
+    v->active = 1;
+    v->midi_note = note;
+    v->velocity = velocity;
+    v->channel = channel;
+
+    // Set volume based on velocity (0-127 → 0-15)
+    opl3_set_volume(voice, ((uint16_t)velocity * 15) / 127);
+
+    // Pitch, bent by the channel's wheel, then key on
+    uint16_t kf = opl3_note_fnum(note, opl3_channel_bend[channel & 0x0F]);
+    vx->key_block = kf >> 8;
+    opl3_write_register(OPL3_CH_FNUM_LO + ch, kf & 0xFF);
+    opl3_write_register(OPL3_CH_KEY_BLOCK + ch, vx->key_block | OPL3_KEY_ON);
+}
+
+// Note off function — key off lets the release phase run
+void opl3_note_off(uint8_t voice) {
+    if (voice >= OPL3_VOICES) return;
+
+    opl3_voices[voice].active = 0;
+    opl3_write_register(OPL3_CH_KEY_BLOCK + opl3_voice_chan[voice],
+                        opl3_voice_extra[voice].key_block);
+}
+
+// Set voice volume via the carrier's total level (0.75 dB steps)
+void opl3_set_volume(uint8_t voice, uint8_t volume) {
+    if (voice >= OPL3_VOICES) return;
+
+    // Clamp volume to 0-15
+    if (volume > 15) volume = 15;
+    opl3_voice_extra[voice].volume = volume;
+    if (opl3_voice_extra[voice].patch == OPL3_PATCH_NONE) return;  // Reset, silent
+
+    uint8_t level = opl3_patches[opl3_voice_extra[voice].patch].op_level[1];
+    uint8_t tl = (level & 0x3F) + (15 - volume) * 4;
+    if (tl > 0x3F) tl = 0x3F;
+    opl3_write_register(OPL3_OP_LEVEL + OPL3_CARRIER + opl3_voice_op[voice],
+                        (level & 0xC0) | tl);
+}
+
+// Replace one nibble of a carrier envelope register with a CC value
+// (0-127 → 15-0, so a higher CC means a slower / lower setting)
+static void opl3_set_carrier_nibble(uint8_t voice, uint8_t reg, uint8_t high,
+                                    uint8_t value) {
+    if (voice >= OPL3_VOICES) return;
+
+    uint16_t addr = reg + OPL3_CARRIER + opl3_voice_op[voice];
+    uint8_t nibble = 15 - (value >> 3);
+    uint8_t cur = opl3_read_shadow(addr);
+
+    if (high) {
+        cur = (cur & 0x0F) | (nibble << 4);
+    } else {
+        cur = (cur & 0xF0) | nibble;
+    }
+    opl3_write_register(addr, cur);
+}
+
+// Set attack time
+void opl3_set_attack(uint8_t voice, uint8_t attack) {
+    opl3_set_carrier_nibble(voice, OPL3_OP_AR_DR, 1, attack);
+}
+
+// Set decay time
+void opl3_set_decay(uint8_t voice, uint8_t decay) {
+    opl3_set_carrier_nibble(voice, OPL3_OP_AR_DR, 0, decay);
+}
+
+// Set sustain level (OPL3 sustain level is an attenuation)
+void opl3_set_sustain(uint8_t voice, uint8_t sustain) {
+    opl3_set_carrier_nibble(voice, OPL3_OP_SL_RR, 1, sustain);
+}
+
+// Set release time
+void opl3_set_release(uint8_t voice, uint8_t release) {
+    opl3_set_carrier_nibble(voice, OPL3_OP_SL_RR, 0, release);
+}
+
+// Apply the AM/VIB operator bits and depth flags to every voice, over
+// the characteristics of the program each voice has loaded.
+// The OPL3 LFOs are fixed-rate (3.7 Hz AM, 6.1 Hz vibrato); CCs choose
+// on/off and normal/deep depth.  The shadow skips unchanged operators.
+static void opl3_update_lfo(void) {
+    uint8_t vib = (opl3_vibrato_depth > opl3_mod_depth)
+                  ? opl3_vibrato_depth : opl3_mod_depth;
+    uint8_t bits = 0;
+    uint8_t depth = 0;
+
+    if (vib) bits |= OPL3_CHAR_VIB;
+    if (vib >= 64) depth |= OPL3_DEEP_VIB;
+    if (opl3_tremolo_rate) bits |= OPL3_CHAR_AM;
+    if (opl3_tremolo_rate >= 64) depth |= OPL3_DEEP_AM;
+
+    opl3_write_register(OPL3_PERCUSSION, depth);
+    if (bits == opl3_lfo_bits) return;
+    opl3_lfo_bits = bits;
+
+    for (uint8_t i = 0; i < OPL3_VOICES; i++) {
+        uint8_t program = opl3_voice_extra[i].patch;
+        uint16_t op = opl3_voice_op[i];
+        if (program == OPL3_PATCH_NONE) continue;
+        opl3_write_register(OPL3_OP_CHAR + op, opl3_patches[program].op_char[0] | bits);
+        opl3_write_register(OPL3_OP_CHAR + OPL3_CARRIER + op,
+                            opl3_patches[program].op_char[1] | bits);
+    }
+}
+
+// Set vibrato depth (global effect, hardware LFO)
+void opl3_set_vibrato(uint8_t depth) {
+    opl3_vibrato_depth = depth;
+    opl3_update_lfo();
+}
+
+// Set tremolo (global effect, hardware LFO), 0 = off
+void opl3_set_tremolo(uint8_t rate) {
+    opl3_tremolo_rate = rate;
+    opl3_update_lfo();
+}
+
+// Set modulation depth (mod wheel — drives vibrato, like CC#9)
+void opl3_set_modulation(uint8_t depth) {
+    opl3_mod_depth = depth;
+    opl3_update_lfo();
+}
+
+// Set pitch bend for one MIDI channel (steps in 1/PITCH_BEND_STEPS semitone)
+// Only voices playing on that channel are retuned.
+void opl3_set_pitch_bend(uint8_t channel, int16_t steps) {
+    channel &= 0x0F;
+    if (opl3_channel_bend[channel] == steps) return;
+    opl3_channel_bend[channel] = steps;
+
+    for (uint8_t i = 0; i < OPL3_VOICES; i++) {
+        voice_t* v = &opl3_voices[i];
+        if (v->active && v->channel == channel) {
+            uint16_t ch = opl3_voice_chan[i];
+            uint16_t kf = opl3_note_fnum(v->midi_note, steps);
+            opl3_voice_extra[i].key_block = kf >> 8;
+            opl3_write_register(OPL3_CH_FNUM_LO + ch, kf & 0xFF);
+            opl3_write_register(OPL3_CH_KEY_BLOCK + ch, (kf >> 8) | OPL3_KEY_ON);
+        }
+    }
+}
+
+// Set preset: the built-in instrument for the next note.  Voices load
+// it in opl3_note_on(), so held notes keep theirs and a part switch
+// writes nothing.
+void opl3_set_preset(uint8_t preset) {
+    if (preset >= OPL3_PATCH_COUNT) return;
+    opl3_program = preset;
+}
+
+// Emergency panic - key off and mute every carrier
+void opl3_panic(void) {
+    opl3_all_off();
+    for (uint8_t i = 0; i < OPL3_VOICES; i++) {
+        opl3_write_register(OPL3_OP_LEVEL + OPL3_CARRIER + opl3_voice_op[i], 0x3F);
+    }
+}
+
+// Test sequence step (see event_wheel.h): a scale, then a chord.  Notes
+// go through the allocator on SYNTH_TEST_CHANNEL, like YM2149 tests.
+static uint16_t opl3_test_step(uint8_t step) {
+    static const uint8_t scale_notes[] = {60, 62, 64, 65, 67, 69, 71, 72};
+    static const uint8_t chord_notes[] = {48, 60, 64, 67, 72, 76};
+
+    if (step < 2 * sizeof(scale_notes)) {
+        uint8_t note = scale_notes[step >> 1];
+        if (step == 0) {
+            con_puts(CON_INFO, "Playing OPL3 test sequence...\n");
+        }
+        if (step & 1) {
+            synthesizer_note_off(note, SYNTH_TEST_CHANNEL);
+            return 50;
+        }
+        synthesizer_note_on(note, 100, SYNTH_TEST_CHANNEL);
+        con_msg_dec(CON_INFO, MSG_NOTE, note);
+        return 300;
+    }
+
+    step -= 2 * sizeof(scale_notes);
+    if (step < sizeof(chord_notes)) {
+        if (step == 0) {
+            con_puts(CON_INFO, "Testing chord...\n");
+        }
+        synthesizer_note_on(chord_notes[step], 90, SYNTH_TEST_CHANNEL);
+        return (step == sizeof(chord_notes) - 1) ? 100 + 1000 : 100;
+    }
+    if (step == sizeof(chord_notes)) {
+        synthesizer_channel_off(SYNTH_TEST_CHANNEL);
+        return 500;
+    }
+
+    con_puts(CON_INFO, "OPL3 test sequence complete.\n");
+    return EVW_SEQ_END;
+}
+
+// Queue the test sequence on the event wheel; returns at once
+void opl3_play_test_sequence(void) {
+    evw_sequence_start(opl3_test_step);
+}
+
+// Initialize OPL3 interface structure
+sound_chip_interface_t opl3_interface = {
+    .chip_id = CHIP_OPL3,
+    .voice_count = OPL3_VOICES,
+    .name = "OPL3 FM",
+
+    .init = opl3_init,
+    .reset = opl3_reset,
+    .all_off = opl3_all_off,
+
+    .note_on = opl3_note_on,
+    .note_off = opl3_note_off,
+
+    .set_volume = opl3_set_volume,
+    .set_attack = opl3_set_attack,
+    .set_decay = opl3_set_decay,
+    .set_sustain = opl3_set_sustain,
+    .set_release = opl3_set_release,
+    .set_vibrato = opl3_set_vibrato,
+    .set_tremolo = opl3_set_tremolo,
+    .set_pitch_bend = opl3_set_pitch_bend,
+    .set_modulation = opl3_set_modulation,
+
+    .set_preset = opl3_set_preset,
+    .panic = opl3_panic,
+    .tick = 0,                  // Vibrato/tremolo use the OPL3's own LFOs
+
+    .voices = opl3_voices
+};
@@ -1,8 +1,14 @@
 #include "../../include/ym2149.h"
+#include "../../include/opl3.h"
+#include "../../include/hal.h"
+#include "../../include/console.h"
+#include "../../include/messages.h"
+#include "../../include/timebase.h"
+#include "../../include/cpmfile.h"
+#include "../../include/event_wheel.h"
+#include "../../include/synthesizer.h"
 #include <stdint.h>
 #include <string.h>
-#include <stdio.h>
-#include <stdlib.h>
 
 // Port configuration implementation
 port_config_t ym2149_ports;
@@ -10,6 +16,22 @@ port_config_t ym2149_ports;
 void port_config_init(void) {
     ym2149_ports.addr_port = 0xD8;  // R5 RC2014 YM2149 register port
     ym2149_ports.data_port = 0xD0;  // R5 RC2014 YM2149 data port
+    ym2149_ports.addr_port2 = 0;    // No second or third card
+    ym2149_ports.data_port2 = 0;
+    ym2149_ports.addr_port3 = 0;
+    ym2149_ports.data_port3 = 0;
+    ym2149_ports.opl3_port = OPL3_PORT_DEFAULT;
+    ym2149_ports.bus_timing = YM2149_TIMING_AUTO;
+    ym2149_ports.ctc_port = TIMEBASE_CTC_PORT_DEFAULT;
+    ym2149_ports.cpu_khz = TIMEBASE_CPU_KHZ_DEFAULT;
+}
+
+// Parse a bus_timing= value: a profile name, or auto
+static unsigned char port_config_parse_timing(const char* value) {
+    for (uint8_t i = 0; i < YM2149_TIMING_COUNT; i++) {
+        if (strcmp(value, ym2149_timing_profiles[i].name) == 0) return i;
+    }
+    return YM2149_TIMING_AUTO;
 }
 
 void port_config_set(unsigned char addr_port, unsigned char data_port) {
@@ -17,37 +39,43 @@ void port_config_set(unsigned char addr_port, unsigned char data_port) {
     ym2149_ports.data_port = data_port;
 }
 
+// One ports.conf line: key=value, numbers in decimal or 0x hex
+static void port_config_line(const char* key, const char* value) {
+    uint8_t n = (uint8_t)cpmf_number(value);
+
+    if (strcmp(key, "addr_port") == 0) {
+        ym2149_ports.addr_port = n;
+    } else if (strcmp(key, "data_port") == 0) {
+        ym2149_ports.data_port = n;
+    } else if (strcmp(key, "addr_port2") == 0) {
+        ym2149_ports.addr_port2 = n;
+    } else if (strcmp(key, "data_port2") == 0) {
+        ym2149_ports.data_port2 = n;
+    } else if (strcmp(key, "addr_port3") == 0) {
+        ym2149_ports.addr_port3 = n;
+    } else if (strcmp(key, "data_port3") == 0) {
+        ym2149_ports.data_port3 = n;
+    } else if (strcmp(key, "opl3_port") == 0) {
+        ym2149_ports.opl3_port = n;
+    } else if (strcmp(key, "bus_timing") == 0) {
+        ym2149_ports.bus_timing = port_config_parse_timing(value);
+    } else if (strcmp(key, "ctc_port") == 0) {
+        ym2149_ports.ctc_port = n;
+    } else if (strcmp(key, "cpu_khz") == 0) {
+        ym2149_ports.cpu_khz = cpmf_number(value);
+    }
+}
+
+// Keys missing from the file take their defaults; without a file the
+// current settings are kept
 int port_config_load_from_file(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
+    port_config_t current = ym2149_ports;
+
+    port_config_init();
+    if (!cpmf_config(filename, port_config_line)) {
+        ym2149_ports = current;
         return 0;  // File not found or cannot open
     }
-    
-    char line[256];
-    unsigned char addr_port = 0xD8;
-    unsigned char data_port = 0xD0;
-    
-    while (fgets(line, sizeof(line), file)) {
-        // Skip comments and empty lines
-        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
-            continue;
-        }
-        
-        // Parse key=value format
-        char* key = strtok(line, "=");
-        char* value = strtok(NULL, "=\n\r");
-        
-        if (key && value) {
-            if (strcmp(key, "addr_port") == 0) {
-                addr_port = (unsigned char)strtoul(value, NULL, 0);
-            } else if (strcmp(key, "data_port") == 0) {
-                data_port = (unsigned char)strtoul(value, NULL, 0);
-            }
-        }
-    }
-    
-    fclose(file);
-    port_config_set(addr_port, data_port);
     return 1;
 }
 
@@ -64,26 +92,346 @@ int port_config_validate(void) {
 }
 
 // Global voice arrays — split to match voice_t stride expected by chip_interface
-voice_t ym2149_voices[3];
-ym2149_voice_extra_t ym2149_voice_extra[3];
+voice_t ym2149_voices[YM2149_MAX_VOICES];
+ym2149_voice_extra_t ym2149_voice_extra[YM2149_MAX_VOICES];
+
+// Detected cards.  Register writes go to ym2149_card; per-voice calls
+// select it once from the voice tables below, so routing costs nothing
+// per register write.
+ym2149_card_t ym2149_cards[YM2149_MAX_CARDS];
+ym2149_card_t* ym2149_card = &ym2149_cards[0];
+uint8_t ym2149_card_count = 0;
+static ym2149_card_t* ym2149_voice_card[YM2149_MAX_VOICES];  // Card per voice
+static uint8_t ym2149_voice_chan[YM2149_MAX_VOICES];         // Tone channel 0-2
+
+// Select the card a voice lives on; returns its tone channel (0-2)
+static uint8_t ym2149_select_voice(uint8_t voice) {
+    ym2149_card = ym2149_voice_card[voice];
+    return ym2149_voice_chan[voice];
+}
+
+// Iterate over the detected cards, selecting each in turn
+#define YM2149_FOR_EACH_CARD(c) \
+    for (c = ym2149_cards; c < ym2149_cards + ym2149_card_count && (ym2149_card = c); c++)
+
+#define YM2149_VOICE_COUNT   (ym2149_interface.voice_count)
+
+static void ym2149_load_patch(uint8_t program);
+
+// Bus timing profiles, fastest first.  Calibration picks the first
+// profile whose delay is at least the measured minimum.
+const ym2149_timing_profile_t ym2149_timing_profiles[YM2149_TIMING_COUNT] = {
+    { "none",    0 },
+    { "short",   1 },
+    { "medium",  3 },
+    { "safe",   64 },
+};
+
+// Calibration gives up above this many loops and falls back to "safe"
+#define YM2149_CALIBRATE_MAX_LOOPS  16
+
+// Active delay, in DJNZ iterations — starts conservative for detection
+uint8_t ym2149_delay_loops = 64;
+static uint8_t ym2149_timing_active = YM2149_TIMING_SAFE;
+static uint8_t ym2149_timing_was_calibrated = 0;
+
+// Bus settle delay: ym2149_delay_loops x 13 T-states.  Callers skip the
+// call entirely when the active profile needs no delay.
+#ifdef __Z88DK
+static void ym2149_bus_delay(void) __naked {
+    __asm
+        ld a, (_ym2149_delay_loops)
+        or a
+        ret z
+        ld b, a
+    ym2149_bus_delay_loop:
+        djnz ym2149_bus_delay_loop
+        ret
+    __endasm;
+}
+#else
+static void ym2149_bus_delay(void) {
+    // The fake bus never needs settling
+}
+#endif
 
-// Small delay function — volatile counter prevents optimisation away
-static void SmallDelay(void) {
-    for (volatile uint8_t i = 0; i < 10; i++) {
+#define YM2149_BUS_SETTLE()  do { if (ym2149_delay_loops) ym2149_bus_delay(); } while (0)
+
+// Modulation LFOs — global, applied to every active voice by ym2149_tick()
+static lfo_t ym2149_vibrato_lfo;
+static lfo_t ym2149_tremolo_lfo;
+static uint8_t ym2149_vibrato_depth = 0;   // CC#9
+static uint8_t ym2149_mod_depth = 0;       // CC#12 (mod wheel)
+static uint8_t ym2149_tremolo_rate = 0;    // CC#10
+static uint8_t ym2149_mod_active = 0;      // Modulation was applied last tick
+
+// Pitch bend per MIDI channel, in PITCH_BEND_STEPS per semitone
+static int16_t ym2149_channel_bend[16];
+
+// Register shadows live in each card (ym2149_card_t) and are only
+// trusted once ym2149_reset() has written every cached register.
+ym2149_reg_stats_t ym2149_reg_stats;
+
+// Register I/O fast path.
+//
+// The chip keeps its address latch between accesses, so a write to the
+// register already latched needs only the data cycle.  ym2149_io_latch
+// tracks the latch of the card the I/O routines are set up for; the other
+// cards keep theirs in ym2149_card_t.latched until selected again.  On
+// the Z80 the card's ports are patched into the OUT instructions when the
+// card changes rather than loaded on every write.
+static ym2149_card_t* ym2149_io_card = 0;
+uint8_t ym2149_io_latch = YM2149_LATCH_UNKNOWN;
+uint8_t ym2149_io_addr;              // Ports of ym2149_io_card
+uint8_t ym2149_io_data;
+
+// ym2149_io_block() arguments
+uint8_t ym2149_io_first;
+uint8_t ym2149_io_count;
+const uint8_t* ym2149_io_src;
+
+#ifdef __Z88DK
+// Store ym2149_io_addr/ym2149_io_data into the OUT instructions below
+static void ym2149_io_patch(void) __naked {
+    __asm
+        ld a, (_ym2149_io_addr)
+        ld (ym2149_io_addr_out + 1), a
+        ld (ym2149_io_block_addr + 1), a
+        ld a, (_ym2149_io_data)
+        ld (ym2149_io_data_out + 1), a
+        ld (ym2149_io_block_data + 1), a
+        ret
+    __endasm;
+}
+
+// Write one register: H = register, L = value.  The address cycle is
+// skipped when H is already latched.
+static void ym2149_io_write(uint16_t reg_data) __z88dk_fastcall __naked {
+    __asm
+        ld a, (_ym2149_io_latch)
+        cp h
+        jr z, ym2149_io_write_data
+        ld a, h
+        ld (_ym2149_io_latch), a
+    ym2149_io_addr_out:
+        out (0xD8), a           ; port patched by ym2149_io_patch
+        ld a, (_ym2149_delay_loops)
+        or a
+        jr z, ym2149_io_write_data
+        ld b, a
+    ym2149_io_write_wait1:
+        djnz ym2149_io_write_wait1
+    ym2149_io_write_data:
+        ld a, l
+    ym2149_io_data_out:
+        out (0xD0), a           ; port patched by ym2149_io_patch
+        ld a, (_ym2149_delay_loops)
+        or a
+        ret z
+        ld b, a
+    ym2149_io_write_wait2:
+        djnz ym2149_io_write_wait2
+        ret
+    __endasm;
+}
+
+// Upload ym2149_io_count registers from ym2149_io_src, starting at
+// ym2149_io_first: address and data OUT per register, one pass.
+static void ym2149_io_block(void) __naked {
+    __asm
+        ld hl, (_ym2149_io_src)
+        ld a, (_ym2149_io_count)
+        ld c, a
+        ld a, (_ym2149_io_first)
+        ld d, a
+        ld a, (_ym2149_delay_loops)
+        ld e, a
+    ym2149_io_block_loop:
+        ld a, d
+    ym2149_io_block_addr:
+        out (0xD8), a           ; port patched by ym2149_io_patch
+        ld a, e
+        or a
+        jr z, ym2149_io_block_value
+        ld b, a
+    ym2149_io_block_wait1:
+        djnz ym2149_io_block_wait1
+    ym2149_io_block_value:
+        ld a, (hl)
+    ym2149_io_block_data:
+        out (0xD0), a           ; port patched by ym2149_io_patch
+        inc hl
+        ld a, e
+        or a
+        jr z, ym2149_io_block_next
+        ld b, a
+    ym2149_io_block_wait2:
+        djnz ym2149_io_block_wait2
+    ym2149_io_block_next:
+        inc d
+        dec c
+        jr nz, ym2149_io_block_loop
+        dec d
+        ld a, d
+        ld (_ym2149_io_latch), a
+        ret
+    __endasm;
+}
+#else
+static void ym2149_io_patch(void) {
+    // The host routines read the port variables directly
+}
+
+static void ym2149_io_write(uint16_t reg_data) {
+    uint8_t reg = reg_data >> 8;
+    if (reg != ym2149_io_latch) {
+        ym2149_io_latch = reg;
+        hal_outp(ym2149_io_addr, reg);
+        YM2149_BUS_SETTLE();
+    }
+    hal_outp(ym2149_io_data, reg_data & 0xFF);
+    YM2149_BUS_SETTLE();
+}
+
+static void ym2149_io_block(void) {
+    const uint8_t* src = ym2149_io_src;
+    uint8_t reg = ym2149_io_first;
+    for (uint8_t n = ym2149_io_count; n; n--, reg++) {
+        hal_outp(ym2149_io_addr, reg);
+        YM2149_BUS_SETTLE();
+        hal_outp(ym2149_io_data, *src++);
+        YM2149_BUS_SETTLE();
+    }
+    ym2149_io_latch = reg - 1;
+}
+#endif
+
+// Point the I/O routines at a card, parking the previous card's latch
+static void ym2149_io_select(ym2149_card_t* c) {
+    if (ym2149_io_card) {
+        ym2149_io_card->latched = ym2149_io_latch;
+    }
+    ym2149_io_card = c;
+    ym2149_io_latch = c->latched;
+    ym2149_io_addr = c->addr_port;
+    ym2149_io_data = c->data_port;
+    ym2149_io_patch();
+}
+
+// Detach the I/O routines from their card (its ports are about to change)
+static void ym2149_io_release(void) {
+    if (ym2149_io_card) {
+        ym2149_io_card->latched = ym2149_io_latch;
+        ym2149_io_card = 0;
     }
 }
 
-// Low-level register write function
+#define YM2149_IO_SELECT(c)  do { if ((c) != ym2149_io_card) ym2149_io_select(c); } while (0)
+
+// Raw bus write — always reaches the chip, never touches the shadow
+static void ym2149_bus_write(uint8_t reg, uint8_t data) {
+    YM2149_IO_SELECT(ym2149_card);
+    ym2149_io_write(((uint16_t)reg << 8) | data);
+}
+
+// Low-level register write function (selected card).
+// Writes that would not change the register are skipped.
 void ym2149_write_register(uint8_t reg, uint8_t data) {
-    // Write address register first
-    outp(YM2149_ADDR_PORT, reg);
-    SmallDelay();
+    ym2149_card_t* c = ym2149_card;
 
-    // Then write data register
-    outp(YM2149_DATA_PORT, data);
-    SmallDelay();
+    reg &= 0x0F;
+    if (c->shadow_valid && reg < YM2149_SHADOW_CACHED &&
+        c->shadow[reg] == data) {
+        ym2149_reg_stats.skipped++;
+        return;
+    }
+    c->shadow[reg] = data;
+    ym2149_reg_stats.writes++;
+    YM2149_IO_SELECT(c);
+    if (reg == ym2149_io_latch) {
+        ym2149_reg_stats.latch_hits++;
+    }
+    ym2149_io_write(((uint16_t)reg << 8) | data);
 }
 
+// Upload consecutive registers (up to the envelope shape, 13) to the
+// selected card in one OUT loop.  With a trusted shadow, cached registers
+// at either end of the range that already hold their value are trimmed
+// off first; the rest go out in a single pass.
+void ym2149_write_block(uint8_t first, const uint8_t* data, uint8_t count) {
+    ym2149_card_t* c = ym2149_card;
+
+    if (c->shadow_valid) {
+        while (count && first < YM2149_SHADOW_CACHED && c->shadow[first] == *data) {
+            first++;
+            data++;
+            count--;
+            ym2149_reg_stats.skipped++;
+        }
+        while (count && first + count - 1 < YM2149_SHADOW_CACHED &&
+               c->shadow[first + count - 1] == data[count - 1]) {
+            count--;
+            ym2149_reg_stats.skipped++;
+        }
+    }
+    if (!count) return;
+
+    memcpy(&c->shadow[first], data, count);
+    ym2149_reg_stats.writes += count;
+    YM2149_IO_SELECT(c);
+    ym2149_io_first = first;
+    ym2149_io_count = count;
+    ym2149_io_src = data;
+    ym2149_io_block();
+}
+
+// Read a register value from the selected card's shadow instead of the bus
+uint8_t ym2149_read_shadow(uint8_t reg) {
+    ym2149_reg_stats.shadow_hits++;
+    return ym2149_card->shadow[reg & 0x0F];
+}
+
+// Forget the selected card's cached values; every write goes to the bus
+// until the next reset
+void ym2149_shadow_invalidate(void) {
+    ym2149_card->shadow_valid = 0;
+}
+
+// Power-on defaults for registers 6-10
+static const uint8_t ym2149_init_regs[] = {
+    0x1F,                           // Noise generator: middle frequency
+    YM2149_MIX_ALL_TONE,            // Tone on all channels, noise off
+    YM2149_VOLUME_FIXED | 0x0F,     // Levels A-C: max volume
+    YM2149_VOLUME_FIXED | 0x0F,
+    YM2149_VOLUME_FIXED | 0x0F,
+};
+
+// Patch bank: loaded from disk, indexed by program number
+ym2149_patch_t ym2149_bank[YM2149_BANK_SIZE];
+const ym2149_patch_t* ym2149_patch = &ym2149_bank[0];
+
+// Built-in patches (the bank without a PATCHES.BNK)
+static const ym2149_patch_t ym2149_builtin_patches[YM2149_BUILTIN_PATCHES] = {
+    // {noise, mixer},            {env period, shape},         mode, curve,               detune
+    { {0x1F, YM2149_MIX_ALL_TONE}, {0, 0, YM2149_ENV_OFF},         0, YM2149_CURVE_LINEAR, 0 },  // Square
+    { {0x1F, YM2149_MIX_ALL_TONE}, {0, 0, YM2149_ENV_SAWTOOTH},    0, YM2149_CURVE_LINEAR, 0 },  // Sawtooth
+    { {0x1F, YM2149_MIX_ALL_TONE}, {0, 0, YM2149_ENV_TRIANGLE},    0, YM2149_CURVE_LINEAR, 0 },  // Triangle
+    { {0x1F, YM2149_MIX_ALL_TONE}, {0, 0, YM2149_ENV_PULSE_DECAY}, 0, YM2149_CURVE_LINEAR, 0 },  // Pulse with decay
+};
+
+// Velocity curves: linear level (0-15, from velocity) to output level
+static const uint8_t ym2149_level_curves[YM2149_CURVE_COUNT][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },           // Linear
+    { 0, 4, 5, 7, 8, 9, 9, 10, 11, 12, 12, 13, 13, 14, 14, 15 },        // Soft
+    { 0, 0, 0, 1, 1, 2, 2, 3, 4, 5, 7, 8, 10, 11, 13, 15 },             // Hard
+    { 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15 }, // Fixed
+};
+
+// Silence: registers 0-13 zeroed, all outputs disabled in the mixer
+static const uint8_t ym2149_reset_regs[YM2149_SHAPE_ENV + 1] = {
+    0, 0, 0, 0, 0, 0, 0, YM2149_MIX_ALL_OFF, 0, 0, 0, 0, 0, 0
+};
+
 // Initialize YM2149 chip
 void ym2149_init(void) {
     // Initialize port configuration with defaults if not already set
@@ -96,97 +444,128 @@ void ym2149_init(void) {
     // Clear all voices
     memset(ym2149_voices, 0, sizeof(ym2149_voices));
     memset(ym2149_voice_extra, 0, sizeof(ym2149_voice_extra));
+
+    // Modulation off until CC#9/10/12 arrive
+    lfo_init(&ym2149_vibrato_lfo, LFO_WAVE_SINE);
+    lfo_init(&ym2149_tremolo_lfo, LFO_WAVE_TRIANGLE);
+    ym2149_vibrato_lfo.rate = YM2149_VIBRATO_RATE;
+    ym2149_vibrato_depth = 0;
+    ym2149_mod_depth = 0;
+    ym2149_tremolo_rate = 0;
+    ym2149_mod_active = 0;
+    memset(ym2149_channel_bend, 0, sizeof(ym2149_channel_bend));
     
     // Initialize to known state
     ym2149_reset();
     
-    // Set up default mixer (enable tone on all channels, disable noise)
-    ym2149_write_register(YM2149_MIXER, YM2149_MIX_ALL_TONE);
-    
-    // Set default envelope shapes for each channel
-    ym2149_write_register(YM2149_LEVEL_A, YM2149_VOLUME_FIXED | 0x0F);  // Max volume
-    ym2149_write_register(YM2149_LEVEL_B, YM2149_VOLUME_FIXED | 0x0F);  // Max volume
-    ym2149_write_register(YM2149_LEVEL_C, YM2149_VOLUME_FIXED | 0x0F);  // Max volume
-    
-    // Set noise generator to reasonable default
-    ym2149_write_register(YM2149_FREQ_NOISE, 0x1F);  // Middle frequency
+    // Noise, mixer and levels are consecutive (registers 6-10)
+    ym2149_card_t* c;
+    YM2149_FOR_EACH_CARD(c) {
+        ym2149_write_block(YM2149_FREQ_NOISE, ym2149_init_regs, sizeof(ym2149_init_regs));
+    }
+
+    // Program 0 from the bank (loaded by chip_manager_init)
+    ym2149_set_preset(0);
+    YM2149_FOR_EACH_CARD(c) {
+        ym2149_load_patch(0);
+    }
 }
 
-// Reset YM2149 to silence - zero all 14 registers
+// Reset every card to silence - zero all 14 registers, mixer off
+// Writes go through to the bus, after which the shadow is known-good.
 void ym2149_reset(void) {
-    for (uint8_t reg = 0; reg <= 0x0D; reg++) {
-        ym2149_write_register(reg, 0x00);
+    ym2149_card_t* c;
+    YM2149_FOR_EACH_CARD(c) {
+        c->shadow_valid = 0;
+        ym2149_write_block(0, ym2149_reset_regs, sizeof(ym2149_reset_regs));
+        c->shadow_valid = 1;
+        c->patch = YM2149_PATCH_NONE;
     }
-    // Disable all outputs after zeroing
-    ym2149_write_register(YM2149_MIXER, YM2149_MIX_ALL_OFF);
 }
 
 // Turn off all voices
 void ym2149_all_off(void) {
-    for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t i = 0; i < YM2149_VOICE_COUNT; i++) {
         ym2149_note_off(i);
     }
 }
 
 // Note on function
 void ym2149_note_on(uint8_t voice, uint8_t note, uint8_t velocity, uint8_t channel) {
-    if (voice >= 3) return;  // YM2149 only has 3 voices
+    if (voice >= YM2149_VOICE_COUNT) return;  // 3 voices per detected card
 
     voice_t* v = &ym2149_voices[voice];
     ym2149_voice_extra_t* vx = &ym2149_voice_extra[voice];
+    const ym2149_patch_t* p = ym2149_patch;
 
     // Store note information
     v->active = 1;
     v->midi_note = note;
     v->velocity = velocity;
     v->channel = channel;
-    v->start_time = 0;  // Could implement timer if needed
+    vx->patch = p - ym2149_bank;
+
+    // The card's shared registers, if another program left them there.
+    // Otherwise an envelope-levelled patch still restarts the (card-wide)
+    // envelope, or a one-shot shape would only sound on the first note.
+    ym2149_select_voice(voice);
+    if (ym2149_card->patch != vx->patch) {
+        ym2149_load_patch(vx->patch);
+    } else if (p->level_mode & YM2149_VOLUME_ENV) {
+        ym2149_write_register(YM2149_SHAPE_ENV, p->regs_11_13[YM2149_PATCH_SHAPE]);
+    }
 
-    // Convert MIDI note to YM2149 frequency
-    vx->frequency = ym2149_note_to_freq(note);
+    // Convert MIDI note to YM2149 frequency, bent by the channel's wheel
+    vx->frequency = ym2149_note_to_freq(note) + p->detune;
+    vx->period = ym2149_channel_bend[channel & 0x0F]
+                 ? ym2149_bend_period(note, ym2149_channel_bend[channel & 0x0F]) + p->detune
+                 : vx->frequency;
 
     // Set frequency (low and high bytes)
-    ym2149_set_frequency(voice, vx->frequency);
+    ym2149_set_frequency(voice, vx->period);
 
-    // Set volume based on velocity (0-127 → 0-15)
-    vx->volume = ((uint16_t)velocity * 15) / 127;
+    // Set volume based on velocity (0-127 → 0-15), through the patch's curve
+    vx->volume = ym2149_level_curves[p->curve][((uint16_t)velocity * 15) / 127];
     ym2149_set_volume(voice, vx->volume);
 }
 
 // Note off function
 void ym2149_note_off(uint8_t voice) {
-    if (voice >= 3) return;
+    if (voice >= YM2149_VOICE_COUNT) return;
 
     ym2149_voices[voice].active = 0;
 
     // Silence the channel by setting volume to 0
-    uint8_t level_reg = YM2149_LEVEL_A + voice;
+    uint8_t level_reg = YM2149_LEVEL_A + ym2149_select_voice(voice);
     ym2149_write_register(level_reg, 0x00);
 }
 
+// Write a voice level register, keeping the envelope mode bit
+static void ym2149_write_level(uint8_t voice, uint8_t level) {
+    uint8_t reg_val = level | ym2149_bank[ym2149_voice_extra[voice].patch].level_mode;
+    if (ym2149_voice_extra[voice].envelope_enabled) {
+        reg_val |= YM2149_VOLUME_ENV;
+    }
+    ym2149_write_register(YM2149_LEVEL_A + ym2149_select_voice(voice), reg_val);
+}
+
 // Set voice volume
 void ym2149_set_volume(uint8_t voice, uint8_t volume) {
-    if (voice >= 3) return;
-
-    ym2149_voice_extra_t* vx = &ym2149_voice_extra[voice];
-    vx->volume = volume;
+    if (voice >= YM2149_VOICE_COUNT) return;
 
     // Clamp volume to 0-15
     if (volume > 15) volume = 15;
 
-    uint8_t level_reg = YM2149_LEVEL_A + voice;
-    uint8_t reg_val = volume;
-    if (vx->envelope_enabled) {
-        reg_val |= YM2149_VOLUME_ENV;
-    }
-    ym2149_write_register(level_reg, reg_val);
+    ym2149_voice_extra[voice].volume = volume;
+    ym2149_write_level(voice, volume);
 }
 
 // Set attack time (map to envelope frequency)
 void ym2149_set_attack(uint8_t voice, uint8_t attack) {
-    if (voice >= 3) return;
+    if (voice >= YM2149_VOICE_COUNT) return;
 
     ym2149_voice_extra_t* vx = &ym2149_voice_extra[voice];
+    uint8_t chan = ym2149_select_voice(voice);
 
     // Map CC value (0-127) to envelope frequency
     uint16_t env_freq = ((uint16_t)attack * 255) / 127;
@@ -197,13 +576,14 @@ void ym2149_set_attack(uint8_t voice, uint8_t attack) {
 
     // Switch to envelope mode
     vx->envelope_enabled = 1;
-    uint8_t level_reg = YM2149_LEVEL_A + voice;
+    uint8_t level_reg = YM2149_LEVEL_A + chan;
     ym2149_write_register(level_reg, YM2149_VOLUME_ENV | vx->volume);
 }
 
 // Set decay time (part of envelope shaping)
 void ym2149_set_decay(uint8_t voice, uint8_t decay) {
-    if (voice >= 3) return;
+    if (voice >= YM2149_VOICE_COUNT) return;
+    ym2149_select_voice(voice);
     
     // Map to envelope shape with decay
     uint8_t envelope_shape = YM2149_ENV_TRIANGLE;
@@ -217,7 +597,7 @@ void ym2149_set_decay(uint8_t voice, uint8_t decay) {
 
 // Set sustain level
 void ym2149_set_sustain(uint8_t voice, uint8_t sustain) {
-    if (voice >= 3) return;
+    if (voice >= YM2149_VOICE_COUNT) return;
     
     // Map sustain to volume level (0-127 → 0-15)
     uint8_t vol = ((uint16_t)sustain * 15) / 127;
@@ -226,7 +606,8 @@ void ym2149_set_sustain(uint8_t voice, uint8_t sustain) {
 
 // Set release time
 void ym2149_set_release(uint8_t voice, uint8_t release) {
-    if (voice >= 3) return;
+    if (voice >= YM2149_VOICE_COUNT) return;
+    ym2149_select_voice(voice);
     
     // Map release to envelope decay rate
     uint16_t env_freq = ((uint16_t)release * 255) / 127;
@@ -234,114 +615,250 @@ void ym2149_set_release(uint8_t voice, uint8_t release) {
     ym2149_write_register(YM2149_FREQ_ENV_MSB, (env_freq >> 8) & 0xFF);
 }
 
+// Vibrato LFO depth is the larger of CC#9 and the mod wheel (CC#12)
+static void ym2149_update_vibrato_depth(void) {
+    ym2149_vibrato_lfo.depth = (ym2149_vibrato_depth > ym2149_mod_depth)
+                               ? ym2149_vibrato_depth : ym2149_mod_depth;
+}
+
 // Set vibrato depth (global effect)
+// YM2149 has no hardware vibrato; ym2149_tick() offsets tone periods.
 void ym2149_set_vibrato(uint8_t depth) {
-    // Suppress unused parameter warning
-    (void)depth;
-    // YM2149 doesn't have hardware vibrato
-    // Could implement via frequency modulation in software if needed
+    ym2149_vibrato_depth = depth;
+    ym2149_update_vibrato_depth();
 }
 
-// Set tremolo rate (global effect)
+// Set tremolo rate (global effect), 0 = off
+// YM2149 has no hardware tremolo; ym2149_tick() lowers voice levels.
 void ym2149_set_tremolo(uint8_t rate) {
-    // Suppress unused parameter warning
-    (void)rate;
-    // YM2149 doesn't have hardware tremolo
-    // Could implement via volume modulation if needed
+    ym2149_tremolo_rate = rate;
+    if (rate == 0) {
+        ym2149_tremolo_lfo.depth = 0;
+        return;
+    }
+    lfo_set_rate_cc(&ym2149_tremolo_lfo, rate);
+    ym2149_tremolo_lfo.depth = YM2149_TREMOLO_DEPTH;
 }
 
-// Set pitch bend
-void ym2149_set_pitch_bend(int16_t bend) {
-    // Apply pitch bend to all active voices
-    for (uint8_t i = 0; i < 3; i++) {
+// Lock the tremolo rate to the MIDI clock: one cycle every `clocks`
+// MIDI clocks (24 = a beat), or 0 for the CC#10 rate again.  Depth is
+// still switched by CC#10.
+void ym2149_set_tremolo_sync(uint8_t clocks) {
+    ym2149_tremolo_lfo.sync = clocks;
+    lfo_set_rate_cc(&ym2149_tremolo_lfo, ym2149_tremolo_rate);
+}
+
+// Set pitch bend for one MIDI channel (steps in 1/PITCH_BEND_STEPS semitone)
+// Only voices playing on that channel are retuned.  A repeated value
+// (common in dense wheel streams) costs nothing; a new one costs one
+// table interpolation per matching voice.
+void ym2149_set_pitch_bend(uint8_t channel, int16_t steps) {
+    channel &= 0x0F;
+    if (ym2149_channel_bend[channel] == steps) return;
+    ym2149_channel_bend[channel] = steps;
+
+    for (uint8_t i = 0; i < YM2149_VOICE_COUNT; i++) {
         voice_t* v = &ym2149_voices[i];
-        if (v->active) {
-            uint16_t base_freq = ym2149_note_to_freq(v->midi_note);
-            uint16_t bent_freq = ym2149_apply_pitch_bend(base_freq, bend);
-            ym2149_set_frequency(i, bent_freq);
+        if (v->active && v->channel == channel) {
+            ym2149_voice_extra_t* vx = &ym2149_voice_extra[i];
+            vx->period = steps ? ym2149_bend_period(v->midi_note, steps) + ym2149_bank[vx->patch].detune
+                               : vx->frequency;   // Cached base period
+            ym2149_set_frequency(i, vx->period);
         }
     }
 }
 
-// Set modulation depth (same as vibrato on YM2149)
+// Set modulation depth (mod wheel — drives the vibrato LFO on YM2149)
 void ym2149_set_modulation(uint8_t depth) {
-    (void)depth;
-    // YM2149 doesn't have hardware modulation
+    ym2149_mod_depth = depth;
+    ym2149_update_vibrato_depth();
+}
+
+// Modulation tick, run every LFO_TICK_INTERVAL timebase ticks.
+// Per tick: two LFO steps, then at most one period and one level
+// update per voice (3 registers per voice, so 9 bus writes per card worst
+// case, fewer in practice as the shadow skips unchanged registers).
+void ym2149_tick(void) {
+    int8_t vib = lfo_step(&ym2149_vibrato_lfo);
+    int8_t trem = lfo_step(&ym2149_tremolo_lfo);
+    uint8_t active = ym2149_vibrato_lfo.depth | ym2149_tremolo_lfo.depth;
+
+    // Idle unless modulating, or restoring voices on the tick after
+    // modulation was switched off
+    if (!active && !ym2149_mod_active) return;
+    ym2149_mod_active = active;
+
+    uint16_t writes = ym2149_reg_stats.writes;
+
+    // Tremolo attenuation in volume steps: 0 .. 2 * depth / 16
+    uint8_t atten = (uint8_t)(((int16_t)trem + ym2149_tremolo_lfo.depth) >> 4);
+
+    for (uint8_t i = 0; i < YM2149_VOICE_COUNT; i++) {
+        if (!ym2149_voices[i].active) continue;
+
+        ym2149_voice_extra_t* vx = &ym2149_voice_extra[i];
+
+        // Vibrato: up to +/- period/16 (about a semitone) at full depth
+        int16_t offset = ((int16_t)(vx->period >> 4) * vib) >> 7;
+        ym2149_set_frequency(i, vx->period + offset);
+
+        ym2149_write_level(i, (vx->volume > atten) ? vx->volume - atten : 0);
+    }
+
+    writes = ym2149_reg_stats.writes - writes;
+    lfo_stats.ticks++;
+    lfo_stats.last_writes = (uint8_t)writes;
+    if (lfo_stats.last_writes > lfo_stats.max_writes) {
+        lfo_stats.max_writes = lfo_stats.last_writes;
+    }
 }
 
-// Set preset
+// Upload a program's register images to the selected card.  The bank is
+// validated when it is loaded, so nothing here depends on the patch
+// contents.
+static void ym2149_load_patch(uint8_t program) {
+    const ym2149_patch_t* p = &ym2149_bank[program];
+
+    ym2149_card->patch = program;
+    ym2149_write_block(YM2149_FREQ_NOISE, p->regs_6_7, sizeof(p->regs_6_7));
+    ym2149_write_block(YM2149_FREQ_ENV_LSB, p->regs_11_13, sizeof(p->regs_11_13));
+}
+
+// Program change: the program for the next note.  Nothing is written
+// until a note starts (see ym2149_patch_t), so switching between parts
+// costs no register writes for the notes already sounding.
 void ym2149_set_preset(uint8_t preset) {
-    // Define some basic presets
-    switch(preset) {
-        case 0:  // Simple square wave
-            ym2149_write_register(YM2149_SHAPE_ENV, YM2149_ENV_OFF);
-            break;
-        case 1:  // Sawtooth
-            ym2149_write_register(YM2149_SHAPE_ENV, YM2149_ENV_SAWTOOTH);
-            break;
-        case 2:  // Triangle
-            ym2149_write_register(YM2149_SHAPE_ENV, YM2149_ENV_TRIANGLE);
-            break;
-        case 3:  // Pulse with decay
-            ym2149_write_register(YM2149_SHAPE_ENV, YM2149_ENV_PULSE_DECAY);
-            break;
+    ym2149_patch = &ym2149_bank[preset & (YM2149_BANK_SIZE - 1)];
+}
+
+// Upload each card's loaded program again: after a SysEx dump changed
+// it, or a test changed the shared registers.  The shadow passes only
+// the bytes that differ.
+void ym2149_patch_refresh(void) {
+    ym2149_card_t* c;
+    YM2149_FOR_EACH_CARD(c) {
+        if (c->patch != YM2149_PATCH_NONE) {
+            ym2149_load_patch(c->patch);
+        }
+    }
+}
+
+// Fill the bank with the built-in patches, repeated across all programs
+void ym2149_bank_defaults(void) {
+    for (uint8_t i = 0; i < YM2149_BANK_SIZE; i++) {
+        ym2149_bank[i] = ym2149_builtin_patches[i % YM2149_BUILTIN_PATCHES];
     }
+    ym2149_patch = &ym2149_bank[0];
+}
+
+// Load a patch bank file over the built-in patches.  Programs beyond the
+// file's patch count keep their built-in patch.  Fields are masked to
+// what the registers hold so program change can upload them unchecked.
+uint8_t ym2149_bank_load(const char* filename) {
+    uint8_t header[8];
+    cpm_file_t file;
+
+    ym2149_bank_defaults();
+    if (!cpmf_open(&file, filename)) {
+        return YM2149_BANK_ERR_OPEN;
+    }
+
+    uint8_t result = YM2149_BANK_ERR_FORMAT;
+    if (cpmf_read(&file, header, sizeof(header)) == sizeof(header) &&
+        memcmp(header, "YMPB", 4) == 0 && header[4] == YM2149_BANK_VERSION &&
+        header[5] <= YM2149_BANK_SIZE) {
+        uint8_t count = header[5];
+        uint16_t len = count * sizeof(ym2149_patch_t);
+        if (cpmf_read(&file, (uint8_t*)ym2149_bank, len) == len) {
+            for (uint8_t i = 0; i < count; i++) {
+                ym2149_patch_t* p = &ym2149_bank[i];
+                p->regs_6_7[YM2149_PATCH_NOISE] &= 0x1F;
+                p->regs_6_7[YM2149_PATCH_MIXER] &= YM2149_MIX_ALL_OFF;
+                p->regs_11_13[YM2149_PATCH_SHAPE] &= 0x0F;
+                p->level_mode &= YM2149_VOLUME_ENV;
+                if (p->curve >= YM2149_CURVE_COUNT) p->curve = YM2149_CURVE_LINEAR;
+            }
+            result = YM2149_BANK_OK;
+        } else {
+            ym2149_bank_defaults();  // Don't keep half a bank
+        }
+    }
+    cpmf_close(&file);
+    return result;
 }
 
 // Emergency panic - silence everything
 void ym2149_panic(void) {
+    ym2149_card_t* c;
+
     ym2149_all_off();
-    ym2149_write_register(YM2149_MIXER, YM2149_MIX_ALL_OFF);  // Disable all outputs
+    // Disable all outputs; the next note reloads its program's mixer
+    YM2149_FOR_EACH_CARD(c) {
+        ym2149_write_register(YM2149_MIXER, YM2149_MIX_ALL_OFF);
+        c->patch = YM2149_PATCH_NONE;
+    }
 }
 
 // Set frequency for a voice
 void ym2149_set_frequency(uint8_t voice, uint16_t freq) {
-    if (voice >= 3) return;
-    
-    uint8_t freq_lsb = YM2149_FREQ_A_LSB + (voice * 2);
-    uint8_t freq_msb = YM2149_FREQ_A_MSB + (voice * 2);
-    
-    ym2149_write_register(freq_lsb, freq & 0xFF);
-    ym2149_write_register(freq_msb, (freq >> 8) & 0x0F);  // Only lower 4 bits valid
+    if (voice >= YM2149_VOICE_COUNT) return;
+
+    uint8_t chan = ym2149_select_voice(voice);
+    uint8_t period[2];
+
+    period[0] = freq & 0xFF;
+    period[1] = (freq >> 8) & 0x0F;  // Only lower 4 bits valid
+    ym2149_write_block(YM2149_FREQ_A_LSB + (chan * 2), period, 2);
 }
 
-// MIDI note to YM2149 tone period conversion
-// Table covers MIDI notes 24 (C1) to 96 (C7)
+// Tone periods for MIDI notes 24 (C1) to 96 (C7)
 // TP = round(1843200 / (16 * freq)) = round(115200 / freq)
 // Higher period = lower pitch (YM2149 convention)
-uint16_t ym2149_note_to_freq(uint8_t note) {
-    static const uint16_t note_tp[] = {
-        /* 24  C1 */ 3522, 3325, 3138, 2962, 2796, 2639, 2491, 2351,
-        /* 32     */ 2219, 2095, 1977, 1866,
-        /* 36  C2 */ 1761, 1662, 1569, 1481, 1398, 1319, 1245, 1175,
-        /* 44     */ 1109, 1047,  989,  933,
-        /* 48  C3 */  881,  831,  784,  740,  699,  660,  623,  588,
-        /* 56     */  555,  524,  494,  467,
-        /* 60  C4 */  440,  416,  392,  370,  349,  330,  311,  294,
-        /* 68     */  277,  262,  247,  233,
-        /* 72  C5 */  220,  208,  196,  185,  175,  165,  156,  147,
-        /* 80     */  139,  131,  124,  117,
-        /* 84  C6 */  110,  104,   98,   93,   87,   82,   78,   73,
-        /* 92     */   69,   65,   62,   58,
-        /* 96  C7 */   55
-    };
+static const uint16_t ym2149_note_tp[] = {
+    /* 24  C1 */ 3522, 3325, 3138, 2962, 2796, 2639, 2491, 2351,
+    /* 32     */ 2219, 2095, 1977, 1866,
+    /* 36  C2 */ 1761, 1662, 1569, 1481, 1398, 1319, 1245, 1175,
+    /* 44     */ 1109, 1047,  989,  933,
+    /* 48  C3 */  881,  831,  784,  740,  699,  660,  623,  588,
+    /* 56     */  555,  524,  494,  467,
+    /* 60  C4 */  440,  416,  392,  370,  349,  330,  311,  294,
+    /* 68     */  277,  262,  247,  233,
+    /* 72  C5 */  220,  208,  196,  185,  175,  165,  156,  147,
+    /* 80     */  139,  131,  124,  117,
+    /* 84  C6 */  110,  104,   98,   93,   87,   82,   78,   73,
+    /* 92     */   69,   65,   62,   58,
+    /* 96  C7 */   55
+};
 
+// MIDI note to YM2149 tone period conversion
+uint16_t ym2149_note_to_freq(uint8_t note) {
     if (note < YM2149_MIDI_NOTE_MIN) note = YM2149_MIDI_NOTE_MIN;
     if (note > YM2149_MIDI_NOTE_MAX) note = YM2149_MIDI_NOTE_MAX;
 
-    return note_tp[note - YM2149_MIDI_NOTE_MIN];
+    return ym2149_note_tp[note - YM2149_MIDI_NOTE_MIN];
 }
 
-// Apply pitch bend to frequency
-uint16_t ym2149_apply_pitch_bend(uint16_t base_freq, int16_t bend) {
-    // Simple linear pitch bend
-    // bend range: -8192 to +8192, map to -semitone to +semitone
-    int16_t bend_amount = bend / 8;  // Simplified calculation
-    int32_t result = (int32_t)base_freq + ((int32_t)base_freq * bend_amount / 100);
+// Tone period for a note bent by `steps` (1/PITCH_BEND_STEPS semitone).
+// The equal-tempered period table is the exponential curve: the whole
+// semitones of the bend pick a table entry and the remaining fraction
+// interpolates towards the next one.  Adjacent entries differ by at most
+// 197, so the interpolation is an 8x16 multiply with no 32-bit maths.
+// Bends past either end of the table saturate at C1 / C7.
+uint16_t ym2149_bend_period(uint8_t note, int16_t steps) {
+    int16_t pos = (int16_t)note * PITCH_BEND_STEPS + steps;
 
-    if (result < 1) result = 1;          // Clamp to minimum valid period
-    if (result > 4095) result = 4095;    // Clamp to 12-bit max
-    return (uint16_t)result;
+    if (pos < YM2149_MIDI_NOTE_MIN * PITCH_BEND_STEPS) {
+        pos = YM2149_MIDI_NOTE_MIN * PITCH_BEND_STEPS;
+    }
+    if (pos > YM2149_MIDI_NOTE_MAX * PITCH_BEND_STEPS) {
+        pos = YM2149_MIDI_NOTE_MAX * PITCH_BEND_STEPS;
+    }
+
+    const uint16_t* tp = &ym2149_note_tp[(pos >> 5) - YM2149_MIDI_NOTE_MIN];
+    uint8_t frac = pos & (PITCH_BEND_STEPS - 1);
+
+    if (frac == 0) return tp[0];
+    return tp[0] - (((tp[0] - tp[1]) * frac) >> 5);
 }
 
 // Read from YM2149 register (for detection)
@@ -350,9 +867,13 @@ uint16_t ym2149_apply_pitch_bend(uint16_t base_freq, int16_t bend) {
 //   IN  → reads the register data       (BDIR=0, BC1=1)
 // The data port (0xD0) is write-only (BDIR=1, BC1=0).
 static uint8_t ym2149_read_register(uint8_t reg) {
-    outp(YM2149_ADDR_PORT, reg);
-    SmallDelay();
-    return inp(YM2149_ADDR_PORT);
+    YM2149_IO_SELECT(ym2149_card);
+    if (reg != ym2149_io_latch) {
+        ym2149_io_latch = reg;
+        hal_outp(ym2149_io_addr, reg);
+        YM2149_BUS_SETTLE();
+    }
+    return hal_inp(ym2149_io_addr);
 }
 
 // Detect YM2149 chip presence
@@ -378,16 +899,19 @@ uint8_t detect_ym2149(void) {
     uint8_t orig_level_a = 0;
     uint8_t orig_level_b = 0;
     
+    // Detect with the conservative profile; calibration comes afterwards
+    ym2149_delay_loops = ym2149_timing_profiles[YM2149_TIMING_SAFE].delay_loops;
+
     // Try to read original states (may fail if no chip present)
-    __asm__("di");  // Disable interrupts during detection
+    hal_di();  // Disable interrupts during detection
     orig_mixer = ym2149_read_register(YM2149_MIXER);
     orig_level_a = ym2149_read_register(YM2149_LEVEL_A);
     orig_level_b = ym2149_read_register(YM2149_LEVEL_B);
     
     // Test 1: Write/read back to mixer register (7)
     for (uint8_t i = 0; i < sizeof(test_values); i++) {
-        ym2149_write_register(YM2149_MIXER, test_values[i]);
-        SmallDelay();
+        ym2149_bus_write(YM2149_MIXER, test_values[i]);
+        YM2149_BUS_SETTLE();
         read_back = ym2149_read_register(YM2149_MIXER);
         
         // Some bits might be read-only, check if at least some bits match
@@ -400,8 +924,8 @@ uint8_t detect_ym2149(void) {
     if (detection_passed) {
         // Test 2: Write/read back to level registers (8, 9)
         for (uint8_t i = 0; i < sizeof(test_values); i++) {
-            ym2149_write_register(YM2149_LEVEL_A, test_values[i]);
-            SmallDelay();
+            ym2149_bus_write(YM2149_LEVEL_A, test_values[i]);
+            YM2149_BUS_SETTLE();
             read_back = ym2149_read_register(YM2149_LEVEL_A);
             
             // Volume bits (0-3) should be readable
@@ -415,8 +939,8 @@ uint8_t detect_ym2149(void) {
     if (detection_passed) {
         // Test 3: Test frequency register accessibility
         // Write to frequency low register and verify it's not stuck
-        ym2149_write_register(YM2149_FREQ_A_LSB, 0x42);
-        SmallDelay();
+        ym2149_bus_write(YM2149_FREQ_A_LSB, 0x42);
+        YM2149_BUS_SETTLE();
         read_back = ym2149_read_register(YM2149_FREQ_A_LSB);
         if (read_back != 0x42) {
             detection_passed = 0;
@@ -424,130 +948,275 @@ uint8_t detect_ym2149(void) {
     }
     
     // Restore original register states
-    ym2149_write_register(YM2149_MIXER, orig_mixer);
-    ym2149_write_register(YM2149_LEVEL_A, orig_level_a);
-    ym2149_write_register(YM2149_LEVEL_B, orig_level_b);
+    ym2149_bus_write(YM2149_MIXER, orig_mixer);
+    ym2149_bus_write(YM2149_LEVEL_A, orig_level_a);
+    ym2149_bus_write(YM2149_LEVEL_B, orig_level_b);
     
-    __asm__("ei");  // Re-enable interrupts
+    hal_ei();  // Re-enable interrupts
+
+    // Detection bypassed the shadow, so it no longer matches the chip
+    ym2149_shadow_invalidate();
     
     return detection_passed;
 }
 
-// Simple delay function for test sequences
-void delay_ms(uint16_t ms) {
-    // Nested loops to avoid uint16_t overflow (ms * 100 overflows when ms > 655)
-    for (volatile uint16_t i = 0; i < ms; i++) {
-        for (volatile uint8_t j = 0; j < 100; j++) {
-            // Adjust iteration count based on actual clock speed
+// Forget all cards (before re-running detection)
+void ym2149_cards_clear(void) {
+    ym2149_io_release();
+    ym2149_card_count = 0;
+    ym2149_card = &ym2149_cards[0];
+    ym2149_interface.voice_count = 0;
+}
+
+// Probe a card at the given ports and, if a chip answers, add its three
+// voices to the pool.  Returns 1 if the card was added.
+uint8_t ym2149_add_card(uint8_t addr_port, uint8_t data_port) {
+    if (ym2149_card_count >= YM2149_MAX_CARDS) return 0;
+
+    // The same card listed twice would double-count its voices
+    for (uint8_t i = 0; i < ym2149_card_count; i++) {
+        if (ym2149_cards[i].addr_port == addr_port) return 0;
+    }
+
+    ym2149_card_t* c = &ym2149_cards[ym2149_card_count];
+    if (c == ym2149_io_card) ym2149_io_release();
+    c->addr_port = addr_port;
+    c->data_port = data_port;
+    c->latched = YM2149_LATCH_UNKNOWN;
+    c->shadow_valid = 0;
+    c->patch = YM2149_PATCH_NONE;
+    ym2149_card = c;
+
+    if (!detect_ym2149()) {
+        ym2149_card = &ym2149_cards[0];
+        return 0;
+    }
+
+    uint8_t voice = ym2149_card_count * 3;
+    for (uint8_t chan = 0; chan < 3; chan++) {
+        ym2149_voice_card[voice + chan] = c;
+        ym2149_voice_chan[voice + chan] = chan;
+    }
+    ym2149_card_count++;
+    ym2149_interface.voice_count = ym2149_card_count * 3;
+    return 1;
+}
+
+// Back-to-back write/read-back probe on the 8-bit wide registers.
+// Returns 1 if every value read back matches what was written.
+static uint8_t ym2149_timing_probe(uint8_t pattern) {
+    static const uint8_t probe_regs[] = {
+        YM2149_FREQ_A_LSB, YM2149_FREQ_B_LSB, YM2149_FREQ_ENV_LSB
+    };
+
+    for (uint8_t i = 0; i < sizeof(probe_regs); i++) {
+        ym2149_bus_write(probe_regs[i], pattern + i);
+    }
+    for (uint8_t i = 0; i < sizeof(probe_regs); i++) {
+        if (ym2149_read_register(probe_regs[i]) != (uint8_t)(pattern + i)) {
+            return 0;
         }
     }
+    return 1;
 }
 
-// Play test sequence to verify audio output
-void ym2149_play_test_sequence(void) {
-    printf("Playing YM2149 test sequence...\n");
+// Find the smallest delay at which the probe passes reliably on the
+// selected card.  Returns the loop count, or 0xFF if no setting up to
+// the limit works.
+static uint8_t ym2149_timing_calibrate(void) {
+    static const uint8_t patterns[] = {0x55, 0xAA, 0x0F, 0xF0};
 
-    // Test 1: Simple tone on each channel
-    printf("Testing individual channels...\n");
-    
-    // Channel A - C4 (MIDI 60)
-    ym2149_set_frequency(0, ym2149_note_to_freq(60));
-    ym2149_set_volume(0, 10);  // Medium volume
-    delay_ms(500);
-
-    // Channel B - E4 (MIDI 64)
-    ym2149_set_frequency(1, ym2149_note_to_freq(64));
-    ym2149_set_volume(1, 10);
-    delay_ms(500);
-
-    // Channel C - G4 (MIDI 67)
-    ym2149_set_frequency(2, ym2149_note_to_freq(67));
-    ym2149_set_volume(2, 10);
-    delay_ms(500);
-    
-    // Test 2: All channels together
-    printf("Testing all channels together...\n");
-    delay_ms(500);
-    
-    // Test 3: Volume sweep
-    printf("Testing volume control...\n");
-    for (uint8_t vol = 15; vol > 0; vol--) {
-        ym2149_set_volume(0, vol);
-        ym2149_set_volume(1, vol);
-        ym2149_set_volume(2, vol);
-        delay_ms(100);
+    for (uint8_t loops = 0; loops <= YM2149_CALIBRATE_MAX_LOOPS; loops++) {
+        uint8_t ok = 1;
+        ym2149_delay_loops = loops;
+        for (uint8_t p = 0; p < sizeof(patterns) && ok; p++) {
+            ok = ym2149_timing_probe(patterns[p]);
+        }
+        if (ok) {
+            return loops;
+        }
     }
-    
-    for (uint8_t vol = 0; vol <= 15; vol++) {
-        ym2149_set_volume(0, vol);
-        ym2149_set_volume(1, vol);
-        ym2149_set_volume(2, vol);
-        delay_ms(100);
+    return 0xFF;
+}
+
+// Select the bus timing profile.  With YM2149_TIMING_AUTO the delay is
+// calibrated with the write/read-back probe on every card and the first
+// profile that covers the slowest is used — one profile slower if any
+// chip needed a delay at all, to leave some margin.
+void ym2149_timing_init(uint8_t profile) {
+    ym2149_timing_was_calibrated = 0;
+
+    if (profile == YM2149_TIMING_AUTO) {
+        uint8_t needed = 0;
+        ym2149_card_t* c;
+        YM2149_FOR_EACH_CARD(c) {
+            uint8_t loops = ym2149_timing_calibrate();
+            if (loops > needed) needed = loops;
+            ym2149_shadow_invalidate();  // Probe wrote around the shadow
+        }
+
+        profile = YM2149_TIMING_SAFE;
+        if (needed != 0xFF) {
+            for (uint8_t i = 0; i < YM2149_TIMING_COUNT; i++) {
+                if (ym2149_timing_profiles[i].delay_loops >= needed) {
+                    profile = i;
+                    break;
+                }
+            }
+            if (needed > 0 && profile < YM2149_TIMING_SAFE) {
+                profile++;
+            }
+            ym2149_timing_was_calibrated = 1;
+        }
+    } else if (profile >= YM2149_TIMING_COUNT) {
+        profile = YM2149_TIMING_SAFE;
     }
-    
-    // Test 4: Noise generator
-    printf("Testing noise generator...\n");
-    ym2149_write_register(YM2149_FREQ_NOISE, 0x1F);  // Middle noise frequency
-    // Enable noise on all channels, disable tone
-    ym2149_write_register(YM2149_MIXER, YM2149_MIX_TONE_A_OFF | YM2149_MIX_TONE_B_OFF | YM2149_MIX_TONE_C_OFF);
-    delay_ms(1000);
-
-    // Clean up - restore tone mode
-    ym2149_write_register(YM2149_MIXER, YM2149_MIX_ALL_TONE);
-    ym2149_all_off();
-    
-    printf("Test sequence complete.\n");
+
+    ym2149_timing_active = profile;
+    ym2149_delay_loops = ym2149_timing_profiles[profile].delay_loops;
 }
 
-// Play musical scale
-void ym2149_play_scale(void) {
-    printf("Playing C major scale...\n");
+// Active bus timing profile (YM2149_TIMING_*)
+uint8_t ym2149_timing_profile(void) {
+    return ym2149_timing_active;
+}
 
-    // C major scale: C4, D4, E4, F4, G4, A4, B4, C5
-    uint8_t scale_notes[] = {60, 62, 64, 65, 67, 69, 71, 72};
+// Returns 1 if the active profile was chosen by calibration
+uint8_t ym2149_timing_calibrated(void) {
+    return ym2149_timing_was_calibrated;
+}
 
-    for (uint8_t i = 0; i < 8; i++) {
-        // Play note on channel A
-        ym2149_set_frequency(0, ym2149_note_to_freq(scale_notes[i]));
-        ym2149_set_volume(0, 12);  // Good volume for testing
-        printf("Note: %d\n", scale_notes[i]);
-        delay_ms(400);
+// Audio test sequences.  Each step function does one step and returns
+// the ticks until the next (see event_wheel.h), so the tests play from
+// the event wheel without holding up MIDI input.  Test notes are played
+// on SYNTH_TEST_CHANNEL through the allocator and released one by one,
+// and levels are only set on voices the test still holds.
 
-        // Brief pause between notes
-        ym2149_set_volume(0, 0);
-        delay_ms(50);
+static void ym2149_test_level(uint8_t note, uint8_t level) {
+    uint8_t voice = find_voice_by_note(note, SYNTH_TEST_CHANNEL);
+    if (voice != 0xFF) {
+        ym2149_set_volume(voice, level);
     }
+}
 
-    printf("Scale complete.\n");
+static void ym2149_test_note_on(uint8_t note, uint8_t level) {
+    synthesizer_note_on(note, 127, SYNTH_TEST_CHANNEL);
+    ym2149_test_level(note, level);
 }
 
-// Play arpeggio test
-void ym2149_play_arpeggio(void) {
-    printf("Playing arpeggio test...\n");
+// Tone per note, a volume sweep down and up, then noise on the first
+static uint16_t ym2149_test_sequence_step(uint8_t step) {
+    static const uint8_t notes[3] = {60, 64, 67};   // C4, E4, G4
 
-    // C major arpeggio: C4, E4, G4
-    uint8_t chord_notes[] = {60, 64, 67};
+    if (step == 0) {
+        con_puts(CON_INFO, "Playing YM2149 test sequence...\n");
+        con_puts(CON_INFO, "Testing individual channels...\n");
+    }
+    if (step < 3) {
+        ym2149_test_note_on(notes[step], 10);  // Medium volume
+        return 500;
+    }
+    if (step == 3) {
+        con_puts(CON_INFO, "Testing all channels together...\n");
+        return 500;
+    }
 
-    // Play each note on separate channel
-    for (uint8_t ch = 0; ch < 3; ch++) {
-        ym2149_set_frequency(ch, ym2149_note_to_freq(chord_notes[ch]));
-        ym2149_set_volume(ch, 8);
-        delay_ms(100);
+    // Volume sweep: 15 down to 1, then 0 up to 15
+    if (step < 4 + 31) {
+        uint8_t n = step - 4;
+        uint8_t vol = (n < 15) ? 15 - n : n - 15;
+        if (n == 0) {
+            con_puts(CON_INFO, "Testing volume control...\n");
+        }
+        for (uint8_t i = 0; i < 3; i++) {
+            ym2149_test_level(notes[i], vol);
+        }
+        return 100;
     }
-    
-    // Let them play together
-    delay_ms(1000);
-    
-    // Fade out
-    for (uint8_t vol = 8; vol > 0; vol--) {
-        ym2149_set_volume(0, vol);
-        ym2149_set_volume(1, vol);
-        ym2149_set_volume(2, vol);
-        delay_ms(150);
+
+    if (step == 4 + 31) {
+        uint8_t voice = find_voice_by_note(notes[0], SYNTH_TEST_CHANNEL);
+        con_puts(CON_INFO, "Testing noise generator...\n");
+        if (voice != 0xFF) {
+            // Noise instead of tone on the test voice's channel only.
+            // Noise period and mixer are per card: select it first.
+            uint8_t chan = ym2149_select_voice(voice);
+            uint8_t mixer = ym2149_bank[ym2149_card->patch].regs_6_7[YM2149_PATCH_MIXER];
+            mixer |= YM2149_MIX_TONE_A_OFF << chan;
+            mixer &= ~(YM2149_MIX_NOISE_A_OFF << chan);
+            ym2149_write_register(YM2149_FREQ_NOISE, 0x1F);
+            ym2149_write_register(YM2149_MIXER, mixer);
+        }
+        return 1000;
     }
-    
-    ym2149_all_off();
-    printf("Arpeggio complete.\n");
+
+    // Clean up: restore the patch's noise and mixer, release the notes
+    ym2149_patch_refresh();
+    for (uint8_t i = 0; i < 3; i++) {
+        synthesizer_note_off(notes[i], SYNTH_TEST_CHANNEL);
+    }
+    con_puts(CON_INFO, "Test sequence complete.\n");
+    return EVW_SEQ_END;
+}
+
+// C major scale, a short gap between notes
+static uint16_t ym2149_scale_step(uint8_t step) {
+    static const uint8_t scale_notes[8] = {60, 62, 64, 65, 67, 69, 71, 72};
+    uint8_t note = scale_notes[(step >> 1) & 7];
+
+    if (step == 0) {
+        con_puts(CON_INFO, "Playing C major scale...\n");
+    }
+    if (step >= 16) {
+        con_puts(CON_INFO, "Scale complete.\n");
+        return EVW_SEQ_END;
+    }
+    if (step & 1) {
+        synthesizer_note_off(note, SYNTH_TEST_CHANNEL);   // Brief pause between notes
+        return 50;
+    }
+    ym2149_test_note_on(note, 12);  // Good volume for testing
+    con_msg_dec(CON_INFO, MSG_NOTE, note);
+    return 400;
+}
+
+// C major chord built up one note at a time, held, then faded out
+static uint16_t ym2149_arpeggio_step(uint8_t step) {
+    static const uint8_t chord_notes[3] = {60, 64, 67};
+
+    if (step < 3) {
+        if (step == 0) {
+            con_puts(CON_INFO, "Playing arpeggio test...\n");
+        }
+        ym2149_test_note_on(chord_notes[step], 8);
+        return (step == 2) ? 100 + 1000 : 100;   // Then let them play together
+    }
+    if (step < 3 + 8) {
+        uint8_t vol = 8 - (step - 3);
+        for (uint8_t i = 0; i < 3; i++) {
+            ym2149_test_level(chord_notes[i], vol);
+        }
+        return 150;
+    }
+
+    for (uint8_t i = 0; i < 3; i++) {
+        synthesizer_note_off(chord_notes[i], SYNTH_TEST_CHANNEL);
+    }
+    con_puts(CON_INFO, "Arpeggio complete.\n");
+    return EVW_SEQ_END;
+}
+
+// Queue the tests; they start when those already queued have finished
+void ym2149_play_test_sequence(void) {
+    evw_sequence_start(ym2149_test_sequence_step);
+}
+
+void ym2149_play_scale(void) {
+    evw_sequence_start(ym2149_scale_step);
+}
+
+void ym2149_play_arpeggio(void) {
+    evw_sequence_start(ym2149_arpeggio_step);
 }
 
 // Initialize YM2149 interface structure
@@ -572,9 +1241,11 @@ sound_chip_interface_t ym2149_interface = {
     .set_tremolo = ym2149_set_tremolo,
     .set_pitch_bend = ym2149_set_pitch_bend,
     .set_modulation = ym2149_set_modulation,
+    .set_tremolo_sync = ym2149_set_tremolo_sync,
     
     .set_preset = ym2149_set_preset,
     .panic = ym2149_panic,
+    .tick = ym2149_tick,
     
     .voices = ym2149_voices
 };
\ No newline at end of file
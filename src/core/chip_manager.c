@@ -1,6 +1,9 @@
 #include "../../include/chip_manager.h"
 #include "../../include/ym2149.h"
+#include "../../include/opl3.h"
 #include "../../include/port_config.h"
+#include "../../include/synthesizer.h"
+#include "../../include/event_wheel.h"
 #include <stdint.h>
 
 // Current chip pointer
@@ -18,6 +21,7 @@ void chip_manager_init(void) {
     // Initialize port configuration and try to load from file
     port_config_init();
     port_config_load_from_file("ports.conf");
+    ym2149_bank_load(YM2149_BANK_FILE);
     
     // Detect available sound chips
     chip_manager_detect_chips();
@@ -25,6 +29,8 @@ void chip_manager_init(void) {
     // Select default chip (YM2149 first if available)
     if (available_chips & CHIP_YM2149) {
         chip_manager_set_chip(CHIP_YM2149);
+    } else if (available_chips & CHIP_OPL3) {
+        chip_manager_set_chip(CHIP_OPL3);
     }
 }
 
@@ -32,14 +38,25 @@ void chip_manager_init(void) {
 void chip_manager_detect_chips(void) {
     available_chips = 0;
     
-    // Test for YM2149
-    if (detect_ym2149()) {
+    // Probe each configured YM2149 card; every card that answers adds
+    // three voices to the pool.  Then pick the fastest safe bus timing.
+    ym2149_cards_clear();
+    ym2149_add_card(ym2149_ports.addr_port, ym2149_ports.data_port);
+    if (ym2149_ports.addr_port2) {
+        ym2149_add_card(ym2149_ports.addr_port2, ym2149_ports.data_port2);
+    }
+    if (ym2149_ports.addr_port3) {
+        ym2149_add_card(ym2149_ports.addr_port3, ym2149_ports.data_port3);
+    }
+    if (ym2149_card_count) {
         available_chips |= CHIP_YM2149;
+        ym2149_timing_init(ym2149_ports.bus_timing);
     }
     
-    // Test for OPL3 (future implementation)
+    // Probe the OPL3 timers, then size its write pacing to the CPU clock
     if (detect_opl3()) {
         available_chips |= CHIP_OPL3;
+        opl3_pacing_init(ym2149_ports.cpu_khz);
     }
 }
 
@@ -49,6 +66,8 @@ uint8_t chip_manager_set_chip(uint8_t chip_id) {
     if (current_chip && current_chip->all_off) {
         current_chip->all_off();
     }
+    voice_map_reset();
+    evw_clear();   // Pending events belong to the old chip
     
     // Initialize and select new chip
     switch (chip_id) {
@@ -58,15 +77,21 @@ uint8_t chip_manager_set_chip(uint8_t chip_id) {
                 if (current_chip->init) {
                     current_chip->init();
                 }
+                midi_parts_reset();
                 return 1;  // Success
             }
             break;
             
         case CHIP_OPL3:
-            // Future: Initialize OPL3 interface
-            // current_chip = &opl3_interface;
-            return 0;  // Not implemented yet
-            // break;
+            if (available_chips & CHIP_OPL3) {
+                current_chip = &opl3_interface;
+                if (current_chip->init) {
+                    current_chip->init();
+                }
+                midi_parts_reset();
+                return 1;  // Success
+            }
+            break;
             
         default:
             return 0;  // Invalid chip ID
@@ -80,10 +105,4 @@ sound_chip_interface_t* chip_manager_get_current(void) {
     return current_chip;
 }
 
-// Test for YM2149 presence is now implemented in ym2149.c
-
-// Test for OPL3 presence
-uint8_t detect_opl3(void) {
-    // Future: Implement OPL3 detection
-    return 0;  // Not implemented yet
-}
\ No newline at end of file
+// Tests for YM2149 and OPL3 presence are implemented in the chip drivers
\ No newline at end of file
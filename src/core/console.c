@@ -0,0 +1,167 @@
+#include "../../include/console.h"
+#include "../../include/messages.h"
+#include "../../include/hal.h"
+#include <stdint.h>
+
+// Output queue — a byte ring drained by console_service()
+static char con_queue[CON_QUEUE_SIZE];
+static uint16_t con_head = 0;    // Next byte to write into the queue
+static uint16_t con_tail = 0;    // Next byte to send to the console
+static uint8_t con_verbosity = CON_DEFAULT_VERBOSITY;
+
+// Message being built by con_begin() .. con_endl()
+#define CON_BUILD_OFF       0    // Filtered: pieces are ignored
+#define CON_BUILD_ON        1
+#define CON_BUILD_FULL      2    // Ran out of queue space: drop at con_endl()
+static uint8_t con_build = CON_BUILD_OFF;
+static uint16_t con_open;        // Write position of the open message
+
+console_stats_t console_stats;
+
+// Initialize the console queue
+void console_init(void) {
+    con_head = 0;
+    con_tail = 0;
+    con_verbosity = CON_DEFAULT_VERBOSITY;
+    console_stats.dropped = 0;
+    console_stats.peak = 0;
+    con_build = CON_BUILD_OFF;
+}
+
+// Set verbosity level (CON_ERROR..CON_DEBUG)
+void console_set_verbosity(uint8_t level) {
+    if (level > CON_DEBUG) level = CON_DEBUG;
+    con_verbosity = level;
+}
+
+// Get current verbosity level
+uint8_t console_get_verbosity(void) {
+    return con_verbosity;
+}
+
+// Queue `len` bytes as one message, or drop the whole message
+static void con_enqueue(const char* text, uint16_t len) {
+    uint16_t used = (con_head - con_tail) & CON_QUEUE_MASK;
+
+    if (len > (CON_QUEUE_SIZE - 1) - used) {
+        console_stats.dropped++;
+        return;
+    }
+
+    for (uint16_t i = 0; i < len; i++) {
+        con_queue[con_head] = text[i];
+        con_head = (con_head + 1) & CON_QUEUE_MASK;
+    }
+
+    used += len;
+    if (used > console_stats.peak) {
+        console_stats.peak = used;
+    }
+}
+
+// Queue a fixed string (no formatting)
+void con_puts(uint8_t level, const char* text) {
+    uint16_t len = 0;
+
+    if (level > con_verbosity) {
+        return;
+    }
+    while (text[len]) {
+        len++;
+    }
+    con_enqueue(text, len);
+}
+
+// Start a message at `level`
+uint8_t con_begin(uint8_t level) {
+    con_open = con_head;
+    con_build = (level <= con_verbosity) ? CON_BUILD_ON : CON_BUILD_OFF;
+    return con_build;
+}
+
+// Append one character to the open message
+void con_char(char c) {
+    if (con_build != CON_BUILD_ON) {
+        return;
+    }
+    if (((con_open - con_tail) & CON_QUEUE_MASK) >= CON_QUEUE_SIZE - 1) {
+        con_build = CON_BUILD_FULL;
+        return;
+    }
+    con_queue[con_open] = c;
+    con_open = (con_open + 1) & CON_QUEUE_MASK;
+}
+
+void con_str(const char* text) {
+    while (*text && con_build == CON_BUILD_ON) {
+        con_char(*text++);
+    }
+}
+
+void con_msg(uint8_t id) {
+    con_str(con_messages[id]);
+}
+
+// Decimal by repeated subtraction — no division on the Z80
+void con_dec(uint16_t value) {
+    static const uint16_t powers[] = { 10000, 1000, 100, 10 };
+    uint8_t started = 0;
+
+    for (uint8_t i = 0; i < sizeof(powers) / sizeof(powers[0]); i++) {
+        char digit = '0';
+        while (value >= powers[i]) {
+            value -= powers[i];
+            digit++;
+        }
+        if (digit != '0' || started) {
+            con_char(digit);
+            started = 1;
+        }
+    }
+    con_char('0' + value);
+}
+
+void con_hex(uint8_t value) {
+    static const char digits[] = "0123456789ABCDEF";
+    con_char(digits[value >> 4]);
+    con_char(digits[value & 0x0F]);
+}
+
+// Finish the open message with a newline and hand it to the drain
+void con_endl(void) {
+    con_char('\n');
+    if (con_build == CON_BUILD_ON) {
+        uint16_t used = (con_open - con_tail) & CON_QUEUE_MASK;
+        con_head = con_open;
+        if (used > console_stats.peak) {
+            console_stats.peak = used;
+        }
+    } else if (con_build == CON_BUILD_FULL) {
+        console_stats.dropped++;
+    }
+    con_build = CON_BUILD_OFF;
+}
+
+// The common one-value message: string table text, number, newline
+void con_msg_dec(uint8_t level, uint8_t id, uint16_t value) {
+    con_begin(level);
+    con_msg(id);
+    con_dec(value);
+    con_endl();
+}
+
+// Idle task: send a few queued characters to the console
+void console_service(void) {
+    for (uint8_t i = 0; i < CON_DRAIN_BUDGET && con_tail != con_head; i++) {
+        hal_putc(con_queue[con_tail]);
+        con_tail = (con_tail + 1) & CON_QUEUE_MASK;
+    }
+}
+
+// Send everything queued.  Blocks — only for startup and exit.
+void console_flush(void) {
+    while (con_tail != con_head) {
+        hal_putc(con_queue[con_tail]);
+        con_tail = (con_tail + 1) & CON_QUEUE_MASK;
+    }
+}
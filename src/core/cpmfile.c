@@ -0,0 +1,247 @@
+#include "../../include/cpmfile.h"
+#include <stdint.h>
+#include <string.h>
+
+// Shared record buffer for cpmf_record() and sequential reads, tagged
+// with the record it holds so repeated reads of one record hit memory
+static uint8_t cpmf_dma[CPMF_RECORD_SIZE];
+static cpm_file_t* cpmf_dma_file = 0;
+static uint16_t cpmf_dma_record;
+
+#ifdef __Z88DK
+
+// BDOS functions used
+#define BDOS_OPEN         15
+#define BDOS_CLOSE        16
+#define BDOS_SET_DMA      26
+#define BDOS_READ_RANDOM  33
+
+uint16_t cpmf_bdos_arg;          // DE for cpmf_bdos()
+
+// Call BDOS function `func` with DE = cpmf_bdos_arg; returns A.
+// IX is saved because not every BDOS preserves it.
+static uint8_t cpmf_bdos(uint8_t func) __z88dk_fastcall __naked {
+    __asm
+        push ix
+        ld c, l
+        ld de, (_cpmf_bdos_arg)
+        call 5
+        pop ix
+        ld l, a
+        ld h, 0
+        ret
+    __endasm;
+}
+
+// Fill the FCB from "D:NAME.EXT" (drive optional, upper-cased, padded)
+static void cpmf_make_fcb(uint8_t* fcb, const char* name) {
+    memset(fcb, 0, CPMF_FCB_SIZE);
+    memset(fcb + 1, ' ', 11);
+    if (name[0] && name[1] == ':') {
+        fcb[0] = (name[0] & 0x1F);   // A=1, B=2 ... either case
+        name += 2;
+    }
+    uint8_t i = 1;
+    for (; *name && *name != '.'; name++) {
+        if (i <= 8) fcb[i++] = (*name >= 'a' && *name <= 'z') ? *name - 32 : *name;
+    }
+    if (*name == '.') {
+        name++;
+        for (i = 9; *name && i <= 11; name++) {
+            fcb[i++] = (*name >= 'a' && *name <= 'z') ? *name - 32 : *name;
+        }
+    }
+}
+
+static uint8_t cpmf_sys_open(cpm_file_t* f, const char* name) {
+    cpmf_make_fcb(f->fcb, name);
+    cpmf_bdos_arg = (uint16_t)f->fcb;
+    return cpmf_bdos(BDOS_OPEN) != 0xFF;
+}
+
+static void cpmf_sys_close(cpm_file_t* f) {
+    // Read-only: nothing to write back, but close for well-behaved BDOSes
+    cpmf_bdos_arg = (uint16_t)f->fcb;
+    cpmf_bdos(BDOS_CLOSE);
+}
+
+static uint8_t cpmf_sys_read(cpm_file_t* f, uint16_t record, uint8_t* dma) {
+    cpmf_bdos_arg = (uint16_t)dma;
+    cpmf_bdos(BDOS_SET_DMA);
+    f->fcb[33] = record & 0xFF;
+    f->fcb[34] = record >> 8;
+    f->fcb[35] = 0;
+    cpmf_bdos_arg = (uint16_t)f->fcb;
+    return cpmf_bdos(BDOS_READ_RANDOM) == 0;
+}
+
+#else // Host build: the same records over stdio
+
+#include <stdio.h>
+
+static uint8_t cpmf_sys_open(cpm_file_t* f, const char* name) {
+    f->host = fopen(name, "rb");
+    return f->host != 0;
+}
+
+static void cpmf_sys_close(cpm_file_t* f) {
+    fclose((FILE*)f->host);
+    f->host = 0;
+}
+
+// A short last record is padded with ^Z, as CP/M files are
+static uint8_t cpmf_sys_read(cpm_file_t* f, uint16_t record, uint8_t* dma) {
+    FILE* file = (FILE*)f->host;
+    if (fseek(file, (long)record * CPMF_RECORD_SIZE, SEEK_SET) != 0) return 0;
+    size_t n = fread(dma, 1, CPMF_RECORD_SIZE, file);
+    if (n == 0) return 0;
+    memset(dma + n, CPMF_TEXT_EOF, CPMF_RECORD_SIZE - n);
+    return 1;
+}
+
+#endif
+
+// Open a file for reading
+uint8_t cpmf_open(cpm_file_t* f, const char* name) {
+    f->open = cpmf_sys_open(f, name);
+    f->seq_record = 0;
+    f->seq_pos = 0;
+    return f->open;
+}
+
+void cpmf_close(cpm_file_t* f) {
+    if (f->open) {
+        cpmf_sys_close(f);
+        f->open = 0;
+    }
+    if (cpmf_dma_file == f) {
+        cpmf_dma_file = 0;
+    }
+}
+
+// Read one record straight into the caller's buffer
+uint8_t cpmf_read_record(cpm_file_t* f, uint16_t record, uint8_t* dma) {
+    return f->open && cpmf_sys_read(f, record, dma);
+}
+
+// Read one record into the shared buffer (or find it already there)
+const uint8_t* cpmf_record(cpm_file_t* f, uint16_t record) {
+    if (cpmf_dma_file == f && cpmf_dma_record == record) {
+        return cpmf_dma;
+    }
+    cpmf_dma_file = 0;
+    if (!cpmf_read_record(f, record, cpmf_dma)) {
+        return 0;
+    }
+    cpmf_dma_file = f;
+    cpmf_dma_record = record;
+    return cpmf_dma;
+}
+
+// Next byte of the file (binary: ^Z is returned like any other byte)
+int16_t cpmf_getc(cpm_file_t* f) {
+    const uint8_t* rec = cpmf_record(f, f->seq_record);
+    if (!rec) {
+        return CPMF_EOF;
+    }
+    uint8_t c = rec[f->seq_pos++];
+    if (f->seq_pos == CPMF_RECORD_SIZE) {
+        f->seq_pos = 0;
+        f->seq_record++;
+    }
+    return c;
+}
+
+// Copy the next `len` bytes; returns how many the file had
+uint16_t cpmf_read(cpm_file_t* f, uint8_t* buf, uint16_t len) {
+    uint16_t done = 0;
+
+    while (done < len) {
+        const uint8_t* rec = cpmf_record(f, f->seq_record);
+        if (!rec) break;
+        uint16_t n = CPMF_RECORD_SIZE - f->seq_pos;
+        if (n > len - done) n = len - done;
+        memcpy(buf + done, rec + f->seq_pos, n);
+        done += n;
+        f->seq_pos += n;
+        if (f->seq_pos == CPMF_RECORD_SIZE) {
+            f->seq_pos = 0;
+            f->seq_record++;
+        }
+    }
+    return done;
+}
+
+// Parse a key=value config file in one pass.  '#' starts a comment
+// line; keys and values end at the first '=' and at the line end (a
+// second '=' ends the value too).  Tokens longer than CPMF_TOKEN_MAX-1
+// are cut short.  Returns 0 if the file could not be opened.
+uint8_t cpmf_config(const char* name, cpmf_config_fn fn) {
+    cpm_file_t file;
+    char key[CPMF_TOKEN_MAX];
+    char value[CPMF_TOKEN_MAX];
+    uint8_t key_len = 0;
+    uint8_t value_len = 0;
+    uint8_t state = 0;           // 0 key, 1 value, 2 skip to line end
+    int16_t c;
+
+    if (!cpmf_open(&file, name)) {
+        return 0;
+    }
+    do {
+        c = cpmf_getc(&file);
+        if (c == CPMF_EOF || c == CPMF_TEXT_EOF || c == '\n' || c == '\r') {
+            if (state == 1 && key_len && value_len) {
+                key[key_len] = '\0';
+                value[value_len] = '\0';
+                fn(key, value);
+            }
+            key_len = 0;
+            value_len = 0;
+            state = 0;
+        } else if (state == 0) {
+            if (c == '#' && key_len == 0) {
+                state = 2;
+            } else if (c == '=') {
+                state = 1;
+            } else if (key_len < CPMF_TOKEN_MAX - 1) {
+                key[key_len++] = c;
+            }
+        } else if (state == 1) {
+            if (c == '=' && value_len) {
+                // Value ends here; ignore the rest of the line
+                key[key_len] = '\0';
+                value[value_len] = '\0';
+                if (key_len) fn(key, value);
+                state = 2;
+            } else if (c != '=' && value_len < CPMF_TOKEN_MAX - 1) {
+                value[value_len++] = c;
+            }
+        }
+    } while (c != CPMF_EOF && c != CPMF_TEXT_EOF);
+
+    cpmf_close(&file);
+    return 1;
+}
+
+// Unsigned number: decimal, or hex with a 0x prefix; stops at the first
+// character that is not a digit
+uint16_t cpmf_number(const char* text) {
+    uint16_t value = 0;
+
+    if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        for (text += 2; ; text++) {
+            char c = *text;
+            if (c >= '0' && c <= '9') c -= '0';
+            else if (c >= 'a' && c <= 'f') c -= 'a' - 10;
+            else if (c >= 'A' && c <= 'F') c -= 'A' - 10;
+            else break;
+            value = (value << 4) | c;
+        }
+        return value;
+    }
+    for (; *text >= '0' && *text <= '9'; text++) {
+        value = value * 10 + (*text - '0');
+    }
+    return value;
+}
@@ -0,0 +1,167 @@
+#include "../../include/event_wheel.h"
+#include "../../include/timebase.h"
+#include <stdint.h>
+#include <string.h>
+
+evw_stats_t evw_stats;
+
+// Event pool, one entry per field; a free event is on the free list
+static uint8_t evw_next[EVW_POOL];       // Next event in the slot / free list
+static uint16_t evw_due[EVW_POOL];       // Due tick
+static evw_fn evw_call[EVW_POOL];        // Callback, 0 = cancelled
+static uint8_t evw_arg[EVW_POOL];
+
+static uint8_t evw_slot[EVW_SLOTS];      // First event per slot
+static uint8_t evw_free;
+static uint16_t evw_cursor;              // First tick of the next slot to expire
+
+// Sequence queue; evw_seq[0] is running
+static evw_step_fn evw_seq[EVW_SEQ_QUEUE];
+static uint8_t evw_seq_count;
+static uint8_t evw_seq_event = EVW_NONE; // Pending step
+
+// Empty the wheel and the sequence queue
+void evw_clear(void) {
+    memset(evw_slot, EVW_NONE, sizeof(evw_slot));
+    for (uint8_t i = 0; i < EVW_POOL; i++) {
+        evw_next[i] = i + 1;
+    }
+    evw_next[EVW_POOL - 1] = EVW_NONE;
+    evw_free = 0;
+    evw_stats.pending = 0;
+    evw_cursor = timebase_now() & ~(EVW_SLOT_TICKS - 1);
+
+    evw_seq_count = 0;
+    evw_seq_event = EVW_NONE;
+}
+
+void evw_init(void) {
+    evw_clear();
+    evw_stats.fired = 0;
+    evw_stats.dropped = 0;
+    evw_stats.peak = 0;
+    evw_stats.slots = 0;
+}
+
+// Run `fn(arg)` `delay` ticks from now (at the end of the slot it falls
+// in, so up to EVW_SLOT_TICKS - 1 late)
+uint8_t evw_schedule(uint16_t delay, evw_fn fn, uint8_t arg) {
+    uint8_t e = evw_free;
+
+    if (e == EVW_NONE) {
+        evw_stats.dropped++;
+        return EVW_NONE;
+    }
+    evw_free = evw_next[e];
+    if (delay > EVW_MAX_DELAY) delay = EVW_MAX_DELAY;
+
+    uint16_t due = timebase_now() + delay;
+    evw_due[e] = due;
+    evw_call[e] = fn;
+    evw_arg[e] = arg;
+
+    // A due tick in a slot already expired goes in the next one to expire
+    if ((int16_t)(due - evw_cursor) < 0) due = evw_cursor;
+    uint8_t s = (due >> EVW_SLOT_SHIFT) & EVW_SLOT_MASK;
+    evw_next[e] = evw_slot[s];
+    evw_slot[s] = e;
+
+    if (++evw_stats.pending > evw_stats.peak) {
+        evw_stats.peak = evw_stats.pending;
+    }
+    return e;
+}
+
+// The event stays on its slot until the wheel reaches it, then is freed
+// without running
+void evw_cancel(uint8_t handle) {
+    if (handle < EVW_POOL) {
+        evw_call[handle] = 0;
+    }
+}
+
+// Expire every slot the clock has moved past.  Each slot costs one look
+// at each event on it; events due on a later turn are left in place.
+void evw_service(void) {
+    uint16_t now = timebase_now();
+
+    // After a stall of more than a turn, one pass over every slot still
+    // finds every overdue event.  Signed: the cursor is a tick ahead of
+    // `now` after expiring the slot that ends on `now`.
+    if ((int16_t)(now - evw_cursor) >= EVW_SPAN) {
+        evw_cursor = (now - EVW_SPAN + EVW_SLOT_TICKS) & ~(EVW_SLOT_TICKS - 1);
+    }
+
+    while ((int16_t)(now - evw_cursor) >= EVW_SLOT_TICKS - 1) {
+        uint8_t* link = &evw_slot[(evw_cursor >> EVW_SLOT_SHIFT) & EVW_SLOT_MASK];
+        uint16_t end = evw_cursor + EVW_SLOT_TICKS;
+
+        evw_stats.slots++;
+        // Callbacks that schedule land in later slots, not this one
+        evw_cursor = end;
+        while (*link != EVW_NONE) {
+            uint8_t e = *link;
+            evw_fn fn = evw_call[e];
+
+            if (fn && (int16_t)(evw_due[e] - end) >= 0) {
+                link = &evw_next[e];           // A later turn
+                continue;
+            }
+            *link = evw_next[e];
+            evw_next[e] = evw_free;
+            evw_free = e;
+            evw_stats.pending--;
+            if (fn) {
+                evw_stats.fired++;
+                fn(evw_arg[e]);
+            }
+        }
+    }
+}
+
+// Run one step of the current sequence and schedule the next, or start
+// the next queued sequence when it finishes
+static void evw_sequence_step(uint8_t step) {
+    uint16_t wait;
+
+    evw_seq_event = EVW_NONE;
+    if (evw_seq_count == 0) return;
+
+    wait = evw_seq[0](step);
+    if (wait == EVW_SEQ_END) {
+        evw_seq_count--;
+        memmove(evw_seq, evw_seq + 1, evw_seq_count * sizeof(evw_seq[0]));
+        if (evw_seq_count == 0) return;
+        wait = 0;
+        step = 0;
+    } else {
+        step++;
+    }
+    evw_seq_event = evw_schedule(wait, evw_sequence_step, step);
+    if (evw_seq_event == EVW_NONE) evw_seq_count = 0;   // Pool full: give up
+}
+
+// Queue a sequence; it starts at step 0 once those ahead of it finish
+uint8_t evw_sequence_start(evw_step_fn step) {
+    if (evw_seq_count >= EVW_SEQ_QUEUE) return 0;
+
+    evw_seq[evw_seq_count++] = step;
+    if (evw_seq_count == 1) {
+        evw_seq_event = evw_schedule(0, evw_sequence_step, 0);
+        if (evw_seq_event == EVW_NONE) {
+            evw_seq_count = 0;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void evw_sequence_stop(void) {
+    evw_cancel(evw_seq_event);
+    evw_seq_event = EVW_NONE;
+    evw_seq_count = 0;
+}
+
+uint8_t evw_sequence_active(void) {
+    return evw_seq_count != 0;
+}
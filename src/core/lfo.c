@@ -0,0 +1,71 @@
+#include "../../include/lfo.h"
+#include <stdint.h>
+
+lfo_stats_t lfo_stats;
+uint16_t lfo_tempo = 0;
+
+// First quarter of a sine wave, 0..127 (round(127 * sin(i/64 * pi/2)))
+static const uint8_t lfo_quarter_sine[64] = {
+      0,   3,   6,   9,  12,  16,  19,  22,  25,  28,  31,  34,  37,  40,  43,  46,
+     49,  51,  54,  57,  60,  63,  65,  68,  71,  73,  76,  78,  81,  83,  85,  88,
+     90,  92,  94,  96,  98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+    117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127,
+};
+
+// Initialize an LFO: stopped, zero depth, phase at the zero crossing
+void lfo_init(lfo_t* lfo, uint8_t wave) {
+    lfo->phase = 0;
+    lfo->rate = 0;
+    lfo->depth = 0;
+    lfo->wave = wave;
+    lfo->sync = 0;
+    lfo->synced_beat = 0;
+}
+
+// Tempo from the MIDI clock follower, picked up by synced LFOs on their
+// next step
+void lfo_set_tempo(uint16_t beat_ms16) {
+    lfo_tempo = beat_ms16;
+}
+
+// Map a CC value (0-127) to a rate of 0.5 - 10 Hz
+void lfo_set_rate_cc(lfo_t* lfo, uint8_t value) {
+    lfo->rate = LFO_RATE_DHZ(5) + (uint16_t)value * 4 * 52 / 5;
+    lfo->synced_beat = 0;            // A synced LFO recomputes on its next step
+}
+
+// Waveform value for a phase step (0-255), in -127..127
+int8_t lfo_wave(uint8_t wave, uint8_t phase) {
+    switch (wave) {
+        case LFO_WAVE_SINE: {
+            uint8_t idx = phase & 0x3F;
+            if (phase & 0x40) idx = 63 - idx;     // Falling quarter
+            int8_t v = (int8_t)lfo_quarter_sine[idx];
+            return (phase & 0x80) ? -v : v;       // Negative half
+        }
+        case LFO_WAVE_TRIANGLE:
+            if (phase < 64) return (int8_t)(phase * 2);
+            if (phase < 192) return (int8_t)(127 - (phase - 64) * 2);
+            return (int8_t)((phase - 192) * 2 - 127);
+        case LFO_WAVE_SQUARE:
+            return (phase & 0x80) ? -127 : 127;
+        case LFO_WAVE_SAW:
+        default:
+            return (phase == 0) ? -127 : (int8_t)(phase - 128);
+    }
+}
+
+// Advance one LFO tick and return the output scaled by depth (-127..127)
+int8_t lfo_step(lfo_t* lfo) {
+    // Synced: one divide per tempo change, not per step
+    if (lfo->sync && lfo_tempo && lfo->synced_beat != lfo_tempo) {
+        uint32_t rate = LFO_SYNC_SCALE / ((uint32_t)lfo_tempo * lfo->sync);
+        lfo->rate = (rate > 0xFFFF) ? 0xFFFF : (uint16_t)rate;
+        lfo->synced_beat = lfo_tempo;
+    }
+    lfo->phase += lfo->rate;
+    if (lfo->depth == 0) {
+        return 0;
+    }
+    return (int8_t)(((int16_t)lfo_wave(lfo->wave, lfo->phase >> 8) * lfo->depth) >> 7);
+}
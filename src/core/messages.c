@@ -0,0 +1,133 @@
+#include "../../include/messages.h"
+#include "../../include/smf_player.h"
+
+// Console string table (see messages.h).  Order must match the enum.
+const char* const con_messages[MSG_COUNT] = {
+    // Shared fragments
+    "0x",
+    " (",
+    ")",
+    ", ",
+    ": ",
+    " writes, ",
+    " skipped, ",
+    " ticks",
+    " events, ",
+    " disk stalls",
+    "Playing ",
+    "Note: ",
+    "MIDI IN: ",
+
+    // Commands
+    "\n=== RC2014 MIDI Synthesizer Commands ===\n"
+    "h/H - Show this help\n"
+    "s/S - Show system status\n"
+    "i/I - Show current I/O ports\n"
+    "r/R - Reload port, CC and voice configuration\n"
+    "t/T - Test audio output\n"
+    "k/K - Keyboard MIDI mode (ESC to exit)\n"
+    "m/M - Toggle BIOS MIDI mode (AUX serial)\n"
+    "f/F - Play/stop MIDI file (" SMF_DEFAULT_FILE " or command line)\n"
+    "v/V - Cycle verbosity (0=errors..3=debug)\n"
+    "a/A - Cycle voice allocation policy\n"
+    "p/P - Panic (all notes off)\n"
+    "1   - Select YM2149 sound chip\n"
+    "2   - Select OPL3 sound chip\n"
+    "q/Q - Quit program\n"
+    "\nKeyboard MIDI keys (in 'k' mode):\n"
+    "  z s x d c v g b h n j m = C..B (lower oct)\n"
+    "  q 2 w 3 e r 5 f 6 y 7 u = C..B (upper oct)\n"
+    "  [ ] = octave down/up, -/+ = velocity\n"
+    "  space = note off, ESC/` = exit mode\n"
+    "===================================\n",
+    "  Register port: 0x",
+    "  Data port: 0x",
+    "  OPL3 port: 0x",
+    "detected",
+    "not detected",
+    "Stopped ",
+    "Verbosity: ",
+    "Unknown command: '",
+    "'. Type 'h' for help.",
+    ". Press 'f' to stop.",
+    "Cannot play ",
+    " read-ahead, ",
+    ", late ",
+    "YM2149 bus: ",
+    " shadow reads, ",
+    " latch hits",
+    "YM2149 timing: ",
+    " profile, ",
+    " delay loops (",
+    "calibrated",
+    "fixed",
+    "OPL3 bus: ",
+    " pacing loops",
+    "  YM2149 cards: ",
+    " voices)",
+    "    Card ",
+    ", voices ",
+    "Current chip: ",
+
+    // Status
+    "Active Chip: ",
+    "Voice Count: ",
+    "  Voice ",
+    ": Note ",
+    ", Vel ",
+    ", Ch ",
+    "MIDI RX: ",
+    "interrupt",
+    "polled",
+    ", overruns ring ",
+    " SIO ",
+    "Scheduler: budget ",
+    ", peak burst ",
+    ", budget hits ",
+    "Timebase: CTC @0x",
+    "Timebase: software",
+    "Timebase: HBIOS timer ",
+    " chained",
+    " Hz",
+    ", uptime ",
+    ", overruns ",
+    "Console: verbosity ",
+    ", dropped ",
+    ", peak ",
+    " bytes",
+    "LFO: ",
+    " late, writes/tick last ",
+    " max ",
+    "  CC#",
+    "Voice alloc: ",
+    ", allocs ",
+    ", steals ",
+    ", retriggers ",
+    "SysEx: device ",
+    ", dumps ",
+    ", requests ",
+    ", ignored ",
+    ", errors ",
+    "MIDI clock: ",
+    "running",
+    "stopped",
+    " BPM, beat ",
+    ", clocks ",
+    ", rejected ",
+    "Events: pending ",
+    ", fired ",
+
+    // MIDI input and keyboard mode
+    " vel: ",
+    "Octave: ",
+    "Velocity: ",
+    "Note off: ",
+    "Ch ",
+    " bend range ",
+    "Note On ",
+    "Note Off ",
+    " vel ",
+
+    // MIDI file player
+    "Finished ",
+};
@@ -0,0 +1,113 @@
+#include "../../include/scheduler.h"
+#include "../../include/midi_driver.h"
+#include "../../include/timebase.h"
+#include "../../include/hal.h"
+#include <stdint.h>
+
+// Cooperative main-loop scheduler.
+//
+// Each pass:
+//   0. Advances the timebase.
+//   1. Drains pending MIDI bytes, up to the configured budget, then runs
+//      the pass tasks (time-critical work such as the SMF player).
+//   2. Every SCHED_CONSOLE_INTERVAL passes, polls the console.  kbhit()
+//      is a full BDOS/HBIOS round trip that costs far more than parsing
+//      a MIDI byte, so it is not done on every pass.
+//   3. Runs the idle tasks, but only when the pass found no MIDI input.
+//
+// This lets a single loop keep up with back-to-back 31250-baud traffic
+// while staying responsive to key presses.
+
+sched_stats_t sched_stats;
+
+static sched_task_fn idle_tasks[SCHED_MAX_IDLE_TASKS];
+static uint8_t idle_task_count = 0;
+static sched_task_fn pass_tasks[SCHED_MAX_PASS_TASKS];
+static uint8_t pass_task_count = 0;
+static sched_key_fn key_handler = 0;
+static uint8_t console_countdown = SCHED_CONSOLE_INTERVAL;
+
+// Initialize scheduler state
+void scheduler_init(void) {
+    idle_task_count = 0;
+    pass_task_count = 0;
+    key_handler = 0;
+    console_countdown = SCHED_CONSOLE_INTERVAL;
+
+    sched_stats.midi_budget = SCHED_MIDI_BUDGET_DEFAULT;
+    sched_stats.peak_burst = 0;
+    sched_stats.budget_hits = 0;
+}
+
+// Set maximum MIDI bytes parsed per pass (0 is treated as 1)
+void scheduler_set_midi_budget(uint8_t budget) {
+    sched_stats.midi_budget = budget ? budget : 1;
+}
+
+// Register a task to run when MIDI input is quiet.
+// Returns 1 on success, 0 if all slots are in use.
+uint8_t scheduler_add_idle_task(sched_task_fn task) {
+    if (idle_task_count >= SCHED_MAX_IDLE_TASKS) {
+        return 0;
+    }
+    idle_tasks[idle_task_count++] = task;
+    return 1;
+}
+
+// Register a task to run on every pass, after MIDI input.
+// Returns 1 on success, 0 if all slots are in use.
+uint8_t scheduler_add_pass_task(sched_task_fn task) {
+    if (pass_task_count >= SCHED_MAX_PASS_TASKS) {
+        return 0;
+    }
+    pass_tasks[pass_task_count++] = task;
+    return 1;
+}
+
+// Set the function that receives console key presses
+void scheduler_set_key_handler(sched_key_fn handler) {
+    key_handler = handler;
+}
+
+// Run one scheduler pass
+void scheduler_pass(void) {
+    timebase_update();
+
+    uint8_t drained = midi_driver_drain(sched_stats.midi_budget);
+
+    if (drained > sched_stats.peak_burst) {
+        sched_stats.peak_burst = drained;
+    }
+    if (drained == sched_stats.midi_budget) {
+        sched_stats.budget_hits++;
+    }
+
+    for (uint8_t i = 0; i < pass_task_count; i++) {
+        pass_tasks[i]();
+    }
+
+    // Throttled console polling
+    if (--console_countdown == 0) {
+        console_countdown = SCHED_CONSOLE_INTERVAL;
+        if (hal_kbhit()) {
+            char key = hal_getch();
+            if (key_handler) {
+                key_handler(key);
+            }
+        }
+    }
+
+    // Idle work only when input is quiet
+    if (drained == 0) {
+        for (uint8_t i = 0; i < idle_task_count; i++) {
+            idle_tasks[i]();
+        }
+    }
+}
+
+// Run the scheduler forever (quit exits the program directly)
+void scheduler_run(void) {
+    while (1) {
+        scheduler_pass();
+    }
+}
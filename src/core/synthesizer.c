@@ -1,124 +1,355 @@
 #include "../../include/synthesizer.h"
 #include "../../include/midi_driver.h"
 #include "../../include/chip_manager.h"
-#include <stdio.h>
-
-// Simple voice allocation for current chip
-uint8_t allocate_voice(uint8_t note, uint8_t velocity, uint8_t channel) {
-    // Suppress unused parameter warnings
-    (void)note;
-    (void)velocity;
-    (void)channel;
-    if (!current_chip) return 0xFF;  // No chip selected
-    
-    // Find free voice
-    for (uint8_t i = 0; i < current_chip->voice_count; i++) {
-        if (!current_chip->voices[i].active) {
-            return i;
-        }
-    }
-    
-    // No free voices, use voice stealing (oldest note)
-    if (current_chip->voice_count == 0) return 0xFF;
+#include "../../include/scheduler.h"
+#include "../../include/console.h"
+#include "../../include/messages.h"
+#include "../../include/timebase.h"
+#include "../../include/port_config.h"
+#include "../../include/lfo.h"
+#include "../../include/sysex.h"
+#include "../../include/midi_clock.h"
+#include "../../include/event_wheel.h"
+#include <string.h>
 
-    uint8_t oldest_voice = 0;
-    uint32_t oldest_time = current_chip->voices[0].start_time;
-    
-    for (uint8_t i = 1; i < current_chip->voice_count; i++) {
-        if (current_chip->voices[i].start_time < oldest_time) {
-            oldest_time = current_chip->voices[i].start_time;
-            oldest_voice = i;
+// Timebase tick at which the next modulation tick is due
+static uint16_t synth_next_tick = 0;
+
+// Note-to-voice index (see VOICE_MAP_* in synthesizer.h)
+static uint8_t voice_map_head[VOICE_MAP_BUCKETS];      // First voice per bucket
+static uint8_t voice_map_next[VOICE_MAP_MAX_VOICES];   // Next voice in chain
+static uint8_t voice_map_bucket[VOICE_MAP_MAX_VOICES]; // Bucket, or VOICE_MAP_END
+
+// Clear the index (all voices unmapped) and resync the allocator
+void voice_map_reset(void) {
+    memset(voice_map_head, VOICE_MAP_END, sizeof(voice_map_head));
+    memset(voice_map_bucket, VOICE_MAP_END, sizeof(voice_map_bucket));
+    valloc_reset();
+}
+
+// Unlink a voice from its bucket chain, if it is in one
+static void voice_map_remove(uint8_t voice) {
+    if (voice >= VOICE_MAP_MAX_VOICES) return;
+
+    uint8_t bucket = voice_map_bucket[voice];
+    if (bucket == VOICE_MAP_END) return;
+    voice_map_bucket[voice] = VOICE_MAP_END;
+
+    uint8_t* link = &voice_map_head[bucket];
+    while (*link != VOICE_MAP_END) {
+        if (*link == voice) {
+            *link = voice_map_next[voice];
+            return;
         }
+        link = &voice_map_next[*link];
     }
-    
-    return oldest_voice;  // Steal oldest voice
 }
 
+// Index a voice under (note, channel).  A stolen voice is unlinked from
+// its old key first, so steal needs no separate bookkeeping.
+static void voice_map_add(uint8_t voice, uint8_t note, uint8_t channel) {
+    if (voice >= VOICE_MAP_MAX_VOICES) return;
+
+    voice_map_remove(voice);
+
+    uint8_t bucket = VOICE_MAP_HASH(note, channel);
+    voice_map_bucket[voice] = bucket;
+    voice_map_next[voice] = voice_map_head[bucket];
+    voice_map_head[bucket] = voice;
+}
+
+// Find the voice playing (note, channel) via the index.  Only voices that
+// hash to the same bucket are compared; entries left behind by a chip
+// reset or panic fail the active check and are skipped.
 uint8_t find_voice_by_note(uint8_t note, uint8_t channel) {
     if (!current_chip) return 0xFF;
-    
-    for (uint8_t i = 0; i < current_chip->voice_count; i++) {
+
+    uint8_t i = voice_map_head[VOICE_MAP_HASH(note, channel)];
+    while (i != VOICE_MAP_END) {
         if (current_chip->voices[i].active &&
             current_chip->voices[i].midi_note == note &&
             current_chip->voices[i].channel == channel) {
             return i;
         }
+        i = voice_map_next[i];
     }
-    
+
     return 0xFF;  // Not found
 }
 
+// Start a note: allocate (or steal) a voice, play it and index it.
+// Returns the voice, or 0xFF if none could be allocated.
+uint8_t synthesizer_note_on(uint8_t note, uint8_t velocity, uint8_t channel) {
+    if (!current_chip || !current_chip->note_on) return 0xFF;
+
+    uint8_t voice = allocate_voice(note, velocity, channel);
+    if (voice != 0xFF) {
+        current_chip->note_on(voice, note, velocity, channel);
+        voice_map_add(voice, note, channel);
+    }
+    return voice;
+}
+
+// Release a note and drop it from the index.
+// Returns the voice released, or 0xFF if the note wasn't playing.
+uint8_t synthesizer_note_off(uint8_t note, uint8_t channel) {
+    if (!current_chip || !current_chip->note_off) return 0xFF;
+
+    uint8_t voice = find_voice_by_note(note, channel);
+    if (voice != 0xFF) {
+        current_chip->note_off(voice);
+        voice_map_remove(voice);
+        valloc_release(voice);
+    }
+    return voice;
+}
+
+// Release every note the channel is sounding
+void synthesizer_channel_off(uint8_t channel) {
+    if (!current_chip) return;
+
+    for (uint8_t i = 0; i < current_chip->voice_count; i++) {
+        voice_t* v = &current_chip->voices[i];
+        if (v->active && v->channel == channel) {
+            synthesizer_note_off(v->midi_note, channel);
+        }
+    }
+}
+
 // Initialize synthesizer system
 void synthesizer_init(void) {
-    printf("Initializing RC2014 MIDI Synthesizer...\n");
+    con_puts(CON_INFO, "Initializing RC2014 MIDI Synthesizer...\n");
+
+    voice_map_reset();
     
-    // Initialize chip manager
+    // Initialize chip manager (also loads ports.conf)
     chip_manager_init();
+
+    // Start the timebase (CTC if present, else the HBIOS timer, else a
+    // count of scheduler passes)
+    timebase_init(ym2149_ports.ctc_port, ym2149_ports.cpu_khz);
+    evw_init();
     
     // Initialize MIDI driver
     midi_driver_init();
+
+    // Voice allocation and part routing (after the channel state is reset)
+    valloc_config_load(VALLOC_CONFIG_FILE);
+    memset(&valloc_stats, 0, sizeof(valloc_stats));
+
+    synth_next_tick = timebase_now() + LFO_TICK_INTERVAL;
     
     // Print status
     synthesizer_print_status();
     
-    printf("Synthesizer ready. MIDI interface active.\n");
+    con_puts(CON_INFO, "Synthesizer ready. MIDI interface active.\n");
 }
 
-// Emergency panic function
+// Emergency panic function: also drops every pending timed event, so
+// nothing scheduled starts a note again
 void synthesizer_panic(void) {
+    evw_clear();
     if (current_chip && current_chip->panic) {
         current_chip->panic();
     }
+    voice_map_reset();
     
-    printf("SYNTHESIZER PANIC: All notes off!\n");
+    con_puts(CON_INFO, "SYNTHESIZER PANIC: All notes off!\n");
+}
+
+// Run the chip's modulation update every LFO_TICK_INTERVAL timebase ticks.
+// Registered as a scheduler idle task, so it never delays MIDI input; a
+// tick that falls more than one interval behind is counted as late and
+// the schedule resyncs instead of bursting to catch up.
+void synthesizer_tick(void) {
+    uint16_t now = timebase_now();
+
+    // Wrap-safe "now < next"
+    if ((int16_t)(now - synth_next_tick) < 0) return;
+
+    synth_next_tick += LFO_TICK_INTERVAL;
+    if ((int16_t)(now - synth_next_tick) >= 0) {
+        synth_next_tick = now + LFO_TICK_INTERVAL;
+        lfo_stats.late++;
+    }
+
+    if (current_chip && current_chip->tick) {
+        current_chip->tick();
+    }
 }
 
 // Print system status
 void synthesizer_print_status(void) {
-    printf("=== RC2014 MIDI Synthesizer Status ===\n");
+    con_puts(CON_INFO, "=== RC2014 MIDI Synthesizer Status ===\n");
     
     // Show detected hardware
-    printf("Hardware Detection:\n");
+    con_puts(CON_INFO, "Hardware Detection:\n");
     if (available_chips & CHIP_YM2149) {
-        printf("  [Y] YM2149 PSG detected\n");
+        con_puts(CON_INFO, "  [Y] YM2149 PSG detected\n");
     } else {
-        printf("  [ ] YM2149 PSG not detected\n");
+        con_puts(CON_INFO, "  [ ] YM2149 PSG not detected\n");
     }
     if (available_chips & CHIP_OPL3) {
-        printf("  [Y] OPL3 FM detected\n");
+        con_puts(CON_INFO, "  [Y] OPL3 FM detected\n");
     } else {
-        printf("  [ ] OPL3 FM not detected\n");
+        con_puts(CON_INFO, "  [ ] OPL3 FM not detected\n");
     }
-    printf("\n");
+    con_puts(CON_INFO, "\n");
     
     if (current_chip) {
-        printf("Active Chip: %s\n", current_chip->name);
-        printf("Voice Count: %d\n", current_chip->voice_count);
+        con_begin(CON_INFO);
+        con_msg(MSG_ACTIVE_CHIP);
+        con_str(current_chip->name);
+        con_endl();
+        con_msg_dec(CON_INFO, MSG_VOICE_COUNT, current_chip->voice_count);
         
-        printf("Active Voices:\n");
+        con_puts(CON_INFO, "Active Voices:\n");
         uint8_t active_count = 0;
         for (uint8_t i = 0; i < current_chip->voice_count; i++) {
             if (current_chip->voices[i].active) {
-                printf("  Voice %d: Note %d, Vel %d, Ch %d\n",
-                       i, current_chip->voices[i].midi_note,
-                       current_chip->voices[i].velocity,
-                       current_chip->voices[i].channel);
+                con_begin(CON_INFO);
+                con_msg(MSG_VOICE);
+                con_dec(i);
+                con_msg(MSG_VOICE_NOTE);
+                con_dec(current_chip->voices[i].midi_note);
+                con_msg(MSG_VOICE_VEL);
+                con_dec(current_chip->voices[i].velocity);
+                con_msg(MSG_VOICE_CH);
+                con_dec(current_chip->voices[i].channel);
+                con_endl();
                 active_count++;
             }
         }
         if (active_count == 0) {
-            printf("  (No active voices)\n");
+            con_puts(CON_INFO, "  (No active voices)\n");
         }
     } else {
-        printf("No sound chip selected!\n");
+        con_puts(CON_ERROR, "No sound chip selected!\n");
     }
     
-    printf("Available CC Controls:\n");
-    for (uint8_t i = 0; i < 12; i++) {
-        printf("  CC#%d (%s): %d\n",
-               midi_cc_controls[i].cc_number,
-               midi_cc_controls[i].name,
-               midi_cc_controls[i].value);
+    con_begin(CON_INFO);
+    con_msg(MSG_MIDI_RX);
+    con_msg(midi_driver_irq_active() ? MSG_INTERRUPT : MSG_POLLED);
+    con_msg(MSG_OVERRUNS_RING);
+    con_dec(midi_rx_stats.ring_overruns);
+    con_msg(MSG_SIO);
+    con_dec(midi_rx_stats.sio_overruns);
+    con_endl();
+
+    con_begin(CON_INFO);
+    con_msg(MSG_SCHED_BUDGET);
+    con_dec(sched_stats.midi_budget);
+    con_msg(MSG_PEAK_BURST);
+    con_dec(sched_stats.peak_burst);
+    con_msg(MSG_BUDGET_HITS);
+    con_dec(sched_stats.budget_hits);
+    con_endl();
+
+    con_begin(CON_INFO);
+    if (timebase_source() == TIMEBASE_SOURCE_CTC) {
+        con_msg(MSG_TIMEBASE_CTC);
+        con_hex(timebase_ctc_port());
+        if (timebase_ctc_chained()) {
+            con_msg(MSG_CHAINED);
+        }
+    } else if (timebase_source() == TIMEBASE_SOURCE_HBIOS) {
+        con_msg(MSG_TIMEBASE_HBIOS);
+        con_dec(timebase_hbios_rate());
+        con_msg(MSG_HZ);
+    } else {
+        con_msg(MSG_TIMEBASE_SOFT);
+    }
+    con_msg(MSG_UPTIME);
+    con_dec(timebase_now());
+    con_msg(MSG_TICKS);
+    if (timebase_source() == TIMEBASE_SOURCE_CTC) {
+        con_msg(MSG_TB_OVERRUNS);
+        con_dec(timebase_stats.overruns);
+    }
+    con_endl();
+
+    con_begin(CON_INFO);
+    con_msg(MSG_CONSOLE_VERBOSITY);
+    con_dec(console_get_verbosity());
+    con_msg(MSG_DROPPED);
+    con_dec(console_stats.dropped);
+    con_msg(MSG_PEAK);
+    con_dec(console_stats.peak);
+    con_msg(MSG_BYTES);
+    con_endl();
+
+    con_begin(CON_INFO);
+    con_msg(MSG_LFO);
+    con_dec(lfo_stats.ticks);
+    con_msg(MSG_TICKS);
+    con_msg(MSG_COMMA);
+    con_dec(lfo_stats.late);
+    con_msg(MSG_LATE_WRITES);
+    con_dec(lfo_stats.last_writes);
+    con_msg(MSG_MAX);
+    con_dec(lfo_stats.max_writes);
+    con_endl();
+
+    con_begin(CON_INFO);
+    con_msg(MSG_VOICE_ALLOC);
+    con_str(valloc_policy_name(valloc_get_policy()));
+    con_msg(MSG_ALLOCS);
+    con_dec(valloc_stats.allocs);
+    con_msg(MSG_STEALS);
+    con_dec(valloc_stats.steals);
+    con_msg(MSG_RETRIGGERS);
+    con_dec(valloc_stats.retriggers);
+    con_endl();
+
+    con_begin(CON_INFO);
+    con_msg(MSG_SYSEX_DEVICE);
+    con_dec(sysex_get_device());
+    con_msg(MSG_DUMPS);
+    con_dec(sysex_stats.dumps);
+    con_msg(MSG_REQUESTS);
+    con_dec(sysex_stats.requests);
+    con_msg(MSG_IGNORED);
+    con_dec(sysex_stats.ignored);
+    con_msg(MSG_ERRORS);
+    con_dec(sysex_stats.errors);
+    con_endl();
+
+    con_begin(CON_INFO);
+    con_msg(MSG_MIDI_CLOCK);
+    con_msg(midi_clock.running ? MSG_RUNNING : MSG_HALTED);
+    con_msg(MSG_COMMA);
+    con_dec(midi_clock_bpm());
+    con_msg(MSG_BPM);
+    con_dec(midi_clock.beat);
+    con_msg(MSG_CLOCKS);
+    con_dec(midi_clock.clocks);
+    con_msg(MSG_REJECTED);
+    con_dec(midi_clock.rejected);
+    con_endl();
+
+    con_begin(CON_INFO);
+    con_msg(MSG_EVENTS_PENDING);
+    con_dec(evw_stats.pending);
+    con_msg(MSG_PEAK);
+    con_dec(evw_stats.peak);
+    con_msg(MSG_FIRED);
+    con_dec(evw_stats.fired);
+    con_msg(MSG_DROPPED);
+    con_dec(evw_stats.dropped);
+    con_endl();
+
+    con_puts(CON_INFO, "Available CC Controls:\n");
+    for (uint8_t i = 0; i < MIDI_CC_COUNT; i++) {
+        if (midi_cc_map[i].handler == MIDI_CC_NONE) continue;
+        con_begin(CON_INFO);
+        con_msg(MSG_CC);
+        con_dec(i);
+        con_msg(MSG_OPEN_PAREN);
+        con_str(midi_cc_handler_name(midi_cc_map[i].handler));
+        con_msg(MSG_CLOSE_PAREN);
+        con_msg(MSG_COLON);
+        con_dec(midi_cc_value[i]);
+        con_endl();
     }
-    printf("===================================\n");
+    con_puts(CON_INFO, "===================================\n");
 }
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "../../include/timebase.h"
+#include "../../include/hal.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+// CTC channel control word:
+//   bit 7 = 0  interrupt disabled (we poll the down-counter)
+//   bit 6      0 = timer, 1 = counter (clocked by CLK/TRG)
+//   bit 5 = 1  prescaler 256 (timer mode only)
+//   bit 4 = 1  rising edge (counter mode)
+//   bit 2 = 1  time constant follows
+//   bit 1 = 1  software reset
+//   bit 0 = 1  control word
+#define CTC_CTRL_TIMER_256   0x27
+#define CTC_CTRL_COUNTER     0x57
+#define CTC_CTRL_STOP        0x03   // Reset, no time constant: channel idle
+#define CTC_TC_256           0x00   // Time constant 0 = 256
+
+// Channel 0 reads while waiting for it to wrap when probing the chain;
+// enough for a wrap (65536 clocks) at any realistic cost per read
+#define TIMEBASE_CHAIN_PROBE_READS   4096
+
+// HBIOS timer reads while waiting for it to tick (a 60 Hz tick is
+// ~17 ms; a read is tens of microseconds)
+#define TIMEBASE_HBIOS_PROBE_READS   2048
+
+volatile uint16_t timebase_tick = 0;
+timebase_stats_t timebase_stats;
+
+static uint8_t tb_source = TIMEBASE_SOURCE_SOFT;
+static uint8_t tb_ctc_port = 0;
+static uint8_t tb_ctc_chained = 0;    // Channel 1 counts channel 0's wraps
+static uint16_t tb_ctc_mask = 0xFF;   // Counter period - 1, in CTC units
+static uint16_t tb_last_count = 0;    // Last counter value (CTC or HBIOS)
+static uint16_t tb_frac = 0;          // CTC units x 8 or HBIOS ms x rate, not yet a tick
+static uint16_t tb_units_per_tick = 230;  // CTC units x 8 per ~1 ms tick
+static uint8_t tb_calls = 0;          // Updates since the last tick (soft) or read (HBIOS)
+uint8_t tb_hbios_rate = 0;            // HBIOS timer ticks/s, 0 = none (set by the asm)
+
+// Returns 1 if a CTC channel at `port` is counting
+static uint8_t timebase_ctc_probe(uint8_t port) {
+    uint8_t first;
+    uint8_t changes = 0;
+
+    hal_outp(port, CTC_CTRL_TIMER_256);
+    hal_outp(port, CTC_TC_256);
+
+    // The counter moves once per 256 clocks; sample it a few times with
+    // a short pause (well under the 65536-clock period) in between
+    first = hal_inp(port);
+    for (uint8_t n = 0; n < 3; n++) {
+        for (volatile uint8_t i = 0; i < 40; i++) {
+        }
+        uint8_t now = hal_inp(port);
+        if (now != first) {
+            changes++;
+        }
+        first = now;
+    }
+    return changes >= 2;
+}
+
+// Returns 1 if channel 1, set up as a counter, counts channel 0's wraps
+// (ZC/TO0 linked to CLK/TRG1).  Otherwise channel 1 is left idle.
+static uint8_t timebase_ctc_probe_chain(uint8_t port) {
+    uint8_t wrapped = 0;
+    uint8_t first, last;
+
+    hal_outp(port + 1, CTC_CTRL_COUNTER);
+    hal_outp(port + 1, CTC_TC_256);
+    first = hal_inp(port + 1);
+    last = hal_inp(port);
+
+    for (uint16_t n = 0; n < TIMEBASE_CHAIN_PROBE_READS; n++) {
+        uint8_t now = hal_inp(port);
+        if (now > last) {
+            wrapped = 1;          // Channel 0 reloaded
+        }
+        last = now;
+        if (wrapped && hal_inp(port + 1) != first) {
+            return 1;
+        }
+    }
+    hal_outp(port + 1, CTC_CTRL_STOP);
+    return 0;
+}
+
+// Read the CTC down-counter, in units of 256 clocks.  Chained, channel 1
+// is the high byte.  It steps a few clocks after channel 0 reloads, and
+// channel 0 reads 0 for that whole unit, so a read that straddles the
+// step or lands on it is taken again.  lo - 1 makes 0 (reloaded, 256)
+// the top of the low byte.
+static uint16_t timebase_ctc_read(void) {
+    uint8_t hi, lo;
+
+    if (!tb_ctc_chained) {
+        return hal_inp(tb_ctc_port);
+    }
+    do {
+        hi = hal_inp(tb_ctc_port + 1);
+        lo = hal_inp(tb_ctc_port);
+    } while (lo == 0 || hal_inp(tb_ctc_port + 1) != hi);
+    return ((uint16_t)hi << 8) | (uint8_t)(lo - 1);
+}
+
+// Read the low word of the HBIOS timer tick count, setting tb_hbios_rate
+// (0 if the HBIOS has no timer call)
+#ifdef __Z88DK
+static uint16_t timebase_hbios_read(void) __naked {
+    __asm
+        push ix
+        push iy
+        ld bc, 0xF8D0       ; HBIOS SYSGET (B) TIMER (C)
+        rst 0x08            ; A = status, DE:HL = ticks, C = ticks/s
+        pop iy
+        pop ix
+        or a
+        jr z, tb_hbios_ok
+        ld c, 0             ; Not supported
+    tb_hbios_ok:
+        ld a, c
+        ld (_tb_hbios_rate), a
+        ret
+    __endasm;
+}
+#else
+static uint16_t timebase_hbios_read(void) {
+    return hal_hbios_timer(&tb_hbios_rate);
+}
+#endif
+
+// Returns 1 if the HBIOS timer call exists and its count moves
+static uint8_t timebase_hbios_probe(void) {
+    uint16_t first = timebase_hbios_read();
+
+    if (!tb_hbios_rate) {
+        return 0;
+    }
+    for (uint16_t n = 0; n < TIMEBASE_HBIOS_PROBE_READS; n++) {
+        if (timebase_hbios_read() != first) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Initialize the timebase.  ctc_port = 0 skips the CTC probe.
+void timebase_init(uint8_t ctc_port, uint16_t cpu_khz) {
+    if (cpu_khz == 0) {
+        cpu_khz = TIMEBASE_CPU_KHZ_DEFAULT;
+    }
+
+    timebase_tick = 0;
+    tb_frac = 0;
+    tb_calls = 0;
+    timebase_stats.overruns = 0;
+
+    // One tick = cpu_khz clocks = cpu_khz / 256 CTC units, kept x 8
+    tb_units_per_tick = cpu_khz / 32;
+
+    tb_source = TIMEBASE_SOURCE_SOFT;
+    tb_ctc_port = ctc_port;
+    tb_ctc_chained = 0;
+    tb_ctc_mask = 0xFF;
+    if (ctc_port && timebase_ctc_probe(ctc_port)) {
+        tb_source = TIMEBASE_SOURCE_CTC;
+        if (timebase_ctc_probe_chain(ctc_port)) {
+            tb_ctc_chained = 1;
+            tb_ctc_mask = 0xFFFF;
+        }
+        tb_last_count = timebase_ctc_read();
+    } else if (timebase_hbios_probe()) {
+        tb_source = TIMEBASE_SOURCE_HBIOS;
+        tb_last_count = timebase_hbios_read();
+    }
+}
+
+// Add elapsed CTC units (at most 0x0FFF, so tb_frac stays in 16 bits)
+static void timebase_add_units(uint16_t units) {
+    tb_frac += units << 3;
+    while (tb_frac >= tb_units_per_tick) {
+        tb_frac -= tb_units_per_tick;
+        timebase_tick++;
+    }
+}
+
+// Advance the tick counter.  Called on every scheduler pass.
+// The CTC counter must be read at least once per period (65536 clocks,
+// or 2^24 chained) to keep exact time; reads more than half a period
+// apart are counted as overruns.
+void timebase_update(void) {
+    if (tb_source == TIMEBASE_SOURCE_CTC) {
+        uint16_t now = timebase_ctc_read();
+        uint16_t elapsed = (tb_last_count - now) & tb_ctc_mask;  // Down-counter
+
+        tb_last_count = now;
+        if (elapsed > (tb_ctc_mask >> 1)) {
+            timebase_stats.overruns++;
+        }
+        while (elapsed > 0x0FFF) {        // Only after a long stall
+            timebase_add_units(0x0FFF);
+            elapsed -= 0x0FFF;
+        }
+        timebase_add_units(elapsed);
+    } else if (tb_source == TIMEBASE_SOURCE_HBIOS) {
+        if (++tb_calls < TIMEBASE_HBIOS_POLL_CALLS) {
+            return;
+        }
+        tb_calls = 0;
+
+        uint16_t now = timebase_hbios_read();
+        uint16_t elapsed = now - tb_last_count;
+
+        // 1000 ms per `rate` timer ticks, the remainder carried
+        tb_last_count = now;
+        while (elapsed) {                 // Normally 0 or 1
+            elapsed--;
+            tb_frac += 1000;
+            timebase_tick += tb_frac / tb_hbios_rate;
+            tb_frac %= tb_hbios_rate;
+        }
+    } else if (++tb_calls >= TIMEBASE_SOFT_CALLS_PER_TICK) {
+        tb_calls = 0;
+        timebase_tick++;
+    }
+}
+
+// Active tick source (TIMEBASE_SOURCE_*)
+uint8_t timebase_source(void) {
+    return tb_source;
+}
+
+// CTC port in use (meaningful only with TIMEBASE_SOURCE_CTC)
+uint8_t timebase_ctc_port(void) {
+    return tb_ctc_port;
+}
+
+// 1 if CTC channel 1 extends channel 0 (TIMEBASE_SOURCE_CTC only)
+uint8_t timebase_ctc_chained(void) {
+    return tb_ctc_chained;
+}
+
+// HBIOS timer rate in Hz (meaningful only with TIMEBASE_SOURCE_HBIOS)
+uint8_t timebase_hbios_rate(void) {
+    return tb_hbios_rate;
+}
@@ -0,0 +1,284 @@
+#include "../../include/voice_alloc.h"
+#include "../../include/synthesizer.h"
+#include "../../include/cpmfile.h"
+#include <stdint.h>
+#include <string.h>
+
+valloc_stats_t valloc_stats;
+
+static uint8_t valloc_policy = VALLOC_OLDEST;
+static uint8_t valloc_reserve[16];           // Voices reserved per channel
+static uint8_t valloc_held[16];              // Voices each channel holds
+
+// First voice of each group; group 0 always starts at voice 0
+static uint8_t valloc_group_start[VALLOC_GROUPS] = {
+    0, VALLOC_NONE, VALLOC_NONE, VALLOC_NONE
+};
+
+// Voice table, one byte per voice per field
+static uint8_t valloc_next[VALLOC_MAX_VOICES];   // Free list / LRU: newer voice
+static uint8_t valloc_prev[VALLOC_MAX_VOICES];   // LRU: older voice
+static uint8_t valloc_chan[VALLOC_MAX_VOICES];   // Owner channel, VALLOC_NONE = free
+static uint8_t valloc_level[VALLOC_MAX_VOICES];  // Note-on velocity
+static uint8_t valloc_group[VALLOC_MAX_VOICES];  // Group the voice is in
+
+// Per group
+static uint8_t valloc_free[VALLOC_GROUPS];       // Free list (LIFO)
+static uint8_t valloc_oldest[VALLOC_GROUPS];     // LRU ring ends
+static uint8_t valloc_newest[VALLOC_GROUPS];
+static uint8_t valloc_size[VALLOC_GROUPS];       // Voices in the group
+
+static uint8_t valloc_count = 0;                 // Voices managed
+static uint8_t valloc_stale = 1;                 // Rebuild before next use
+
+static const char* const valloc_policy_names[VALLOC_POLICY_COUNT] = {
+    "oldest", "quietest", "retrigger", "reserve"
+};
+
+// Append a voice to the newest end of its group's ring
+static void valloc_lru_append(uint8_t voice) {
+    uint8_t g = valloc_group[voice];
+
+    valloc_prev[voice] = valloc_newest[g];
+    valloc_next[voice] = VALLOC_NONE;
+    if (valloc_newest[g] != VALLOC_NONE) {
+        valloc_next[valloc_newest[g]] = voice;
+    } else {
+        valloc_oldest[g] = voice;
+    }
+    valloc_newest[g] = voice;
+}
+
+static void valloc_lru_unlink(uint8_t voice) {
+    uint8_t g = valloc_group[voice];
+    uint8_t prev = valloc_prev[voice];
+    uint8_t next = valloc_next[voice];
+
+    if (prev != VALLOC_NONE) valloc_next[prev] = next;
+    else valloc_oldest[g] = next;
+    if (next != VALLOC_NONE) valloc_prev[next] = prev;
+    else valloc_newest[g] = prev;
+}
+
+// Rebuild the lists from the current chip's voices.  Voices already
+// sounding go on their ring in index order; the rest are free, lowest
+// number on top.
+static void valloc_rebuild(void) {
+    voice_t* voices = current_chip->voices;
+    uint8_t g = 0;
+
+    valloc_count = current_chip->voice_count;
+    if (valloc_count > VALLOC_MAX_VOICES) valloc_count = VALLOC_MAX_VOICES;
+    memset(valloc_free, VALLOC_NONE, sizeof(valloc_free));
+    memset(valloc_oldest, VALLOC_NONE, sizeof(valloc_oldest));
+    memset(valloc_newest, VALLOC_NONE, sizeof(valloc_newest));
+    memset(valloc_size, 0, sizeof(valloc_size));
+    memset(valloc_held, 0, sizeof(valloc_held));
+
+    for (uint8_t i = 0; i < valloc_count; i++) {
+        while (g + 1 < VALLOC_GROUPS && i >= valloc_group_start[g + 1]) g++;
+        valloc_group[i] = g;
+        valloc_size[g]++;
+    }
+    for (uint8_t i = valloc_count; i-- > 0; ) {
+        g = valloc_group[i];
+        if (voices[i].active) {
+            uint8_t channel = voices[i].channel & 0x0F;
+            valloc_chan[i] = channel;
+            valloc_level[i] = voices[i].velocity;
+            valloc_held[channel]++;
+            valloc_prev[i] = VALLOC_NONE;
+            valloc_next[i] = valloc_oldest[g];
+            if (valloc_oldest[g] != VALLOC_NONE) {
+                valloc_prev[valloc_oldest[g]] = i;
+            } else {
+                valloc_newest[g] = i;
+            }
+            valloc_oldest[g] = i;
+        } else {
+            valloc_chan[i] = VALLOC_NONE;
+            valloc_next[i] = valloc_free[g];
+            valloc_free[g] = i;
+        }
+    }
+    valloc_stale = 0;
+}
+
+// Forget the lists; they are rebuilt from the chip on next use.  Called
+// whenever voices are silenced behind the allocator's back (chip switch,
+// panic, init).
+void valloc_reset(void) {
+    valloc_stale = 1;
+}
+
+// Pick a sounding voice in group `g` to take over for `channel`
+static uint8_t valloc_victim(uint8_t g, uint8_t channel) {
+    uint8_t v = valloc_oldest[g];
+
+    if (v == VALLOC_NONE) return v;
+    if (valloc_policy == VALLOC_QUIETEST) {
+        uint8_t best = v;
+        for (v = valloc_next[v]; v != VALLOC_NONE; v = valloc_next[v]) {
+            if (valloc_level[v] < valloc_level[best]) best = v;
+        }
+        return best;
+    }
+    if (valloc_policy == VALLOC_RESERVE) {
+        for (; v != VALLOC_NONE; v = valloc_next[v]) {
+            uint8_t owner = valloc_chan[v];
+            if (owner == channel || valloc_held[owner] > valloc_reserve[owner]) {
+                return v;
+            }
+        }
+        return valloc_oldest[g];  // Every voice is reserved: oldest after all
+    }
+    return v;
+}
+
+// Take a voice for a new note from the channel's group: a free one if
+// there is one, otherwise one the policy gives up.  The voice is marked
+// in use for `channel`.
+uint8_t allocate_voice(uint8_t note, uint8_t velocity, uint8_t channel) {
+    if (!current_chip || current_chip->voice_count == 0) return VALLOC_NONE;
+    if (valloc_stale) valloc_rebuild();
+
+    channel &= 0x0F;
+    uint8_t g = midi_channels[channel].group;
+    if (g >= VALLOC_GROUPS || valloc_size[g] == 0) g = 0;  // Not on this chip
+
+    uint8_t voice = VALLOC_NONE;
+    if (valloc_policy == VALLOC_RETRIGGER) {
+        voice = find_voice_by_note(note, channel);
+        if (voice < valloc_count && valloc_chan[voice] != VALLOC_NONE) {
+            valloc_stats.retriggers++;
+            valloc_lru_unlink(voice);
+        } else {
+            voice = VALLOC_NONE;
+        }
+    }
+    if (voice == VALLOC_NONE) {
+        voice = valloc_free[g];
+        if (voice != VALLOC_NONE) {
+            valloc_free[g] = valloc_next[voice];
+            valloc_stats.allocs++;
+        } else {
+            voice = valloc_victim(g, channel);
+            if (voice == VALLOC_NONE) return VALLOC_NONE;
+            valloc_stats.steals++;
+            valloc_lru_unlink(voice);
+        }
+    }
+
+    if (valloc_chan[voice] != VALLOC_NONE) {
+        valloc_held[valloc_chan[voice]]--;
+    }
+    valloc_chan[voice] = channel;
+    valloc_held[channel]++;
+    valloc_level[voice] = velocity;
+    valloc_lru_append(voice);
+    return voice;
+}
+
+// Return a released voice to its group's free list
+void valloc_release(uint8_t voice) {
+    if (valloc_stale || voice >= valloc_count) return;
+    if (valloc_chan[voice] == VALLOC_NONE) return;
+
+    uint8_t g = valloc_group[voice];
+    valloc_held[valloc_chan[voice]]--;
+    valloc_chan[voice] = VALLOC_NONE;
+    valloc_lru_unlink(voice);
+    valloc_next[voice] = valloc_free[g];
+    valloc_free[g] = voice;
+}
+
+void valloc_set_policy(uint8_t policy) {
+    if (policy < VALLOC_POLICY_COUNT) valloc_policy = policy;
+}
+
+uint8_t valloc_get_policy(void) {
+    return valloc_policy;
+}
+
+const char* valloc_policy_name(uint8_t policy) {
+    if (policy >= VALLOC_POLICY_COUNT) policy = VALLOC_OLDEST;
+    return valloc_policy_names[policy];
+}
+
+// Reserve voices for a channel (VALLOC_RESERVE policy)
+void valloc_set_reserve(uint8_t channel, uint8_t voices) {
+    valloc_reserve[channel & 0x0F] = voices;
+}
+
+// Start group 1-3 at `first_voice`; takes effect from the next note
+void valloc_set_group(uint8_t group, uint8_t first_voice) {
+    if (group == 0 || group >= VALLOC_GROUPS) return;
+    valloc_group_start[group] = first_voice;
+    valloc_stale = 1;
+}
+
+// One voices.cfg line (keys in voice_alloc.h)
+static void valloc_config_line(const char* key, const char* value) {
+    if (strcmp(key, "policy") == 0) {
+        for (uint8_t p = 0; p < VALLOC_POLICY_COUNT; p++) {
+            if (strcmp(value, valloc_policy_names[p]) == 0) {
+                valloc_policy = p;
+                break;
+            }
+        }
+    } else if (key[0] == 'c' && key[1] == 'h') {
+        uint16_t channel = cpmf_number(key + 2);
+        if (channel >= 1 && channel <= 16) {
+            valloc_reserve[channel - 1] = (uint8_t)cpmf_number(value);
+        }
+    } else if (strncmp(key, "group", 5) == 0) {
+        valloc_set_group((uint8_t)cpmf_number(key + 5), (uint8_t)cpmf_number(value));
+    } else if (strncmp(key, "part", 4) == 0) {
+        uint16_t channel = cpmf_number(key + 4);
+        if (channel >= 1 && channel <= 16) {
+            midi_channel_state_t* ch = &midi_channels[channel - 1];
+            const char* chip = strchr(value, ',');
+            ch->group = (uint8_t)cpmf_number(value);
+            ch->chip = CHIP_NONE;
+            if (chip) {
+                if (strcmp(chip + 1, "ym2149") == 0) ch->chip = CHIP_YM2149;
+                else if (strcmp(chip + 1, "opl3") == 0) ch->chip = CHIP_OPL3;
+            }
+        }
+    }
+}
+
+// Load the policy, reservations, groups and part routing.  Keys missing
+// from the file take their defaults (oldest, nothing reserved, one group,
+// every part on it); without a file the current settings are kept.
+int valloc_config_load(const char* filename) {
+    uint8_t policy = valloc_policy;
+    uint8_t reserve[16];
+    uint8_t group_start[VALLOC_GROUPS];
+    uint8_t routes[16][2];
+
+    memcpy(reserve, valloc_reserve, sizeof(reserve));
+    memcpy(group_start, valloc_group_start, sizeof(group_start));
+    for (uint8_t i = 0; i < 16; i++) {
+        routes[i][0] = midi_channels[i].group;
+        routes[i][1] = midi_channels[i].chip;
+        midi_channels[i].group = 0;
+        midi_channels[i].chip = CHIP_NONE;
+    }
+    valloc_policy = VALLOC_OLDEST;
+    memset(valloc_reserve, 0, sizeof(valloc_reserve));
+    memset(valloc_group_start + 1, VALLOC_NONE, VALLOC_GROUPS - 1);
+    valloc_stale = 1;
+
+    if (!cpmf_config(filename, valloc_config_line)) {
+        valloc_policy = policy;
+        memcpy(valloc_reserve, reserve, sizeof(reserve));
+        memcpy(valloc_group_start, group_start, sizeof(group_start));
+        for (uint8_t i = 0; i < 16; i++) {
+            midi_channels[i].group = routes[i][0];
+            midi_channels[i].chip = routes[i][1];
+        }
+        return 0;
+    }
+    return 1;
+}
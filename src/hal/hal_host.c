@@ -0,0 +1,135 @@
+#include "../../include/hal.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Host implementation of the HAL: a fake RC2014 bus.  Never linked into
+// the Z80 build (the Makefile only adds it to the host sources).
+
+// Bus
+static hal_bus_write_t hal_bus_log[HAL_BUS_LOG_SIZE];
+static uint32_t hal_bus_writes = 0;
+static const hal_bus_device_t* hal_bus_device = 0;
+
+// Console capture
+static char hal_console_buf[HAL_CONSOLE_SIZE];
+static uint16_t hal_console_len = 0;
+static uint8_t hal_console_echo_on = 0;
+
+// Scripted keyboard
+static char hal_keys[64];
+static uint8_t hal_keys_head = 0;
+static uint8_t hal_keys_tail = 0;
+
+// HBIOS system timer
+static uint8_t hal_hbios_rate = 0;
+static uint16_t hal_hbios_calls_per_tick = 0;
+static uint16_t hal_hbios_calls = 0;
+static uint16_t hal_hbios_ticks = 0;
+
+// Record the write, then pass it to the device model
+void hal_outp(uint8_t port, uint8_t value) {
+    if (hal_bus_writes < HAL_BUS_LOG_SIZE) {
+        hal_bus_log[hal_bus_writes].port = port;
+        hal_bus_log[hal_bus_writes].value = value;
+    }
+    hal_bus_writes++;
+    if (hal_bus_device && hal_bus_device->write) {
+        hal_bus_device->write(port, value);
+    }
+}
+
+// Reads come from the device model; an empty bus floats high
+uint8_t hal_inp(uint8_t port) {
+    if (hal_bus_device && hal_bus_device->read) {
+        return hal_bus_device->read(port);
+    }
+    return 0xFF;
+}
+
+void hal_bus_reset(void) {
+    hal_bus_device = 0;
+    hal_bus_clear_log();
+    hal_hbios_timer_set(0, 0);
+}
+
+void hal_bus_attach(const hal_bus_device_t* device) {
+    hal_bus_device = device;
+}
+
+uint32_t hal_bus_write_count(void) {
+    return hal_bus_writes;
+}
+
+const hal_bus_write_t* hal_bus_write_at(uint16_t index) {
+    if (index >= hal_bus_writes || index >= HAL_BUS_LOG_SIZE) {
+        return 0;
+    }
+    return &hal_bus_log[index];
+}
+
+void hal_bus_clear_log(void) {
+    hal_bus_writes = 0;
+}
+
+// Console output is captured (the last byte is kept for the NUL)
+void hal_putc(char c) {
+    if (hal_console_len < HAL_CONSOLE_SIZE - 1) {
+        hal_console_buf[hal_console_len++] = c;
+        hal_console_buf[hal_console_len] = '\0';
+    }
+    if (hal_console_echo_on) {
+        putchar(c);
+    }
+}
+
+void hal_console_clear(void) {
+    hal_console_len = 0;
+    hal_console_buf[0] = '\0';
+}
+
+const char* hal_console_text(void) {
+    return hal_console_buf;
+}
+
+void hal_console_echo(uint8_t on) {
+    hal_console_echo_on = on;
+}
+
+// Keyboard input comes from hal_keys_push()
+void hal_keys_push(const char* keys) {
+    while (*keys) {
+        uint8_t next = (hal_keys_head + 1) & (sizeof(hal_keys) - 1);
+        if (next == hal_keys_tail) return;  // Full
+        hal_keys[hal_keys_head] = *keys++;
+        hal_keys_head = next;
+    }
+}
+
+int hal_kbhit(void) {
+    return hal_keys_head != hal_keys_tail;
+}
+
+char hal_getch(void) {
+    char c;
+
+    if (hal_keys_head == hal_keys_tail) return 0;
+    c = hal_keys[hal_keys_tail];
+    hal_keys_tail = (hal_keys_tail + 1) & (sizeof(hal_keys) - 1);
+    return c;
+}
+
+uint16_t hal_hbios_timer(uint8_t* rate) {
+    *rate = hal_hbios_rate;
+    if (hal_hbios_calls_per_tick && ++hal_hbios_calls >= hal_hbios_calls_per_tick) {
+        hal_hbios_calls = 0;
+        hal_hbios_ticks++;
+    }
+    return hal_hbios_ticks;
+}
+
+void hal_hbios_timer_set(uint8_t rate, uint16_t calls_per_tick) {
+    hal_hbios_rate = rate;
+    hal_hbios_calls_per_tick = calls_per_tick;
+    hal_hbios_calls = 0;
+}
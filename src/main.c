@@ -3,53 +3,74 @@
 #include "../include/chip_manager.h"
 #include "../include/midi_driver.h"
 #include "../include/ym2149.h"
+#include "../include/opl3.h"
 #include "../include/port_config.h"
-#include <stdio.h>
+#include "../include/scheduler.h"
+#include "../include/console.h"
+#include "../include/messages.h"
+#include "../include/smf_player.h"
+#include "../include/event_wheel.h"
+#include "../include/sysex.h"
 #include <stdlib.h>
-#include <conio.h>
 
 // Function prototypes
 void print_help(void);
 void print_chip_status(void);
+void print_ym2149_cards(void);
+void print_ports(void);
 void process_command(char cmd);
+void handle_key(char key);
 void run_audio_test(void);
+void play_file(const char* filename);
 
-// Main function
-int main(void) {
-    printf("\n=== RC2014 Multi-Chip MIDI Synthesizer ===\n");
-    printf("Version 1.0 - YM2149 + OPL3 Ready\n\n");
+// Main function ("MIDISYN SONG.MID" starts playing the file)
+int main(int argc, char** argv) {
+    console_init();
+    con_puts(CON_INFO, "\n=== RC2014 Multi-Chip MIDI Synthesizer ===\n");
+    con_puts(CON_INFO, "Version 1.0 - YM2149 + OPL3 Ready\n\n");
 
-    // Initialize synthesizer system
+    // Initialize scheduler and synthesizer system
+    scheduler_init();
     synthesizer_init();
 
-    printf("\nReady. Type 'h' for help.\n\n");
+    con_puts(CON_INFO, "\nReady. Type 'h' for help.\n\n");
+    console_flush();
 
-    // Main loop: process MIDI and check for keyboard commands
-    while (1) {
-        // Process any pending MIDI input (BIOS mode)
-        midi_driver_process_input();
+    // Main loop: drain MIDI in bursts, poll the console at a fixed interval.
+    // Queued console output is only written when MIDI input is idle.
+    scheduler_add_idle_task(console_service);
+    scheduler_add_idle_task(synthesizer_tick);
+    scheduler_add_idle_task(smf_player_prefetch);
+    scheduler_add_pass_task(smf_player_service);
+    scheduler_add_pass_task(evw_service);
+    scheduler_add_pass_task(sysex_service);
+    scheduler_set_key_handler(handle_key);
+    if (argc > 1) {
+        play_file(argv[1]);
+    }
+    scheduler_run();
 
-        // Check for keyboard command (non-blocking)
-        if (kbhit()) {
-            char cmd = getch();
-            if (cmd == '\n' || cmd == '\r') {
-                continue;
-            }
-            // In keyboard MIDI mode, route keys to MIDI handler
-            // unless it's the escape key (0x1B) to exit keyboard mode
-            if (midi_get_mode() == MIDI_MODE_KEYBOARD) {
-                if (cmd == 0x1B || cmd == '`') {
-                    // ESC or backtick exits keyboard MIDI mode
-                    midi_set_mode(MIDI_MODE_NONE);
-                    synthesizer_panic();
-                    printf("\nKeyboard MIDI mode off.\n");
-                } else {
-                    midi_keyboard_process_key(cmd);
-                }
-            } else {
-                process_command(cmd);
-            }
+    return 0;
+}
+
+// Handle a console key press
+void handle_key(char key) {
+    if (key == '\n' || key == '\r') {
+        return;
+    }
+    // In keyboard MIDI mode, route keys to MIDI handler
+    // unless it's the escape key (0x1B) to exit keyboard mode
+    if (midi_get_mode() == MIDI_MODE_KEYBOARD) {
+        if (key == 0x1B || key == '`') {
+            // ESC or backtick exits keyboard MIDI mode
+            midi_set_mode(MIDI_MODE_NONE);
+            synthesizer_panic();
+            con_puts(CON_INFO, "\nKeyboard MIDI mode off.\n");
+        } else {
+            midi_keyboard_process_key(key);
         }
+    } else {
+        process_command(key);
     }
 }
 
@@ -72,16 +93,21 @@ void process_command(char cmd) {
             break;
 
         case '1':
-            printf("Switching to YM2149...\n");
+            con_puts(CON_INFO, "Switching to YM2149...\n");
             if (chip_manager_set_chip(CHIP_YM2149)) {
-                printf("YM2149 selected successfully.\n");
+                con_puts(CON_INFO, "YM2149 selected successfully.\n");
             } else {
-                printf("Failed to select YM2149.\n");
+                con_puts(CON_ERROR, "Failed to select YM2149.\n");
             }
             break;
 
         case '2':
-            printf("OPL3 not yet implemented.\n");
+            con_puts(CON_INFO, "Switching to OPL3...\n");
+            if (chip_manager_set_chip(CHIP_OPL3)) {
+                con_puts(CON_INFO, "OPL3 selected successfully.\n");
+            } else {
+                con_puts(CON_ERROR, "Failed to select OPL3.\n");
+            }
             break;
 
         case 't':
@@ -91,20 +117,46 @@ void process_command(char cmd) {
 
         case 'i':
         case 'I':
-            printf("Current I/O ports:\n");
-            printf("  Register port: 0x%02X\n", ym2149_ports.addr_port);
-            printf("  Data port: 0x%02X\n", ym2149_ports.data_port);
+            con_puts(CON_INFO, "Current I/O ports:\n");
+            print_ports();
+            print_ym2149_cards();
+            con_begin(CON_INFO);
+            con_msg(MSG_OPL3_PORT);
+            con_hex(ym2149_ports.opl3_port);
+            con_msg(MSG_OPEN_PAREN);
+            con_msg((available_chips & CHIP_OPL3) ? MSG_DETECTED : MSG_NOT_DETECTED);
+            con_msg(MSG_CLOSE_PAREN);
+            con_endl();
             break;
 
         case 'r':
         case 'R':
-            printf("Reloading port configuration...\n");
+            con_puts(CON_INFO, "Reloading port configuration...\n");
             if (port_config_load_from_file("ports.conf")) {
-                printf("Configuration loaded successfully.\n");
-                printf("  Register port: 0x%02X\n", ym2149_ports.addr_port);
-                printf("  Data port: 0x%02X\n", ym2149_ports.data_port);
+                con_puts(CON_INFO, "Configuration loaded successfully.\n");
+                print_ports();
+                // Re-probe so added or removed cards take effect
+                chip_manager_detect_chips();
+                if (current_chip) {
+                    chip_manager_set_chip(current_chip->chip_id);
+                }
+                print_ym2149_cards();
             } else {
-                printf("Failed to load ports.conf - using defaults.\n");
+                con_puts(CON_ERROR, "Failed to load ports.conf - using defaults.\n");
+            }
+            midi_cc_map_defaults();
+            if (midi_cc_map_load(MIDI_CC_MAP_FILE)) {
+                con_puts(CON_INFO, "CC map loaded from " MIDI_CC_MAP_FILE ".\n");
+            }
+            if (valloc_config_load(VALLOC_CONFIG_FILE)) {
+                con_puts(CON_INFO, "Voice allocation loaded from " VALLOC_CONFIG_FILE ".\n");
+            }
+            if (ym2149_bank_load(YM2149_BANK_FILE) == YM2149_BANK_OK) {
+                con_puts(CON_INFO, "Patch bank loaded from " YM2149_BANK_FILE ".\n");
+            }
+            if (current_chip && current_chip->chip_id == CHIP_YM2149) {
+                ym2149_set_preset(0);
+                ym2149_patch_refresh();
             }
             break;
 
@@ -112,8 +164,8 @@ void process_command(char cmd) {
         case 'K':
             // Enter keyboard MIDI mode
             midi_set_mode(MIDI_MODE_KEYBOARD);
-            printf("Keyboard MIDI mode on.\n");
-            printf("Keys: z-m/q-u=notes [/]=octave -/+=vel space=off ESC=exit\n");
+            con_puts(CON_INFO, "Keyboard MIDI mode on.\n");
+            con_puts(CON_INFO, "Keys: z-m/q-u=notes [/]=octave -/+=vel space=off ESC=exit\n");
             break;
 
         case 'm':
@@ -122,86 +174,240 @@ void process_command(char cmd) {
             if (midi_get_mode() == MIDI_MODE_BIOS) {
                 midi_set_mode(MIDI_MODE_NONE);
                 synthesizer_panic();
-                printf("BIOS MIDI mode off.\n");
+                con_puts(CON_INFO, "BIOS MIDI mode off.\n");
             } else {
                 midi_set_mode(MIDI_MODE_BIOS);
-                printf("BIOS MIDI mode on (AUX serial port).\n");
+                con_puts(CON_INFO, "BIOS MIDI mode on (AUX serial port).\n");
+            }
+            break;
+
+        case 'f':
+        case 'F':
+            // Toggle playback of the last file (SMF_DEFAULT_FILE at first)
+            if (smf_player_active()) {
+                smf_player_stop();
+                con_begin(CON_INFO);
+                con_msg(MSG_STOPPED);
+                con_str(smf_player_file());
+                con_char('.');
+                con_endl();
+            } else {
+                play_file(smf_player_file()[0] ? smf_player_file() : SMF_DEFAULT_FILE);
             }
             break;
 
+        case 'v':
+        case 'V':
+            // Cycle console verbosity: errors, info, MIDI log, debug
+            console_set_verbosity((console_get_verbosity() + 1) % (CON_DEBUG + 1));
+            con_msg_dec(CON_ERROR, MSG_VERBOSITY, console_get_verbosity());
+            break;
+
+        case 'a':
+        case 'A':
+            // Cycle the voice steal policy
+            valloc_set_policy((valloc_get_policy() + 1) % VALLOC_POLICY_COUNT);
+            con_begin(CON_INFO);
+            con_msg(MSG_VOICE_ALLOC);
+            con_str(valloc_policy_name(valloc_get_policy()));
+            con_endl();
+            break;
+
         case '0':
         case 'q':
         case 'Q':
-            printf("Exiting synthesizer...\n");
+            con_puts(CON_INFO, "Exiting synthesizer...\n");
             synthesizer_panic();
+            midi_driver_shutdown();  // Restore HBIOS interrupt vector
+            console_flush();
             exit(0);
             break;
 
         default:
-            printf("Unknown command: '%c'. Type 'h' for help.\n", cmd);
+            con_begin(CON_ERROR);
+            con_msg(MSG_UNKNOWN_COMMAND);
+            con_char(cmd);
+            con_msg(MSG_UNKNOWN_COMMAND_END);
+            con_endl();
             break;
     }
 }
 
 // Print help information
 void print_help(void) {
-    printf("\n=== RC2014 MIDI Synthesizer Commands ===\n");
-    printf("h/H - Show this help\n");
-    printf("s/S - Show system status\n");
-    printf("i/I - Show current I/O ports\n");
-    printf("r/R - Reload port configuration\n");
-    printf("t/T - Test audio output (YM2149 only)\n");
-    printf("k/K - Keyboard MIDI mode (ESC to exit)\n");
-    printf("m/M - Toggle BIOS MIDI mode (AUX serial)\n");
-    printf("p/P - Panic (all notes off)\n");
-    printf("1   - Select YM2149 sound chip\n");
-    printf("2   - Select OPL3 sound chip (not implemented)\n");
-    printf("q/Q - Quit program\n");
-    printf("\nKeyboard MIDI keys (in 'k' mode):\n");
-    printf("  z s x d c v g b h n j m = C..B (lower oct)\n");
-    printf("  q 2 w 3 e r 5 f 6 y 7 u = C..B (upper oct)\n");
-    printf("  [ ] = octave down/up, -/+ = velocity\n");
-    printf("  space = note off, ESC/` = exit mode\n");
-    printf("===================================\n");
+    con_puts(CON_INFO, con_messages[MSG_HELP]);
+}
+
+// Print the first card's I/O ports
+void print_ports(void) {
+    con_begin(CON_INFO);
+    con_msg(MSG_REGISTER_PORT);
+    con_hex(ym2149_ports.addr_port);
+    con_endl();
+    con_begin(CON_INFO);
+    con_msg(MSG_DATA_PORT);
+    con_hex(ym2149_ports.data_port);
+    con_endl();
+}
+
+// Start playing a Standard MIDI File
+void play_file(const char* filename) {
+    uint8_t result = smf_player_open(filename);
+    if (result == SMF_OK) {
+        con_begin(CON_INFO);
+        con_msg(MSG_PLAYING);
+        con_str(filename);
+        con_msg(MSG_PRESS_F_TO_STOP);
+    } else {
+        con_begin(CON_ERROR);
+        con_msg(MSG_CANNOT_PLAY);
+        con_str(filename);
+        con_msg(MSG_COLON);
+        con_str(smf_player_error_name(result));
+    }
+    con_endl();
 }
 
 // Print chip status
 void print_chip_status(void) {
-    printf("\n");
+    con_puts(CON_INFO, "\n");
     synthesizer_print_status();
+
+    if (smf_player_active()) {
+        con_begin(CON_INFO);
+        con_msg(MSG_PLAYING);
+        con_str(smf_player_file());
+        con_msg(MSG_COLON);
+        con_dec(smf_stats.events);
+        con_msg(MSG_EVENTS);
+        con_dec(smf_stats.prefetches);
+        con_msg(MSG_READ_AHEAD);
+        con_dec(smf_stats.underruns);
+        con_msg(MSG_DISK_STALLS);
+        con_msg(MSG_LATE);
+        con_dec(smf_stats.max_late);
+        con_msg(MSG_TICKS);
+        con_endl();
+    }
+
+    if (current_chip && current_chip->chip_id == CHIP_YM2149) {
+        const ym2149_timing_profile_t* timing = &ym2149_timing_profiles[ym2149_timing_profile()];
+
+        con_begin(CON_INFO);
+        con_msg(MSG_YM_BUS);
+        con_dec(ym2149_reg_stats.writes);
+        con_msg(MSG_WRITES);
+        con_dec(ym2149_reg_stats.skipped);
+        con_msg(MSG_SKIPPED);
+        con_dec(ym2149_reg_stats.shadow_hits);
+        con_msg(MSG_SHADOW_READS);
+        con_dec(ym2149_reg_stats.latch_hits);
+        con_msg(MSG_LATCH_HITS);
+        con_endl();
+
+        con_begin(CON_INFO);
+        con_msg(MSG_YM_TIMING);
+        con_str(timing->name);
+        con_msg(MSG_PROFILE);
+        con_dec(timing->delay_loops);
+        con_msg(MSG_DELAY_LOOPS);
+        con_msg(ym2149_timing_calibrated() ? MSG_CALIBRATED : MSG_FIXED);
+        con_msg(MSG_CLOSE_PAREN);
+        con_endl();
+    }
+    if (current_chip && current_chip->chip_id == CHIP_OPL3) {
+        con_begin(CON_INFO);
+        con_msg(MSG_OPL3_BUS);
+        con_dec(opl3_reg_stats.writes);
+        con_msg(MSG_WRITES);
+        con_dec(opl3_reg_stats.skipped);
+        con_msg(MSG_SKIPPED);
+        con_dec(opl3_pace_loops);
+        con_msg(MSG_PACING_LOOPS);
+        con_endl();
+    }
 }
 
-// Run audio test sequence
+// List the detected YM2149 cards and the voices they provide
+void print_ym2149_cards(void) {
+    con_begin(CON_INFO);
+    con_msg(MSG_YM_CARDS);
+    con_dec(ym2149_card_count);
+    con_msg(MSG_OPEN_PAREN);
+    con_dec(ym2149_card_count * 3);
+    con_msg(MSG_VOICES_SUFFIX);
+    con_endl();
+    for (uint8_t i = 0; i < ym2149_card_count; i++) {
+        con_begin(CON_INFO);
+        con_msg(MSG_CARD);
+        con_dec(i + 1);
+        con_msg(MSG_COLON);
+        con_msg(MSG_HEX_PREFIX);
+        con_hex(ym2149_cards[i].addr_port);
+        con_char('/');
+        con_msg(MSG_HEX_PREFIX);
+        con_hex(ym2149_cards[i].data_port);
+        con_msg(MSG_VOICES);
+        con_dec(i * 3);
+        con_char('-');
+        con_dec(i * 3 + 2);
+        con_endl();
+    }
+}
+
+// Audio test sequences (see event_wheel.h) queued around the chip's own
+static uint16_t audio_test_pause(uint8_t step) {
+    return step ? EVW_SEQ_END : 500;
+}
+
+static uint16_t audio_test_done(uint8_t step) {
+    (void)step;
+    con_puts(CON_INFO, "\n=== Audio Test Complete ===\n");
+    return EVW_SEQ_END;
+}
+
+// Start the audio test.  The tests play from the event wheel, so MIDI
+// input and commands keep working; 'p' stops them.
 void run_audio_test(void) {
-    printf("\n=== Audio Test Mode ===\n");
+    con_puts(CON_INFO, "\n=== Audio Test Mode ===\n");
 
     if (!current_chip) {
-        printf("No sound chip selected! Please select a chip first.\n");
+        con_puts(CON_ERROR, "No sound chip selected! Please select a chip first.\n");
+        return;
+    }
+
+    // Restart if a test is already playing
+    evw_sequence_stop();
+    synthesizer_channel_off(SYNTH_TEST_CHANNEL);
+    if (current_chip->chip_id == CHIP_YM2149) {
+        ym2149_patch_refresh();   // Shared registers a stopped test changed
+    }
+
+    if (current_chip->chip_id == CHIP_OPL3) {
+        con_puts(CON_INFO, "Testing OPL3 audio output...\n");
+        opl3_play_test_sequence();
+        evw_sequence_start(audio_test_done);
         return;
     }
 
     if (current_chip->chip_id != CHIP_YM2149) {
-        printf("Audio test only implemented for YM2149 chip.\n");
-        printf("Current chip: %s\n", current_chip->name);
+        con_puts(CON_INFO, "Audio test not implemented for this chip.\n");
+        con_begin(CON_INFO);
+        con_msg(MSG_CURRENT_CHIP);
+        con_str(current_chip->name);
+        con_endl();
         return;
     }
 
-    printf("Testing YM2149 audio output...\n");
-    printf("You should hear audio tones if your hardware is working.\n");
-    printf("Press Ctrl+C to interrupt if needed.\n\n");
+    con_puts(CON_INFO, "Testing YM2149 audio output...\n");
+    con_puts(CON_INFO, "You should hear audio tones if your hardware is working.\n");
+    con_puts(CON_INFO, "Press 'p' to stop.\n\n");
 
-    // Run full test sequence
+    // Full test sequence, scale and arpeggio, half a second apart
     ym2149_play_test_sequence();
-
-    delay_ms(500);
-
-    printf("\nRunning scale test...\n");
+    evw_sequence_start(audio_test_pause);
     ym2149_play_scale();
-
-    delay_ms(500);
-
-    printf("\nRunning arpeggio test...\n");
+    evw_sequence_start(audio_test_pause);
     ym2149_play_arpeggio();
-
-    printf("\n=== Audio Test Complete ===\n");
+    evw_sequence_start(audio_test_done);
 }
@@ -0,0 +1,111 @@
+#include "../../include/midi_clock.h"
+#include "../../include/timebase.h"
+#include "../../include/lfo.h"
+#include <stdint.h>
+
+midi_clock_t midi_clock;
+
+static uint8_t midi_clock_armed;       // Next clock plays the current position
+static uint8_t midi_clock_synced;      // Beat measurement has a start mark
+static uint8_t midi_clock_count;       // Clocks since the mark
+static uint16_t midi_clock_mark;       // Timebase tick of the mark
+static uint16_t midi_clock_jump;       // Unconfirmed new beat length, 1/16 ms
+
+void midi_clock_init(void) {
+    midi_clock.running = 0;
+    midi_clock.clock = 0;
+    midi_clock.beat = 0;
+    midi_clock.beat_ms16 = 0;
+    midi_clock.clocks = 0;
+    midi_clock.rejected = 0;
+    midi_clock_armed = 0;
+    midi_clock_synced = 0;
+    midi_clock_jump = 0;
+    lfo_set_tempo(0);
+}
+
+// Returns 1 if `a` is within 25% of `b`
+static uint8_t midi_clock_near(uint16_t a, uint16_t b) {
+    uint16_t diff = (a > b) ? a - b : b - a;
+    return diff <= (b >> 2);
+}
+
+// Fold one measured beat length into the estimate
+static void midi_clock_measure(uint16_t ms) {
+    uint16_t len;
+    uint16_t est = midi_clock.beat_ms16;
+
+    if (ms == 0 || ms > MIDI_CLOCK_MAX_BEAT) {
+        midi_clock.rejected++;          // Stalled or paused stream
+        return;
+    }
+    len = ms << 4;
+
+    if (est && midi_clock_near(len, est)) {
+        est += (int16_t)(len - est) >> 2;
+    } else if (!est || (midi_clock_jump && midi_clock_near(len, midi_clock_jump))) {
+        est = len;                      // First beat, or a confirmed tempo change
+    } else {
+        midi_clock_jump = len;          // Wait for the next beat to confirm
+        midi_clock.rejected++;
+        return;
+    }
+    midi_clock_jump = 0;
+    midi_clock.beat_ms16 = est;
+    lfo_set_tempo(est);
+}
+
+// One timing clock: advance the song position while running, and measure
+// a beat every 24 clocks whether running or not (sequencers send clock
+// while stopped too)
+void midi_clock_pulse(void) {
+    uint16_t now = timebase_now();
+
+    midi_clock.clocks++;
+    if (midi_clock.running) {
+        if (midi_clock_armed) {
+            midi_clock_armed = 0;
+        } else if (++midi_clock.clock == MIDI_CLOCK_PPQN) {
+            midi_clock.clock = 0;
+            midi_clock.beat++;
+        }
+    }
+
+    if (!midi_clock_synced) {
+        midi_clock_synced = 1;
+        midi_clock_count = 0;
+        midi_clock_mark = now;
+    } else if (++midi_clock_count == MIDI_CLOCK_PPQN) {
+        midi_clock_count = 0;
+        midi_clock_measure(now - midi_clock_mark);
+        midi_clock_mark = now;
+    }
+}
+
+// System realtime byte.  Active sensing and reset are ignored.
+void midi_clock_realtime(uint8_t byte) {
+    switch (byte) {
+        case MIDI_CLOCK:
+            midi_clock_pulse();
+            break;
+        case MIDI_START:
+            midi_clock.clock = 0;
+            midi_clock.beat = 0;
+            // fall through
+        case MIDI_CONTINUE:
+            midi_clock.running = 1;
+            midi_clock_armed = 1;
+            break;
+        case MIDI_STOP:
+            midi_clock.running = 0;
+            break;
+    }
+}
+
+// Tempo in beats per minute, rounded
+uint16_t midi_clock_bpm(void) {
+    uint16_t est = midi_clock.beat_ms16;
+
+    if (est == 0) return 0;
+    return (uint16_t)((60000UL * 16 + est / 2) / est);
+}
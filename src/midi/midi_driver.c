@@ -1,12 +1,20 @@
 #include "../../include/midi_driver.h"
 #include "../../include/chip_interface.h"
 #include "../../include/synthesizer.h"
+#include "../../include/console.h"
+#include "../../include/messages.h"
+#include "../../include/hal.h"
+#include "../../include/cpmfile.h"
+#include "../../include/sysex.h"
+#include "../../include/midi_clock.h"
 #include <stdint.h>
-#include <stdio.h>
+#include <string.h>
 
 // Global MIDI state
 midi_state_t midi_state;
-midi_cc_control_t midi_cc_controls[12];
+midi_cc_map_t midi_cc_map[MIDI_CC_COUNT];
+uint8_t midi_cc_value[MIDI_CC_COUNT];
+midi_channel_state_t midi_channels[16];
 
 // Current MIDI input mode
 static uint8_t midi_mode = MIDI_MODE_NONE;
@@ -16,6 +24,17 @@ static uint8_t kb_current_octave = 5;    // Default octave (C5 = MIDI 60)
 static uint8_t kb_current_velocity = 100; // Default velocity
 static uint8_t kb_last_note = 0xFF;       // Last note played (for note-off)
 
+// Part whose program and modulation the chip has loaded, and the values
+static uint8_t midi_part = MIDI_PART_NONE;
+static uint8_t midi_part_program = 0;
+static uint8_t midi_part_modulation = 0;
+
+// Handler names, indexed by MIDI_CC_*
+static const char* const midi_cc_handler_names[MIDI_CC_HANDLER_COUNT] = {
+    "none", "volume", "attack", "decay", "sustain", "release",
+    "vibrato", "tremolo", "bend", "modulation", "tremsync"
+};
+
 // Direct Z80-SIO hardware I/O for auxiliary serial port (Channel B).
 //
 // HBIOS RST 08H was found to corrupt CP/M console I/O state, so we
@@ -27,6 +46,10 @@ static uint8_t kb_last_note = 0xFF;       // Last note played (for note-off)
 //
 // RR0 bit 0 = Rx Character Available.
 // Writing 0x00 to the control port selects RR0 for the next read.
+#define SIO_CHB_CTRL    0x82
+#define SIO_CHB_DATA    0x83
+
+#ifdef __Z88DK
 
 // Check SIO Channel B Rx status — returns 0 if empty, 1 if data available
 static uint8_t bios_auxist(void) __naked {
@@ -59,11 +82,11 @@ static uint8_t bios_auxin(void) __naked {
 // We avoid a full channel reset (WR0 command 0x18) because that
 // clears the baud rate clock linkage in MAME's SIO emulation.
 //
-// CRITICAL: WR1 must be set to 0x00 to disable all interrupts on
+// CRITICAL: WR1 is set to 0x00 here to disable all interrupts on
 // Channel B.  RomWBW HBIOS enables Rx interrupts for both SIO
-// channels; its ISR reads incoming bytes before our polling code
-// can see them.  Disabling interrupts ensures we can poll RR0/data
-// directly.
+// channels; its ISR reads incoming bytes before our code can see
+// them.  Receive interrupts are only re-enabled (by sio_chb_irq_on)
+// once our own ISR has been hooked in front of the HBIOS handler.
 //
 // WR4 MUST be set to async mode (non-zero stop bits field) — if WR4
 // defaults to 0x00, the SIO enters sync mode and never receives
@@ -112,6 +135,238 @@ static void sio_chb_init(void) __naked {
     __endasm;
 }
 
+// Enable SIO Channel B receive interrupts.
+// WR1 = 0x18: interrupt on all Rx characters, parity does not affect
+// the vector.  Only called once midi_rx_isr is installed at 0x0038.
+static void sio_chb_irq_on(void) __naked {
+    __asm
+        ld a, 0x01
+        out (0x82), a
+        ld a, 0x18          ; WR1: Rx int on all chars, no Tx/Ext ints
+        out (0x82), a
+        ret
+    __endasm;
+}
+
+// Disable all SIO Channel B interrupts (WR1 = 0x00)
+static void sio_chb_irq_off(void) __naked {
+    __asm
+        ld a, 0x01
+        out (0x82), a
+        xor a
+        out (0x82), a
+        ret
+    __endasm;
+}
+
+// Check the Channel B transmit buffer (RR0 bit 2 = Tx Buffer Empty)
+static uint8_t sio_chb_tx_ready(void) __naked {
+    __asm
+        xor a               ; select RR0
+        out (0x82), a
+        in a, (0x82)
+        and 0x04            ; isolate bit 2 (Tx Buffer Empty)
+        ld l, a             ; return in L
+        ld h, 0
+        ret
+    __endasm;
+}
+
+// Write a byte to the Channel B transmitter.  Byte in L (fastcall).
+static void sio_chb_tx(uint8_t byte) __naked __z88dk_fastcall {
+    __asm
+        ld a, l
+        out (0x83), a
+        ret
+    __endasm;
+}
+
+#else // Host build: the same register sequences in C, on the fake bus
+
+static uint8_t bios_auxist(void) {
+    hal_outp(SIO_CHB_CTRL, 0x00);           // Select RR0
+    return hal_inp(SIO_CHB_CTRL) & 0x01;    // Rx Char Available
+}
+
+static uint8_t bios_auxin(void) {
+    return hal_inp(SIO_CHB_DATA);
+}
+
+static void sio_chb_init(void) {
+    static const uint8_t init_seq[] = {
+        0x00,           // Pointer to WR0
+        0x30,           // Error Reset
+        0x01, 0x00,     // WR1: all interrupts off
+        0x04, 0xC4,     // WR4: x64 clock, 1 stop bit, no parity
+        0x03, 0xC1,     // WR3: Rx 8 bits, Rx Enable
+        0x05, 0xEA      // WR5: DTR, Tx 8 bits, Tx Enable, RTS
+    };
+    for (uint8_t i = 0; i < sizeof(init_seq); i++) {
+        hal_outp(SIO_CHB_CTRL, init_seq[i]);
+    }
+}
+
+static uint8_t sio_chb_tx_ready(void) {
+    hal_outp(SIO_CHB_CTRL, 0x00);               // Select RR0
+    return hal_inp(SIO_CHB_CTRL) & 0x04;        // Tx Buffer Empty
+}
+
+static void sio_chb_tx(uint8_t byte) {
+    hal_outp(SIO_CHB_DATA, byte);
+}
+
+#endif // __Z88DK
+
+// ---------------------------------------------------------------------------
+// Interrupt-driven receive
+//
+// RomWBW on the RC2014 runs the Z80 in interrupt mode 1: every interrupt
+// executes RST 38H, and CP/M page zero holds a JP to the HBIOS interrupt
+// handler at 0x0038.  We save that jump target, point 0x0038 at our own
+// ISR, and chain to the saved HBIOS handler when we are done.  HBIOS
+// still services its own sources (console SIO Channel A, timers) and
+// issues the EI/RETI that clears the SIO daisy chain.
+//
+// The ISR drains every byte waiting in the Channel B FIFO into a
+// power-of-two ring buffer.  The main loop drains the ring at its own
+// pace, so slow console output no longer overruns the 3-byte SIO FIFO.
+//
+// If 0x0038 does not hold a JP (e.g. an IM2 HBIOS build), the hook is
+// not installed and the driver falls back to polling RR0.
+// ---------------------------------------------------------------------------
+
+#define RST38_OPCODE    (*(volatile uint8_t*)0x0038)
+#define RST38_TARGET    (*(volatile uint16_t*)0x0039)
+#define Z80_OPCODE_JP   0xC3
+
+// Ring buffer — shared with the ISR, so not static (referenced from asm)
+uint8_t midi_rx_buf[MIDI_RX_BUF_SIZE];
+volatile uint8_t midi_rx_head;    // Next write slot (ISR only)
+volatile uint8_t midi_rx_tail;    // Next read slot (main loop only)
+midi_rx_stats_t midi_rx_stats;
+
+uint16_t midi_hbios_vector;       // Saved HBIOS handler from 0x0039
+
+// Timing clocks counted by the ISR; the main loop replays the difference
+// from midi_clock_seen, so neither side needs to disable interrupts
+volatile uint8_t midi_clock_rx;
+static uint8_t midi_clock_seen;
+static uint8_t midi_irq_installed = 0;
+
+#ifdef __Z88DK
+
+// SIO Channel B receive ISR, entered via JP from 0x0038 with interrupts
+// disabled.  Preserves all registers and chains to the HBIOS handler.
+static void midi_rx_isr(void) __naked {
+    __asm
+        push af
+        push bc
+        push de
+        push hl
+
+    midi_rx_isr_loop:
+        xor a               ; select RR0
+        out (0x82), a
+        in a, (0x82)
+        rrca                ; bit 0 (Rx Char Available) -> carry
+        jr nc, midi_rx_isr_done
+
+        ld a, 0x01          ; select RR1 to check for a receiver overrun
+        out (0x82), a
+        in a, (0x82)
+        and 0x20            ; RR1 bit 5 = Rx Overrun Error
+        jr z, midi_rx_isr_read
+        ld a, 0x30          ; WR0: Error Reset
+        out (0x82), a
+        ld hl, (_midi_rx_stats + 2)     ; midi_rx_stats.sio_overruns
+        inc hl
+        ld (_midi_rx_stats + 2), hl
+
+    midi_rx_isr_read:
+        in a, (0x83)        ; read data byte (clears the Rx interrupt)
+        cp 0xF8             ; timing clock: counted, not queued
+        jr nz, midi_rx_isr_queue
+        ld hl, _midi_clock_rx
+        inc (hl)
+        jr midi_rx_isr_loop
+
+    midi_rx_isr_queue:
+        ld e, a             ; E = received byte
+        ld a, (_midi_rx_head)
+        ld l, a
+        inc a
+        and MIDI_RX_BUF_MASK
+        ld d, a             ; D = head after this byte
+        ld a, (_midi_rx_tail)
+        cp d
+        jr z, midi_rx_isr_full
+
+        ld h, 0             ; store byte at midi_rx_buf[head]
+        ld bc, _midi_rx_buf
+        add hl, bc
+        ld (hl), e
+        ld a, d             ; publish the new head only after the store
+        ld (_midi_rx_head), a
+        jr midi_rx_isr_loop
+
+    midi_rx_isr_full:
+        ld hl, (_midi_rx_stats)         ; midi_rx_stats.ring_overruns
+        inc hl
+        ld (_midi_rx_stats), hl
+        jr midi_rx_isr_loop
+
+    midi_rx_isr_done:
+        pop hl
+        pop de
+        pop bc
+        pop af
+        push hl
+        ld hl, (_midi_hbios_vector)
+        ex (sp), hl         ; restore HL, HBIOS handler address on stack
+        ret                 ; chain to the HBIOS interrupt handler
+    __endasm;
+}
+
+// Hook midi_rx_isr in front of the HBIOS handler at 0x0038.
+// Returns 1 if receive interrupts are active, 0 if we must poll.
+static uint8_t midi_irq_install(void) {
+    if (midi_irq_installed) return 1;
+    if (RST38_OPCODE != Z80_OPCODE_JP) return 0;  // Not IM1 / not RomWBW
+
+    midi_rx_head = 0;
+    midi_rx_tail = 0;
+
+    __asm__("di");
+    midi_hbios_vector = RST38_TARGET;
+    RST38_TARGET = (uint16_t)midi_rx_isr;
+    sio_chb_irq_on();
+    midi_irq_installed = 1;
+    __asm__("ei");
+    return 1;
+}
+
+// Disable Channel B interrupts and put the HBIOS vector back
+static void midi_irq_remove(void) {
+    if (!midi_irq_installed) return;
+
+    __asm__("di");
+    sio_chb_irq_off();
+    RST38_TARGET = midi_hbios_vector;
+    midi_irq_installed = 0;
+    __asm__("ei");
+}
+
+#else // Host build: there is no page zero to hook, so always poll
+
+static uint8_t midi_irq_install(void) {
+    return 0;
+}
+
+static void midi_irq_remove(void) {
+}
+
+#endif // __Z88DK
+
 // Initialize MIDI driver
 void midi_driver_init(void) {
     // Clear MIDI state
@@ -123,33 +378,105 @@ void midi_driver_init(void) {
     midi_state.expected_bytes = 0;
     midi_state.byte_count = 0;
 
+    midi_rx_head = 0;
+    midi_rx_tail = 0;
+    midi_rx_stats.ring_overruns = 0;
+    midi_rx_stats.sio_overruns = 0;
+    midi_clock_rx = 0;
+    midi_clock_seen = 0;
+    midi_clock_init();
+
+    memset(midi_channels, 0, sizeof(midi_channels));
+    for (uint8_t i = 0; i < 16; i++) {
+        midi_channels[i].bend_range = MIDI_BEND_RANGE_DEFAULT;
+        midi_channels[i].rpn_msb = MIDI_RPN_NULL;
+        midi_channels[i].rpn_lsb = MIDI_RPN_NULL;
+        midi_channels[i].volume = MIDI_VOLUME_NONE;
+        midi_channels[i].last_voice = 0xFF;
+        midi_channels[i].chip = CHIP_NONE;
+    }
+    midi_parts_reset();
+    sysex_init();
+
     midi_mode = MIDI_MODE_NONE;
     kb_current_octave = 5;
     kb_current_velocity = 100;
     kb_last_note = 0xFF;
 
-    // Initialize CC controls mapping
-    // 8 rotary knobs
-    for (uint8_t i = 0; i < 8; i++) {
-        midi_cc_controls[i].cc_number = i + 1;  // CC#1-8 for knobs
-        midi_cc_controls[i].value = 0;
-        midi_cc_controls[i].is_knob = 1;
-        midi_cc_controls[i].name = "Knob";
+    // CC mapping: built-in layout, then ccmap.cfg overrides if present
+    memset(midi_cc_value, 0, sizeof(midi_cc_value));
+    midi_cc_map_defaults();
+    midi_cc_map_load(MIDI_CC_MAP_FILE);
+}
+
+// Built-in CC layout: CC#1-8 knobs, CC#9-12 sliders
+void midi_cc_map_defaults(void) {
+    static const uint8_t defaults[12] = {
+        MIDI_CC_VOLUME, MIDI_CC_VOLUME, MIDI_CC_VOLUME, MIDI_CC_VOLUME,
+        MIDI_CC_ATTACK, MIDI_CC_DECAY, MIDI_CC_SUSTAIN, MIDI_CC_RELEASE,
+        MIDI_CC_VIBRATO, MIDI_CC_TREMOLO, MIDI_CC_BEND, MIDI_CC_MODULATION
+    };
+
+    memset(midi_cc_map, 0, sizeof(midi_cc_map));
+    for (uint8_t i = 0; i < 12; i++) {
+        midi_cc_map[i + 1].handler = defaults[i];
+        midi_cc_map[i + 1].target = MIDI_CC_TARGET_LAST;
+    }
+}
+
+// Handler name, as used in ccmap.cfg and the status display
+const char* midi_cc_handler_name(uint8_t handler) {
+    if (handler >= MIDI_CC_HANDLER_COUNT) handler = MIDI_CC_NONE;
+    return midi_cc_handler_names[handler];
+}
+
+// One ccmap.cfg line: cc=handler[,target], or sysex_device=id
+static void midi_cc_map_line(const char* key, const char* value) {
+    char handler[CPMF_TOKEN_MAX];
+    if (strcmp(key, "sysex_device") == 0) {
+        sysex_set_device((uint8_t)cpmf_number(value));
+        return;
+    }
+
+    uint16_t cc = cpmf_number(key);
+    if (cc >= MIDI_CC_COUNT) return;
+
+    strcpy(handler, value);
+    uint8_t target = MIDI_CC_TARGET_LAST;
+    char* comma = strchr(handler, ',');
+    if (comma) {
+        *comma++ = '\0';
+        if (strcmp(comma, "all") == 0) {
+            target = MIDI_CC_TARGET_ALL;
+        } else if (strcmp(comma, "last") != 0) {
+            target = (uint8_t)cpmf_number(comma);
+        }
     }
 
-    // 4 sliders
-    for (uint8_t i = 0; i < 4; i++) {
-        midi_cc_controls[i + 8].cc_number = i + 9;  // CC#9-12 for sliders
-        midi_cc_controls[i + 8].value = 0;
-        midi_cc_controls[i + 8].is_knob = 0;
-        midi_cc_controls[i + 8].name = "Slider";
+    for (uint8_t h = 0; h < MIDI_CC_HANDLER_COUNT; h++) {
+        if (strcmp(handler, midi_cc_handler_names[h]) == 0) {
+            midi_cc_map[cc].handler = h;
+            midi_cc_map[cc].target = target;
+            break;
+        }
     }
 }
 
+// Load CC overrides from a mapping file.
+// Format: <cc>=<handler>[,<target>], e.g. "74=attack,all" or "7=none".
+// Target is a voice number, "last" (default) or "all".
+// Returns 1 if the file was read, 0 if it could not be opened.
+int midi_cc_map_load(const char* filename) {
+    return cpmf_config(filename, midi_cc_map_line);  // 0: keep the current table
+}
+
 // Set MIDI input mode
 void midi_set_mode(uint8_t mode) {
     if (mode == MIDI_MODE_BIOS) {
         sio_chb_init();
+        midi_irq_install();
+    } else {
+        midi_irq_remove();
     }
     midi_mode = mode;
 }
@@ -159,34 +486,90 @@ uint8_t midi_get_mode(void) {
     return midi_mode;
 }
 
+// Restore the HBIOS interrupt vector and leave MIDI mode.
+// Must be called before returning to CP/M.
+void midi_driver_shutdown(void) {
+    midi_irq_remove();
+    midi_mode = MIDI_MODE_NONE;
+}
+
+// Returns 1 if bytes are being received by the SIO interrupt handler
+uint8_t midi_driver_irq_active(void) {
+    return midi_irq_installed;
+}
+
 // Check if MIDI data is available (BIOS mode)
 uint8_t midi_driver_available(void) {
     if (midi_mode != MIDI_MODE_BIOS) {
         return 0;
     }
+    if (midi_irq_installed) {
+        return midi_rx_head != midi_rx_tail;
+    }
     return bios_auxist();
 }
 
 // Read one byte from MIDI interface (BIOS mode)
+// Caller must check midi_driver_available() first.
 uint8_t midi_driver_read_byte(void) {
     if (midi_mode != MIDI_MODE_BIOS) {
         return 0;
     }
+    if (midi_irq_installed) {
+        uint8_t byte = midi_rx_buf[midi_rx_tail];
+        midi_rx_tail = (midi_rx_tail + 1) & MIDI_RX_BUF_MASK;
+        return byte;
+    }
     return bios_auxin();
 }
 
-// Process one pending MIDI byte (if available).
-// Only one byte per call so the main loop always returns to kbhit()
-// for console command processing.  At 7.3 MHz the loop iterates fast
-// enough to keep up with 31250-baud MIDI (≈3125 bytes/sec).
-void midi_driver_process_input(void) {
+// MIDI OUT.  Nothing waits for the transmitter: callers send a byte
+// only when midi_driver_send_ready() says the SIO can take it, so a
+// long reply is spread over scheduler passes (see sysex_service()).
+// Only in BIOS mode, where the SIO has been set up.
+uint8_t midi_driver_send_ready(void) {
+    return midi_mode == MIDI_MODE_BIOS && sio_chb_tx_ready();
+}
+
+void midi_driver_send(uint8_t byte) {
+    if (midi_mode == MIDI_MODE_BIOS) {
+        sio_chb_tx(byte);
+    }
+}
+
+// Drain pending MIDI bytes into the parser, at most `budget` per call.
+// Returns the number of bytes processed (0 = input is quiet).  With
+// receive interrupts active the ISR buffers bytes while the main loop
+// is busy, so the budget only bounds how long one pass can take.
+//
+// Realtime bytes (clock, start/stop, active sensing) are handled but
+// not counted, so a clock stream neither uses up the budget meant for
+// notes nor keeps the idle tasks from running.  At most 255 of them
+// are taken per call, which keeps a pass bounded.
+uint8_t midi_driver_drain(uint8_t budget) {
+    uint8_t count = 0;
+    uint8_t realtime = 0;
+
     if (midi_mode != MIDI_MODE_BIOS) {
-        return;
+        return 0;
+    }
+
+    // Clocks the ISR counted since the last call
+    while (midi_clock_seen != midi_clock_rx) {
+        midi_clock_seen++;
+        midi_clock_pulse();
     }
-    if (midi_driver_available()) {
+
+    while (count < budget && midi_driver_available()) {
         uint8_t byte = midi_driver_read_byte();
         midi_process_byte(byte);
+        if (byte < 0xF8) {
+            count++;
+        } else if (++realtime == 0xFF) {
+            break;
+        }
     }
+    return count;
 }
 
 // Keyboard MIDI mode: map a key press to MIDI note/CC messages
@@ -251,7 +634,12 @@ void midi_keyboard_process_key(char key) {
         // Send note-on
         midi_process_message(MIDI_NOTE_ON, midi_note, kb_current_velocity);
         kb_last_note = midi_note;
-        printf("Note: %d vel: %d\n", midi_note, kb_current_velocity);
+        con_begin(CON_INFO);
+        con_msg(MSG_NOTE);
+        con_dec(midi_note);
+        con_msg(MSG_VEL_KB);
+        con_dec(kb_current_velocity);
+        con_endl();
         return;
     }
 
@@ -260,13 +648,13 @@ void midi_keyboard_process_key(char key) {
         case '[':  // Octave down
             if (kb_current_octave > 0) {
                 kb_current_octave--;
-                printf("Octave: %d\n", kb_current_octave);
+                con_msg_dec(CON_INFO, MSG_OCTAVE, kb_current_octave);
             }
             break;
         case ']':  // Octave up
             if (kb_current_octave < 9) {
                 kb_current_octave++;
-                printf("Octave: %d\n", kb_current_octave);
+                con_msg_dec(CON_INFO, MSG_OCTAVE, kb_current_octave);
             }
             break;
         case '-':  // Velocity down
@@ -275,7 +663,7 @@ void midi_keyboard_process_key(char key) {
             } else {
                 kb_current_velocity = 1;
             }
-            printf("Velocity: %d\n", kb_current_velocity);
+            con_msg_dec(CON_INFO, MSG_VELOCITY, kb_current_velocity);
             break;
         case '=':  // Velocity up
             if (kb_current_velocity < 118) {
@@ -283,12 +671,12 @@ void midi_keyboard_process_key(char key) {
             } else {
                 kb_current_velocity = 127;
             }
-            printf("Velocity: %d\n", kb_current_velocity);
+            con_msg_dec(CON_INFO, MSG_VELOCITY, kb_current_velocity);
             break;
         case ' ':  // Space = note off (release current note)
             if (kb_last_note != 0xFF) {
                 midi_process_message(MIDI_NOTE_OFF, kb_last_note, 0);
-                printf("Note off: %d\n", kb_last_note);
+                con_msg_dec(CON_INFO, MSG_NOTE_OFF_KB, kb_last_note);
                 kb_last_note = 0xFF;
             }
             break;
@@ -306,17 +694,25 @@ void midi_keyboard_process_key(char key) {
 void midi_process_byte(uint8_t byte) {
     // System Realtime (0xF8-0xFF): can appear mid-message, never touch parser state
     if (byte >= 0xF8) {
-        // Could handle clock (0xF8), start (0xFA), stop (0xFC) here if needed
+        midi_clock_realtime(byte);
         return;
     }
 
     // Check for status byte (MSB set)
     if (byte & 0x80) {
+        // Any status byte ends a SysEx message; only F7 completes it
+        if (sysex_state != SYSEX_IDLE) {
+            sysex_end(byte == 0xF7);
+        }
+
         // System Common (0xF0-0xF7): clear running status
         if (byte >= 0xF0) {
             midi_state.status = 0;
             midi_state.byte_count = 0;
             midi_state.expected_bytes = 0;
+            if (byte == 0xF0) {
+                sysex_start();
+            }
             return;
         }
 
@@ -342,6 +738,10 @@ void midi_process_byte(uint8_t byte) {
                 break;
         }
     }
+    // SysEx data is parsed as it arrives
+    else if (sysex_state != SYSEX_IDLE) {
+        sysex_byte(byte);
+    }
     // Check for running status (data byte without status)
     else if (midi_state.status != 0) {
         midi_state.byte_count++;
@@ -361,154 +761,253 @@ void midi_process_byte(uint8_t byte) {
     }
 }
 
+// Start a "MIDI IN: <text><value>" log line; the caller adds any more
+// pieces and ends it with con_endl()
+static void midi_log(uint8_t id, uint8_t value) {
+    con_begin(CON_MIDI);
+    con_msg(MSG_MIDI_IN);
+    con_msg(id);
+    con_dec(value);
+}
+
+// Send a channel's pitch bend to the chip in PITCH_BEND_STEPS per semitone.
+// Full deflection (8192) is bend_range semitones:
+//   bend * range * 32 / 8192 = ((bend >> 5) * range) >> 3
+// which stays within 16 bits for ranges up to MIDI_BEND_RANGE_MAX.
+static void midi_send_bend(uint8_t channel) {
+    midi_channel_state_t* ch = &midi_channels[channel];
+
+    if (current_chip && current_chip->set_pitch_bend) {
+        current_chip->set_pitch_bend(channel,
+                                     ((ch->bend >> 5) * ch->bend_range) >> 3);
+    }
+}
+
+// Data entry (CC#6) for the selected RPN. Returns 1 if consumed.
+static uint8_t midi_rpn_data_entry(uint8_t channel, uint8_t value) {
+    midi_channel_state_t* ch = &midi_channels[channel];
+
+    if (ch->rpn_msb == MIDI_RPN_NULL && ch->rpn_lsb == MIDI_RPN_NULL) {
+        return 0;  // No RPN selected: CC#6 keeps its synth mapping
+    }
+    if (ch->rpn_msb == 0 && ch->rpn_lsb == 0) {
+        // RPN 0: pitch bend sensitivity, coarse (semitones)
+        if (value > MIDI_BEND_RANGE_MAX) value = MIDI_BEND_RANGE_MAX;
+        ch->bend_range = value;
+        midi_send_bend(channel);
+        if (midi_mode == MIDI_MODE_BIOS) {
+            midi_log(MSG_CH, channel + 1);
+            con_msg(MSG_BEND_RANGE);
+            con_dec(value);
+            con_endl();
+        }
+    }
+    return 1;  // Other RPNs are accepted and ignored
+}
+
+// The chip was (re)initialised with program 0 and no modulation
+void midi_parts_reset(void) {
+    midi_part = MIDI_PART_NONE;
+    midi_part_program = 0;
+    midi_part_modulation = 0;
+}
+
+// Load a part's program and modulation onto the chip, where they differ
+// from what the last part left there
+static void midi_part_load(uint8_t channel) {
+    midi_channel_state_t* ch = &midi_channels[channel];
+
+    midi_part = channel;
+    if (ch->program != midi_part_program && current_chip->set_preset) {
+        current_chip->set_preset(ch->program);
+        midi_part_program = ch->program;
+    }
+    if (ch->modulation != midi_part_modulation && current_chip->set_modulation) {
+        current_chip->set_modulation(ch->modulation);
+        midi_part_modulation = ch->modulation;
+    }
+}
+
+// Apply a per-voice setter to the voice(s) a CC mapping targets on the
+// channel.  Only sounding voices are touched, so a knob can't unmute a
+// free voice or reach into another part.
+static void midi_cc_to_voices(void (*set)(uint8_t voice, uint8_t value),
+                              uint8_t channel, uint8_t target, uint8_t value) {
+    voice_t* voices = current_chip->voices;
+
+    if (!set) return;
+
+    if (target == MIDI_CC_TARGET_ALL) {
+        for (uint8_t i = 0; i < current_chip->voice_count; i++) {
+            if (voices[i].active && voices[i].channel == channel) {
+                set(i, value);
+            }
+        }
+        return;
+    }
+    if (target == MIDI_CC_TARGET_LAST) {
+        target = midi_channels[channel].last_voice;
+        if (target < current_chip->voice_count && voices[target].channel != channel) {
+            return;  // Taken over by another part since
+        }
+    }
+    if (target < current_chip->voice_count && voices[target].active) {
+        set(target, value);
+    }
+}
+
+// CC handlers, indexed by MIDI_CC_* (current_chip is checked by the caller)
+static void midi_cc_none(uint8_t channel, uint8_t target, uint8_t value) {
+    (void)channel; (void)target; (void)value;
+}
+
+// Volume aimed at the channel (not a fixed voice) is also kept as the
+// part's level for its later notes
+static void midi_cc_volume(uint8_t channel, uint8_t target, uint8_t value) {
+    if (target >= MIDI_CC_TARGET_ALL) {
+        midi_channels[channel].volume = value;
+    }
+    midi_cc_to_voices(current_chip->set_volume, channel, target, (uint16_t)value * 15 / 127);
+}
+
+static void midi_cc_attack(uint8_t channel, uint8_t target, uint8_t value) {
+    midi_cc_to_voices(current_chip->set_attack, channel, target, value);
+}
+
+static void midi_cc_decay(uint8_t channel, uint8_t target, uint8_t value) {
+    midi_cc_to_voices(current_chip->set_decay, channel, target, value);
+}
+
+static void midi_cc_sustain(uint8_t channel, uint8_t target, uint8_t value) {
+    midi_cc_to_voices(current_chip->set_sustain, channel, target, value);
+}
+
+static void midi_cc_release(uint8_t channel, uint8_t target, uint8_t value) {
+    midi_cc_to_voices(current_chip->set_release, channel, target, value);
+}
+
+static void midi_cc_vibrato(uint8_t channel, uint8_t target, uint8_t value) {
+    (void)channel; (void)target;
+    if (current_chip->set_vibrato) current_chip->set_vibrato(value);
+}
+
+static void midi_cc_tremolo(uint8_t channel, uint8_t target, uint8_t value) {
+    (void)channel; (void)target;
+    if (current_chip->set_tremolo) current_chip->set_tremolo(value);
+}
+
+// Pitch bend from a CC: scale 0-127 to the pitch wheel range
+static void midi_cc_bend(uint8_t channel, uint8_t target, uint8_t value) {
+    (void)target;
+    midi_channels[channel].bend = ((int16_t)value - 64) * 128;
+    midi_send_bend(channel);
+}
+
+// Modulation is the part's; it reaches the chip now only if the part is
+// the one playing, otherwise with the part's next note
+static void midi_cc_modulation(uint8_t channel, uint8_t target, uint8_t value) {
+    (void)target;
+    midi_channels[channel].modulation = value;
+    if (midi_part == channel || midi_part == MIDI_PART_NONE) {
+        midi_part_load(channel);
+    }
+}
+
+// Tremolo locked to the MIDI clock: value / 16 selects free-running, then
+// a whole note, half, quarter, eighth, eighth triplet, 16th or 32nd
+static void midi_cc_tremolo_sync(uint8_t channel, uint8_t target, uint8_t value) {
+    static const uint8_t clocks[8] = { 0, 96, 48, 24, 12, 8, 6, 3 };
+    (void)channel; (void)target;
+    if (current_chip->set_tremolo_sync) current_chip->set_tremolo_sync(clocks[value >> 4]);
+}
+
+typedef void (*midi_cc_handler_fn)(uint8_t channel, uint8_t target, uint8_t value);
+
+static const midi_cc_handler_fn midi_cc_handlers[MIDI_CC_HANDLER_COUNT] = {
+    midi_cc_none, midi_cc_volume, midi_cc_attack, midi_cc_decay,
+    midi_cc_sustain, midi_cc_release, midi_cc_vibrato, midi_cc_tremolo,
+    midi_cc_bend, midi_cc_modulation, midi_cc_tremolo_sync
+};
+
 // Process complete MIDI message
 void midi_process_message(uint8_t status, uint8_t data1, uint8_t data2) {
     uint8_t channel = status & 0x0F;
     uint8_t command = status & 0xF0;
-    
+    midi_channel_state_t* ch = &midi_channels[channel];
+
+    // Parts routed to a chip other than the one playing are silent
+    if (ch->chip != CHIP_NONE && (!current_chip || current_chip->chip_id != ch->chip)) {
+        return;
+    }
+
     switch (command) {
         case MIDI_NOTE_ON:
             if (current_chip && current_chip->note_on) {
                 if (data2 == 0) {
                     // Note-on with velocity 0 is equivalent to note-off
-                    if (current_chip->note_off) {
-                        uint8_t voice = find_voice_by_note(data1, channel);
-                        if (voice != 0xFF) {
-                            current_chip->note_off(voice);
-                        }
+                    synthesizer_note_off(data1, channel);
+                    if (midi_mode == MIDI_MODE_BIOS) {
+                        midi_log(MSG_NOTE_OFF_IN, data1);
+                        con_endl();
                     }
-                    if (midi_mode == MIDI_MODE_BIOS)
-                        printf("MIDI IN: Note Off %d\n", data1);
                 } else {
-                    uint8_t voice = allocate_voice(data1, data2, channel);
+                    midi_part_load(channel);
+                    uint8_t voice = synthesizer_note_on(data1, data2, channel);
                     if (voice != 0xFF) {
-                        current_chip->note_on(voice, data1, data2, channel);
+                        ch->last_voice = voice;
+                        if (ch->volume != MIDI_VOLUME_NONE && current_chip->set_volume) {
+                            current_chip->set_volume(voice, (uint16_t)ch->volume * 15 / 127);
+                        }
+                    }
+                    if (midi_mode == MIDI_MODE_BIOS) {
+                        midi_log(MSG_NOTE_ON_IN, data1);
+                        con_msg(MSG_VEL_IN);
+                        con_dec(data2);
+                        con_endl();
                     }
-                    if (midi_mode == MIDI_MODE_BIOS)
-                        printf("MIDI IN: Note On %d vel %d\n", data1, data2);
                 }
             }
             break;
 
         case MIDI_NOTE_OFF:
-            if (current_chip && current_chip->note_off) {
-                uint8_t voice = find_voice_by_note(data1, channel);
-                if (voice != 0xFF) {
-                    current_chip->note_off(voice);
-                }
+            synthesizer_note_off(data1, channel);
+            if (midi_mode == MIDI_MODE_BIOS) {
+                midi_log(MSG_NOTE_OFF_IN, data1);
+                con_endl();
             }
-            if (midi_mode == MIDI_MODE_BIOS)
-                printf("MIDI IN: Note Off %d\n", data1);
             break;
             
         case MIDI_CONTROL_CHANGE:
-            // Update CC control state
-            for (uint8_t i = 0; i < 12; i++) {
-                if (midi_cc_controls[i].cc_number == data1) {
-                    midi_cc_controls[i].value = data2;
-                    break;
-                }
-            }
-            
-            // Apply CC to current chip
-            if (current_chip) {
-                switch (data1) {
-                    case 1: case 2: case 3: case 4:  // Volume controls
-                        if (current_chip->set_volume) {
-                            // Map to first active voice or global
-                            for (uint8_t i = 0; i < current_chip->voice_count; i++) {
-                                if (current_chip->voices[i].active) {
-                                    current_chip->set_volume(i, (uint16_t)data2 * 15 / 127);
-                                    break;
-                                }
-                            }
-                        }
-                        break;
-                        
-                    case 5:  // Attack
-                        if (current_chip->set_attack) {
-                            for (uint8_t i = 0; i < current_chip->voice_count; i++) {
-                                if (current_chip->voices[i].active) {
-                                    current_chip->set_attack(i, data2);
-                                    break;
-                                }
-                            }
-                        }
-                        break;
-                        
-                    case 6:  // Decay
-                        if (current_chip->set_decay) {
-                            for (uint8_t i = 0; i < current_chip->voice_count; i++) {
-                                if (current_chip->voices[i].active) {
-                                    current_chip->set_decay(i, data2);
-                                    break;
-                                }
-                            }
-                        }
-                        break;
-                        
-                    case 7:  // Sustain
-                        if (current_chip->set_sustain) {
-                            for (uint8_t i = 0; i < current_chip->voice_count; i++) {
-                                if (current_chip->voices[i].active) {
-                                    current_chip->set_sustain(i, data2);
-                                    break;
-                                }
-                            }
-                        }
-                        break;
-                        
-                    case 8:  // Release
-                        if (current_chip->set_release) {
-                            for (uint8_t i = 0; i < current_chip->voice_count; i++) {
-                                if (current_chip->voices[i].active) {
-                                    current_chip->set_release(i, data2);
-                                    break;
-                                }
-                            }
-                        }
-                        break;
-                        
-                    case 9:  // Vibrato
-                        if (current_chip->set_vibrato) {
-                            current_chip->set_vibrato(data2);
-                        }
-                        break;
-                        
-                    case 10:  // Tremolo
-                        if (current_chip->set_tremolo) {
-                            current_chip->set_tremolo(data2);
-                        }
-                        break;
-                        
-                    case 11:  // Expression / pitch bend via CC
-                        if (current_chip->set_pitch_bend) {
-                            // Scale CC value (0-127) to pitch bend range
-                            int16_t bend = ((int16_t)data2 - 64) * 128;
-                            current_chip->set_pitch_bend(bend);
-                        }
-                        break;
-                        
-                    case 12:  // Modulation
-                        if (current_chip->set_modulation) {
-                            current_chip->set_modulation(data2);
-                        }
-                        break;
+            midi_cc_value[data1] = data2;
+
+            // RPN selection and data entry (CC#6 only while an RPN is selected)
+            if (data1 == 101) {
+                ch->rpn_msb = data2;
+            } else if (data1 == 100) {
+                ch->rpn_lsb = data2;
+            } else if (data1 == 38) {
+                // Data entry LSB (RPN 0 cents): not supported
+            } else if (data1 != 6 || !midi_rpn_data_entry(channel, data2)) {
+                // Direct table dispatch
+                midi_cc_map_t* m = &midi_cc_map[data1];
+                if (m->handler != MIDI_CC_NONE && current_chip) {
+                    midi_cc_handlers[m->handler](channel, m->target, data2);
                 }
             }
             break;
             
         case MIDI_PROGRAM_CHANGE:
-            if (current_chip && current_chip->set_preset) {
-                current_chip->set_preset(data1);
+            // Loaded now if this part is the one playing, else at its next note
+            ch->program = data1;
+            if (current_chip && (midi_part == channel || midi_part == MIDI_PART_NONE)) {
+                midi_part_load(channel);
             }
             break;
             
         case MIDI_PITCH_BEND:
-            if (current_chip && current_chip->set_pitch_bend) {
-                int16_t bend = (data2 << 7) | data1;
-                current_chip->set_pitch_bend(bend - 8192);  // Center at 0
-            }
+            // 14-bit wheel position, centered at 0
+            ch->bend = (int16_t)(((uint16_t)data2 << 7) | data1) - 8192;
+            midi_send_bend(channel);
             break;
     }
 }
\ No newline at end of file
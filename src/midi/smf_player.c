@@ -0,0 +1,399 @@
+#include "../../include/smf_player.h"
+#include "../../include/midi_driver.h"
+#include "../../include/synthesizer.h"
+#include "../../include/timebase.h"
+#include "../../include/console.h"
+#include "../../include/messages.h"
+#include "../../include/cpmfile.h"
+#include <stdint.h>
+#include <string.h>
+
+// Per-track stream: two record buffers and the next event, parsed ahead
+typedef struct {
+    uint8_t  buf[2][SMF_RECORD_SIZE];
+    uint8_t  cur;            // Buffer being parsed
+    uint8_t  pos;            // Next byte in buf[cur]; SMF_RECORD_SIZE = used up
+    uint8_t  back_ready;     // buf[cur ^ 1] already holds next_record
+    uint16_t next_record;    // Record that follows buf[cur] in the file
+    uint32_t remaining;      // Track bytes not yet parsed
+    uint32_t tick;           // Absolute tick of the pending event
+    uint8_t  running;        // Running status
+    uint8_t  status;         // Pending event (SMF_EVENT_TEMPO = tempo change)
+    uint8_t  data1;
+    uint8_t  data2;
+    uint32_t tempo;          // Pending tempo, microseconds per quarter note
+} smf_track_t;
+
+#define SMF_EVENT_TEMPO     0xFF
+#define SMF_EVENT_BUDGET    8      // Events dispatched per scheduler pass
+
+smf_stats_t smf_stats;
+
+static cpm_file_t smf_file;
+static char smf_name[SMF_NAME_MAX];
+static uint8_t smf_playing = 0;
+
+static smf_track_t smf_tracks[SMF_MAX_TRACKS];
+static uint8_t smf_track_count = 0;
+static uint8_t smf_prefetch_next = 0;     // Round-robin start for read-ahead
+
+// Min-heap of track indices, ordered by (tick, index)
+static uint8_t smf_heap[SMF_MAX_TRACKS];
+static uint8_t smf_heap_size = 0;
+
+// Song position: ticks are converted to microseconds with the current
+// tempo, carrying the division remainder so long files do not drift
+static uint16_t smf_division;
+static uint32_t smf_us_per_tick;          // tempo / division
+static uint16_t smf_us_rem;               // tempo % division
+static uint32_t smf_cur_tick;             // Tick of the last dispatched event
+static uint32_t smf_cur_us;               // ...and its song time
+static uint16_t smf_cur_frac;
+static uint32_t smf_next_us;              // Song time of the heap top
+static uint16_t smf_next_frac;
+static uint32_t smf_play_us;              // Song clock, advanced by the timebase
+static uint16_t smf_last_tick;            // timebase_now() at the last pass
+
+static const char* const smf_error_names[] = {
+    "ok", "file not found", "not a type 0/1 SMF", "too many tracks", "truncated file"
+};
+
+// ---------------------------------------------------------------------------
+// Disk access
+// ---------------------------------------------------------------------------
+
+static uint32_t smf_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint16_t)p[2] << 8) | p[3];
+}
+
+// Read `len` bytes at `offset` through the shared record buffer (chunk
+// headers only); returns the number read
+static uint16_t smf_read_at(uint32_t offset, uint8_t* buf, uint16_t len) {
+    uint16_t done = 0;
+
+    if ((offset >> 7) > 0xFFFF) return 0;    // Beyond any CP/M file
+    uint16_t record = offset >> 7;
+    uint8_t pos = offset & (SMF_RECORD_SIZE - 1);
+    while (done < len) {
+        const uint8_t* rec = cpmf_record(&smf_file, record);
+        if (!rec) break;
+        uint16_t n = SMF_RECORD_SIZE - pos;
+        if (n > len - done) n = len - done;
+        memcpy(buf + done, rec + pos, n);
+        done += n;
+        pos = 0;
+        record++;
+    }
+    return done;
+}
+
+// Read one CP/M record straight into a track buffer (a short last record
+// is padded with ^Z that the track's byte count never reaches)
+static void smf_read_record(uint16_t record, uint8_t* buf) {
+    cpmf_read_record(&smf_file, record, buf);
+}
+
+static void smf_fill_back(smf_track_t* t) {
+    smf_read_record(t->next_record, t->buf[t->cur ^ 1]);
+    t->next_record++;
+    t->back_ready = 1;
+}
+
+// Next byte of a track, swapping to the read-ahead buffer at a record end
+static uint8_t smf_track_byte(smf_track_t* t) {
+    if (t->remaining == 0) return 0;
+    if (t->pos == SMF_RECORD_SIZE) {
+        if (!t->back_ready) {
+            smf_fill_back(t);
+            smf_stats.underruns++;
+        }
+        t->cur ^= 1;
+        t->pos = 0;
+        t->back_ready = 0;
+    }
+    t->remaining--;
+    return t->buf[t->cur][t->pos++];
+}
+
+static uint32_t smf_track_varlen(smf_track_t* t) {
+    uint32_t value = 0;
+    uint8_t b;
+    do {
+        b = smf_track_byte(t);
+        value = (value << 7) | (b & 0x7F);
+    } while ((b & 0x80) && t->remaining);
+    return value;
+}
+
+static void smf_track_skip(smf_track_t* t, uint32_t len) {
+    while (len-- && t->remaining) {
+        smf_track_byte(t);
+    }
+}
+
+// Parse a track's next channel message or tempo change into t->status.
+// Other meta events and SysEx are skipped (their delta still counts).
+// Returns 0 at the end of the track.
+static uint8_t smf_track_next(smf_track_t* t) {
+    while (t->remaining) {
+        t->tick += smf_track_varlen(t);
+        uint8_t b = smf_track_byte(t);
+
+        if (b == 0xFF) {
+            uint8_t type = smf_track_byte(t);
+            uint32_t len = smf_track_varlen(t);
+            if (type == 0x2F) return 0;              // End of track
+            if (type == 0x51 && len == 3) {
+                t->tempo = (uint32_t)smf_track_byte(t) << 16;
+                t->tempo |= (uint16_t)smf_track_byte(t) << 8;
+                t->tempo |= smf_track_byte(t);
+                t->status = SMF_EVENT_TEMPO;
+                return 1;
+            }
+            smf_track_skip(t, len);
+            continue;
+        }
+        if (b == 0xF0 || b == 0xF7) {
+            smf_track_skip(t, smf_track_varlen(t));
+            continue;
+        }
+
+        if (b & 0x80) {
+            if (b > 0xEF) return 0;                 // Not valid in a file
+            t->running = b;
+            b = smf_track_byte(t);
+        }
+        if (t->running == 0) return 0;              // Data with no status
+
+        t->status = t->running;
+        t->data1 = b;
+        t->data2 = ((t->running & 0xE0) == 0xC0) ? 0 : smf_track_byte(t);
+        return 1;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Track merge
+// ---------------------------------------------------------------------------
+
+static uint8_t smf_heap_less(uint8_t a, uint8_t b) {
+    uint32_t ta = smf_tracks[a].tick;
+    uint32_t tb = smf_tracks[b].tick;
+    return ta < tb || (ta == tb && a < b);
+}
+
+static void smf_heap_push(uint8_t track) {
+    uint8_t i = smf_heap_size++;
+    while (i > 0) {
+        uint8_t parent = (i - 1) >> 1;
+        if (!smf_heap_less(track, smf_heap[parent])) break;
+        smf_heap[i] = smf_heap[parent];
+        i = parent;
+    }
+    smf_heap[i] = track;
+}
+
+// Restore heap order after the top track's tick grew
+static void smf_heap_sift_down(void) {
+    uint8_t track = smf_heap[0];
+    uint8_t i = 0;
+    while (1) {
+        uint8_t child = (i << 1) + 1;
+        if (child >= smf_heap_size) break;
+        if (child + 1 < smf_heap_size && smf_heap_less(smf_heap[child + 1], smf_heap[child])) {
+            child++;
+        }
+        if (!smf_heap_less(smf_heap[child], track)) break;
+        smf_heap[i] = smf_heap[child];
+        i = child;
+    }
+    smf_heap[i] = track;
+}
+
+// ---------------------------------------------------------------------------
+// Timing
+// ---------------------------------------------------------------------------
+
+static void smf_set_tempo(uint32_t tempo) {
+    smf_us_per_tick = tempo / smf_division;
+    smf_us_rem = tempo % smf_division;
+}
+
+// Song time of the heap top, from the last dispatched event's time
+static void smf_schedule_next(void) {
+    uint32_t delta = smf_tracks[smf_heap[0]].tick - smf_cur_tick;
+    uint32_t part = delta * smf_us_rem + smf_cur_frac;
+
+    smf_next_us = smf_cur_us + delta * smf_us_per_tick + part / smf_division;
+    smf_next_frac = part % smf_division;
+}
+
+// ---------------------------------------------------------------------------
+// Player
+// ---------------------------------------------------------------------------
+
+static void smf_close(void) {
+    cpmf_close(&smf_file);
+    smf_playing = 0;
+    smf_heap_size = 0;
+}
+
+// Open a type 0 or type 1 file and start playing it
+uint8_t smf_player_open(const char* filename) {
+    uint8_t hdr[14];
+
+    smf_player_stop();
+    memset(&smf_stats, 0, sizeof(smf_stats));
+    strncpy(smf_name, filename, SMF_NAME_MAX - 1);
+    smf_name[SMF_NAME_MAX - 1] = '\0';
+
+    if (!cpmf_open(&smf_file, filename)) return SMF_ERR_OPEN;
+
+    if (smf_read_at(0, hdr, 14) != 14) {
+        smf_close();
+        return SMF_ERR_READ;
+    }
+    uint16_t format = ((uint16_t)hdr[8] << 8) | hdr[9];
+    uint16_t ntracks = ((uint16_t)hdr[10] << 8) | hdr[11];
+    smf_division = ((uint16_t)hdr[12] << 8) | hdr[13];
+    if (memcmp(hdr, "MThd", 4) != 0 || format > 1 ||
+        smf_division == 0 || (smf_division & 0x8000)) {
+        smf_close();
+        return SMF_ERR_FORMAT;
+    }
+    if (ntracks > SMF_MAX_TRACKS) {
+        smf_close();
+        return SMF_ERR_TRACKS;
+    }
+
+    // Walk the chunks; unknown chunk types are skipped
+    uint32_t offset = 8 + smf_be32(hdr + 4);
+    smf_track_count = 0;
+    while (smf_track_count < ntracks) {
+        if (smf_read_at(offset, hdr, 8) != 8) {
+            smf_close();
+            return SMF_ERR_READ;
+        }
+        uint32_t len = smf_be32(hdr + 4);
+        if (memcmp(hdr, "MTrk", 4) == 0) {
+            uint8_t index = smf_track_count++;
+            smf_track_t* t = &smf_tracks[index];
+            uint32_t start = offset + 8;
+
+            memset(t, 0, sizeof(*t));
+            t->pos = start % SMF_RECORD_SIZE;
+            t->next_record = start / SMF_RECORD_SIZE + 1;
+            t->remaining = len;
+            smf_read_record(t->next_record - 1, t->buf[0]);
+            if (smf_track_next(t)) {
+                smf_heap_push(index);
+            }
+        }
+        offset += 8 + len;
+    }
+
+    smf_set_tempo(SMF_TEMPO_DEFAULT);
+    smf_cur_tick = 0;
+    smf_cur_us = 0;
+    smf_cur_frac = 0;
+    smf_play_us = 0;
+    smf_last_tick = timebase_now();
+    smf_prefetch_next = 0;
+    smf_playing = 1;
+    if (smf_heap_size) {
+        smf_schedule_next();
+    }
+    return SMF_OK;
+}
+
+// Stop playback and silence the synth
+void smf_player_stop(void) {
+    if (smf_playing) {
+        smf_close();
+        synthesizer_panic();
+    }
+}
+
+uint8_t smf_player_active(void) {
+    return smf_playing;
+}
+
+const char* smf_player_error_name(uint8_t error) {
+    if (error > SMF_ERR_READ) error = SMF_ERR_FORMAT;
+    return smf_error_names[error];
+}
+
+const char* smf_player_file(void) {
+    return smf_name;
+}
+
+// Dispatch every event that is due, up to SMF_EVENT_BUDGET per pass so
+// MIDI input and the console are not starved by a dense file
+void smf_player_service(void) {
+    if (!smf_playing) return;
+
+    uint16_t now = timebase_now();
+    smf_play_us += (uint32_t)(uint16_t)(now - smf_last_tick) * 1000;
+    smf_last_tick = now;
+
+    for (uint8_t budget = SMF_EVENT_BUDGET; budget; budget--) {
+        if (smf_heap_size == 0) {
+            smf_close();
+            con_begin(CON_INFO);
+            con_msg(MSG_FINISHED);
+            con_str(smf_name);
+            con_msg(MSG_OPEN_PAREN);
+            con_dec(smf_stats.events);
+            con_msg(MSG_EVENTS);
+            con_dec(smf_stats.underruns);
+            con_msg(MSG_DISK_STALLS);
+            con_msg(MSG_CLOSE_PAREN);
+            con_endl();
+            return;
+        }
+        if ((int32_t)(smf_play_us - smf_next_us) < 0) return;
+
+        uint32_t late = (smf_play_us - smf_next_us) / 1000;
+        if (late > smf_stats.max_late) {
+            smf_stats.max_late = late > 0xFFFF ? 0xFFFF : (uint16_t)late;
+        }
+
+        smf_track_t* t = &smf_tracks[smf_heap[0]];
+        smf_cur_tick = t->tick;
+        smf_cur_us = smf_next_us;
+        smf_cur_frac = smf_next_frac;
+
+        if (t->status == SMF_EVENT_TEMPO) {
+            smf_set_tempo(t->tempo);
+        } else {
+            midi_process_message(t->status, t->data1, t->data2);
+            smf_stats.events++;
+        }
+
+        if (smf_track_next(t)) {
+            smf_heap_sift_down();
+        } else {
+            smf_heap[0] = smf_heap[--smf_heap_size];
+            if (smf_heap_size) smf_heap_sift_down();
+        }
+        if (smf_heap_size) smf_schedule_next();
+    }
+}
+
+// Idle task: fill one empty back buffer, round-robin over the tracks
+void smf_player_prefetch(void) {
+    if (!smf_playing) return;
+
+    for (uint8_t n = 0; n < smf_track_count; n++) {
+        smf_track_t* t = &smf_tracks[smf_prefetch_next];
+        if (++smf_prefetch_next >= smf_track_count) smf_prefetch_next = 0;
+
+        if (!t->back_ready && t->remaining > (uint8_t)(SMF_RECORD_SIZE - t->pos)) {
+            smf_fill_back(t);
+            smf_stats.prefetches++;
+            return;
+        }
+    }
+}
@@ -0,0 +1,230 @@
+#include "../../include/sysex.h"
+#include "../../include/midi_driver.h"
+#include "../../include/chip_interface.h"
+#include "../../include/ym2149.h"
+#include <stdint.h>
+
+sysex_stats_t sysex_stats;
+uint8_t sysex_state = SYSEX_IDLE;
+
+static uint8_t sysex_device = SYSEX_DEVICE_DEFAULT;
+static uint8_t sysex_command;
+static uint8_t sysex_program;
+static uint8_t sysex_count;            // Nibbles received
+static uint8_t sysex_high;             // High nibble of the byte in progress
+static uint8_t sysex_sum;              // Running 7-bit checksum
+static uint8_t* sysex_patch;           // Bank slot being written
+
+// Reply in progress: one patch dump at a time is encoded into
+// sysex_tx_buf and sent a byte per sysex_service() call
+static uint8_t sysex_tx_buf[SYSEX_PATCH_DUMP_LEN];
+static uint8_t sysex_tx_len;           // Bytes in the buffer
+static uint8_t sysex_tx_pos;           // Next byte to send
+static uint8_t sysex_tx_next;          // Next program to encode
+static uint8_t sysex_tx_count;         // Programs still to encode
+
+// Field masks for a patch byte, as ym2149_bank_load() applies them, so a
+// slot is always safe to upload, even part way through a dump
+static const uint8_t sysex_patch_mask[sizeof(ym2149_patch_t)] = {
+    0x1F,                   // noise
+    YM2149_MIX_ALL_OFF,     // mixer
+    0xFF, 0xFF,             // envelope period
+    0x0F,                   // envelope shape
+    YM2149_VOLUME_ENV,      // level_mode
+    YM2149_CURVE_COUNT - 1, // curve
+    0xFF                    // detune
+};
+
+void sysex_init(void) {
+    sysex_state = SYSEX_IDLE;
+    sysex_device = SYSEX_DEVICE_DEFAULT;
+    sysex_stats.dumps = 0;
+    sysex_stats.requests = 0;
+    sysex_stats.ignored = 0;
+    sysex_stats.errors = 0;
+    sysex_tx_len = sysex_tx_pos = 0;
+    sysex_tx_count = 0;
+}
+
+void sysex_set_device(uint8_t device) {
+    sysex_device = device & 0x7F;
+}
+
+uint8_t sysex_get_device(void) {
+    return sysex_device;
+}
+
+// Encode one program from the bank as a patch dump into sysex_tx_buf
+static void sysex_encode_patch(uint8_t program) {
+    const uint8_t* p = (const uint8_t*)&ym2149_bank[program];
+    uint8_t* out = sysex_tx_buf;
+    uint8_t sum = program;
+
+    *out++ = 0xF0;
+    *out++ = SYSEX_ID;
+    *out++ = sysex_device;
+    *out++ = SYSEX_PATCH_DUMP;
+    *out++ = program;
+    for (uint8_t i = 0; i < sizeof(ym2149_patch_t); i++) {
+        uint8_t high = p[i] >> 4;
+        uint8_t low = p[i] & 0x0F;
+        *out++ = high;
+        *out++ = low;
+        sum += high + low;
+    }
+    *out++ = (uint8_t)-sum & 0x7F;
+    *out = 0xF7;
+    sysex_tx_len = SYSEX_PATCH_DUMP_LEN;
+    sysex_tx_pos = 0;
+}
+
+// Queue `count` programs from `first` as the reply.  A dump already on
+// the wire is finished first.  No reply unless MIDI OUT is set up.
+static void sysex_reply(uint8_t first, uint8_t count) {
+    if (midi_get_mode() != MIDI_MODE_BIOS) return;
+    sysex_tx_next = first;
+    sysex_tx_count = count;
+}
+
+// Send the next reply byte if the transmitter is free.  Called every
+// scheduler pass; a byte takes 320 us at 31250 baud, so one per pass
+// keeps up without ever waiting.
+void sysex_service(void) {
+    if (sysex_tx_pos == sysex_tx_len) {
+        if (sysex_tx_count == 0) return;
+        sysex_encode_patch(sysex_tx_next++);
+        sysex_tx_count--;
+    }
+    if (midi_get_mode() != MIDI_MODE_BIOS) {
+        sysex_tx_len = sysex_tx_pos = 0;    // MIDI OUT went away: drop it
+        sysex_tx_count = 0;
+        return;
+    }
+    if (midi_driver_send_ready()) {
+        midi_driver_send(sysex_tx_buf[sysex_tx_pos++]);
+    }
+}
+
+uint8_t sysex_tx_busy(void) {
+    return sysex_tx_pos != sysex_tx_len || sysex_tx_count != 0;
+}
+
+void sysex_start(void) {
+    sysex_state = SYSEX_MANUFACTURER;
+}
+
+// One data byte.  Each state takes its byte and names the next, so a
+// byte costs the same whatever the message length.
+void sysex_byte(uint8_t byte) {
+    switch (sysex_state) {
+        case SYSEX_MANUFACTURER:
+            if (byte == SYSEX_ID) {
+                sysex_state = SYSEX_DEVICE;
+            } else {
+                sysex_stats.ignored++;
+                sysex_state = SYSEX_SKIP;
+            }
+            break;
+
+        case SYSEX_DEVICE:
+            if (byte == sysex_device || byte == SYSEX_DEVICE_ALL ||
+                sysex_device == SYSEX_DEVICE_ALL) {
+                sysex_state = SYSEX_COMMAND;
+            } else {
+                sysex_stats.ignored++;
+                sysex_state = SYSEX_SKIP;
+            }
+            break;
+
+        case SYSEX_COMMAND:
+            sysex_command = byte;
+            if (byte == SYSEX_PATCH_DUMP || byte == SYSEX_PATCH_REQUEST) {
+                sysex_state = SYSEX_PROGRAM;
+            } else if (byte == SYSEX_BANK_REQUEST) {
+                sysex_state = SYSEX_END;
+            } else {
+                sysex_stats.errors++;
+                sysex_state = SYSEX_SKIP;
+            }
+            break;
+
+        case SYSEX_PROGRAM:
+            sysex_program = byte;
+            if (sysex_command == SYSEX_PATCH_DUMP) {
+                sysex_patch = (uint8_t*)&ym2149_bank[byte];
+                sysex_sum = byte;
+                sysex_count = 0;
+                sysex_state = SYSEX_DATA;
+            } else {
+                sysex_state = SYSEX_END;
+            }
+            break;
+
+        case SYSEX_DATA:
+            // Decode into the bank slot as the low nibble of each byte lands
+            byte &= 0x0F;
+            sysex_sum += byte;
+            if (!(sysex_count & 1)) {
+                sysex_high = byte << 4;
+            } else {
+                uint8_t i = sysex_count >> 1;
+                sysex_patch[i] = (sysex_high | byte) & sysex_patch_mask[i];
+            }
+            if (++sysex_count == SYSEX_PATCH_NIBBLES) {
+                sysex_state = SYSEX_CHECKSUM;
+            }
+            break;
+
+        case SYSEX_CHECKSUM:
+            sysex_sum += byte;
+            sysex_state = SYSEX_END;
+            break;
+
+        case SYSEX_END:
+            sysex_stats.errors++;       // Longer than its command allows
+            sysex_state = SYSEX_SKIP;
+            break;
+
+        default:                        // SYSEX_SKIP
+            break;
+    }
+}
+
+// End of message: act on it if it arrived whole
+void sysex_end(uint8_t eox) {
+    uint8_t state = sysex_state;
+
+    sysex_state = SYSEX_IDLE;
+    if (state == SYSEX_SKIP || state == SYSEX_IDLE) return;
+    if (state != SYSEX_END || !eox) {
+        sysex_stats.errors++;           // Truncated
+        return;
+    }
+
+    switch (sysex_command) {
+        case SYSEX_PATCH_DUMP:
+            // A bad checksum leaves the (masked, playable) bytes in the
+            // slot; the sender is expected to retry
+            if (sysex_sum & 0x7F) {
+                sysex_stats.errors++;
+                return;
+            }
+            sysex_stats.dumps++;
+            // Cards with this program loaded take its new register image;
+            // the shadow leaves the others untouched
+            if (current_chip && current_chip->chip_id == CHIP_YM2149) {
+                ym2149_patch_refresh();
+            }
+            break;
+
+        case SYSEX_PATCH_REQUEST:
+            sysex_stats.requests++;
+            sysex_reply(sysex_program, 1);
+            break;
+
+        case SYSEX_BANK_REQUEST:
+            sysex_stats.requests++;
+            sysex_reply(0, YM2149_BANK_SIZE);
+            break;
+    }
+}
@@ -0,0 +1,117 @@
+-- tests/e2e/mame_iotap.lua
+--
+-- I/O tap for the MIDI stress test, loaded by mame_test.lua when
+-- run_e2e.sh is started with --midi-stress.
+--
+-- Logs every byte the Z80 reads from the MIDI SIO data port and every
+-- YM2149 register write, stamped with emulated time, so midi_stress.py
+-- can line up what was sent, what the synth actually received and what
+-- it did with it.  One record per line:
+--
+--   R <usec> <byte>          SIO data port read (a received MIDI byte)
+--   W <usec> <card> <reg> <value>
+--                            YM2149 register write (latched register)
+--
+-- Times are emulated microseconds since the tap was installed, at the
+-- resolution of MAME's scheduler timeslices (well under a millisecond with
+-- the SIO running).  Values are hex.  The log is flushed once per frame so
+-- the Python side can read it while MAME is still running.
+--
+-- Environment:
+--   MIDI_TAP        log path (required)
+--   TAP_SIO_DATA    MIDI SIO data port (default 0x83, SIO channel B)
+--   TAP_YM_PORTS    YM2149 cards as addr:data pairs, comma-separated
+--                   (default D8:D0)
+--   PROFILE_CPU     device tag of the Z80 (default: first z80 device)
+
+local iotap = {}
+
+local log_path = os.getenv("MIDI_TAP")
+local sio_data = tonumber(os.getenv("TAP_SIO_DATA") or "0x83")
+
+local fh
+local start_time
+local handlers = {}     -- Taps are removed when garbage collected
+local latch = {}        -- card index -> latched register
+local addr_card = {}    -- address port -> card index
+local data_card = {}    -- data port -> card index
+
+local function now_us()
+    return math.floor((manager.machine.time:as_double() - start_time) * 1e6)
+end
+
+local function parse_ports(spec)
+    local n = 0
+    for a, d in spec:gmatch("(%x+):(%x+)") do
+        addr_card[tonumber(a, 16)] = n
+        data_card[tonumber(d, 16)] = n
+        latch[n] = 0
+        n = n + 1
+    end
+    return n
+end
+
+local function find_cpu()
+    local tag = os.getenv("PROFILE_CPU")
+    if tag then
+        return manager.machine.devices[tag]
+    end
+    for _, dev in pairs(manager.machine.devices) do
+        if dev.shortname == "z80" then
+            return dev
+        end
+    end
+    return nil
+end
+
+function iotap.start()
+    fh = io.open(log_path or "", "w")
+    if not fh then
+        print("[mame_iotap] cannot open tap log " .. tostring(log_path))
+        return false
+    end
+    local cpu = find_cpu()
+    if not cpu then
+        print("[mame_iotap] Z80 not found — set PROFILE_CPU")
+        return false
+    end
+    local cards = parse_ports(os.getenv("TAP_YM_PORTS") or "D8:D0")
+    local io_space = cpu.spaces["io"]
+    start_time = manager.machine.time:as_double()
+
+    -- The Z80 puts B or A on the upper address lines during IN/OUT, so tap
+    -- the whole space and decode the low byte as the RC2014 bus does.
+    handlers[#handlers + 1] = io_space:install_read_tap(0x0000, 0xFFFF, "midi_rx",
+        function(offset, data, mask)
+            if (offset & 0xFF) == sio_data then
+                fh:write(string.format("R %d %02X\n", now_us(), data & 0xFF))
+            end
+        end)
+    handlers[#handlers + 1] = io_space:install_write_tap(0x0000, 0xFFFF, "ym_regs",
+        function(offset, data, mask)
+            local port = offset & 0xFF
+            local card = addr_card[port]
+            if card then
+                latch[card] = data & 0x0F
+                return
+            end
+            card = data_card[port]
+            if card then
+                fh:write(string.format("W %d %d %X %02X\n",
+                    now_us(), card, latch[card], data & 0xFF))
+            end
+        end)
+
+    emu.register_frame_done(function()
+        fh:flush()
+    end)
+    emu.add_machine_stop_notifier(function()
+        fh:close()
+    end)
+
+    print(string.format("[mame_iotap] SIO data 0x%02X, %d YM2149 card(s) → %s",
+        sio_data, cards, log_path))
+    return true
+end
+
+return iotap
@@ -0,0 +1,278 @@
+-- tests/e2e/mame_profile.lua
+--
+-- T-state profiler for hot-path functions, loaded by mame_test.lua when
+-- run_e2e.sh is started with --profile.
+--
+-- How it works
+-- ------------
+-- 1. Function addresses come from the z88dk map file (zcc -m), e.g.
+--      _midi_process_byte  = $1A2B ; addr, public, , midi_driver_c, ...
+-- 2. A debugger breakpoint is set on each function's entry.  MAME must run
+--    with "-debug -debugger none" so breakpoints work without a debugger UI.
+-- 3. When an entry breakpoint stops the CPU, the return address is read
+--    from (SP) and a second breakpoint is set there.  The call has returned
+--    when that address is reached with SP back above the return address.
+-- 4. Cycle counts come from the debugger's totalcycles symbol (Z80 clock
+--    cycles = T-states).  Time spent in profiled callees is tracked so each
+--    function gets both inclusive and self T-states.
+-- 5. On machine stop a JSON report is written (see write_report), which
+--    tests/e2e/profile_compare.py diffs between builds.
+--
+-- Interrupts taken inside a profiled call (the SIO receive ISR, HBIOS
+-- timer) are counted in that call, so max values can show ISR spikes.
+--
+-- Environment:
+--   PROFILE_MAP    z88dk map file (required)
+--   PROFILE_OUT    report path (default tests/e2e/results/profile.json)
+--   PROFILE_FUNCS  comma-separated C function names (default: see below)
+--   PROFILE_CPU    device tag of the Z80 (default: first z80 device)
+
+local profile = {}
+
+local DEFAULT_FUNCS = {
+    "midi_process_byte",
+    "midi_process_message",
+    "allocate_voice",
+    "ym2149_write_register",
+    "ym2149_note_on",
+}
+
+local MAX_DEPTH = 64    -- Frames kept; deeper means we lost returns
+
+local map_path = os.getenv("PROFILE_MAP")
+local out_path = os.getenv("PROFILE_OUT") or "tests/e2e/results/profile.json"
+
+local cpu, dbg, program
+local funcs = {}        -- name -> { addr, calls, total, self, min, max }
+local by_addr = {}      -- entry address -> func
+local exit_bps = {}     -- return address -> { bp, refs }
+local frames = {}       -- outstanding calls, innermost last
+local lost = 0          -- frames dropped (MAX_DEPTH) or unmatched
+
+-- ---------------------------------------------------------------------------
+-- Map file
+-- ---------------------------------------------------------------------------
+
+local function load_map(path, wanted)
+    local fh = io.open(path, "r")
+    if not fh then
+        return nil, "cannot open map file " .. path
+    end
+    local found = {}
+    for line in fh:lines() do
+        local sym, hex = line:match("^_([%w_]+)%s*=%s*%$(%x+)")
+        if sym and wanted[sym] then
+            found[sym] = tonumber(hex, 16)
+        end
+    end
+    fh:close()
+    return found
+end
+
+-- ---------------------------------------------------------------------------
+-- CPU access
+-- ---------------------------------------------------------------------------
+
+local function find_cpu()
+    local tag = os.getenv("PROFILE_CPU")
+    if tag then
+        return manager.machine.devices[tag]
+    end
+    for _, dev in pairs(manager.machine.devices) do
+        if dev.shortname == "z80" then
+            return dev
+        end
+    end
+    return nil
+end
+
+-- Clock cycles executed so far, from the debugger's totalcycles symbol
+local function total_cycles()
+    dbg:command('printf "%d",totalcycles')
+    local log = dbg.consolelog
+    return tonumber(log[#log]) or 0
+end
+
+local function exit_bp_add(addr)
+    local e = exit_bps[addr]
+    if e then
+        e.refs = e.refs + 1
+    else
+        exit_bps[addr] = { bp = cpu.debug:bpset(addr), refs = 1 }
+    end
+end
+
+local function exit_bp_release(addr)
+    local e = exit_bps[addr]
+    if not e then return end
+    e.refs = e.refs - 1
+    if e.refs == 0 and not by_addr[addr] then
+        cpu.debug:bpclear(e.bp)
+        exit_bps[addr] = nil
+    end
+end
+
+-- ---------------------------------------------------------------------------
+-- Breakpoint handling (called from the periodic hook while stopped)
+-- ---------------------------------------------------------------------------
+
+local function on_stop()
+    local pc = cpu.state["PC"].value
+    local sp = cpu.state["SP"].value
+    local now = total_cycles()
+
+    -- Returns: the innermost call whose return address is reached at its
+    -- caller's stack level.  A skipped conditional call passes the same
+    -- address, but only while no frame for it is outstanding.
+    while #frames > 0 do
+        local top = frames[#frames]
+        if top.ret ~= pc or top.sp ~= sp then break end
+        frames[#frames] = nil
+        local f = top.func
+        local elapsed = now - top.start
+        f.calls = f.calls + 1
+        f.total = f.total + elapsed
+        f.self = f.self + elapsed - top.children
+        if elapsed < f.min then f.min = elapsed end
+        if elapsed > f.max then f.max = elapsed end
+        if #frames > 0 then
+            local parent = frames[#frames]
+            parent.children = parent.children + elapsed
+        end
+        exit_bp_release(pc)
+    end
+
+    -- Entry
+    local f = by_addr[pc]
+    if f then
+        if #frames >= MAX_DEPTH then
+            lost = lost + #frames
+            for _, fr in ipairs(frames) do exit_bp_release(fr.ret) end
+            frames = {}
+        end
+        local ret = program:read_u16(sp)
+        frames[#frames + 1] = {
+            func = f, start = now, ret = ret, sp = (sp + 2) & 0xFFFF,
+            children = 0,
+        }
+        exit_bp_add(ret)
+    end
+
+    dbg.execution_state = "run"
+end
+
+-- ---------------------------------------------------------------------------
+-- Report
+-- ---------------------------------------------------------------------------
+
+local function write_report()
+    local fh = io.open(out_path, "w")
+    if not fh then
+        print("[mame_profile] cannot write " .. out_path)
+        return
+    end
+
+    local names = {}
+    for name in pairs(funcs) do names[#names + 1] = name end
+    table.sort(names)
+
+    fh:write("{\n")
+    fh:write(string.format('  "map": "%s",\n', map_path))
+    fh:write(string.format('  "cpu_clock": %d,\n', cpu.clock))
+    fh:write(string.format('  "lost_frames": %d,\n', lost))
+    fh:write('  "functions": {\n')
+    for i, name in ipairs(names) do
+        local f = funcs[name]
+        local calls = f.calls
+        fh:write(string.format(
+            '    "%s": {"addr": %d, "calls": %d, "tstates_total": %d, ' ..
+            '"tstates_avg": %.1f, "tstates_self_avg": %.1f, ' ..
+            '"tstates_min": %d, "tstates_max": %d}%s\n',
+            name, f.addr, calls, f.total,
+            calls > 0 and f.total / calls or 0,
+            calls > 0 and f.self / calls or 0,
+            calls > 0 and f.min or 0, f.max,
+            i < #names and "," or ""))
+    end
+    fh:write('  },\n')
+
+    -- Cost per complete MIDI message: every byte's parse cost, spread
+    -- over the messages that were dispatched
+    local bytes = funcs["midi_process_byte"]
+    local msgs = funcs["midi_process_message"]
+    local per_msg = 0
+    if bytes and msgs and msgs.calls > 0 then
+        per_msg = bytes.total / msgs.calls
+    end
+    fh:write(string.format(
+        '  "per_midi_message": {"messages": %d, "tstates": %.1f}\n',
+        msgs and msgs.calls or 0, per_msg))
+    fh:write("}\n")
+    fh:close()
+
+    print("[mame_profile] report written to " .. out_path)
+    for _, name in ipairs(names) do
+        local f = funcs[name]
+        print(string.format("[mame_profile] %-24s %6d calls  avg %7.1f T  self %7.1f T  max %d T",
+            name, f.calls, f.calls > 0 and f.total / f.calls or 0,
+            f.calls > 0 and f.self / f.calls or 0, f.max))
+    end
+end
+
+-- ---------------------------------------------------------------------------
+-- Start-up
+-- ---------------------------------------------------------------------------
+
+function profile.start()
+    dbg = manager.machine.debugger
+    if not dbg then
+        print("[mame_profile] debugger not enabled — run MAME with -debug -debugger none")
+        return false
+    end
+    cpu = find_cpu()
+    if not cpu then
+        print("[mame_profile] Z80 not found — set PROFILE_CPU")
+        return false
+    end
+    program = cpu.spaces["program"]
+
+    local list = DEFAULT_FUNCS
+    local env = os.getenv("PROFILE_FUNCS")
+    if env and env ~= "" then
+        list = {}
+        for name in env:gmatch("[^,%s]+") do list[#list + 1] = name end
+    end
+    local wanted = {}
+    for _, name in ipairs(list) do wanted[name] = true end
+
+    local addrs, err = load_map(map_path or "", wanted)
+    if not addrs then
+        print("[mame_profile] " .. err)
+        return false
+    end
+
+    for _, name in ipairs(list) do
+        local addr = addrs[name]
+        if addr then
+            local f = { addr = addr, calls = 0, total = 0, self = 0,
+                        min = math.huge, max = 0 }
+            funcs[name] = f
+            by_addr[addr] = f
+            cpu.debug:bpset(addr)
+            print(string.format("[mame_profile] %-24s $%04X", name, addr))
+        else
+            print("[mame_profile] not in map: " .. name)
+        end
+    end
+
+    -- The debugger calls periodic hooks while the CPU is stopped
+    emu.register_periodic(function()
+        if dbg.execution_state == "stop" then
+            on_stop()
+        end
+    end)
+    emu.add_machine_stop_notifier(write_report)
+    return true
+end
+
+return profile
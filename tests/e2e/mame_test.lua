@@ -22,6 +22,16 @@
 -- A frame-count safety cutoff is also provided so that a hung Python script
 -- cannot leave MAME running forever.
 --
+-- Profiling
+-- ---------
+-- When PROFILE_MAP is set (run_e2e.sh --profile) this script also loads
+-- mame_profile.lua, which counts T-states per call for the hot-path
+-- functions and writes a JSON report when the machine stops.
+--
+-- When MIDI_TAP is set (run_e2e.sh --midi-stress) it loads mame_iotap.lua,
+-- which logs MIDI bytes read from the SIO and YM2149 register writes for
+-- midi_stress.py to correlate.
+--
 -- Requirements: MAME 0.229+ (tested with 0.264)
 
 local RESULTS_DIR = "tests/e2e/results"
@@ -49,6 +59,20 @@ print("[mame_test] null-modem watchdog started")
 print("[mame_test] Waiting for done flag: " .. DONE_FLAG)
 print("[mame_test] Safety cutoff: " .. MAX_FRAMES .. " frames")
 
+if os.getenv("PROFILE_MAP") then
+    local profile = dofile("tests/e2e/mame_profile.lua")
+    if profile.start() then
+        print("[mame_test] profiling enabled")
+    end
+end
+
+if os.getenv("MIDI_TAP") then
+    local iotap = dofile("tests/e2e/mame_iotap.lua")
+    if iotap.start() then
+        print("[mame_test] MIDI/YM2149 I/O tap enabled")
+    end
+end
+
 -- ---------------------------------------------------------------------------
 -- Per-frame callback
 -- ---------------------------------------------------------------------------
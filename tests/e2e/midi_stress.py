@@ -0,0 +1,499 @@
+#!/usr/bin/env python3
+# tests/e2e/midi_stress.py
+#
+# MIDI stress / replay generator and drop detector for the E2E harness.
+#
+# null_modem_terminal.py uses this module to stream a Standard MIDI File or
+# a synthetic worst case into the MIDI (rs232b) socket at the real MIDI byte
+# rate, then correlates what was sent with what MAME saw:
+#
+#   sent bytes ──(SIO reads, mame_iotap.lua "R" records)──> received bytes
+#   received note-ons ──(YM2149 writes, "W" records)──────> sounding voices
+#
+# and reports, per rate step:
+#   bytes_dropped   sent but never read from the SIO (receiver overrun)
+#   notes_dropped   a note-on that never produced a sounding YM2149 voice
+#   notes_late      the voice started more than --late-ms after the last
+#                   byte of the note-on was read
+# plus stuck_notes: voices still sounding after every note-off was sent.
+#
+# The synthetic stream is the worst case the parser has to cope with: dense
+# six-note chords on four channels, CC volume sweeps, running status for the
+# whole stream, realtime clock bytes interleaved inside messages and
+# velocity-0 note-offs.  With several rate multipliers (--rates 1,2,4) each
+# step compresses the same stream in time; the highest step with no drops
+# is reported as the throughput ceiling for the build.
+#
+# Stand-alone use (no MAME needed):
+#   midi_stress.py generate [--smf FILE] -o sent.json
+#   midi_stress.py analyse sent.json tap.log [--late-ms N]
+#
+# Requires Python 3.9+ (stdlib only).
+
+from __future__ import annotations
+
+import argparse
+import bisect
+import heapq
+import json
+import math
+import pathlib
+import struct
+import sys
+import time
+
+MIDI_BYTE_RATE = 3125        # 31250 baud, 10 bits per byte
+YM_CLOCK = 1843200           # Matches the ym2149.c frequency table
+YM_VOICES_PER_CARD = 3
+NOTE_MIN, NOTE_MAX = 24, 96  # The synth clamps notes to this range
+LATE_MS_DEFAULT = 10.0
+MATCH_WINDOW_MS = 250.0      # Longest latency still counted as "late"
+BEND_TOLERANCE = 2           # Semitones allowed while a channel is bent
+ALIGN_LOOKAHEAD = 64         # Sent bytes searched per received byte
+REALTIME_CLOCK = 0xF8
+
+
+# ---------------------------------------------------------------------------
+# Sources: (time in seconds, complete MIDI message) lists
+# ---------------------------------------------------------------------------
+
+def _read_varlen(data: bytes, pos: int) -> tuple[int, int]:
+    value = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value = (value << 7) | (b & 0x7F)
+        if not b & 0x80:
+            return value, pos
+
+
+def _parse_track(data: bytes):
+    """Yield (tick, message) for channel messages and (tick, tempo) for
+    tempo meta events as (tick, None, tempo)."""
+    pos, tick, status = 0, 0, 0
+    while pos < len(data):
+        delta, pos = _read_varlen(data, pos)
+        tick += delta
+        b = data[pos]
+        if b == 0xFF:
+            kind = data[pos + 1]
+            length, pos = _read_varlen(data, pos + 2)
+            if kind == 0x51 and length == 3:
+                yield tick, None, int.from_bytes(data[pos:pos + 3], "big")
+            pos += length
+            if kind == 0x2F:
+                return
+            continue
+        if b in (0xF0, 0xF7):
+            length, pos = _read_varlen(data, pos + 1)
+            pos += length
+            continue
+        if b & 0x80:
+            status = b
+            pos += 1
+        size = 1 if status & 0xE0 == 0xC0 else 2
+        yield tick, bytes([status]) + data[pos:pos + size], None
+        pos += size
+
+
+def read_smf(path: str | pathlib.Path) -> list[tuple[float, bytes]]:
+    """Read a type 0 or type 1 SMF into a time-ordered message list.
+    Tracks are merged with a heap; SysEx and meta events are dropped."""
+    data = pathlib.Path(path).read_bytes()
+    if data[:4] != b"MThd":
+        raise ValueError(f"{path}: not a Standard MIDI File")
+    hlen = struct.unpack(">I", data[4:8])[0]
+    fmt, ntracks, division = struct.unpack(">HHH", data[8:14])
+    if fmt not in (0, 1):
+        raise ValueError(f"{path}: SMF type {fmt} not supported")
+    if division & 0x8000:
+        raise ValueError(f"{path}: SMPTE time division not supported")
+
+    tracks, pos = [], 8 + hlen
+    while pos < len(data) and len(tracks) < ntracks:
+        clen = struct.unpack(">I", data[pos + 4:pos + 8])[0]
+        if data[pos:pos + 4] == b"MTrk":
+            tracks.append(_parse_track(data[pos + 8:pos + 8 + clen]))
+        pos += 8 + clen
+
+    events: list[tuple[float, bytes]] = []
+    tempo, last_tick, seconds = 500000, 0, 0.0
+    merged = heapq.merge(*[((t, i, n, m, tp) for n, (t, m, tp) in enumerate(tr))
+                           for i, tr in enumerate(tracks)])
+    for tick, _track, _n, msg, new_tempo in merged:
+        seconds += (tick - last_tick) * tempo / (division * 1e6)
+        last_tick = tick
+        if new_tempo is not None:
+            tempo = new_tempo
+        else:
+            events.append((seconds, msg))
+    return events
+
+
+def synthetic() -> list[tuple[float, bytes]]:
+    """Worst-case stream: everything back to back, no musical pauses."""
+    events: list[tuple[float, bytes]] = []
+    t = 0.0
+
+    def add(*msg: int, hold: float = 0.0) -> None:
+        nonlocal t
+        events.append((t, bytes(msg)))
+        t += hold
+
+    # Dense chords: six notes on each of four channels, all at once
+    chord = (48, 52, 55, 60, 64, 67)
+    for step in range(8):
+        root = step * 2
+        for ch in range(4):
+            for n in chord:
+                add(0x90 | ch, n + root, 100)
+        t += 0.05
+        for ch in range(4):
+            for n in chord:
+                add(0x80 | ch, n + root, 0)
+
+    # CC volume sweeps over a held chord; end at full volume before release
+    for ch in range(4):
+        add(0x90 | ch, 60 + ch * 4, 110)
+    for value in list(range(0, 128)) + list(range(127, -1, -8)) + [127]:
+        for ch in range(4):
+            add(0xB0 | ch, 1 + ch, value)
+    for ch in range(4):
+        add(0x80 | ch, 60 + ch * 4, 0)
+
+    # Fast repeats and velocity-0 note-offs (running status throughout)
+    for rep in range(32):
+        note = 40 + (rep * 7) % 48
+        add(0x90, note, 90)
+        add(0x90, note, 0)
+        add(0x91, note + 12, 70)
+        add(0x81, note + 12, 64)
+
+    # Pitch bend with notes held, then centred again
+    add(0x92, 69, 100)
+    for value in range(0, 0x4000, 0x400):
+        add(0xE2, value & 0x7F, value >> 7)
+    add(0xE2, 0x00, 0x40)
+    add(0x82, 69, 0)
+    return events
+
+
+def encode(events: list[tuple[float, bytes]], realtime_every: int = 5):
+    """Encode with running status and a clock byte every `realtime_every`
+    bytes (also inside messages).  Returns (bytes, byte times, messages)
+    where each message is (first index, last index, time, full message)."""
+    out = bytearray()
+    times: list[float] = []
+    msgs = []
+    status = 0
+    for t, msg in events:
+        first = None
+        body = msg[1:] if msg[0] == status else msg
+        status = msg[0]
+        for b in body:
+            if realtime_every and len(out) % realtime_every == realtime_every - 1:
+                out.append(REALTIME_CLOCK)
+                times.append(t)
+            if first is None:
+                first = len(out)
+            out.append(b)
+            times.append(t)
+        msgs.append((first, len(out) - 1, t, msg))
+    return bytes(out), times, msgs
+
+
+def build(source: str, rates: list[float]) -> dict:
+    """The full stream: `source` once per rate multiplier, compressed in
+    time by that factor, with a 200 ms gap between steps."""
+    events = synthetic() if source == "synthetic" else read_smf(source)
+    data, times, msgs = encode(events)
+    plan = {"source": source, "bytes": bytearray(), "times": [],
+            "msgs": [], "segments": []}
+    offset_t = 0.0
+    for rate in rates:
+        base = len(plan["bytes"])
+        plan["bytes"] += data
+        plan["times"] += [offset_t + tt / rate for tt in times]
+        plan["msgs"] += [(a + base, b + base, offset_t + tt / rate, m)
+                         for a, b, tt, m in msgs]
+        plan["segments"].append({"rate": rate, "first": base,
+                                 "last": len(plan["bytes"]) - 1})
+        span = (times[-1] if times else 0.0) / rate
+        offset_t += max(span, len(data) / (MIDI_BYTE_RATE * rate)) + 0.2
+    return plan
+
+
+def save_plan(plan: dict, path: str | pathlib.Path) -> None:
+    pathlib.Path(path).write_text(json.dumps({
+        "source": plan["source"],
+        "bytes": bytes(plan["bytes"]).hex(),
+        "msgs": [[a, b, t, m.hex()] for a, b, t, m in plan["msgs"]],
+        "segments": plan["segments"],
+    }))
+
+
+def load_plan(path: str | pathlib.Path) -> dict:
+    raw = json.loads(pathlib.Path(path).read_text())
+    return {
+        "source": raw["source"],
+        "bytes": bytes.fromhex(raw["bytes"]),
+        "msgs": [(a, b, t, bytes.fromhex(m)) for a, b, t, m in raw["msgs"]],
+        "segments": raw["segments"],
+    }
+
+
+# ---------------------------------------------------------------------------
+# Streaming
+# ---------------------------------------------------------------------------
+
+def stream(send, plan: dict) -> float:
+    """Send the plan through `send(bytes)`, each byte no earlier than its
+    event time and no faster than its step's multiple of the MIDI byte
+    rate (wall clock).  Returns the seconds taken."""
+    data = plan["bytes"]
+    due = list(plan["times"])
+    for seg in plan["segments"]:
+        gap = 1.0 / (MIDI_BYTE_RATE * seg["rate"])
+        for i in range(seg["first"] + 1, seg["last"] + 1):
+            due[i] = max(due[i], due[i - 1] + gap)
+
+    start = time.monotonic()
+    i = 0
+    while i < len(data):
+        now = time.monotonic() - start
+        j = i
+        while j < len(data) and due[j] <= now:
+            j += 1
+        if j > i:
+            send(bytes(data[i:j]))
+            i = j
+        else:
+            time.sleep(min(0.002, due[i] - now))
+    return time.monotonic() - start
+
+
+# ---------------------------------------------------------------------------
+# Analysis
+# ---------------------------------------------------------------------------
+
+def read_tap(path: str | pathlib.Path):
+    reads, writes = [], []
+    for line in pathlib.Path(path).read_text().splitlines():
+        f = line.split()
+        if len(f) == 3 and f[0] == "R":
+            reads.append((int(f[1]), int(f[2], 16)))
+        elif len(f) == 5 and f[0] == "W":
+            writes.append((int(f[1]), int(f[2]), int(f[3], 16), int(f[4], 16)))
+    return reads, writes
+
+
+def align(sent: bytes, reads: list[tuple[int, int]]) -> list[int | None]:
+    """Map each sent byte to the time (usec) it was read, or None if it was
+    dropped.  Overruns drop bytes but never reorder them, so a greedy
+    forward match is enough."""
+    at: list[int | None] = [None] * len(sent)
+    pos = 0
+    for us, b in reads:
+        for k in range(pos, min(pos + ALIGN_LOOKAHEAD, len(sent))):
+            if sent[k] == b:
+                at[k] = us
+                pos = k + 1
+                break
+    return at
+
+
+def period_to_note(period: int) -> int | None:
+    if period == 0:
+        return None
+    freq = YM_CLOCK / (16 * period)
+    return round(69 + 12 * math.log2(freq / 440.0))
+
+
+class YmModel:
+    """Replays YM2149 writes in time order and records voice starts."""
+
+    def __init__(self, writes):
+        self.writes = writes
+        self.pos = 0
+        self.regs: dict[tuple[int, int], int] = {}
+        self.starts: list[tuple[int, int]] = []      # (usec, note)
+        self._replay_all()
+        self.regs = {}
+
+    def _level(self, card, ch):
+        return self.regs.get((card, 8 + ch), 0) & 0x1F
+
+    def _note(self, card, ch):
+        period = (self.regs.get((card, ch * 2), 0)
+                  | (self.regs.get((card, ch * 2 + 1), 0) & 0x0F) << 8)
+        return period_to_note(period)
+
+    def _apply(self, w, record):
+        us, card, reg, val = w
+        ch = reg - 8 if 8 <= reg <= 10 else (reg // 2 if reg < 6 else None)
+        was = self._level(card, ch) if ch is not None else 0
+        self.regs[(card, reg)] = val
+        if ch is None or not record:
+            return
+        # A voice starts when its level rises from zero, or when its pitch
+        # changes while it sounds (a steal or retrigger)
+        if self._level(card, ch) and (not was or reg < 6):
+            note = self._note(card, ch)
+            if note is not None:
+                self.starts.append((us, note))
+
+    def _replay_all(self):
+        for w in self.writes:
+            self._apply(w, True)
+        self.final = dict(self.regs)
+
+    def advance(self, us):
+        while self.pos < len(self.writes) and self.writes[self.pos][0] <= us:
+            self._apply(self.writes[self.pos], False)
+            self.pos += 1
+
+    def sounding(self):
+        notes = set()
+        for (card, reg) in list(self.regs):
+            if 8 <= reg <= 10 and self._level(card, reg - 8):
+                n = self._note(card, reg - 8)
+                if n is not None:
+                    notes.add(n)
+        return notes
+
+    def stuck(self):
+        self.regs = self.final
+        out = []
+        for (card, reg) in sorted(self.final):
+            if 8 <= reg <= 10 and self._level(card, reg - 8):
+                out.append({"voice": card * YM_VOICES_PER_CARD + reg - 8,
+                            "note": self._note(card, reg - 8)})
+        return out
+
+
+def _percentile(values: list[float], pct: float) -> float:
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * pct / 100))]
+
+
+def analyse(plan: dict, tap_path: str | pathlib.Path,
+            late_ms: float = LATE_MS_DEFAULT) -> dict:
+    sent = plan["bytes"]
+    reads, writes = read_tap(tap_path)
+    at = align(sent, reads)
+    ym = YmModel(writes)
+    start_times = [s[0] for s in ym.starts]
+
+    # Expected voices: note-ons loud enough to be heard, in arrival order
+    bent = [False] * 16
+    expected = []
+    for first, last, _t, msg in plan["msgs"]:
+        kind, ch = msg[0] & 0xF0, msg[0] & 0x0F
+        if kind == 0xE0:
+            bent[ch] = msg[1:3] != b"\x00\x40"
+        elif kind == 0x90 and msg[2] * 15 // 127 > 0:
+            note = min(max(msg[1], NOTE_MIN), NOTE_MAX)
+            received = all(at[k] is not None for k in range(first, last + 1))
+            expected.append((at[last] if received else None, first, note,
+                             BEND_TOLERANCE if bent[ch] else 0))
+
+    outcome: dict[int, tuple[str, float]] = {}      # first index -> result
+    window = int(MATCH_WINDOW_MS * 1000)
+    for us, first, note, tol in sorted(expected, key=lambda e: (e[0] is None, e[0] or 0)):
+        if us is None:
+            outcome[first] = ("lost", 0.0)
+            continue
+        ym.advance(us)
+        if any(abs(n - note) <= tol for n in ym.sounding()):
+            outcome[first] = ("ok", 0.0)
+            continue
+        k = bisect.bisect_left(start_times, us)
+        result = ("dropped", 0.0)
+        while k < len(ym.starts) and ym.starts[k][0] <= us + window:
+            if abs(ym.starts[k][1] - note) <= tol:
+                lat = (ym.starts[k][0] - us) / 1000.0
+                result = ("late" if lat > late_ms else "ok", lat)
+                break
+            k += 1
+        outcome[first] = result
+
+    segments = []
+    for seg in plan["segments"]:
+        lo, hi = seg["first"], seg["last"]
+        got = [at[k] for k in range(lo, hi + 1) if at[k] is not None]
+        res = [outcome[f] for f in outcome if lo <= f <= hi]
+        lats = [lat for kind, lat in res if kind in ("ok", "late")]
+        span = (max(got) - min(got)) / 1e6 if len(got) > 1 else 0.0
+        segments.append({
+            "rate": seg["rate"],
+            "bytes_sent": hi - lo + 1,
+            "bytes_received": len(got),
+            "bytes_dropped": hi - lo + 1 - len(got),
+            "notes": len(res),
+            "notes_dropped": sum(1 for kind, _ in res if kind in ("dropped", "lost")),
+            "notes_lost_in_transit": sum(1 for kind, _ in res if kind == "lost"),
+            "notes_late": sum(1 for kind, _ in res if kind == "late"),
+            "latency_ms_p50": round(_percentile(lats, 50), 2),
+            "latency_ms_p95": round(_percentile(lats, 95), 2),
+            "latency_ms_max": round(max(lats, default=0.0), 2),
+            "rx_bytes_per_sec": round(len(got) / span, 1) if span else 0.0,
+        })
+
+    clean = [s["rate"] for s in segments
+             if not s["bytes_dropped"] and not s["notes_dropped"]]
+    return {
+        "source": plan["source"],
+        "late_ms": late_ms,
+        "segments": segments,
+        "stuck_notes": ym.stuck(),
+        "ceiling_rate": max(clean, default=0),
+    }
+
+
+def format_report(report: dict) -> str:
+    lines = [f"{'rate':>5} {'bytes':>7} {'dropped':>7} {'notes':>6} "
+             f"{'dropped':>7} {'late':>5} {'p50 ms':>7} {'p95 ms':>7} "
+             f"{'max ms':>7} {'rx B/s':>8}"]
+    for s in report["segments"]:
+        lines.append(f"{s['rate']:>4}x {s['bytes_sent']:>7} {s['bytes_dropped']:>7} "
+                     f"{s['notes']:>6} {s['notes_dropped']:>7} {s['notes_late']:>5} "
+                     f"{s['latency_ms_p50']:>7} {s['latency_ms_p95']:>7} "
+                     f"{s['latency_ms_max']:>7} {s['rx_bytes_per_sec']:>8}")
+    lines.append(f"stuck notes: {len(report['stuck_notes'])}  "
+                 f"ceiling: {report['ceiling_rate']}x MIDI rate")
+    return "\n".join(lines)
+
+
+def parse_rates(text: str) -> list[float]:
+    return [float(r) if "." in r else int(r) for r in text.split(",") if r]
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="MIDI stress generator / analyser")
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    gen = sub.add_parser("generate", help="write a stream plan")
+    gen.add_argument("--smf", help="Standard MIDI File (default: synthetic)")
+    gen.add_argument("--rates", default="1", help="rate multipliers, e.g. 1,2,4")
+    gen.add_argument("-o", "--output", required=True)
+    ana = sub.add_parser("analyse", help="correlate a plan with a tap log")
+    ana.add_argument("plan")
+    ana.add_argument("tap")
+    ana.add_argument("--late-ms", type=float, default=LATE_MS_DEFAULT)
+    ana.add_argument("--json", action="store_true", help="print the JSON report")
+    args = parser.parse_args()
+
+    if args.cmd == "generate":
+        plan = build(args.smf or "synthetic", parse_rates(args.rates))
+        save_plan(plan, args.output)
+        print(f"{len(plan['bytes'])} bytes, {len(plan['msgs'])} messages")
+        return 0
+
+    report = analyse(load_plan(args.plan), args.tap, args.late_ms)
+    print(json.dumps(report, indent=2) if args.json else format_report(report))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
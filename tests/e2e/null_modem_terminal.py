@@ -23,6 +23,11 @@
 #   BOOT_TIMEOUT    Seconds to wait for CP/M A> after boot (default: 120)
 #   CMD_TIMEOUT     Seconds allowed per command (default: 30)
 #   AUDIO_TIMEOUT   Seconds allowed for the audio test sequence (default: 60)
+#   MIDI_STRESS     "synthetic" or a .mid path: stream it into the MIDI port
+#                   and check for dropped/late/stuck notes (midi_stress.py)
+#   MIDI_TAP        I/O tap log written by mame_iotap.lua (with MIDI_STRESS)
+#   STRESS_RATES    Comma-separated MIDI rate multipliers (default: 1)
+#   STRESS_LATE_MS  Emulated latency above which a note is late (default: 10)
 #
 # Requires Python 3.9+ (stdlib only).
 #
@@ -33,14 +38,18 @@
 from __future__ import annotations
 
 import errno
+import json
 import os
 import pathlib
+import re
 import signal
 import socket
 import sys
 import time
 import traceback
 
+import midi_stress
+
 # ---------------------------------------------------------------------------
 # Configuration
 # ---------------------------------------------------------------------------
@@ -54,6 +63,12 @@ CONNECT_TIMEOUT = int(os.environ.get("CONNECT_TIMEOUT", "60"))
 BOOT_TIMEOUT    = int(os.environ.get("BOOT_TIMEOUT",   "120"))
 CMD_TIMEOUT     = int(os.environ.get("CMD_TIMEOUT",     "30"))
 AUDIO_TIMEOUT   = int(os.environ.get("AUDIO_TIMEOUT",   "60"))
+EXPECT_OPL3     = os.environ.get("EXPECT_OPL3", "0") == "1"  # OPL3 bus card fitted
+MIDI_STRESS     = os.environ.get("MIDI_STRESS", "")   # empty = no stress step
+MIDI_TAP        = os.environ.get("MIDI_TAP", "")
+STRESS_RATES    = midi_stress.parse_rates(os.environ.get("STRESS_RATES", "1"))
+STRESS_LATE_MS  = float(os.environ.get("STRESS_LATE_MS",
+                                       str(midi_stress.LATE_MS_DEFAULT)))
 
 RESULT_FILE  = RESULTS_DIR / "test_result.txt"
 SERIAL_LOG   = RESULTS_DIR / "serial_io.log"
@@ -432,6 +447,59 @@ class NullModemTerminal:
 # Test suite
 # ---------------------------------------------------------------------------
 
+def _parse_uptime(text: str) -> int | None:
+    """Extract the tick count from the status 'Timebase: …, uptime N ticks' line."""
+    match = re.search(r"uptime (\d+) ticks", text)
+    return int(match.group(1)) if match else None
+
+
+def run_midi_stress(term: NullModemTerminal, midi_term: NullModemTerminal) -> None:
+    """Stream MIDI_STRESS into the MIDI port and correlate it with the
+    SIO reads and YM2149 writes logged by mame_iotap.lua."""
+    log(f"Running MIDI stress ({MIDI_STRESS}, rates {STRESS_RATES}) …")
+
+    # Per-message logging would swamp the console: verbosity 2 → 3 → 0 → 1
+    for level in (3, 0, 1):
+        term.send_cmd("v", wait_for=f"Verbosity: {level}", timeout=CMD_TIMEOUT)
+    term._buf = ""
+    term.send_cmd("m", wait_for="BIOS MIDI mode on", timeout=CMD_TIMEOUT)
+    term._buf = ""
+
+    plan = midi_stress.build(MIDI_STRESS, STRESS_RATES)
+    midi_stress.save_plan(plan, RESULTS_DIR / "midi_stress_plan.json")
+    log(f"  streaming {len(plan['bytes'])} bytes, {len(plan['msgs'])} messages …")
+    took = midi_stress.stream(midi_term.send_raw, plan)
+    log(f"  streamed in {took:.1f}s; letting the synth settle …")
+    time.sleep(3.0)
+
+    # Snapshot the tap before 'm' off, whose panic would silence stuck notes
+    report = None
+    if MIDI_TAP and pathlib.Path(MIDI_TAP).exists():
+        report = midi_stress.analyse(plan, MIDI_TAP, STRESS_LATE_MS)
+    status = term.send_cmd("s", wait_for="Scheduler:", timeout=CMD_TIMEOUT)
+    rx = re.search(r"MIDI RX: .*", status)
+    if rx:
+        log(f"  {rx.group(0).strip()}")
+    term._buf = ""
+    term.send_cmd("m", wait_for="BIOS MIDI mode off", timeout=CMD_TIMEOUT)
+    term.send_cmd("v", wait_for="Verbosity: 2", timeout=CMD_TIMEOUT)
+    term._buf = ""
+
+    if report is None:
+        log(f"  no tap log at {MIDI_TAP!r} — cannot correlate")
+        check(False, "midi stress: I/O tap log present")
+        return
+    (RESULTS_DIR / "midi_stress.json").write_text(
+        json.dumps(report, indent=2))
+    for line in midi_stress.format_report(report).splitlines():
+        log(f"  {line}")
+
+    first = report["segments"][0]
+    check(first["notes_dropped"] == 0,
+          f"midi stress: no dropped notes at {first['rate']}x MIDI rate")
+    check(not report["stuck_notes"], "midi stress: no stuck notes")
+
+
 def run_tests() -> bool:
     term = NullModemTerminal(HOST, PORT)
 
@@ -615,13 +683,29 @@ def run_tests() -> bool:
         term.send_cmd("s", timeout=CMD_TIMEOUT)
         time.sleep(2.0)
         term._drain()
+        uptime_1 = _parse_uptime(term._buf)
         term._buf = ""
         log("  status command completed (output captured to log above)")
 
+        # Second status: the timebase tick counter must have advanced
+        term.send_cmd("s", timeout=CMD_TIMEOUT)
+        time.sleep(2.0)
+        term._drain()
+        uptime_2 = _parse_uptime(term._buf)
+        status_out = term._buf
+        term._buf = ""
+        if uptime_1 is None or uptime_2 is None:
+            log("WARNING: timebase uptime line garbled — skipping tick check")
+        else:
+            log(f"  timebase uptime {uptime_1} → {uptime_2} ticks")
+            check(uptime_2 != uptime_1, "status: timebase ticks advancing")
+        check("LFO:" in status_out, "status: LFO engine statistics shown")
+
         # ------------------------------------------------------------------
         # 7. i — ioports
         # ------------------------------------------------------------------
         log("Running 'i' (ioports) …")
+        io_out = ""
         try:
             io_out = term.send_cmd("i", wait_for="Data port:",
                                    timeout=CMD_TIMEOUT)
@@ -633,6 +717,60 @@ def run_tests() -> bool:
             log("WARNING: ioports output truncated — continuing")
         time.sleep(1.0)
         term._drain()
+        # MAME's rc2014zedp has one YM2149 card at the default ports
+        check("YM2149 cards: 1 (3 voices)" in term._buf
+              or "YM2149 cards: 1 (3 voices)" in io_out,
+              "ioports: one YM2149 card pooled")
+        check("OPL3 port:" in term._buf or "OPL3 port:" in io_out,
+              "ioports: OPL3 port line present")
+        term._buf = ""
+
+        # ------------------------------------------------------------------
+        # 7a. 2/1 — select OPL3 and back (only with --opl3-card)
+        # ------------------------------------------------------------------
+        if EXPECT_OPL3:
+            log("Running '2' (select OPL3) …")
+            try:
+                opl3_out = term.send_cmd("2", wait_for="OPL3 selected",
+                                         timeout=CMD_TIMEOUT)
+                check("OPL3 selected successfully." in opl3_out,
+                      "opl3: detected and selected")
+            except TimeoutError:
+                check(False, "opl3: detected and selected")
+            term._buf = ""
+            term.send_cmd("s", timeout=CMD_TIMEOUT)
+            time.sleep(2.0)
+            term._drain()
+            check("Active Chip: OPL3 FM" in term._buf
+                  or "OPL3 bus:" in term._buf,
+                  "opl3: status shows OPL3 register statistics")
+            term._buf = ""
+            try:
+                term.send_cmd("1", wait_for="YM2149 selected",
+                              timeout=CMD_TIMEOUT)
+            except TimeoutError:
+                log("WARNING: switch back to YM2149 not confirmed")
+            term._buf = ""
+
+        # ------------------------------------------------------------------
+        # 7b. v — console verbosity (cycles 2 → 3 → 0 → 1 → 2)
+        # ------------------------------------------------------------------
+        log("Running 'v' (verbosity) …")
+        try:
+            v_out = term.send_cmd("v", wait_for="Verbosity: 3",
+                                  timeout=CMD_TIMEOUT)
+            check("Verbosity: 3" in v_out, "verbosity: cycled to debug")
+        except TimeoutError:
+            log("WARNING: verbosity output truncated — continuing")
+        for expected in ("0", "1", "2"):
+            try:
+                term.send_cmd("v", wait_for=f"Verbosity: {expected}",
+                              timeout=CMD_TIMEOUT)
+            except TimeoutError:
+                log(f"WARNING: did not see 'Verbosity: {expected}'")
+        check(True, "verbosity: restored to MIDI log level")
+        time.sleep(1.0)
+        term._drain()
         term._buf = ""
 
         # ------------------------------------------------------------------
@@ -740,6 +878,20 @@ def run_tests() -> bool:
             except TimeoutError:
                 pass
 
+            # RPN 0 (pitch bend sensitivity) = 12 semitones, then close
+            # the RPN so CC#6 goes back to its synth mapping
+            log("  Sending RPN 0 bend range 12 + pitch bend via AUX port …")
+            midi_term.send_raw(bytes([0xB0, 0x65, 0x00, 0x64, 0x00, 0x06, 0x0C,
+                                      0x65, 0x7F, 0x64, 0x7F,
+                                      0xE0, 0x00, 0x60, 0xE0, 0x00, 0x40]))
+            try:
+                term.wait_for("bend range 12", timeout=CMD_TIMEOUT)
+                check(True, "bios midi: RPN 0 bend range accepted")
+            except TimeoutError:
+                term._drain()
+                log(f"  Console buffer after timeout: {term._buf[-300:]!r}")
+                check(False, "bios midi: RPN 0 bend range accepted")
+
             # Audio verification for BIOS MIDI is deferred to WAV check
             check(True, "bios midi: MIDI bytes sent (audio check deferred to WAV)")
 
@@ -756,6 +908,15 @@ def run_tests() -> bool:
             log("MIDI serial port not available — skipping BIOS MIDI test")
             check(True, "bios midi: skipped (no MIDI port)")
 
+        # ------------------------------------------------------------------
+        # 9a. MIDI stress / replay (opt-in: run_e2e.sh --midi-stress)
+        # ------------------------------------------------------------------
+        if MIDI_STRESS and midi_term is not None and midi_term.connected:
+            run_midi_stress(term, midi_term)
+        elif MIDI_STRESS:
+            log("MIDI serial port not available — skipping MIDI stress test")
+            check(False, "midi stress: MIDI port connected")
+
         # ------------------------------------------------------------------
         # 10. t — audio test
         # ------------------------------------------------------------------
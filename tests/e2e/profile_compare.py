@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""
+tests/e2e/profile_compare.py
+
+Compare two profile.json reports written by mame_profile.lua
+(run_e2e.sh --profile) and flag T-state regressions between builds.
+
+Usage:
+    python3 tests/e2e/profile_compare.py BASE.json NEW.json [--threshold PCT]
+
+Prints one line per function with the average T-states per call in both
+builds, plus the cost per MIDI message.  Exits 1 if any average grew by
+more than the threshold (default 5%), so it can gate CI.
+
+Averages are compared rather than totals: the number of calls depends on
+how much MIDI traffic the run happened to send.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as fh:
+        return json.load(fh)
+
+
+def change(base, new):
+    if base == 0:
+        return 0.0 if new == 0 else float("inf")
+    return (new - base) * 100.0 / base
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("base")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="allowed growth in percent (default: 5)")
+    args = parser.parse_args()
+
+    base = load(args.base)
+    new = load(args.new)
+    regressions = []
+
+    print(f"{'function':<24} {'base avg':>10} {'new avg':>10} {'change':>8}"
+          f" {'base self':>10} {'new self':>10}")
+    names = sorted(set(base["functions"]) | set(new["functions"]))
+    for name in names:
+        b = base["functions"].get(name)
+        n = new["functions"].get(name)
+        if b is None or n is None:
+            print(f"{name:<24} {'only in ' + ('new' if b is None else 'base'):>21}")
+            continue
+        if b["calls"] == 0 or n["calls"] == 0:
+            print(f"{name:<24} {'not called':>21}")
+            continue
+        pct = change(b["tstates_avg"], n["tstates_avg"])
+        flag = ""
+        if pct > args.threshold:
+            flag = "  REGRESSION"
+            regressions.append(name)
+        print(f"{name:<24} {b['tstates_avg']:>10.1f} {n['tstates_avg']:>10.1f}"
+              f" {pct:>+7.1f}% {b['tstates_self_avg']:>10.1f}"
+              f" {n['tstates_self_avg']:>10.1f}{flag}")
+
+    bm = base.get("per_midi_message", {})
+    nm = new.get("per_midi_message", {})
+    if bm.get("messages") and nm.get("messages"):
+        pct = change(bm["tstates"], nm["tstates"])
+        flag = ""
+        if pct > args.threshold:
+            flag = "  REGRESSION"
+            regressions.append("per_midi_message")
+        print(f"{'per MIDI message':<24} {bm['tstates']:>10.1f}"
+              f" {nm['tstates']:>10.1f} {pct:>+7.1f}%{flag}")
+
+    for report, label in ((base, "base"), (new, "new")):
+        if report.get("lost_frames"):
+            print(f"warning: {label} lost {report['lost_frames']} call frames")
+
+    if regressions:
+        print(f"\n{len(regressions)} regression(s) above {args.threshold}%: "
+              + ", ".join(regressions))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -51,6 +51,22 @@
 #   --serial-port PORT   TCP port for the null-modem socket (default: auto)
 #   --rs232-slot SLOT    MAME slot name for the RS232 port (default: auto-detect)
 #   --rompath PATH       MAME ROM search path (default: /opt/mame-roms or $MAME_ROMPATH)
+#   --opl3-card CARD     Fit an OPL3 bus card (MAME device name, e.g. from
+#                        -listslots) and check that 'i'/'2' detect it.  The
+#                        stock rc2014zedp has none, so this is off by default.
+#   --opl3-slot SLOT     Bus slot for the OPL3 card (default: bus:13)
+#   --profile            Run under the MAME debugger and record T-states per
+#                        call for the hot-path functions (mame_profile.lua).
+#                        Needs midisynth.map from 'make' (zcc -m); writes
+#                        results/profile.json.  Much slower than a normal run,
+#                        so raise --timeout accordingly.
+#   --profile-map PATH   Map file for --profile (default: midisynth.map)
+#   --midi-stress SRC    Stream SRC ("synthetic" or a .mid file) into the MIDI
+#                        port at the MIDI byte rate and report dropped, late
+#                        and stuck notes from MAME's view of the SIO and the
+#                        YM2149 (midi_stress.py, results/midi_stress.json)
+#   --stress-rates LIST  Rate multipliers for --midi-stress (default: 1), e.g.
+#                        1,2,4; the highest step without drops is the ceiling
 #   --list-slots         Print MAME -listslots output for rc2014zedp and exit
 #   -h, --help           Show this help and exit
 
@@ -75,6 +91,12 @@ MIDI_PORT="${MIDI_PORT:-}"          # empty → auto-detect a free port (for AUX
 RS232_SLOT="${RS232_SLOT:-}"        # empty → auto-discover via mame -listslots
 RS232_SLOT_B="${RS232_SLOT_B:-}"    # empty → auto-discover rs232b via mame -listslots
 MAME_ROMPATH="${MAME_ROMPATH:-/opt/mame-roms}"
+OPL3_CARD="${OPL3_CARD:-}"          # empty → no OPL3 card, OPL3 step skipped
+OPL3_SLOT="${OPL3_SLOT:-bus:13}"
+PROFILE=false
+PROFILE_MAP="${PROFILE_MAP:-$PROJECT_DIR/midisynth.map}"
+MIDI_STRESS="${MIDI_STRESS:-}"      # empty → no stress step
+STRESS_RATES="${STRESS_RATES:-1}"
 LIST_SLOTS=false
 
 # ---------------------------------------------------------------------------
@@ -97,6 +119,17 @@ while [[ $# -gt 0 ]]; do
         --rs232-slot-b=*)   RS232_SLOT_B="${1#*=}" ;;
         --rompath)          MAME_ROMPATH="$2"; shift ;;
         --rompath=*)        MAME_ROMPATH="${1#*=}" ;;
+        --opl3-card)        OPL3_CARD="$2"; shift ;;
+        --opl3-card=*)      OPL3_CARD="${1#*=}" ;;
+        --opl3-slot)        OPL3_SLOT="$2"; shift ;;
+        --opl3-slot=*)      OPL3_SLOT="${1#*=}" ;;
+        --profile)          PROFILE=true ;;
+        --profile-map)      PROFILE_MAP="$2"; shift ;;
+        --profile-map=*)    PROFILE_MAP="${1#*=}" ;;
+        --midi-stress)      MIDI_STRESS="$2"; shift ;;
+        --midi-stress=*)    MIDI_STRESS="${1#*=}" ;;
+        --stress-rates)     STRESS_RATES="$2"; shift ;;
+        --stress-rates=*)   STRESS_RATES="${1#*=}" ;;
         --list-slots)       LIST_SLOTS=true ;;
         -h|--help)
             sed -n '/^# /p' "$0" | sed 's/^# \?//'
@@ -338,6 +371,40 @@ else
     MAME_ARGS+=(-bitb "socket.127.0.0.1:${SERIAL_PORT}")
 fi
 
+EXPECT_OPL3=0
+if [[ -n "$OPL3_CARD" ]]; then
+    MAME_ARGS+=("-${OPL3_SLOT}" "$OPL3_CARD")
+    EXPECT_OPL3=1
+    info "OPL3 card  : ${OPL3_CARD} in ${OPL3_SLOT}"
+fi
+
+# Profiling: mame_test.lua loads mame_profile.lua when PROFILE_MAP is set
+# in MAME's environment.  Breakpoints need the debugger core but no UI.
+if [[ "$PROFILE" == true ]]; then
+    [[ -f "$PROFILE_MAP" ]] || fail "Map file not found: $PROFILE_MAP (run make)"
+    export PROFILE_MAP
+    export PROFILE_OUT="$RESULTS_DIR/profile.json"
+    rm -f "$PROFILE_OUT"
+    MAME_ARGS+=(-debug -debugger none)
+    info "Profiling  : $PROFILE_MAP → $PROFILE_OUT"
+else
+    unset PROFILE_MAP
+fi
+
+# MIDI stress: mame_test.lua loads mame_iotap.lua when MIDI_TAP is set
+MIDI_TAP=""
+if [[ -n "$MIDI_STRESS" ]]; then
+    if [[ "$MIDI_STRESS" != synthetic && ! -f "$MIDI_STRESS" ]]; then
+        fail "MIDI file not found: $MIDI_STRESS"
+    fi
+    [[ -n "$RS232_SLOT_B" && "$MIDI_PORT" -gt 0 ]] \
+        || warn "No MIDI serial port — the stress step will fail"
+    MIDI_TAP="$RESULTS_DIR/midi_tap.log"
+    export MIDI_TAP
+    rm -f "$MIDI_TAP" "$RESULTS_DIR/midi_stress.json"
+    info "MIDI stress: ${MIDI_STRESS} at ${STRESS_RATES}x → $RESULTS_DIR/midi_stress.json"
+fi
+
 AUDIO_FILE="$RESULTS_DIR/audio.wav"
 rm -f "$AUDIO_FILE"
 MAME_ARGS+=(-wavwrite "$AUDIO_FILE")
@@ -390,6 +457,10 @@ CONNECT_TIMEOUT=90 \
 BOOT_TIMEOUT="${BOOT_TIMEOUT:-120}" \
 CMD_TIMEOUT="${CMD_TIMEOUT:-30}" \
 AUDIO_TIMEOUT="${AUDIO_TIMEOUT:-60}" \
+EXPECT_OPL3="$EXPECT_OPL3" \
+MIDI_STRESS="$MIDI_STRESS" \
+MIDI_TAP="$MIDI_TAP" \
+STRESS_RATES="$STRESS_RATES" \
 timeout "$TEST_TIMEOUT" python3 "$SCRIPT_DIR/null_modem_terminal.py" &
 PYTHON_PID=$!
 info "Python server PID: $PYTHON_PID"
@@ -551,4 +622,10 @@ info "Audio      : $AUDIO_FILE"
 info "Serial log : $SERIAL_LOG_FILE"
 info "Snapshots  : $RESULTS_DIR/snapshots/"
 info "MAME log   : $LOG_FILE"
+if [[ "$PROFILE" == true ]]; then
+    info "Profile    : $PROFILE_OUT"
+fi
+if [[ -n "$MIDI_STRESS" ]]; then
+    info "MIDI stress: $RESULTS_DIR/midi_stress.json"
+fi
 echo "==================================="
@@ -0,0 +1,87 @@
+#include "host_test.h"
+#include "../../include/hal.h"
+#include "../../include/chip_interface.h"
+#include "../../include/chip_manager.h"
+#include "../../include/midi_driver.h"
+#include "../../include/synthesizer.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Host micro-benchmarks (make host-bench).
+//
+// Host nanoseconds only rank changes against each other; the number to
+// watch is bus writes per operation, which is what costs Z80 time on
+// the real bus and does not depend on the host CPU.  One line per
+// benchmark:
+//   <name> <ns/op> ns/op <writes/op> writes/op
+
+#define BENCH_ITERATIONS  200000UL
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_report(const char* name, double ns, unsigned long ops,
+                         uint32_t writes) {
+    printf("%-28s %8.1f ns/op %6.2f writes/op\n",
+           name, ns / ops, (double)writes / ops);
+}
+
+// Note on + note off for a rotating set of notes, as raw MIDI bytes
+static void bench_note_stream(const char* name, uint8_t chip_id) {
+    uint8_t msg[6] = { 0x90, 0, 100, 0x80, 0, 0 };
+
+    host_synth_setup(chip_id);
+    double start = bench_now_ns();
+    for (unsigned long i = 0; i < BENCH_ITERATIONS; i++) {
+        msg[1] = msg[4] = 36 + (i % 48);
+        host_midi_send(msg, sizeof(msg));
+    }
+    bench_report(name, bench_now_ns() - start, BENCH_ITERATIONS * 2,
+                 hal_bus_write_count());
+}
+
+// CC sweep on one held note: mostly absorbed by the register shadow
+static void bench_cc_sweep(const char* name, uint8_t chip_id) {
+    static const uint8_t note[] = { 0x90, 60, 100 };
+    uint8_t cc[3] = { 0xB0, 1, 0 };
+
+    host_synth_setup(chip_id);
+    host_midi_send(note, sizeof(note));
+    hal_bus_clear_log();
+    double start = bench_now_ns();
+    for (unsigned long i = 0; i < BENCH_ITERATIONS; i++) {
+        cc[2] = i & 0x7F;
+        host_midi_send(cc, sizeof(cc));
+    }
+    bench_report(name, bench_now_ns() - start, BENCH_ITERATIONS,
+                 hal_bus_write_count());
+}
+
+// Voice allocation with every voice busy (always a steal)
+static void bench_allocate_full(const char* name, uint8_t chip_id) {
+    host_synth_setup(chip_id);
+    for (uint8_t n = 0; n < chip_manager_get_current()->voice_count; n++) {
+        synthesizer_note_on(40 + n, 100, 0);
+    }
+    volatile uint8_t sink = 0;
+    double start = bench_now_ns();
+    for (unsigned long i = 0; i < BENCH_ITERATIONS; i++) {
+        sink += allocate_voice(60, 100, 0);
+    }
+    (void)sink;
+    bench_report(name, bench_now_ns() - start, BENCH_ITERATIONS, 0);
+}
+
+int main(void) {
+    bench_note_stream("ym2149_note_on_off", CHIP_YM2149);
+    bench_note_stream("opl3_note_on_off", CHIP_OPL3);
+    bench_cc_sweep("ym2149_cc_volume_sweep", CHIP_YM2149);
+    bench_cc_sweep("opl3_cc_volume_sweep", CHIP_OPL3);
+    bench_allocate_full("ym2149_allocate_full", CHIP_YM2149);
+    bench_allocate_full("opl3_allocate_full", CHIP_OPL3);
+    return 0;
+}
@@ -0,0 +1,242 @@
+#include "host_test.h"
+#include "../../include/hal.h"
+#include <stdint.h>
+#include <string.h>
+
+// Chip models behind the HAL fake bus.  They only model what the drivers
+// rely on: register latches, the YM2149 read-back used for detection,
+// the OPL3 status/timer flags, the SIO Channel B receive and transmit
+// paths and the CTC channels the timebase polls.
+
+#define FAKE_YM_MAX   3
+
+typedef struct {
+    uint8_t fitted;
+    uint8_t addr_port;
+    uint8_t data_port;
+    uint8_t latch;
+    uint8_t regs[16];
+} fake_ym2149_t;
+
+static fake_ym2149_t fake_ym[FAKE_YM_MAX];
+
+static struct {
+    uint8_t fitted;
+    uint8_t base;
+    uint8_t opl2;
+    uint8_t latch[2];
+    uint8_t status;
+    uint8_t t1_running;
+    uint8_t regs[512];
+} fake_opl3;
+
+static uint8_t fake_sio_buf[1024];
+static uint16_t fake_sio_head;
+static uint16_t fake_sio_tail;
+static uint8_t fake_sio_tx[4096];
+static uint16_t fake_sio_tx_len;
+static uint8_t fake_sio_tx_busy;       // RR0 reads until Tx Buffer Empty
+uint16_t fake_sio_tx_overruns;         // Data writes while not empty
+
+// CTC channels 0 (timer, prescaler 256) and 1 (counter).  Time is a clock
+// count that every read of either channel moves on.
+static struct {
+    uint8_t fitted;
+    uint8_t base;
+    uint8_t linked;            // ZC/TO0 drives CLK/TRG1
+    uint16_t clocks_per_read;
+    uint32_t clocks;
+    uint32_t ch0_start;        // Clock when channel 0 got its time constant
+    uint32_t ch1_start;        // Channel 0 wraps when channel 1 got its
+    uint8_t tc_next[2];        // Next write is a time constant
+    uint8_t running[2];
+} fake_ctc;
+
+static uint32_t fake_ctc_wraps(void) {
+    return (fake_ctc.clocks - fake_ctc.ch0_start) >> 16;
+}
+
+static void fake_ctc_write(uint8_t ch, uint8_t value) {
+    if (fake_ctc.tc_next[ch]) {
+        fake_ctc.tc_next[ch] = 0;
+        fake_ctc.running[ch] = 1;
+        if (ch == 0) {
+            fake_ctc.ch0_start = fake_ctc.clocks;
+        } else {
+            fake_ctc.ch1_start = fake_ctc_wraps();
+        }
+    } else if (value & 0x01) {
+        fake_ctc.tc_next[ch] = (value & 0x04) != 0;
+        if (value & 0x02) {
+            fake_ctc.running[ch] = 0;
+        }
+    }
+}
+
+// Down-counters with a time constant of 256: 0 on reload, then 255..1
+static uint8_t fake_ctc_read(uint8_t ch) {
+    uint8_t value = 0;
+
+    fake_ctc.clocks += fake_ctc.clocks_per_read;
+    if (ch == 0 && fake_ctc.running[0]) {
+        value = (uint8_t)(0 - ((fake_ctc.clocks - fake_ctc.ch0_start) >> 8));
+    } else if (ch == 1 && fake_ctc.running[1] && fake_ctc.linked && fake_ctc.running[0]) {
+        value = (uint8_t)(0 - (fake_ctc_wraps() - fake_ctc.ch1_start));
+    }
+    return value;
+}
+
+static void fake_bus_write(uint8_t port, uint8_t value) {
+    for (uint8_t i = 0; i < FAKE_YM_MAX; i++) {
+        fake_ym2149_t* y = &fake_ym[i];
+        if (!y->fitted) continue;
+        if (port == y->addr_port) {
+            y->latch = value & 0x0F;
+            return;
+        }
+        if (port == y->data_port) {
+            y->regs[y->latch] = value;
+            return;
+        }
+    }
+
+    if (fake_ctc.fitted && (uint8_t)(port - fake_ctc.base) < 2) {
+        fake_ctc_write(port - fake_ctc.base, value);
+        return;
+    }
+
+    if (fake_opl3.fitted && (uint8_t)(port - fake_opl3.base) < 4) {
+        uint8_t offset = port - fake_opl3.base;
+        uint8_t bank = offset >> 1;
+        if (!(offset & 1)) {
+            fake_opl3.latch[bank] = value;
+            return;
+        }
+        uint16_t reg = ((uint16_t)bank << 8) | fake_opl3.latch[bank];
+        fake_opl3.regs[reg] = value;
+        if (reg == 0x004) {
+            if (value & 0x80) {
+                fake_opl3.status = 0;              // IRQ reset
+            } else {
+                fake_opl3.t1_running = (value & 0x01) && !(value & 0x40);
+            }
+        }
+        return;
+    }
+
+    if (port == FAKE_SIO_DATA) {
+        if (fake_sio_tx_busy) fake_sio_tx_overruns++;
+        if (fake_sio_tx_len < sizeof(fake_sio_tx)) {
+            fake_sio_tx[fake_sio_tx_len++] = value;
+        }
+        fake_sio_tx_busy = 1;
+    }
+}
+
+static uint8_t fake_bus_read(uint8_t port) {
+    for (uint8_t i = 0; i < FAKE_YM_MAX; i++) {
+        fake_ym2149_t* y = &fake_ym[i];
+        if (y->fitted && port == y->addr_port) {
+            return y->regs[y->latch];
+        }
+    }
+
+    if (fake_opl3.fitted && port == fake_opl3.base) {
+        if (fake_opl3.t1_running) {
+            fake_opl3.status |= 0xC0;              // IRQ + T1 overflow
+        }
+        return fake_opl3.status | (fake_opl3.opl2 ? 0x06 : 0x00);
+    }
+
+    if (fake_ctc.fitted && (uint8_t)(port - fake_ctc.base) < 2) {
+        return fake_ctc_read(port - fake_ctc.base);
+    }
+
+    if (port == FAKE_SIO_CTRL) {
+        // RR0: Rx Char Available (bit 0); Tx Buffer Empty (bit 2) on the
+        // second read after a data write
+        uint8_t tbe = fake_sio_tx_busy ? 0 : 0x04;
+        if (fake_sio_tx_busy) fake_sio_tx_busy--;
+        return tbe | (fake_sio_head != fake_sio_tail);
+    }
+    if (port == FAKE_SIO_DATA && fake_sio_head != fake_sio_tail) {
+        uint8_t b = fake_sio_buf[fake_sio_tail];
+        fake_sio_tail = (fake_sio_tail + 1) % sizeof(fake_sio_buf);
+        return b;
+    }
+    return 0xFF;
+}
+
+static const hal_bus_device_t fake_bus = { fake_bus_write, fake_bus_read };
+
+void fake_devices_attach(void) {
+    memset(fake_ym, 0, sizeof(fake_ym));
+    memset(&fake_opl3, 0, sizeof(fake_opl3));
+    fake_sio_head = fake_sio_tail = 0;
+    fake_sio_tx_len = 0;
+    fake_sio_tx_busy = 0;
+    fake_sio_tx_overruns = 0;
+    memset(&fake_ctc, 0, sizeof(fake_ctc));
+    hal_bus_attach(&fake_bus);
+}
+
+void fake_ym2149_fit(uint8_t addr_port, uint8_t data_port) {
+    for (uint8_t i = 0; i < FAKE_YM_MAX; i++) {
+        if (!fake_ym[i].fitted) {
+            fake_ym[i].fitted = 1;
+            fake_ym[i].addr_port = addr_port;
+            fake_ym[i].data_port = data_port;
+            return;
+        }
+    }
+}
+
+uint8_t fake_ym2149_reg(uint8_t addr_port, uint8_t reg) {
+    for (uint8_t i = 0; i < FAKE_YM_MAX; i++) {
+        if (fake_ym[i].fitted && fake_ym[i].addr_port == addr_port) {
+            return fake_ym[i].regs[reg & 0x0F];
+        }
+    }
+    return 0xFF;
+}
+
+void fake_opl3_fit(uint8_t base, uint8_t opl2) {
+    fake_opl3.fitted = 1;
+    fake_opl3.base = base;
+    fake_opl3.opl2 = opl2;
+}
+
+uint8_t fake_opl3_reg(uint16_t reg) {
+    return fake_opl3.regs[reg & 0x1FF];
+}
+
+void fake_sio_send(const uint8_t* bytes, uint16_t len) {
+    while (len--) {
+        fake_sio_buf[fake_sio_head] = *bytes++;
+        fake_sio_head = (fake_sio_head + 1) % sizeof(fake_sio_buf);
+    }
+}
+
+uint16_t fake_sio_pending(void) {
+    return (fake_sio_head - fake_sio_tail + sizeof(fake_sio_buf)) % sizeof(fake_sio_buf);
+}
+
+const uint8_t* fake_sio_sent(uint16_t* len) {
+    *len = fake_sio_tx_len;
+    return fake_sio_tx;
+}
+
+void fake_sio_sent_clear(void) {
+    fake_sio_tx_len = 0;
+}
+
+void fake_ctc_fit(uint8_t base, uint8_t linked, uint16_t clocks_per_read) {
+    fake_ctc.fitted = 1;
+    fake_ctc.base = base;
+    fake_ctc.linked = linked;
+    fake_ctc.clocks_per_read = clocks_per_read;
+}
+
+void fake_ctc_advance(uint32_t clocks) {
+    fake_ctc.clocks += clocks;
+}
@@ -0,0 +1,61 @@
+#include "host_test.h"
+#include "../../include/hal.h"
+#include "../../include/synthesizer.h"
+#include "../../include/chip_manager.h"
+#include "../../include/midi_driver.h"
+#include "../../include/console.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Shared test helpers (linked into both synth_tests and synth_bench)
+
+int host_test_failed;              // Failures in the current test
+int host_test_checks;
+
+void host_test_check(int ok, const char* expr, const char* file, int line) {
+    host_test_checks++;
+    if (!ok) {
+        host_test_failed++;
+        printf("    FAIL %s:%d: %s\n", file, line, expr);
+    }
+}
+
+void host_test_check_eq(long actual, long expected, const char* expr,
+                        const char* file, int line) {
+    host_test_checks++;
+    if (actual != expected) {
+        host_test_failed++;
+        printf("    FAIL %s:%d: %s == %ld, expected %ld\n",
+               file, line, expr, actual, expected);
+    }
+}
+
+void host_synth_setup(uint8_t chip_id) {
+    hal_bus_reset();
+    fake_devices_attach();
+    fake_ym2149_fit(0xD8, 0xD0);
+    fake_opl3_fit(0x60, 0);
+
+    console_init();
+    hal_console_clear();
+    synthesizer_init();
+    chip_manager_set_chip(chip_id);
+    console_flush();
+    hal_bus_clear_log();
+}
+
+void host_midi_send(const uint8_t* bytes, uint16_t len) {
+    while (len--) {
+        midi_process_byte(*bytes++);
+    }
+}
+
+uint16_t host_bus_writes_to(uint8_t port) {
+    uint16_t n = 0;
+    const hal_bus_write_t* w;
+
+    for (uint16_t i = 0; (w = hal_bus_write_at(i)) != 0; i++) {
+        if (w->port == port) n++;
+    }
+    return n;
+}
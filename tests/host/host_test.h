@@ -0,0 +1,133 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdint.h>
+
+// Host unit tests (make host).  The synth core is built with gcc against
+// the fake bus in src/hal/hal_host.c; fake_devices.c plugs chip models
+// into that bus so detection, register sequences and MIDI input can be
+// checked without MAME.
+
+// --- Checks and setup (host_test.c) ---
+
+#define CHECK(cond) \
+    host_test_check((cond) != 0, #cond, __FILE__, __LINE__)
+#define CHECK_EQ(actual, expected) \
+    host_test_check_eq((long)(actual), (long)(expected), #actual, __FILE__, __LINE__)
+
+extern int host_test_failed;         // Failed checks in the current test
+extern int host_test_checks;
+
+void host_test_check(int ok, const char* expr, const char* file, int line);
+void host_test_check_eq(long actual, long expected, const char* expr,
+                        const char* file, int line);
+
+// Fresh synth on the fake bus with a YM2149 (0xD8/0xD0) and an OPL3
+// (0x60) fitted, `chip_id` selected and the bus log cleared
+void host_synth_setup(uint8_t chip_id);
+
+// Send raw MIDI bytes through the parser
+void host_midi_send(const uint8_t* bytes, uint16_t len);
+
+// Bus writes in the log to `port`
+uint16_t host_bus_writes_to(uint8_t port);
+
+// --- Fake devices (fake_devices.c) ---
+
+#define FAKE_SIO_CTRL   0x82
+#define FAKE_SIO_DATA   0x83
+
+void fake_devices_attach(void);          // Reset models and attach to the bus
+
+// YM2149: register latch on the address port, read back on the same port
+void fake_ym2149_fit(uint8_t addr_port, uint8_t data_port);
+uint8_t fake_ym2149_reg(uint8_t addr_port, uint8_t reg);
+
+// OPL3: four ports from `base`; timer 1 overflows as soon as it starts.
+// `opl2` answers with the OPL2 status bits set.
+void fake_opl3_fit(uint8_t base, uint8_t opl2);
+uint8_t fake_opl3_reg(uint16_t reg);
+
+// SIO Channel B receiver: bytes queued here are read via RR0/data port
+void fake_sio_send(const uint8_t* bytes, uint16_t len);
+uint16_t fake_sio_pending(void);
+
+// SIO Channel B transmitter: bytes written to the data port, in order.
+// Tx Buffer Empty reads clear for one RR0 read after each byte, and a
+// byte written before then counts as an overrun.
+const uint8_t* fake_sio_sent(uint16_t* len);
+void fake_sio_sent_clear(void);
+extern uint16_t fake_sio_tx_overruns;
+
+// Z80 CTC channels 0-1 from `base`.  Every read of either advances the
+// clock by `clocks_per_read`; `linked` clocks channel 1 from channel 0.
+void fake_ctc_fit(uint8_t base, uint8_t linked, uint16_t clocks_per_read);
+void fake_ctc_advance(uint32_t clocks);
+
+// --- Test cases ---
+
+void test_midi_note_on_off(void);
+void test_midi_running_status(void);
+void test_midi_velocity_zero_is_note_off(void);
+void test_midi_realtime_inside_message(void);
+void test_midi_system_common_clears_status(void);
+void test_midi_rpn_bend_range(void);
+void test_midi_cc_table_dispatch(void);
+void test_midi_drain_from_sio(void);
+void test_midi_parts(void);
+void test_midi_parts_opl3(void);
+void test_midi_sysex_patch_dump(void);
+void test_midi_sysex_filter(void);
+void test_midi_sysex_dump_request(void);
+void test_midi_clock_tempo(void);
+void test_midi_clock_transport(void);
+void test_midi_clock_drain_budget(void);
+
+void test_alloc_free_voices_first(void);
+void test_alloc_steals_oldest(void);
+void test_alloc_note_off_by_channel(void);
+void test_alloc_hash_collision(void);
+void test_alloc_opl3_eighteen_voices(void);
+void test_alloc_free_list_resync(void);
+void test_alloc_policies(void);
+void test_alloc_voice_groups(void);
+
+void test_ym2149_detection(void);
+void test_ym2149_note_on_registers(void);
+void test_ym2149_shadow_skips_repeats(void);
+void test_ym2149_envelope_retrigger(void);
+void test_ym2149_panic_then_note(void);
+void test_ym2149_latch_elision(void);
+void test_ym2149_block_upload(void);
+void test_ym2149_patch_bank(void);
+void test_ym2149_second_card_routing(void);
+void test_opl3_detection(void);
+void test_opl3_reset_registers(void);
+void test_opl3_note_on_off_registers(void);
+void test_opl3_bank1_ports(void);
+
+void test_console_builder(void);
+void test_console_full_queue_drops_message(void);
+void test_console_status_text(void);
+
+void test_cpmf_config_tokenizer(void);
+void test_cpmf_records(void);
+void test_cpmf_loaders(void);
+
+void test_smf_type1_merge(void);
+void test_smf_tempo_change(void);
+void test_smf_record_read_ahead(void);
+void test_smf_errors(void);
+
+void test_evw_order_and_lateness(void);
+void test_evw_long_delay(void);
+void test_evw_cancel_and_pool(void);
+void test_evw_stall(void);
+void test_evw_passes_per_tick(void);
+void test_evw_sequences(void);
+void test_evw_audio_test_nonblocking(void);
+void test_timebase_ctc_chained(void);
+void test_timebase_ctc_unchained(void);
+void test_timebase_hbios(void);
+
+#endif // HOST_TEST_H
@@ -0,0 +1,179 @@
+#include "host_test.h"
+#include "../../include/chip_interface.h"
+#include "../../include/chip_manager.h"
+#include "../../include/synthesizer.h"
+#include "../../include/timebase.h"
+#include "../../include/opl3.h"
+#include <stdint.h>
+
+// Voice allocation, stealing and the note-to-voice index
+
+#define VOICES  (chip_manager_get_current()->voices)
+
+void test_alloc_free_voices_first(void) {
+    host_synth_setup(CHIP_YM2149);
+    CHECK_EQ(synthesizer_note_on(60, 100, 0), 0);
+    CHECK_EQ(synthesizer_note_on(62, 100, 0), 1);
+    CHECK_EQ(synthesizer_note_off(60, 0), 0);
+
+    // The freed voice is reused before anything is stolen
+    CHECK_EQ(synthesizer_note_on(64, 100, 0), 0);
+    CHECK_EQ(synthesizer_note_on(65, 100, 0), 2);
+}
+
+void test_alloc_steals_oldest(void) {
+    host_synth_setup(CHIP_YM2149);
+    timebase_tick = 100;
+    synthesizer_note_on(60, 100, 0);           // Voice 0
+    timebase_tick = 200;
+    synthesizer_note_on(62, 100, 0);           // Voice 1
+    timebase_tick = 300;
+    synthesizer_note_on(64, 100, 0);           // Voice 2
+
+    timebase_tick = 400;
+    CHECK_EQ(synthesizer_note_on(67, 100, 0), 0);
+    CHECK_EQ(find_voice_by_note(60, 0), 0xFF);  // Stolen note is unindexed
+    CHECK_EQ(find_voice_by_note(67, 0), 0);
+
+    // Ages survive the tick counter wrapping
+    timebase_tick = 0xFFF0;
+    synthesizer_note_off(62, 0);
+    synthesizer_note_on(69, 100, 0);           // Voice 1 at 0xFFF0
+    timebase_tick = 0x0010;
+    CHECK_EQ(synthesizer_note_on(71, 100, 0), 2);  // Voice 2 (tick 300) is oldest
+}
+
+void test_alloc_note_off_by_channel(void) {
+    host_synth_setup(CHIP_YM2149);
+    synthesizer_note_on(60, 100, 0);
+    synthesizer_note_on(60, 100, 5);
+
+    // Same note on another channel must not release the wrong voice
+    CHECK_EQ(synthesizer_note_off(60, 5), 1);
+    CHECK(VOICES[0].active);
+    CHECK(!VOICES[1].active);
+    CHECK_EQ(synthesizer_note_off(60, 5), 0xFF);
+    CHECK_EQ(synthesizer_note_off(60, 0), 0);
+}
+
+void test_alloc_hash_collision(void) {
+    // (44, ch 0) and (40, ch 1) share a bucket: 44 == 40 ^ (1 << 2)
+    CHECK_EQ(VOICE_MAP_HASH(44, 0), VOICE_MAP_HASH(40, 1));
+
+    host_synth_setup(CHIP_YM2149);
+    uint8_t a = synthesizer_note_on(44, 100, 0);
+    uint8_t b = synthesizer_note_on(40, 100, 1);
+    CHECK_EQ(find_voice_by_note(44, 0), a);
+    CHECK_EQ(find_voice_by_note(40, 1), b);
+    CHECK_EQ(find_voice_by_note(44, 1), 0xFF);
+
+    // Unlinking one entry keeps the rest of the chain
+    CHECK_EQ(synthesizer_note_off(44, 0), a);
+    CHECK_EQ(find_voice_by_note(40, 1), b);
+    CHECK_EQ(synthesizer_note_off(40, 1), b);
+}
+
+void test_alloc_opl3_eighteen_voices(void) {
+    host_synth_setup(CHIP_OPL3);
+    CHECK_EQ(chip_manager_get_current()->voice_count, OPL3_VOICES);
+
+    for (uint8_t i = 0; i < OPL3_VOICES; i++) {
+        timebase_tick = 10 + i;
+        CHECK_EQ(synthesizer_note_on(40 + i, 100, 0), i);
+    }
+    for (uint8_t i = 0; i < OPL3_VOICES; i++) {
+        CHECK_EQ(find_voice_by_note(40 + i, 0), i);
+    }
+
+    // Full: the 19th note takes the oldest voice
+    timebase_tick = 100;
+    CHECK_EQ(synthesizer_note_on(90, 100, 0), 0);
+    CHECK_EQ(find_voice_by_note(40, 0), 0xFF);
+
+    // Release everything through the index
+    for (uint8_t i = 1; i < OPL3_VOICES; i++) {
+        CHECK_EQ(synthesizer_note_off(40 + i, 0), i);
+    }
+    CHECK_EQ(synthesizer_note_off(90, 0), 0);
+}
+
+void test_alloc_free_list_resync(void) {
+    host_synth_setup(CHIP_YM2149);
+    synthesizer_note_on(60, 100, 0);
+    synthesizer_note_on(62, 100, 0);
+    synthesizer_note_on(64, 100, 0);
+    synthesizer_note_off(62, 0);
+    CHECK_EQ(synthesizer_note_on(65, 100, 0), 1);  // From the free list
+    CHECK_EQ(valloc_stats.steals, 0);
+
+    // Panic frees every voice behind the allocator's back; the lists are
+    // rebuilt from the chip before the next note
+    synthesizer_panic();
+    CHECK_EQ(synthesizer_note_on(67, 100, 0), 0);
+    CHECK_EQ(synthesizer_note_on(69, 100, 0), 1);
+    CHECK_EQ(synthesizer_note_on(71, 100, 0), 2);
+    CHECK_EQ(valloc_stats.steals, 0);
+    CHECK_EQ(synthesizer_note_on(72, 100, 0), 0);  // Oldest after the rebuild
+    CHECK_EQ(valloc_stats.steals, 1);
+}
+
+void test_alloc_policies(void) {
+    // Quietest: lowest velocity, the older one on a tie
+    host_synth_setup(CHIP_YM2149);
+    valloc_set_policy(VALLOC_QUIETEST);
+    synthesizer_note_on(60, 100, 0);           // Voice 0
+    synthesizer_note_on(62, 30, 0);            // Voice 1
+    synthesizer_note_on(64, 30, 0);            // Voice 2
+    CHECK_EQ(synthesizer_note_on(65, 90, 0), 1);
+    CHECK_EQ(synthesizer_note_on(67, 90, 0), 2);
+    CHECK_EQ(synthesizer_note_on(69, 90, 0), 1);  // Tie at 90: voice 1 is older
+    CHECK_EQ(find_voice_by_note(60, 0), 0);       // The loud note survives
+
+    // Retrigger: a repeated note keeps its voice even with voices free
+    host_synth_setup(CHIP_YM2149);
+    valloc_set_policy(VALLOC_RETRIGGER);
+    CHECK_EQ(synthesizer_note_on(60, 100, 0), 0);
+    CHECK_EQ(synthesizer_note_on(60, 80, 0), 0);
+    CHECK_EQ(synthesizer_note_on(60, 80, 1), 1);  // Other channel: new voice
+    CHECK_EQ(valloc_stats.retriggers, 1);
+    CHECK_EQ(synthesizer_note_off(60, 0), 0);
+    CHECK_EQ(synthesizer_note_off(60, 0), 0xFF);  // Only one voice held it
+
+    // Reserve: channel 9 keeps one voice however old it is
+    host_synth_setup(CHIP_YM2149);
+    valloc_set_policy(VALLOC_RESERVE);
+    valloc_set_reserve(9, 1);
+    synthesizer_note_on(36, 100, 9);           // Voice 0, oldest
+    synthesizer_note_on(60, 100, 0);           // Voice 1
+    synthesizer_note_on(62, 100, 0);           // Voice 2
+    CHECK_EQ(synthesizer_note_on(64, 100, 0), 1);
+    CHECK_EQ(synthesizer_note_on(65, 100, 0), 2);
+    CHECK_EQ(find_voice_by_note(36, 9), 0);
+    CHECK_EQ(synthesizer_note_on(38, 100, 9), 0);  // The channel's own voice
+
+    valloc_set_reserve(9, 0);
+    valloc_set_policy(VALLOC_OLDEST);
+}
+
+void test_alloc_voice_groups(void) {
+    // YM2149 voices 0-1 for everything, voice 2 kept for channel 10
+    host_synth_setup(CHIP_YM2149);
+    valloc_set_group(1, 2);
+    midi_channels[9].group = 1;
+
+    CHECK_EQ(synthesizer_note_on(36, 100, 9), 2);
+    CHECK_EQ(synthesizer_note_on(60, 100, 0), 0);
+    CHECK_EQ(synthesizer_note_on(62, 100, 0), 1);
+    CHECK_EQ(synthesizer_note_on(64, 100, 0), 0);  // Steals within its group
+    CHECK_EQ(find_voice_by_note(36, 9), 2);
+    CHECK_EQ(synthesizer_note_on(38, 100, 9), 2);
+    CHECK_EQ(synthesizer_note_off(38, 9), 2);
+    CHECK_EQ(synthesizer_note_on(40, 100, 9), 2);  // Back from its free list
+
+    // A group the chip has no voices for falls back to group 0
+    valloc_set_group(1, 12);
+    CHECK_EQ(synthesizer_note_on(42, 100, 9), 0);
+
+    valloc_set_group(1, VALLOC_NONE);
+    midi_channels[9].group = 0;
+}
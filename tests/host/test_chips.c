@@ -0,0 +1,280 @@
+#include "host_test.h"
+#include "../../include/hal.h"
+#include "../../include/chip_interface.h"
+#include "../../include/chip_manager.h"
+#include "../../include/port_config.h"
+#include "../../include/ym2149.h"
+#include "../../include/opl3.h"
+#include "../../include/synthesizer.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Chip detection and register sequences on the fake bus
+
+void test_ym2149_detection(void) {
+    host_synth_setup(CHIP_YM2149);
+    CHECK(available_chips & CHIP_YM2149);
+    CHECK_EQ(ym2149_card_count, 1);
+
+    // Empty bus: every read floats to 0xFF
+    fake_devices_attach();
+    hal_bus_attach(0);
+    chip_manager_detect_chips();
+    CHECK(!(available_chips & CHIP_YM2149));
+    CHECK_EQ(ym2149_card_count, 0);
+}
+
+void test_ym2149_note_on_registers(void) {
+    host_synth_setup(CHIP_YM2149);
+    ym2149_note_on(0, 69, 100, 0);           // A4: period 262 = 0x106
+
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_FREQ_A_LSB), 0x06);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_FREQ_A_LSB + 1), 0x01);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_A), 100 * 15 / 127);
+
+    // Address then data for each register: three registers, six writes
+    CHECK_EQ(hal_bus_write_count(), 6);
+    CHECK_EQ(hal_bus_write_at(0)->port, 0xD8);
+    CHECK_EQ(hal_bus_write_at(1)->port, 0xD0);
+
+    ym2149_note_off(0);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_A), 0);
+}
+
+void test_ym2149_shadow_skips_repeats(void) {
+    host_synth_setup(CHIP_YM2149);
+    ym2149_note_on(1, 60, 100, 0);
+    uint32_t writes = hal_bus_write_count();
+    uint16_t skipped = ym2149_reg_stats.skipped;
+
+    // Retriggering the same note writes nothing
+    ym2149_note_on(1, 60, 100, 0);
+    CHECK_EQ(hal_bus_write_count(), writes);
+    CHECK_EQ(ym2149_reg_stats.skipped - skipped, 3);
+
+    // The envelope shape is always written: the same shape again is
+    // what restarts the envelope
+    ym2149_set_decay(1, 10);
+    writes = hal_bus_write_count();
+    ym2149_set_decay(1, 10);
+    CHECK_EQ(hal_bus_write_count() - writes, 1);   // Latched: data only
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_SHAPE_ENV), YM2149_ENV_TRIANGLE);
+}
+
+// Data writes to one register of the card at 0xD8/0xD0 in the bus log
+static uint16_t ym2149_data_writes_to(uint8_t reg) {
+    const hal_bus_write_t* w;
+    uint8_t latch = 0xFF;
+    uint16_t n = 0;
+
+    for (uint16_t i = 0; (w = hal_bus_write_at(i)) != 0; i++) {
+        if (w->port == 0xD8) latch = w->value;
+        if (w->port == 0xD0 && latch == reg) n++;
+    }
+    return n;
+}
+
+void test_ym2149_envelope_retrigger(void) {
+    host_synth_setup(CHIP_YM2149);
+    ym2149_bank[5].regs_11_13[YM2149_PATCH_SHAPE] = YM2149_ENV_DECAY;
+    ym2149_bank[5].level_mode = YM2149_VOLUME_ENV;
+    ym2149_set_preset(5);
+
+    // A one-shot envelope restarts on every note of an envelope patch,
+    // not only the one that loaded the program
+    ym2149_note_on(0, 60, 100, 0);
+    CHECK_EQ(ym2149_data_writes_to(YM2149_SHAPE_ENV), 1);
+    ym2149_note_off(0);
+    hal_bus_clear_log();
+    ym2149_note_on(0, 62, 100, 0);
+    CHECK_EQ(ym2149_data_writes_to(YM2149_SHAPE_ENV), 1);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_SHAPE_ENV), YM2149_ENV_DECAY);
+
+    // A fixed-level patch leaves the envelope alone
+    ym2149_set_preset(0);
+    ym2149_note_on(1, 64, 100, 0);
+    hal_bus_clear_log();
+    ym2149_note_on(1, 65, 100, 0);
+    CHECK_EQ(ym2149_data_writes_to(YM2149_SHAPE_ENV), 0);
+}
+
+void test_ym2149_panic_then_note(void) {
+    host_synth_setup(CHIP_YM2149);
+    synthesizer_note_on(60, 100, 0);
+    synthesizer_panic();
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_MIXER), YM2149_MIX_ALL_OFF);
+
+    // The same program again: the next note still reloads the mixer
+    synthesizer_note_on(62, 100, 0);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_MIXER), YM2149_MIX_ALL_TONE);
+    CHECK(fake_ym2149_reg(0xD8, YM2149_LEVEL_A) != 0);
+}
+
+void test_ym2149_latch_elision(void) {
+    host_synth_setup(CHIP_YM2149);
+    uint16_t hits = ym2149_reg_stats.latch_hits;
+
+    // Same register again: the address is still latched, data cycle only
+    ym2149_write_register(YM2149_LEVEL_A, 5);
+    CHECK_EQ(hal_bus_write_count(), 2);
+    ym2149_write_register(YM2149_LEVEL_A, 6);
+    CHECK_EQ(hal_bus_write_count(), 3);
+    CHECK_EQ(hal_bus_write_at(2)->port, 0xD0);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_A), 6);
+    CHECK_EQ(ym2149_reg_stats.latch_hits - hits, 1);
+}
+
+void test_ym2149_block_upload(void) {
+    host_synth_setup(CHIP_YM2149);
+
+    // Reset: all 14 registers in one pass, mixer straight to off
+    ym2149_reset();
+    CHECK_EQ(hal_bus_write_count(), 28);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_MIXER), YM2149_MIX_ALL_OFF);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_C), 0);
+
+    // Unchanged registers at the ends of a block are trimmed by the shadow
+    ym2149_set_frequency(2, 0x123);
+    CHECK_EQ(hal_bus_write_count(), 28 + 4);
+    ym2149_set_frequency(2, 0x223);
+    CHECK_EQ(hal_bus_write_count(), 28 + 4 + 2);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_FREQ_A_LSB + 4), 0x23);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_FREQ_A_LSB + 5), 0x02);
+    ym2149_set_frequency(2, 0x223);
+    CHECK_EQ(hal_bus_write_count(), 28 + 4 + 2);
+}
+
+void test_ym2149_patch_bank(void) {
+    static const uint8_t bank[] = {
+        'Y', 'M', 'P', 'B', YM2149_BANK_VERSION, 2, 0, 0,
+        0x1F, YM2149_MIX_ALL_TONE, 0x00, 0x00, YM2149_ENV_OFF, 0, YM2149_CURVE_LINEAR, 0,
+        0x05, 0x30, 0x34, 0x12, 0x0E, YM2149_VOLUME_ENV, YM2149_CURVE_FIXED, (uint8_t)-3,
+    };
+    FILE* f = fopen(YM2149_BANK_FILE, "wb");
+    fwrite(bank, 1, sizeof(bank), f);
+    fclose(f);
+
+    host_synth_setup(CHIP_YM2149);
+    CHECK_EQ(ym2149_bank_load(YM2149_BANK_FILE), YM2149_BANK_OK);
+
+    // Program change writes nothing; the first note on the card uploads
+    // registers 6-7 and 11-13 straight from the table
+    hal_bus_clear_log();
+    ym2149_set_preset(1);
+    CHECK_EQ(hal_bus_write_count(), 0);
+    ym2149_note_on(0, 69, 10, 0);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_FREQ_NOISE), 0x05);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_MIXER), 0x30);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_FREQ_ENV_LSB), 0x34);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_FREQ_ENV_LSB + 1), 0x12);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_SHAPE_ENV), 0x0E);
+
+    // Fixed curve, envelope level mode, detuned period (262 - 3)
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_A), YM2149_VOLUME_ENV | 15);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_FREQ_A_LSB), 0x03);
+
+    // Programs past the file's patch count keep the built-in patches
+    ym2149_set_preset(YM2149_BANK_SIZE + 2);
+    ym2149_note_on(1, 72, 100, 0);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_SHAPE_ENV), YM2149_ENV_TRIANGLE);
+
+    // A bad header leaves the built-in bank
+    f = fopen(YM2149_BANK_FILE, "wb");
+    fwrite(bank, 1, 4, f);
+    fclose(f);
+    CHECK_EQ(ym2149_bank_load(YM2149_BANK_FILE), YM2149_BANK_ERR_FORMAT);
+    CHECK_EQ(ym2149_bank[1].regs_11_13[YM2149_PATCH_SHAPE], YM2149_ENV_SAWTOOTH);
+    remove(YM2149_BANK_FILE);
+    CHECK_EQ(ym2149_bank_load(YM2149_BANK_FILE), YM2149_BANK_ERR_OPEN);
+}
+
+void test_ym2149_second_card_routing(void) {
+    host_synth_setup(CHIP_YM2149);
+    fake_ym2149_fit(0xA0, 0xA1);
+    ym2149_ports.addr_port2 = 0xA0;
+    ym2149_ports.data_port2 = 0xA1;
+    chip_manager_detect_chips();
+    chip_manager_set_chip(CHIP_YM2149);
+    CHECK_EQ(ym2149_card_count, 2);
+    CHECK_EQ(chip_manager_get_current()->voice_count, 6);
+
+    // Voice 4 = card 2, channel B
+    hal_bus_clear_log();
+    ym2149_note_on(4, 69, 127, 0);
+    CHECK_EQ(fake_ym2149_reg(0xA0, YM2149_FREQ_B_LSB), 0x06);
+    CHECK_EQ(fake_ym2149_reg(0xA0, YM2149_LEVEL_A + 1), 15);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_FREQ_B_LSB), 0);
+    CHECK_EQ(host_bus_writes_to(0xD8), 0);
+
+    ym2149_ports.addr_port2 = 0;
+    ym2149_ports.data_port2 = 0;
+}
+
+void test_opl3_detection(void) {
+    host_synth_setup(CHIP_YM2149);
+    CHECK(available_chips & CHIP_OPL3);
+
+    // An OPL2 passes the timer test but has status bits 1-2 set
+    fake_devices_attach();
+    fake_ym2149_fit(0xD8, 0xD0);
+    fake_opl3_fit(0x60, 1);
+    chip_manager_detect_chips();
+    CHECK(!(available_chips & CHIP_OPL3));
+
+    // Nothing fitted
+    fake_devices_attach();
+    fake_ym2149_fit(0xD8, 0xD0);
+    chip_manager_detect_chips();
+    CHECK(!(available_chips & CHIP_OPL3));
+    CHECK(!chip_manager_set_chip(CHIP_OPL3));
+
+    // Disabled in ports.conf: the bus is never touched
+    ym2149_ports.opl3_port = 0;
+    hal_bus_clear_log();
+    CHECK(!detect_opl3());
+    CHECK_EQ(hal_bus_write_count(), 0);
+    ym2149_ports.opl3_port = OPL3_PORT_DEFAULT;
+}
+
+void test_opl3_reset_registers(void) {
+    host_synth_setup(CHIP_OPL3);
+    CHECK_EQ(fake_opl3_reg(OPL3_NEW), 0x01);
+    CHECK_EQ(fake_opl3_reg(OPL3_4OP_ENABLE), 0x00);
+
+    // Default patch loaded into both banks, output to both speakers
+    CHECK_EQ(fake_opl3_reg(OPL3_CH_FB_CONN) & OPL3_OUT_LR, OPL3_OUT_LR);
+    CHECK_EQ(fake_opl3_reg(0x100 + OPL3_CH_FB_CONN + 8) & OPL3_OUT_LR, OPL3_OUT_LR);
+
+    // Reloading the same patch is absorbed by the shadow
+    opl3_set_preset(0);
+    CHECK_EQ(hal_bus_write_count(), 0);
+}
+
+void test_opl3_note_on_off_registers(void) {
+    host_synth_setup(CHIP_OPL3);
+    opl3_note_on(0, 69, 100, 0);             // A4: F-number 580, block 4
+
+    CHECK_EQ(fake_opl3_reg(OPL3_CH_FNUM_LO), 580 & 0xFF);
+    CHECK_EQ(fake_opl3_reg(OPL3_CH_KEY_BLOCK), OPL3_KEY_ON | (4 << 2) | (580 >> 8));
+    CHECK_EQ(fake_opl3_reg(OPL3_OP_LEVEL + 3) & 0x3F, (15 - 100 * 15 / 127) * 4);
+
+    // Key off keeps the block/F-number so the release keeps its pitch
+    opl3_note_off(0);
+    CHECK_EQ(fake_opl3_reg(OPL3_CH_KEY_BLOCK), (4 << 2) | (580 >> 8));
+
+    // Half a semitone of bend interpolates towards A#4 (615)
+    opl3_set_pitch_bend(0, PITCH_BEND_STEPS / 2);
+    opl3_note_on(0, 69, 100, 0);
+    CHECK_EQ(fake_opl3_reg(OPL3_CH_FNUM_LO), (580 + (615 - 580) / 2) & 0xFF);
+}
+
+void test_opl3_bank1_ports(void) {
+    host_synth_setup(CHIP_OPL3);
+    opl3_note_on(9, 60, 100, 0);             // C4 on bank 1, channel 0
+
+    CHECK(host_bus_writes_to(0x62) > 0);
+    CHECK_EQ(host_bus_writes_to(0x60), 0);
+    CHECK_EQ(fake_opl3_reg(0x100 + OPL3_CH_FNUM_LO), 345 & 0xFF);
+    CHECK_EQ(fake_opl3_reg(0x100 + OPL3_CH_KEY_BLOCK), OPL3_KEY_ON | (4 << 2) | (345 >> 8));
+    CHECK_EQ(fake_opl3_reg(OPL3_CH_KEY_BLOCK) & OPL3_KEY_ON, 0);
+}
@@ -0,0 +1,60 @@
+#include "host_test.h"
+#include "../../include/hal.h"
+#include "../../include/console.h"
+#include "../../include/messages.h"
+#include "../../include/synthesizer.h"
+#include <stdint.h>
+#include <string.h>
+
+// Lean console output: message builder, string table, queue limits
+
+void test_console_builder(void) {
+    host_synth_setup(CHIP_YM2149);
+    hal_console_clear();
+
+    con_begin(CON_INFO);
+    con_msg(MSG_NOTE);
+    con_dec(0);
+    con_msg(MSG_COMMA);
+    con_dec(65535);
+    con_msg(MSG_COMMA);
+    con_msg(MSG_HEX_PREFIX);
+    con_hex(0x0A);
+    con_endl();
+    con_msg_dec(CON_INFO, MSG_OCTAVE, 100);
+
+    // Filtered: nothing is queued, not even the newline
+    con_msg_dec(CON_DEBUG, MSG_VELOCITY, 5);
+    console_flush();
+    CHECK(strcmp(hal_console_text(), "Note: 0, 65535, 0x0A\nOctave: 100\n") == 0);
+}
+
+void test_console_full_queue_drops_message(void) {
+    host_synth_setup(CHIP_YM2149);
+    hal_console_clear();
+
+    // One long message fills the queue to a few bytes short
+    con_begin(CON_INFO);
+    for (uint16_t i = 0; i < CON_QUEUE_SIZE - 5; i++) {
+        con_char('.');
+    }
+    con_endl();
+    uint16_t dropped = console_stats.dropped;
+    con_msg_dec(CON_INFO, MSG_VERBOSITY, 12345);
+    CHECK_EQ(console_stats.dropped - dropped, 1);
+    console_flush();
+    CHECK(strstr(hal_console_text(), "Verbosity") == 0);
+}
+
+void test_console_status_text(void) {
+    host_synth_setup(CHIP_YM2149);
+    hal_console_clear();
+    synthesizer_print_status();
+    console_flush();
+
+    // Same text the printf-based status produced
+    const char* text = hal_console_text();
+    CHECK(strstr(text, "Active Chip: YM2149 PSG\nVoice Count: 3\n") != 0);
+    CHECK(strstr(text, "MIDI RX: polled, overruns ring 0 SIO 0\n") != 0);
+    CHECK(strstr(text, "  CC#1 (volume): 0\n") != 0);
+}
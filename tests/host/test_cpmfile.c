@@ -0,0 +1,133 @@
+#include "host_test.h"
+#include "../../include/cpmfile.h"
+#include "../../include/ym2149.h"
+#include "../../include/midi_driver.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// BDOS file layer: records, sequential reads, the config tokenizer
+
+#define CPMF_TEST_FILE  "test.cfg"
+
+static char cpmf_seen[256];
+
+static void cpmf_write(const char* text, uint16_t len) {
+    FILE* f = fopen(CPMF_TEST_FILE, "wb");
+    fwrite(text, 1, len, f);
+    fclose(f);
+}
+
+// Record every pair as "key:value;"
+static void cpmf_collect(const char* key, const char* value) {
+    strcat(cpmf_seen, key);
+    strcat(cpmf_seen, ":");
+    strcat(cpmf_seen, value);
+    strcat(cpmf_seen, ";");
+}
+
+void test_cpmf_config_tokenizer(void) {
+    static const char text[] =
+        "# comment=ignored\n"
+        "a=1\r\n"
+        "\n"
+        "bb=0x2F\r"
+        "novalue\n"
+        "empty=\n"
+        "c=3=junk\n"
+        "a_very_long_key_name=a_very_long_value\n"
+        "last=9\x1A" "after=eof\n";
+
+    cpmf_seen[0] = '\0';
+    CHECK_EQ(cpmf_config(CPMF_TEST_FILE ".none", cpmf_collect), 0);
+    cpmf_write(text, sizeof(text) - 1);
+    CHECK_EQ(cpmf_config(CPMF_TEST_FILE, cpmf_collect), 1);
+    CHECK(strcmp(cpmf_seen, "a:1;bb:0x2F;c:3;a_very_long_key:a_very_long_val;last:9;") == 0);
+
+    // Last line without a newline still counts
+    cpmf_seen[0] = '\0';
+    cpmf_write("x=5", 3);
+    cpmf_config(CPMF_TEST_FILE, cpmf_collect);
+    CHECK(strcmp(cpmf_seen, "x:5;") == 0);
+
+    CHECK_EQ(cpmf_number("0"), 0);
+    CHECK_EQ(cpmf_number("1843"), 1843);
+    CHECK_EQ(cpmf_number("0xd8"), 0xD8);
+    CHECK_EQ(cpmf_number("0XFFFF"), 0xFFFF);
+    CHECK_EQ(cpmf_number("12 "), 12);
+    remove(CPMF_TEST_FILE);
+}
+
+void test_cpmf_records(void) {
+    static uint8_t data[300];
+    uint8_t buf[CPMF_RECORD_SIZE];
+    cpm_file_t f;
+
+    for (uint16_t i = 0; i < sizeof(data); i++) data[i] = i * 7;
+    cpmf_write((const char*)data, sizeof(data));
+    CHECK_EQ(cpmf_open(&f, "missing.dat"), 0);
+    CHECK_EQ(cpmf_open(&f, CPMF_TEST_FILE), 1);
+
+    // Random reads, the last record padded with ^Z
+    CHECK_EQ(cpmf_read_record(&f, 1, buf), 1);
+    CHECK(memcmp(buf, data + 128, 128) == 0);
+    const uint8_t* rec = cpmf_record(&f, 2);
+    CHECK(rec != 0);
+    CHECK(memcmp(rec, data + 256, 44) == 0);
+    CHECK_EQ(rec[44], CPMF_TEXT_EOF);
+    CHECK_EQ(rec[127], CPMF_TEXT_EOF);
+    CHECK(cpmf_record(&f, 3) == 0);
+
+    // Sequential reads cross records and run to the padded end
+    static uint8_t seq[400];
+    CHECK_EQ(cpmf_getc(&f), data[0]);
+    CHECK_EQ(cpmf_read(&f, seq, 200), 200);
+    CHECK(memcmp(seq, data + 1, 200) == 0);
+    CHECK_EQ(cpmf_read(&f, seq, 400), 3 * CPMF_RECORD_SIZE - 201);
+    CHECK_EQ(cpmf_getc(&f), CPMF_EOF);
+    cpmf_close(&f);
+    CHECK_EQ(cpmf_read_record(&f, 0, buf), 0);
+    remove(CPMF_TEST_FILE);
+}
+
+void test_cpmf_loaders(void) {
+    static const char ports[] =
+        "# ports\r\n"
+        "addr_port=0xA0\r\n"
+        "data_port=161\r\n"
+        "bus_timing=safe\r\n"
+        "cpu_khz=18432\r\n";
+    static const char ccmap[] =
+        "74=attack,all\n"
+        "75=modulation,last\n"
+        "7=none\n"
+        "76=decay,2\n"
+        "200=volume\n";
+
+    port_config_t saved = ym2149_ports;
+    cpmf_write(ports, sizeof(ports) - 1);
+    CHECK_EQ(port_config_load_from_file(CPMF_TEST_FILE), 1);
+    CHECK_EQ(ym2149_ports.addr_port, 0xA0);
+    CHECK_EQ(ym2149_ports.data_port, 161);
+    CHECK_EQ(ym2149_ports.bus_timing, YM2149_TIMING_SAFE);
+    CHECK_EQ(ym2149_ports.cpu_khz, 18432);
+    CHECK_EQ(ym2149_ports.addr_port2, 0);         // Missing keys: defaults
+
+    // Without a file the settings are kept
+    CHECK_EQ(port_config_load_from_file("missing.cfg"), 0);
+    CHECK_EQ(ym2149_ports.addr_port, 0xA0);
+    ym2149_ports = saved;
+
+    cpmf_write(ccmap, sizeof(ccmap) - 1);
+    midi_cc_map_defaults();
+    CHECK_EQ(midi_cc_map_load(CPMF_TEST_FILE), 1);
+    CHECK_EQ(midi_cc_map[74].handler, MIDI_CC_ATTACK);
+    CHECK_EQ(midi_cc_map[74].target, MIDI_CC_TARGET_ALL);
+    CHECK_EQ(midi_cc_map[75].handler, MIDI_CC_MODULATION);
+    CHECK_EQ(midi_cc_map[75].target, MIDI_CC_TARGET_LAST);
+    CHECK_EQ(midi_cc_map[7].handler, MIDI_CC_NONE);
+    CHECK_EQ(midi_cc_map[76].handler, MIDI_CC_DECAY);
+    CHECK_EQ(midi_cc_map[76].target, 2);
+    midi_cc_map_defaults();
+    remove(CPMF_TEST_FILE);
+}
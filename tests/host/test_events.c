@@ -0,0 +1,344 @@
+#include "host_test.h"
+#include "../../include/chip_interface.h"
+#include "../../include/chip_manager.h"
+#include "../../include/synthesizer.h"
+#include "../../include/timebase.h"
+#include "../../include/event_wheel.h"
+#include "../../include/ym2149.h"
+#include "../../include/hal.h"
+#include <stdint.h>
+
+// Event wheel: expiry order and lateness, long delays, cancel, pool
+// limits, stalls and the sequence runner
+
+static uint8_t evw_log[64];
+static uint16_t evw_log_tick[64];
+static uint8_t evw_log_len;
+
+static void evw_record(uint8_t arg) {
+    evw_log_tick[evw_log_len] = timebase_now();
+    evw_log[evw_log_len++] = arg;
+}
+
+static void evw_test_reset(uint16_t tick) {
+    host_synth_setup(CHIP_YM2149);
+    timebase_tick = tick;
+    evw_init();
+    evw_log_len = 0;
+}
+
+// Advance the clock a tick at a time, servicing the wheel each tick
+static void evw_run_until(uint16_t tick) {
+    while (timebase_tick != tick) {
+        timebase_tick++;
+        evw_service();
+    }
+}
+
+void test_evw_order_and_lateness(void) {
+    evw_test_reset(0);
+
+    evw_schedule(40, evw_record, 3);
+    evw_schedule(10, evw_record, 1);
+    evw_schedule(11, evw_record, 2);
+    evw_schedule(0, evw_record, 0);
+    CHECK_EQ(evw_stats.pending, 4);
+    CHECK_EQ(evw_stats.peak, 4);
+
+    evw_run_until(100);
+    CHECK_EQ(evw_log_len, 4);
+    // Slot order is kept; 10 and 11 share a slot and run in either order
+    CHECK_EQ(evw_log[0], 0);
+    CHECK_EQ(evw_log[1] + evw_log[2], 1 + 2);
+    CHECK_EQ(evw_log[3], 3);
+    // Never early, and at most a slot late
+    CHECK(evw_log_tick[1] >= 11 && evw_log_tick[1] < 10 + EVW_SLOT_TICKS);
+    CHECK_EQ(evw_log_tick[2], evw_log_tick[1]);
+    CHECK(evw_log_tick[3] >= 40 && evw_log_tick[3] < 40 + EVW_SLOT_TICKS);
+    CHECK_EQ(evw_stats.fired, 4);
+    CHECK_EQ(evw_stats.pending, 0);
+
+    // Delays across the tick counter wrap
+    evw_test_reset(0xFFF0);
+    evw_schedule(0x30, evw_record, 7);
+    evw_run_until(0x001C);
+    CHECK_EQ(evw_log_len, 0);
+    evw_run_until(0x0030);
+    CHECK_EQ(evw_log_len, 1);
+    CHECK(evw_log_tick[0] >= 0x0020 && evw_log_tick[0] < 0x0020 + EVW_SLOT_TICKS);
+}
+
+void test_evw_long_delay(void) {
+    evw_test_reset(5);
+
+    // Same slot as the short one, several turns later
+    evw_schedule(3 * EVW_SPAN + 20, evw_record, 2);
+    evw_schedule(20, evw_record, 1);
+
+    evw_run_until(5 + 3 * EVW_SPAN);
+    CHECK_EQ(evw_log_len, 1);
+    CHECK_EQ(evw_log[0], 1);
+    CHECK_EQ(evw_stats.pending, 1);
+
+    evw_run_until(5 + 3 * EVW_SPAN + 40);
+    CHECK_EQ(evw_log_len, 2);
+    CHECK_EQ(evw_log[1], 2);
+    CHECK(evw_log_tick[1] >= 5 + 3 * EVW_SPAN + 20);
+
+    // Delays past the limit are clamped
+    evw_schedule(0xFFFF, evw_record, 3);
+    evw_run_until(timebase_tick + EVW_MAX_DELAY + EVW_SLOT_TICKS);
+    CHECK_EQ(evw_log_len, 3);
+}
+
+void test_evw_cancel_and_pool(void) {
+    uint8_t handle;
+
+    evw_test_reset(0);
+    handle = evw_schedule(20, evw_record, 1);
+    evw_schedule(20, evw_record, 2);
+    evw_cancel(handle);
+    evw_run_until(40);
+    CHECK_EQ(evw_log_len, 1);
+    CHECK_EQ(evw_log[0], 2);
+    CHECK_EQ(evw_stats.fired, 1);
+    CHECK_EQ(evw_stats.pending, 0);    // The cancelled event went back to the pool
+
+    // A full pool refuses and counts the drop
+    for (uint8_t i = 0; i < EVW_POOL; i++) {
+        CHECK(evw_schedule(10 + i, evw_record, i) != EVW_NONE);
+    }
+    CHECK_EQ(evw_schedule(10, evw_record, 0xFF), EVW_NONE);
+    CHECK_EQ(evw_stats.dropped, 1);
+    CHECK_EQ(evw_stats.peak, EVW_POOL);
+
+    evw_log_len = 0;
+    evw_run_until(100);
+    CHECK_EQ(evw_log_len, EVW_POOL);
+    CHECK_EQ(evw_stats.pending, 0);
+
+    // Clear drops everything pending
+    evw_schedule(10, evw_record, 1);
+    evw_clear();
+    evw_log_len = 0;
+    evw_run_until(200);
+    CHECK_EQ(evw_log_len, 0);
+    CHECK(evw_schedule(10, evw_record, 1) != EVW_NONE);
+}
+
+void test_evw_stall(void) {
+    evw_test_reset(0);
+
+    evw_schedule(30, evw_record, 1);
+    evw_schedule(EVW_SPAN + 100, evw_record, 2);
+    evw_schedule(4 * EVW_SPAN, evw_record, 3);
+
+    // No service for two turns: one pass catches up on both overdue events
+    timebase_tick = 2 * EVW_SPAN + 7;
+    evw_service();
+    CHECK_EQ(evw_log_len, 2);
+    CHECK_EQ(evw_log[0] + evw_log[1], 1 + 2);
+    CHECK_EQ(evw_stats.pending, 1);
+
+    evw_run_until(4 * EVW_SPAN + EVW_SLOT_TICKS);
+    CHECK_EQ(evw_log_len, 3);
+    CHECK_EQ(evw_log[2], 3);
+}
+
+// Many passes per tick, as when the main loop is idle: each slot is
+// expired once, whatever the tick lands on within it
+void test_evw_passes_per_tick(void) {
+    evw_test_reset(0);
+    evw_schedule(EVW_SPAN / 2, evw_record, 1);
+
+    for (uint16_t t = 0; t < 2 * EVW_SPAN; t++) {
+        timebase_tick = t;
+        for (uint8_t pass = 0; pass < 10; pass++) {
+            evw_service();
+        }
+    }
+    CHECK_EQ(evw_stats.slots, 2 * EVW_SLOTS);
+    CHECK_EQ(evw_log_len, 1);
+}
+
+static uint8_t evw_seq_steps;
+
+static uint16_t evw_test_steps(uint8_t step) {
+    evw_record(step);
+    evw_seq_steps++;
+    return (step < 2) ? 20 : EVW_SEQ_END;
+}
+
+void test_evw_sequences(void) {
+    evw_test_reset(0);
+    evw_seq_steps = 0;
+
+    // Two back to back: steps 0,1,2 then 0,1,2
+    CHECK(evw_sequence_start(evw_test_steps));
+    CHECK(evw_sequence_start(evw_test_steps));
+    CHECK(evw_sequence_active());
+    evw_run_until(200);
+    CHECK_EQ(evw_seq_steps, 6);
+    CHECK_EQ(evw_log[3], 0);
+    CHECK_EQ(evw_log[5], 2);
+    CHECK(evw_log_tick[2] - evw_log_tick[0] >= 40);
+    CHECK(!evw_sequence_active());
+
+    // Stopped part way through
+    evw_seq_steps = 0;
+    evw_sequence_start(evw_test_steps);
+    evw_run_until(210);
+    CHECK_EQ(evw_seq_steps, 1);
+    evw_sequence_stop();
+    evw_run_until(400);
+    CHECK_EQ(evw_seq_steps, 1);
+    CHECK_EQ(evw_stats.pending, 0);
+}
+
+// The scale test plays from the wheel: the call returns at once and MIDI
+// keeps working between notes
+void test_evw_audio_test_nonblocking(void) {
+    static const uint8_t held_on[3] = {0x90, 50, 100};
+    static const uint8_t note_on[3] = {0x90, 72, 100};
+    uint8_t held, voice;
+
+    evw_test_reset(0);
+    host_midi_send(held_on, sizeof(held_on));
+    held = find_voice_by_note(50, 0);
+    CHECK(held != 0xFF);
+    uint8_t held_level = fake_ym2149_reg(0xD8, YM2149_LEVEL_A + held);
+
+    hal_bus_clear_log();
+    ym2149_play_scale();
+    CHECK_EQ(timebase_tick, 0);
+    CHECK_EQ(host_bus_writes_to(0xD0), 0);
+
+    // The test note is allocated like any other: not on the held voice
+    evw_run_until(10);
+    voice = find_voice_by_note(60, SYNTH_TEST_CHANNEL);
+    CHECK(voice != 0xFF && voice != held);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_A + voice), 12);
+    CHECK(evw_sequence_active());
+
+    // Incoming notes reach the chip, on a voice of their own
+    host_midi_send(note_on, sizeof(note_on));
+    CHECK(find_voice_by_note(72, 0) != 0xFF);
+    CHECK(find_voice_by_note(72, 0) != voice);
+
+    evw_run_until(410);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_A + voice), 0);     // Gap between notes
+    evw_run_until(8 * 450 + 100);
+    CHECK(!evw_sequence_active());
+
+    // Only the test's own notes were released
+    CHECK_EQ(find_voice_by_note(50, 0), held);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_A + held), held_level);
+
+    // Noise goes to the test voice's channel, and the patch's mixer is
+    // back when the test ends.  Three test notes on one card take every
+    // voice, so the live notes are stolen as usual.
+    ym2149_play_test_sequence();
+    evw_run_until(timebase_tick + 6000);
+    voice = find_voice_by_note(60, SYNTH_TEST_CHANNEL);
+    CHECK(voice != 0xFF);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_MIXER),
+             (YM2149_MIX_ALL_TONE | (YM2149_MIX_TONE_A_OFF << voice)) &
+             ~(YM2149_MIX_NOISE_A_OFF << voice));
+    evw_run_until(timebase_tick + 1000);
+    CHECK(!evw_sequence_active());
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_MIXER), YM2149_MIX_ALL_TONE);
+    CHECK_EQ(find_voice_by_note(60, SYNTH_TEST_CHANNEL), 0xFF);
+
+    // Panic stops a test part way through
+    ym2149_play_arpeggio();
+    evw_run_until(timebase_tick + 50);
+    CHECK(evw_sequence_active());
+    synthesizer_panic();
+    CHECK(!evw_sequence_active());
+    CHECK_EQ(evw_stats.pending, 0);
+}
+
+// Timebase sources: the CTC with and without channel 1 chained, and the
+// HBIOS timer on boards without a CTC
+
+// CPU clocks per tick at the default 7373 kHz (28.75 CTC units)
+#define TB_CLOCKS_PER_TICK  7360UL
+
+void test_timebase_ctc_chained(void) {
+    uint16_t t0;
+
+    host_synth_setup(CHIP_YM2149);
+    fake_ctc_fit(0x88, 1, 300);
+    timebase_init(0x88, 7373);
+    CHECK_EQ(timebase_source(), TIMEBASE_SOURCE_CTC);
+    CHECK(timebase_ctc_chained());
+
+    // One pass far beyond channel 0's 65536-clock wrap loses nothing
+    timebase_update();
+    t0 = timebase_tick;
+    fake_ctc_advance(50 * TB_CLOCKS_PER_TICK);
+    timebase_update();
+    CHECK_EQ((uint16_t)(timebase_tick - t0), 50);
+    CHECK_EQ(timebase_stats.overruns, 0);
+
+    // Over half the chained period (2^23 clocks) is counted
+    t0 = timebase_tick;
+    fake_ctc_advance(1500 * TB_CLOCKS_PER_TICK);
+    timebase_update();
+    CHECK_EQ((uint16_t)(timebase_tick - t0), 1500);
+    CHECK_EQ(timebase_stats.overruns, 1);
+}
+
+void test_timebase_ctc_unchained(void) {
+    uint16_t t0;
+
+    host_synth_setup(CHIP_YM2149);
+    fake_ctc_fit(0x88, 0, 300);
+    timebase_init(0x88, 7373);
+    CHECK_EQ(timebase_source(), TIMEBASE_SOURCE_CTC);
+    CHECK(!timebase_ctc_chained());
+
+    timebase_update();
+    t0 = timebase_tick;
+    fake_ctc_advance(3 * TB_CLOCKS_PER_TICK);
+    timebase_update();
+    CHECK_EQ((uint16_t)(timebase_tick - t0), 3);
+    CHECK_EQ(timebase_stats.overruns, 0);
+
+    // A pass longer than 65536 clocks loses the wrap, and is counted
+    t0 = timebase_tick;
+    fake_ctc_advance(100000);
+    timebase_update();
+    CHECK((uint16_t)(timebase_tick - t0) < 100000 / TB_CLOCKS_PER_TICK);
+    CHECK_EQ(timebase_stats.overruns, 1);
+}
+
+void test_timebase_hbios(void) {
+    host_synth_setup(CHIP_YM2149);
+
+    // 50 Hz: 20 ms per timer tick, whatever the pass rate
+    hal_hbios_timer_set(50, 3);
+    timebase_init(0x88, 7373);
+    CHECK_EQ(timebase_source(), TIMEBASE_SOURCE_HBIOS);
+    CHECK_EQ(timebase_hbios_rate(), 50);
+    for (uint16_t i = 0; i < 10 * 3 * TIMEBASE_HBIOS_POLL_CALLS; i++) {
+        timebase_update();
+    }
+    CHECK_EQ(timebase_tick, 200);
+
+    // 60 Hz carries the remainder: three timer ticks are 50 ms
+    hal_hbios_timer_set(60, 1);
+    timebase_init(0x88, 7373);
+    for (uint16_t i = 0; i < 3 * TIMEBASE_HBIOS_POLL_CALLS; i++) {
+        timebase_update();
+    }
+    CHECK_EQ(timebase_tick, 50);
+
+    // A timer that never moves, or no timer call: count passes
+    hal_hbios_timer_set(50, 0);
+    timebase_init(0x88, 7373);
+    CHECK_EQ(timebase_source(), TIMEBASE_SOURCE_SOFT);
+    hal_hbios_timer_set(0, 1);
+    timebase_init(0x88, 7373);
+    CHECK_EQ(timebase_source(), TIMEBASE_SOURCE_SOFT);
+}
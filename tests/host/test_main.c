@@ -0,0 +1,105 @@
+#include "host_test.h"
+#include <stdio.h>
+#include <string.h>
+
+// Host unit test runner.  Run with no arguments for every test, or with
+// a name prefix ("midi", "alloc", "ym2149", "opl3", "console", "cpmf", "smf", "evw", "timebase") to select a
+// group.
+
+typedef struct {
+    const char* name;
+    void (*fn)(void);
+} host_test_t;
+
+#define HOST_TEST(fn)  { #fn, fn }
+
+static const host_test_t host_tests[] = {
+    HOST_TEST(test_midi_note_on_off),
+    HOST_TEST(test_midi_running_status),
+    HOST_TEST(test_midi_velocity_zero_is_note_off),
+    HOST_TEST(test_midi_realtime_inside_message),
+    HOST_TEST(test_midi_system_common_clears_status),
+    HOST_TEST(test_midi_rpn_bend_range),
+    HOST_TEST(test_midi_cc_table_dispatch),
+    HOST_TEST(test_midi_drain_from_sio),
+    HOST_TEST(test_midi_parts),
+    HOST_TEST(test_midi_parts_opl3),
+    HOST_TEST(test_midi_sysex_patch_dump),
+    HOST_TEST(test_midi_sysex_filter),
+    HOST_TEST(test_midi_sysex_dump_request),
+    HOST_TEST(test_midi_clock_tempo),
+    HOST_TEST(test_midi_clock_transport),
+    HOST_TEST(test_midi_clock_drain_budget),
+
+    HOST_TEST(test_alloc_free_voices_first),
+    HOST_TEST(test_alloc_steals_oldest),
+    HOST_TEST(test_alloc_note_off_by_channel),
+    HOST_TEST(test_alloc_hash_collision),
+    HOST_TEST(test_alloc_opl3_eighteen_voices),
+    HOST_TEST(test_alloc_free_list_resync),
+    HOST_TEST(test_alloc_policies),
+    HOST_TEST(test_alloc_voice_groups),
+
+    HOST_TEST(test_ym2149_detection),
+    HOST_TEST(test_ym2149_note_on_registers),
+    HOST_TEST(test_ym2149_shadow_skips_repeats),
+    HOST_TEST(test_ym2149_envelope_retrigger),
+    HOST_TEST(test_ym2149_panic_then_note),
+    HOST_TEST(test_ym2149_latch_elision),
+    HOST_TEST(test_ym2149_block_upload),
+    HOST_TEST(test_ym2149_patch_bank),
+    HOST_TEST(test_ym2149_second_card_routing),
+    HOST_TEST(test_opl3_detection),
+    HOST_TEST(test_opl3_reset_registers),
+    HOST_TEST(test_opl3_note_on_off_registers),
+    HOST_TEST(test_opl3_bank1_ports),
+
+    HOST_TEST(test_console_builder),
+    HOST_TEST(test_console_full_queue_drops_message),
+    HOST_TEST(test_console_status_text),
+
+    HOST_TEST(test_cpmf_config_tokenizer),
+    HOST_TEST(test_cpmf_records),
+    HOST_TEST(test_cpmf_loaders),
+
+    HOST_TEST(test_smf_type1_merge),
+    HOST_TEST(test_smf_tempo_change),
+    HOST_TEST(test_smf_record_read_ahead),
+    HOST_TEST(test_smf_errors),
+
+    HOST_TEST(test_evw_order_and_lateness),
+    HOST_TEST(test_evw_long_delay),
+    HOST_TEST(test_evw_cancel_and_pool),
+    HOST_TEST(test_evw_stall),
+    HOST_TEST(test_evw_passes_per_tick),
+    HOST_TEST(test_evw_sequences),
+    HOST_TEST(test_evw_audio_test_nonblocking),
+    HOST_TEST(test_timebase_ctc_chained),
+    HOST_TEST(test_timebase_ctc_unchained),
+    HOST_TEST(test_timebase_hbios),
+};
+
+int main(int argc, char** argv) {
+    const char* prefix = argc > 1 ? argv[1] : "";
+    int run = 0, failed = 0;
+
+    for (unsigned i = 0; i < sizeof(host_tests) / sizeof(host_tests[0]); i++) {
+        const host_test_t* t = &host_tests[i];
+        // Match "midi" against "test_midi_..."
+        if (*prefix && strncmp(t->name + 5, prefix, strlen(prefix)) != 0) {
+            continue;
+        }
+        host_test_failed = 0;
+        t->fn();
+        run++;
+        if (host_test_failed) {
+            failed++;
+            printf("FAIL %s\n", t->name);
+        } else {
+            printf("ok   %s\n", t->name);
+        }
+    }
+
+    printf("\n%d tests, %d checks, %d failed\n", run, host_test_checks, failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,500 @@
+#include "host_test.h"
+#include "../../include/hal.h"
+#include "../../include/chip_interface.h"
+#include "../../include/chip_manager.h"
+#include "../../include/midi_driver.h"
+#include "../../include/synthesizer.h"
+#include "../../include/ym2149.h"
+#include "../../include/opl3.h"
+#include "../../include/sysex.h"
+#include "../../include/midi_clock.h"
+#include "../../include/timebase.h"
+#include "../../include/lfo.h"
+#include <stdint.h>
+#include <string.h>
+
+// MIDI byte parser and message dispatch
+
+#define VOICES  (chip_manager_get_current()->voices)
+
+void test_midi_note_on_off(void) {
+    static const uint8_t on[] = { 0x90, 60, 100 };
+    static const uint8_t off[] = { 0x80, 60, 0 };
+
+    host_synth_setup(CHIP_YM2149);
+    host_midi_send(on, sizeof(on));
+    CHECK_EQ(find_voice_by_note(60, 0), 0);
+    CHECK(VOICES[0].active);
+    CHECK_EQ(VOICES[0].midi_note, 60);
+    CHECK_EQ(VOICES[0].velocity, 100);
+
+    host_midi_send(off, sizeof(off));
+    CHECK(!VOICES[0].active);
+    CHECK_EQ(find_voice_by_note(60, 0), 0xFF);
+}
+
+void test_midi_running_status(void) {
+    // One status byte, three notes
+    static const uint8_t msg[] = { 0x93, 60, 100, 64, 90, 67, 80 };
+
+    host_synth_setup(CHIP_YM2149);
+    host_midi_send(msg, sizeof(msg));
+    CHECK_EQ(find_voice_by_note(60, 3), 0);
+    CHECK_EQ(find_voice_by_note(64, 3), 1);
+    CHECK_EQ(find_voice_by_note(67, 3), 2);
+    CHECK_EQ(VOICES[2].velocity, 80);
+    CHECK_EQ(VOICES[2].channel, 3);
+}
+
+void test_midi_velocity_zero_is_note_off(void) {
+    static const uint8_t msg[] = { 0x90, 62, 100, 62, 0 };
+
+    host_synth_setup(CHIP_YM2149);
+    host_midi_send(msg, sizeof(msg));
+    CHECK(!VOICES[0].active);
+    CHECK_EQ(find_voice_by_note(62, 0), 0xFF);
+}
+
+void test_midi_realtime_inside_message(void) {
+    // Clock and active sensing between status and data bytes
+    static const uint8_t msg[] = { 0x90, 0xF8, 60, 0xFE, 100, 0xF8 };
+
+    host_synth_setup(CHIP_YM2149);
+    host_midi_send(msg, sizeof(msg));
+    CHECK(VOICES[0].active);
+    CHECK_EQ(VOICES[0].midi_note, 60);
+    CHECK_EQ(VOICES[0].velocity, 100);
+}
+
+void test_midi_system_common_clears_status(void) {
+    // Song select (0xF3) ends running status: the trailing bytes are
+    // orphaned data and must not start a note
+    static const uint8_t msg[] = { 0x90, 60, 100, 0xF3, 64, 100 };
+
+    host_synth_setup(CHIP_YM2149);
+    host_midi_send(msg, sizeof(msg));
+    CHECK(VOICES[0].active);
+    CHECK(!VOICES[1].active);
+    CHECK_EQ(find_voice_by_note(64, 0), 0xFF);
+}
+
+void test_midi_rpn_bend_range(void) {
+    // RPN 0 (pitch bend sensitivity) = 12 semitones on channel 2
+    static const uint8_t msg[] = { 0xB1, 101, 0, 100, 0, 6, 12 };
+    static const uint8_t too_wide[] = { 0xB1, 6, 99 };
+
+    host_synth_setup(CHIP_YM2149);
+    CHECK_EQ(midi_channels[1].bend_range, MIDI_BEND_RANGE_DEFAULT);
+    host_midi_send(msg, sizeof(msg));
+    CHECK_EQ(midi_channels[1].bend_range, 12);
+    CHECK_EQ(midi_channels[0].bend_range, MIDI_BEND_RANGE_DEFAULT);
+
+    host_midi_send(too_wide, sizeof(too_wide));
+    CHECK(midi_channels[1].bend_range <= MIDI_BEND_RANGE_MAX);
+}
+
+void test_midi_cc_table_dispatch(void) {
+    static const uint8_t note[] = { 0x90, 60, 127 };
+    static const uint8_t cc_volume[] = { 0xB0, 1, 64 };   // CC#1 = volume
+    static const uint8_t cc_unmapped[] = { 0xB0, 90, 64 };
+
+    host_synth_setup(CHIP_YM2149);
+    host_midi_send(note, sizeof(note));
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_A), 15);
+
+    host_midi_send(cc_volume, sizeof(cc_volume));
+    CHECK_EQ(midi_cc_value[1], 64);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_A), 64 * 15 / 127);
+
+    // Unmapped CCs are stored but never reach the bus
+    hal_bus_clear_log();
+    host_midi_send(cc_unmapped, sizeof(cc_unmapped));
+    CHECK_EQ(midi_cc_value[90], 64);
+    CHECK_EQ(hal_bus_write_count(), 0);
+}
+
+void test_midi_drain_from_sio(void) {
+    static const uint8_t msg[] = { 0x90, 60, 100, 64, 100 };
+
+    host_synth_setup(CHIP_YM2149);
+    midi_set_mode(MIDI_MODE_BIOS);
+
+    // Receiver set up in async mode: WR4 (x64, 1 stop) before WR3 (Rx enable)
+    CHECK(host_bus_writes_to(FAKE_SIO_CTRL) >= 10);
+
+    fake_sio_send(msg, sizeof(msg));
+    CHECK_EQ(midi_driver_drain(2), 2);          // Budget respected
+    CHECK(!VOICES[0].active);
+    CHECK_EQ(midi_driver_drain(16), 3);
+    CHECK_EQ(fake_sio_pending(), 0);
+    CHECK_EQ(find_voice_by_note(60, 0), 0);
+    CHECK_EQ(find_voice_by_note(64, 0), 1);
+
+    midi_driver_shutdown();
+    CHECK_EQ(midi_driver_drain(16), 0);
+}
+
+void test_midi_parts(void) {
+    static const uint8_t setup[] = {
+        0xC0, 1,                 // Part 1: program 1
+        0xC1, 2,                 // Part 2: program 2
+        0x90, 60, 127,           // Voice 0
+        0x91, 64, 127,           // Voice 1
+    };
+    static const uint8_t cc_part2[] = { 0xB1, 1, 64 };  // CC#1 volume, last voice
+    static const uint8_t next[] = { 0x90, 62, 127, 0x91, 65, 127 };
+    static const uint8_t routed[] = { 0x92, 70, 100 };
+
+    host_synth_setup(CHIP_YM2149);
+    host_midi_send(setup, sizeof(setup));
+    CHECK_EQ(ym2149_cards[0].patch, 2);         // Loaded by part 2's note
+
+    // A CC only reaches the sending part's voices
+    host_midi_send(cc_part2, sizeof(cc_part2));
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_A), 15);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_B), 64 * 15 / 127);
+
+    // Each part's program is back on the card for its next note, and the
+    // volume sticks to part 2's new note
+    host_midi_send(next, 3);
+    CHECK_EQ(ym2149_cards[0].patch, 1);
+    CHECK_EQ(ym2149_voice_extra[2].patch, 1);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_C), 15);
+    synthesizer_note_off(60, 0);
+    host_midi_send(next + 3, 3);
+    CHECK_EQ(ym2149_cards[0].patch, 2);
+    CHECK_EQ(ym2149_voice_extra[1].patch, 2);   // Held note keeps its own
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_LEVEL_A), 64 * 15 / 127);
+
+    // A part routed to the OPL3 is silent while the YM2149 plays
+    midi_channels[2].chip = CHIP_OPL3;
+    host_midi_send(routed, sizeof(routed));
+    CHECK_EQ(find_voice_by_note(70, 2), 0xFF);
+    midi_channels[2].chip = CHIP_YM2149;
+    host_midi_send(routed, sizeof(routed));
+    CHECK(find_voice_by_note(70, 2) != 0xFF);
+    midi_channels[2].chip = CHIP_NONE;
+}
+
+// Two parts on different programs: a part switch loads only the voice
+// the new note gets, and the other part's held note keeps its operators
+void test_midi_parts_opl3(void) {
+    static const uint8_t setup[] = {
+        0xC0, 1,                 // Part 1: organ
+        0xC1, 2,                 // Part 2: brass
+        0x90, 60, 127,           // Voice 0, held throughout
+    };
+    uint8_t msg[6];
+    uint32_t writes;
+
+    host_synth_setup(CHIP_OPL3);
+    host_midi_send(setup, sizeof(setup));
+    CHECK_EQ(opl3_voice_extra[0].patch, 1);
+    CHECK_EQ(fake_opl3_reg(OPL3_OP_CHAR), 0x22);
+    CHECK_EQ(fake_opl3_reg(OPL3_CH_FB_CONN) & 0x0F, 0x01);
+
+    hal_bus_clear_log();
+    for (uint8_t i = 0; i < 8; i++) {
+        uint8_t part = (i & 1) ? 0 : 1;
+        msg[0] = 0x90 | part; msg[1] = 64 + i; msg[2] = 127;
+        msg[3] = 0x80 | part; msg[4] = 64 + i; msg[5] = 0;
+        host_midi_send(msg, sizeof(msg));
+    }
+    writes = hal_bus_write_count();
+
+    // Each switch is at most one voice's patch (11 registers, address and
+    // data each) plus the note, against 18 voices' worth when a switch
+    // reloaded them all
+    CHECK(writes <= 8 * 24);
+    CHECK_EQ(opl3_voice_extra[0].patch, 1);
+    CHECK_EQ(fake_opl3_reg(OPL3_OP_CHAR), 0x22);
+    CHECK_EQ(fake_opl3_reg(OPL3_CH_FB_CONN) & 0x0F, 0x01);
+    CHECK(find_voice_by_note(60, 0) == 0);
+}
+
+// Build a patch dump for `program` addressed to `device`; returns its length
+static uint16_t sysex_patch_dump(uint8_t* out, uint8_t device, uint8_t program,
+                                 const ym2149_patch_t* patch) {
+    const uint8_t* p = (const uint8_t*)patch;
+    uint8_t sum = program;
+    uint16_t n = 0;
+
+    out[n++] = 0xF0;
+    out[n++] = SYSEX_ID;
+    out[n++] = device;
+    out[n++] = SYSEX_PATCH_DUMP;
+    out[n++] = program;
+    for (uint8_t i = 0; i < sizeof(ym2149_patch_t); i++) {
+        out[n++] = p[i] >> 4;
+        out[n++] = p[i] & 0x0F;
+        sum += (p[i] >> 4) + (p[i] & 0x0F);
+    }
+    out[n++] = (uint8_t)-sum & 0x7F;
+    out[n++] = 0xF7;
+    return n;
+}
+
+void test_midi_sysex_patch_dump(void) {
+    static const ym2149_patch_t patch = { { 0x12, 0x38 }, { 0x34, 0x02, 0x0E }, 0, 2, -3 };
+    static const ym2149_patch_t wild = { { 0xFF, 0xFF }, { 0xFF, 0xFF, 0xFF }, 0xFF, 0xFF, 0 };
+    static const uint8_t orphan[] = { 64, 100 };
+    uint8_t msg[32];
+    uint16_t len;
+
+    host_synth_setup(CHIP_YM2149);
+    host_midi_send((const uint8_t[]){ 0x90, 60, 100 }, 3);
+
+    // Decoded into the bank; a clock byte inside the dump is transparent
+    len = sysex_patch_dump(msg, SYSEX_DEVICE_DEFAULT, 5, &patch);
+    host_midi_send(msg, 9);
+    midi_process_byte(0xF8);
+    host_midi_send(msg + 9, len - 9);
+    CHECK_EQ(sysex_stats.dumps, 1);
+    CHECK_EQ(sysex_stats.errors, 0);
+    CHECK(memcmp(&ym2149_bank[5], &patch, sizeof(patch)) == 0);
+
+    // SysEx ended running status: orphaned data doesn't start a note
+    host_midi_send(orphan, sizeof(orphan));
+    CHECK_EQ(find_voice_by_note(64, 0), 0xFF);
+
+    // Fields are masked as they land, as when loading a bank file
+    len = sysex_patch_dump(msg, SYSEX_DEVICE_DEFAULT, 6, &wild);
+    host_midi_send(msg, len);
+    CHECK_EQ(ym2149_bank[6].regs_6_7[YM2149_PATCH_NOISE], 0x1F);
+    CHECK_EQ(ym2149_bank[6].regs_6_7[YM2149_PATCH_MIXER], YM2149_MIX_ALL_OFF);
+    CHECK_EQ(ym2149_bank[6].regs_11_13[YM2149_PATCH_SHAPE], 0x0F);
+    CHECK_EQ(ym2149_bank[6].level_mode, YM2149_VOLUME_ENV);
+    CHECK(ym2149_bank[6].curve < YM2149_CURVE_COUNT);
+
+    // A dump for the program on the chip is uploaded at once
+    len = sysex_patch_dump(msg, SYSEX_DEVICE_DEFAULT, 0, &patch);
+    host_midi_send(msg, len);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_FREQ_NOISE), 0x12);
+    CHECK_EQ(fake_ym2149_reg(0xD8, YM2149_FREQ_ENV_LSB), 0x34);
+
+    // Bad checksum: counted, not stored as a good dump
+    len = sysex_patch_dump(msg, SYSEX_DEVICE_DEFAULT, 7, &patch);
+    msg[len - 2] ^= 0x01;
+    host_midi_send(msg, len);
+    CHECK_EQ(sysex_stats.dumps, 3);
+    CHECK_EQ(sysex_stats.errors, 1);
+}
+
+void test_midi_sysex_filter(void) {
+    static const ym2149_patch_t patch = { { 0x05, 0x38 }, { 0x10, 0x00, 0x08 }, 0, 1, 0 };
+    static const uint8_t other_mfr[] = { 0xF0, 0x43, 0x10, 0x01, 0x05, 0x01, 0xF7 };
+    uint8_t msg[32];
+    uint16_t len;
+
+    host_synth_setup(CHIP_YM2149);
+    ym2149_patch_t before = ym2149_bank[9];
+
+    // Other manufacturers and other devices are skipped to F7
+    host_midi_send(other_mfr, sizeof(other_mfr));
+    len = sysex_patch_dump(msg, 0x05, 9, &patch);
+    host_midi_send(msg, len);
+    CHECK_EQ(sysex_stats.ignored, 2);
+    CHECK(memcmp(&ym2149_bank[9], &before, sizeof(before)) == 0);
+
+    // Our device ID, or the broadcast ID
+    sysex_set_device(0x05);
+    host_midi_send(msg, len);
+    CHECK_EQ(sysex_stats.dumps, 1);
+    len = sysex_patch_dump(msg, SYSEX_DEVICE_ALL, 10, &patch);
+    host_midi_send(msg, len);
+    CHECK_EQ(sysex_stats.dumps, 2);
+    CHECK(memcmp(&ym2149_bank[10], &patch, sizeof(patch)) == 0);
+
+    // A status byte cuts a dump short: counted as an error, and the
+    // note it starts still plays
+    len = sysex_patch_dump(msg, 0x05, 11, &patch);
+    host_midi_send(msg, 10);
+    host_midi_send((const uint8_t[]){ 0x90, 60, 100 }, 3);
+    CHECK_EQ(sysex_stats.errors, 1);
+    CHECK_EQ(sysex_stats.dumps, 2);
+    CHECK(find_voice_by_note(60, 0) != 0xFF);
+}
+
+// Run the reply transmitter until it has nothing left; returns the passes
+static uint16_t sysex_flush(void) {
+    uint16_t passes = 0;
+    while (sysex_tx_busy() && passes < 60000) {
+        sysex_service();
+        passes++;
+    }
+    return passes;
+}
+
+void test_midi_sysex_dump_request(void) {
+    static const uint8_t request[] = { 0xF0, SYSEX_ID, 0x00, SYSEX_PATCH_REQUEST, 2, 0xF7 };
+    static const uint8_t bank[] = { 0xF0, SYSEX_ID, 0x7F, SYSEX_BANK_REQUEST, 0xF7 };
+    static const uint8_t note_on[] = { 0x90, 62, 100 };
+    uint8_t expect[32];
+    const uint8_t* sent;
+    uint16_t len, n;
+
+    host_synth_setup(CHIP_YM2149);
+
+    // No reply while the SIO isn't set up for MIDI
+    host_midi_send(request, sizeof(request));
+    sysex_flush();
+    sent = fake_sio_sent(&n);
+    CHECK_EQ(n, 0);
+    CHECK_EQ(sysex_stats.requests, 1);
+
+    // The parser only queues the reply; the pass task sends it a byte
+    // at a time, each once the transmitter is empty
+    midi_set_mode(MIDI_MODE_BIOS);
+    fake_sio_sent_clear();
+    host_midi_send(request, sizeof(request));
+    fake_sio_sent(&n);
+    CHECK_EQ(n, 0);
+    CHECK(sysex_tx_busy());
+    len = sysex_patch_dump(expect, SYSEX_DEVICE_DEFAULT, 2, &ym2149_bank[2]);
+    CHECK_EQ(len, SYSEX_PATCH_DUMP_LEN);
+    CHECK_EQ(sysex_flush(), 2 * len - 1);     // Every other pass finds it busy
+    sent = fake_sio_sent(&n);
+    CHECK_EQ(n, len);
+    CHECK(memcmp(sent, expect, len) == 0);
+    CHECK_EQ(fake_sio_tx_overruns, 0);
+
+    // The reply restores the patch it came from
+    ym2149_patch_t saved = ym2149_bank[2];
+    memset(&ym2149_bank[2], 0, sizeof(ym2149_patch_t));
+    host_midi_send(sent, n);
+    CHECK(memcmp(&ym2149_bank[2], &saved, sizeof(saved)) == 0);
+    CHECK_EQ(sysex_stats.dumps, 1);
+
+    // Bank request: every program, in order, while notes keep playing
+    fake_sio_sent_clear();
+    host_midi_send(bank, sizeof(bank));
+    for (uint8_t i = 0; i < 100; i++) sysex_service();
+    host_midi_send(note_on, sizeof(note_on));
+    CHECK(find_voice_by_note(62, 0) != 0xFF);
+    CHECK(sysex_tx_busy());
+    sysex_flush();
+    sent = fake_sio_sent(&n);
+    CHECK_EQ(n, YM2149_BANK_SIZE * len);
+    CHECK_EQ(sent[len * 127 + 4], 127);
+    CHECK_EQ(sysex_stats.requests, 3);
+    CHECK_EQ(fake_sio_tx_overruns, 0);
+
+    // Leaving BIOS mode drops the rest of a reply
+    host_midi_send(bank, sizeof(bank));
+    sysex_service();
+    midi_set_mode(MIDI_MODE_NONE);
+    sysex_service();
+    CHECK(!sysex_tx_busy());
+
+    midi_driver_shutdown();
+}
+
+// One beat of MIDI clock, `ms` long, ending on the clock that closes it
+static void clock_beat(uint16_t ms) {
+    for (uint8_t i = 0; i < MIDI_CLOCK_PPQN; i++) {
+        timebase_tick += (i == 0) ? ms - (ms / 24) * 23 : ms / 24;
+        midi_process_byte(MIDI_CLOCK);
+    }
+}
+
+void test_midi_clock_tempo(void) {
+    static const int8_t jitter[] = { 0, 3, -2, 1, -3, 2, 0, -1 };
+    lfo_t lfo;
+
+    host_synth_setup(CHIP_YM2149);
+    CHECK_EQ(midi_clock_bpm(), 0);
+
+    // 120 BPM with a few ms of jitter per beat
+    timebase_tick = 1000;
+    midi_process_byte(MIDI_CLOCK);
+    for (uint8_t i = 0; i < sizeof(jitter); i++) {
+        clock_beat(500 + jitter[i]);
+    }
+    CHECK_EQ(midi_clock_bpm(), 120);
+    CHECK_EQ(midi_clock.rejected, 0);
+
+    // One stray beat (a stalled sender) is not taken as a tempo change
+    clock_beat(900);
+    CHECK_EQ(midi_clock_bpm(), 120);
+    CHECK_EQ(midi_clock.rejected, 1);
+
+    // Two beats agreeing on a new tempo are
+    clock_beat(250);
+    CHECK_EQ(midi_clock_bpm(), 120);
+    clock_beat(250);
+    CHECK_EQ(midi_clock_bpm(), 240);
+
+    // Synced LFOs pick the tempo up: one cycle per beat at 240 BPM, 4 Hz
+    lfo_init(&lfo, LFO_WAVE_SINE);
+    lfo.sync = MIDI_CLOCK_PPQN;
+    lfo_step(&lfo);
+    CHECK_EQ(lfo.rate, LFO_SYNC_SCALE / ((uint32_t)midi_clock.beat_ms16 * 24));
+    CHECK(lfo.rate > LFO_RATE_DHZ(39) && lfo.rate < LFO_RATE_DHZ(41));
+}
+
+void test_midi_clock_transport(void) {
+    static const uint8_t note[] = { 0x90, 60, 100 };
+
+    host_synth_setup(CHIP_YM2149);
+    timebase_tick = 0;
+
+    // Clock while stopped measures tempo but doesn't move the position
+    clock_beat(500);
+    CHECK(!midi_clock.running);
+    CHECK_EQ(midi_clock.beat, 0);
+
+    // Start: the first clock is position 0, then a beat every 24
+    midi_process_byte(MIDI_START);
+    CHECK(midi_clock.running);
+    clock_beat(500);
+    CHECK_EQ(midi_clock.beat, 0);
+    CHECK_EQ(midi_clock.clock, 23);
+    clock_beat(500);
+    CHECK_EQ(midi_clock.beat, 1);
+    CHECK_EQ(midi_clock.clock, 23);
+
+    // Stop holds the position, continue resumes from it
+    midi_process_byte(MIDI_STOP);
+    clock_beat(500);
+    CHECK_EQ(midi_clock.beat, 1);
+    midi_process_byte(MIDI_CONTINUE);
+    midi_process_byte(MIDI_CLOCK);
+    midi_process_byte(MIDI_CLOCK);
+    CHECK_EQ(midi_clock.beat, 2);
+    CHECK_EQ(midi_clock.clock, 0);
+
+    // Clocks inside a channel message leave it intact
+    host_midi_send(note, 1);
+    midi_process_byte(MIDI_CLOCK);
+    host_midi_send(note + 1, 2);
+    CHECK(find_voice_by_note(60, 0) != 0xFF);
+}
+
+void test_midi_clock_drain_budget(void) {
+    uint8_t stream[64];
+    uint8_t n = 0;
+
+    host_synth_setup(CHIP_YM2149);
+    midi_set_mode(MIDI_MODE_BIOS);
+
+    // Clock bytes packed around two notes
+    for (uint8_t i = 0; i < 20; i++) stream[n++] = MIDI_CLOCK;
+    stream[n++] = 0x90; stream[n++] = 60; stream[n++] = 100;
+    for (uint8_t i = 0; i < 20; i++) stream[n++] = MIDI_CLOCK;
+    stream[n++] = 64; stream[n++] = 100;
+    fake_sio_send(stream, n);
+
+    // The clocks don't use up the budget, and a pass of only clocks
+    // still counts as quiet input
+    CHECK_EQ(midi_driver_drain(5), 5);
+    CHECK_EQ(fake_sio_pending(), 0);
+    CHECK(find_voice_by_note(60, 0) != 0xFF);
+    CHECK(find_voice_by_note(64, 0) != 0xFF);
+    CHECK_EQ(midi_clock.clocks, 40);
+
+    fake_sio_send(stream, 20);
+    CHECK_EQ(midi_driver_drain(5), 0);
+    CHECK_EQ(midi_clock.clocks, 60);
+
+    midi_driver_shutdown();
+}
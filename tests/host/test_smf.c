@@ -0,0 +1,216 @@
+#include "host_test.h"
+#include "../../include/chip_interface.h"
+#include "../../include/chip_manager.h"
+#include "../../include/synthesizer.h"
+#include "../../include/timebase.h"
+#include "../../include/smf_player.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Standard MIDI File player: track merge, tempo map, record streaming
+
+#define SMF_TEST_FILE  "test.mid"
+
+static uint8_t smf_buf[4096];
+static uint16_t smf_len;
+static uint16_t smf_track_start;
+
+static void smf_put(const uint8_t* bytes, uint16_t len) {
+    memcpy(smf_buf + smf_len, bytes, len);
+    smf_len += len;
+}
+
+static void smf_put_be(uint32_t value, uint8_t bytes) {
+    while (bytes--) {
+        smf_buf[smf_len++] = (value >> (bytes * 8)) & 0xFF;
+    }
+}
+
+static void smf_put_varlen(uint32_t value) {
+    uint8_t tmp[4];
+    uint8_t n = 0;
+    do {
+        tmp[n++] = value & 0x7F;
+        value >>= 7;
+    } while (value);
+    while (n--) {
+        smf_buf[smf_len++] = tmp[n] | (n ? 0x80 : 0);
+    }
+}
+
+static void smf_begin(uint16_t format, uint16_t tracks, uint16_t division) {
+    smf_len = 0;
+    smf_put((const uint8_t*)"MThd", 4);
+    smf_put_be(6, 4);
+    smf_put_be(format, 2);
+    smf_put_be(tracks, 2);
+    smf_put_be(division, 2);
+}
+
+static void smf_track_begin(void) {
+    smf_put((const uint8_t*)"MTrk", 4);
+    smf_put_be(0, 4);                       // Patched by smf_track_end()
+    smf_track_start = smf_len;
+}
+
+static void smf_event(uint32_t delta, uint8_t status, uint8_t d1, uint8_t d2) {
+    smf_put_varlen(delta);
+    smf_buf[smf_len++] = status;
+    smf_buf[smf_len++] = d1;
+    smf_buf[smf_len++] = d2;
+}
+
+static void smf_tempo(uint32_t delta, uint32_t tempo) {
+    static const uint8_t meta[] = { 0xFF, 0x51, 0x03 };
+    smf_put_varlen(delta);
+    smf_put(meta, sizeof(meta));
+    smf_put_be(tempo, 3);
+}
+
+static void smf_track_end(void) {
+    static const uint8_t eot[] = { 0x00, 0xFF, 0x2F, 0x00 };
+    smf_put(eot, sizeof(eot));
+    uint16_t len = smf_len - smf_track_start;
+    smf_buf[smf_track_start - 2] = len >> 8;
+    smf_buf[smf_track_start - 1] = len & 0xFF;
+}
+
+static uint8_t smf_save_and_open(void) {
+    FILE* f = fopen(SMF_TEST_FILE, "wb");
+    fwrite(smf_buf, 1, smf_len, f);
+    fclose(f);
+    return smf_player_open(SMF_TEST_FILE);
+}
+
+// Run the player at timebase tick `ms` (1 tick = 1 ms)
+static void smf_run_at(uint16_t ms) {
+    timebase_tick = ms;
+    for (uint8_t i = 0; i < 8; i++) {
+        smf_player_service();
+    }
+}
+
+static uint8_t smf_note_sounding(uint8_t note) {
+    voice_t* voices = chip_manager_get_current()->voices;
+    for (uint8_t i = 0; i < chip_manager_get_current()->voice_count; i++) {
+        if (voices[i].active && voices[i].midi_note == note) return 1;
+    }
+    return 0;
+}
+
+void test_smf_type1_merge(void) {
+    host_synth_setup(CHIP_YM2149);
+    smf_begin(1, 3, 96);
+    smf_track_begin();                       // Tempo track: 120 BPM
+    smf_tempo(0, 500000);
+    smf_track_end();
+    smf_track_begin();
+    smf_event(0, 0x90, 60, 100);
+    smf_event(96, 0x80, 60, 0);
+    smf_track_end();
+    smf_track_begin();
+    smf_event(48, 0x91, 64, 100);
+    smf_event(96, 0x91, 64, 0);              // Velocity 0 = note off
+    smf_track_end();
+
+    timebase_tick = 0;
+    CHECK_EQ(smf_save_and_open(), SMF_OK);
+    smf_run_at(0);
+    CHECK(smf_note_sounding(60));
+    CHECK(!smf_note_sounding(64));
+
+    smf_run_at(249);                         // 48 ticks = 250 ms
+    CHECK(!smf_note_sounding(64));
+    smf_run_at(250);
+    CHECK(smf_note_sounding(64));
+
+    smf_run_at(500);
+    CHECK(!smf_note_sounding(60));
+    CHECK(smf_note_sounding(64));
+    smf_run_at(750);
+    CHECK(!smf_note_sounding(64));
+    CHECK(!smf_player_active());
+    CHECK_EQ(smf_stats.events, 4);
+}
+
+void test_smf_tempo_change(void) {
+    host_synth_setup(CHIP_YM2149);
+    smf_begin(0, 1, 96);
+    smf_track_begin();
+    smf_event(0, 0x90, 60, 100);
+    smf_tempo(96, 250000);                   // 500 ms, then twice as fast
+    smf_event(96, 0x90, 62, 100);            // 500 + 250 ms
+    smf_event(960, 0x80, 62, 0);             // 750 + 2500 ms
+    smf_track_end();
+
+    timebase_tick = 0;
+    CHECK_EQ(smf_save_and_open(), SMF_OK);
+    smf_run_at(749);
+    CHECK(!smf_note_sounding(62));
+    smf_run_at(750);
+    CHECK(smf_note_sounding(62));
+
+    // The song clock survives the 16-bit tick counter wrapping
+    uint16_t start = 0xFFFF;
+    timebase_tick = start;
+    smf_player_open(SMF_TEST_FILE);
+    smf_run_at(start + 750);
+    CHECK(smf_note_sounding(62));
+    smf_run_at(start + 3249);
+    CHECK(smf_note_sounding(62));
+    smf_run_at(start + 3250);
+    CHECK(!smf_note_sounding(62));
+}
+
+void test_smf_record_read_ahead(void) {
+    // 200 events over five records: idle read-ahead keeps disk reads out
+    // of the event path; without it every record boundary stalls
+    for (uint8_t prefetch = 0; prefetch < 2; prefetch++) {
+        host_synth_setup(CHIP_YM2149);
+        smf_begin(0, 1, 96);
+        smf_track_begin();
+        for (uint8_t i = 0; i < 100; i++) {
+            smf_event(0, 0x90, 40 + (i % 40), 100);
+            smf_event(1, 0x80, 40 + (i % 40), 0);
+        }
+        smf_track_end();
+        CHECK(smf_len > 4 * SMF_RECORD_SIZE);
+
+        timebase_tick = 0;
+        CHECK_EQ(smf_save_and_open(), SMF_OK);
+        for (uint16_t ms = 0; ms < 1200 && smf_player_active(); ms++) {
+            if (prefetch) smf_player_prefetch();
+            smf_run_at(ms);
+        }
+        CHECK(!smf_player_active());
+        CHECK_EQ(smf_stats.events, 200);
+        if (prefetch) {
+            CHECK_EQ(smf_stats.underruns, 0);
+            CHECK(smf_stats.prefetches >= 4);
+        } else {
+            CHECK(smf_stats.underruns >= 4);
+        }
+    }
+}
+
+void test_smf_errors(void) {
+    host_synth_setup(CHIP_YM2149);
+    CHECK_EQ(smf_player_open("missing.mid"), SMF_ERR_OPEN);
+
+    smf_begin(2, 1, 96);                     // Type 2 is not supported
+    smf_track_begin();
+    smf_track_end();
+    CHECK_EQ(smf_save_and_open(), SMF_ERR_FORMAT);
+
+    smf_begin(1, SMF_MAX_TRACKS + 1, 96);
+    CHECK_EQ(smf_save_and_open(), SMF_ERR_TRACKS);
+
+    smf_begin(0, 1, 0xE728);                 // SMPTE timing
+    CHECK_EQ(smf_save_and_open(), SMF_ERR_FORMAT);
+
+    smf_begin(0, 1, 96);                     // Track chunk missing
+    CHECK_EQ(smf_save_and_open(), SMF_ERR_READ);
+    CHECK(!smf_player_active());
+    remove(SMF_TEST_FILE);
+}
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+tools/mkpatchbank.py
+
+Build a YM2149 patch bank (PATCHES.BNK) from a text description.
+
+Usage:
+    python3 tools/mkpatchbank.py patches.txt PATCHES.BNK
+    python3 tools/mkpatchbank.py --dump PATCHES.BNK
+
+One patch per line, program number first, then key=value fields.
+Fields left out take the built-in square patch's value; programs not
+listed repeat the four built-in patches, as the synth does without a
+bank file.  '#' starts a comment.
+
+    # program  fields
+    0   name=square
+    5   mixer=tone+noise noise=4 shape=0x0E env=0x0800 mode=env curve=hard
+    12  detune=-2 curve=soft
+
+Fields:
+    noise    noise period, 0-31
+    mixer    tone, noise, tone+noise or off (all channels), or a raw R7 value
+    env      envelope period, 0-65535
+    shape    envelope shape, 0-15 (written to R13)
+    mode     fixed (level from velocity) or env (level from the envelope)
+    curve    linear, soft, hard or fixed (velocity to level)
+    detune   tone period offset, -128..127 (positive = flatter)
+    name     ignored; for the reader
+
+The file layout matches ym2149_patch_t in include/ym2149.h: "YMPB",
+version 1, patch count, two reserved bytes, then 8 bytes per patch.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"YMPB"
+VERSION = 1
+BANK_SIZE = 128
+
+MIXERS = {"tone": 0x38, "noise": 0x07, "tone+noise": 0x00, "off": 0x3F}
+MODES = {"fixed": 0x00, "env": 0x10}
+CURVES = {"linear": 0, "soft": 1, "hard": 2, "fixed": 3}
+
+# Built-in patches (ym2149_builtin_patches in src/chips/ym2149.c)
+BUILTIN = [
+    dict(noise=0x1F, mixer=0x38, env=0, shape=0x00, mode=0, curve=0, detune=0),
+    dict(noise=0x1F, mixer=0x38, env=0, shape=0x03, mode=0, curve=0, detune=0),
+    dict(noise=0x1F, mixer=0x38, env=0, shape=0x02, mode=0, curve=0, detune=0),
+    dict(noise=0x1F, mixer=0x38, env=0, shape=0x07, mode=0, curve=0, detune=0),
+]
+
+
+def parse_value(key, value):
+    if key == "mixer" and value in MIXERS:
+        return MIXERS[value]
+    if key == "mode":
+        return MODES[value]
+    if key == "curve":
+        return CURVES[value]
+    return int(value, 0)
+
+
+def parse(path):
+    patches = {}
+    with open(path) as fh:
+        for lineno, line in enumerate(fh, 1):
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            fields = line.split()
+            program = int(fields[0], 0)
+            if not 0 <= program < BANK_SIZE:
+                sys.exit(f"{path}:{lineno}: program {program} out of range")
+            patch = dict(BUILTIN[0])
+            for field in fields[1:]:
+                key, _, value = field.partition("=")
+                if key == "name":
+                    continue
+                if key not in patch:
+                    sys.exit(f"{path}:{lineno}: unknown field '{key}'")
+                try:
+                    patch[key] = parse_value(key, value)
+                except (KeyError, ValueError):
+                    sys.exit(f"{path}:{lineno}: bad value for {key}: '{value}'")
+            patches[program] = patch
+    return patches
+
+
+def pack(patch):
+    return struct.pack("<BBHBBBb", patch["noise"] & 0x1F, patch["mixer"] & 0x3F,
+                       patch["env"] & 0xFFFF, patch["shape"] & 0x0F,
+                       patch["mode"], patch["curve"], patch["detune"])
+
+
+def build(patches):
+    count = max(patches) + 1 if patches else 0
+    out = bytearray(MAGIC + bytes([VERSION, count, 0, 0]))
+    for program in range(count):
+        out += pack(patches.get(program, BUILTIN[program % len(BUILTIN)]))
+    return bytes(out)
+
+
+def dump(path):
+    with open(path, "rb") as fh:
+        data = fh.read()
+    if data[:4] != MAGIC or len(data) < 8 or data[4] != VERSION:
+        sys.exit(f"{path}: not a version {VERSION} patch bank")
+    names = {v: k for k, v in CURVES.items()}
+    for program in range(data[5]):
+        rec = data[8 + program * 8:16 + program * 8]
+        if len(rec) < 8:
+            sys.exit(f"{path}: truncated at program {program}")
+        noise, mixer, env, shape, mode, curve, detune = struct.unpack("<BBHBBBb", rec)
+        print(f"{program:<3} noise={noise} mixer=0x{mixer:02X} env={env} "
+              f"shape=0x{shape:X} mode={'env' if mode else 'fixed'} "
+              f"curve={names.get(curve, curve)} detune={detune}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("--dump", action="store_true", help="list a bank file")
+    parser.add_argument("input")
+    parser.add_argument("output", nargs="?", default="PATCHES.BNK")
+    args = parser.parse_args()
+
+    if args.dump:
+        dump(args.input)
+        return
+    bank = build(parse(args.input))
+    with open(args.output, "wb") as fh:
+        fh.write(bank)
+    print(f"{args.output}: {bank[5]} patches, {len(bank)} bytes")
+
+
+if __name__ == "__main__":
+    main()
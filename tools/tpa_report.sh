@@ -0,0 +1,39 @@
+#!/bin/sh
+# tools/tpa_report.sh COM MAP [TPA_TOP]
+#
+# Size report run after every Z80 build: the .COM size on disk and the
+# TPA left above the program once its BSS is allocated.  The program end
+# comes from the z88dk map (zcc -m); TPA_TOP is the BDOS base of the
+# target CP/M (read the word at 0006h on the machine to find it).
+
+com="$1"
+map="$2"
+top="${3:-0xD806}"
+
+if [ ! -f "$com" ]; then
+    echo "tpa_report: $com not found" >&2
+    exit 1
+fi
+
+size=$(wc -c < "$com" | tr -d ' ')
+records=$(( (size + 127) / 128 ))
+
+# Prefer the end of BSS; fall back to the end of the loaded image
+end=""
+if [ -f "$map" ]; then
+    end=$(awk '$1 == "__BSS_END_tail" { bss = $3 }
+               $1 == "__tail"         { tail = $3 }
+               END { v = bss ? bss : tail; sub(/^\$/, "", v); print v }' "$map")
+fi
+if [ -n "$end" ]; then
+    end=$(( 0x$end ))
+    source="map"
+else
+    end=$(( 0x100 + size ))
+    source="no map: BSS not counted"
+fi
+
+free=$(( top - end ))
+printf '%s: %d bytes (%d records)\n' "$com" "$size" "$records"
+printf 'Program end 0x%04X (%s), TPA top 0x%04X: %d bytes free\n' \
+       "$end" "$source" "$(( top ))" "$free"